@@ -29,10 +29,13 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include <assert.h>
 
 #include "utils.h"
+#include "arena.h"
 #include <endian.h>
+#include <time.h>
 
 #include "base58.h"
 
@@ -68,10 +71,10 @@ ssize_t base58_encode(const void * data, ssize_t length, char ** p_b58)
 	src += cb_leading_zeros;
 	length -= cb_leading_zeros;
 	
-	unsigned char * dst = calloc(dst_size, 1);
+	unsigned char * dst = lib_calloc(dst_size, 1);
 	assert(dst);
 	
-	size_t cb_dst = 1;
+	size_t cb_dst = (length > 0);	// an all-zero input is encoded as leading '1's only
 	for(size_t i = 0; i < length; ++i) {
 		int carry = src[i];
 		
@@ -95,7 +98,7 @@ ssize_t base58_encode(const void * data, ssize_t length, char ** p_b58)
 	
 	char * b58 = *p_b58;
 	if(NULL == b58) {
-		b58 = calloc(cb_dst + cb_leading_zeros + 1, 1);
+		b58 = lib_calloc(cb_dst + cb_leading_zeros + 1, 1);
 		assert(b58);
 		*p_b58 = b58;
 	}
@@ -106,7 +109,7 @@ ssize_t base58_encode(const void * data, ssize_t length, char ** p_b58)
 		b58[i] = s_b58_digits[(int)dst[cb_dst - i - 1]];
 	}
 	b58[cb_dst] = '\0';
-	free(dst);
+	lib_free(dst);
 	return (cb_dst + cb_leading_zeros);
 }
 
@@ -115,23 +118,23 @@ ssize_t base58_decode(const char * b58, ssize_t cb_b58, unsigned char ** p_dst)
 	if(cb_b58 <= 0) cb_b58 = strlen(b58);
 	if(cb_b58 == 0) return 0;
 	
-	unsigned char * dst_buf = calloc(cb_b58 + 1, 1);	// dst size <= b58.length
+	unsigned char * dst_buf = lib_calloc(cb_b58 + 1, 1);	// dst size <= b58.length
 	assert(dst_buf);
 	unsigned char * dst = dst_buf;
 	
 	// insert leading zeros
 	ssize_t offset = 0;
-	while(b58[offset] == '1') ++offset; 
+	while(offset < cb_b58 && b58[offset] == '1') ++offset; 
 	dst += offset;
 	b58 += offset;
 	cb_b58 -= offset;
 	
-	ssize_t cb_dst = 1;
+	ssize_t cb_dst = (cb_b58 > 0);
 	for(int i = 0; i < cb_b58; ++i)
 	{
-		int carry = s_b58_table[(int)b58[i]];
+		int carry = s_b58_table[(unsigned char)b58[i]];
 		if(carry == 0xFF) {
-			free(dst_buf);
+			lib_free(dst_buf);
 			return -1;
 		}
 		
@@ -162,12 +165,117 @@ ssize_t base58_decode(const char * b58, ssize_t cb_b58, unsigned char ** p_dst)
 	if(NULL == *p_dst) *p_dst = dst_buf;
 	else {
 		memcpy(*p_dst, dst_buf, cb_dst);
-		free(dst_buf);
+		lib_free(dst_buf);
 	}
 	return cb_dst;
 }
 
 
+/*
+ * fixed-width codec of 25-byte payloads (Base58Check addresses: [ version | hash160 | checksum ]):
+ *   the payload is a 200-bit number held in 7 big-endian 32-bit limbs, converted 5 digits
+ *   (one 58^5 limb) at a time, with no allocation and no per-byte carry loop.
+ */
+#define BASE58_POW5	(656356768u)	// 58^5 < 2^30
+#define BASE58_25_LIMBS	(7)
+
+// the limbs start at payload[1]: never 4-byte aligned
+static inline uint32_t load_be32(const unsigned char * p) { uint32_t x; memcpy(&x, p, 4); return be32toh(x); }
+static inline void store_be32(unsigned char * p, uint32_t x) { x = htobe32(x); memcpy(p, &x, 4); }
+
+static const uint32_t s_b58_powers[5] = { 1, 58, 58 * 58, 58 * 58 * 58, 58 * 58 * 58 * 58 };
+
+ssize_t base58_encode_25(const unsigned char payload[static BASE58_PAYLOAD_25], char b58[static BASE58_MAX_LENGTH_25 + 1])
+{
+	uint32_t limbs[BASE58_25_LIMBS];
+	limbs[0] = payload[0];
+	for(int i = 1; i < BASE58_25_LIMBS; ++i) limbs[i] = load_be32(&payload[1 + (i - 1) * 4]);
+	
+	// 35 digits, least significant group first
+	// (the quotient loses ~29 bits per pass: its zero top limbs are skipped)
+	uint32_t groups[BASE58_25_LIMBS];
+	int top = 0;
+	for(int g = 0; g < BASE58_25_LIMBS; ++g) {
+		while(top < BASE58_25_LIMBS && 0 == limbs[top]) ++top;
+		uint64_t rem = 0;
+		for(int i = top; i < BASE58_25_LIMBS; ++i) {
+			rem = (rem << 32) | limbs[i];
+			limbs[i] = (uint32_t)(rem / BASE58_POW5);
+			rem %= BASE58_POW5;
+		}
+		groups[g] = (uint32_t)rem;
+	}
+	
+	char digits[BASE58_MAX_LENGTH_25];
+	for(int g = 0; g < BASE58_25_LIMBS; ++g) {
+		uint32_t group = groups[g];
+		char * p = &digits[BASE58_MAX_LENGTH_25 - 1 - g * 5];
+		for(int i = 0; i < 5; ++i, --p) {
+			*p = group % 58;
+			group /= 58;
+		}
+	}
+	
+	int zeros = 0;
+	while(zeros < BASE58_PAYLOAD_25 && 0 == payload[zeros]) ++zeros;
+	int first = 0;
+	while(first < BASE58_MAX_LENGTH_25 && 0 == digits[first]) ++first;
+	
+	char * p = b58;
+	for(int i = 0; i < zeros; ++i) *p++ = '1';
+	for(int i = first; i < BASE58_MAX_LENGTH_25; ++i) *p++ = s_b58_digits[(int)digits[i]];
+	*p = '\0';
+	return (p - b58);
+}
+
+int base58_decode_25(const char * b58, ssize_t cb_b58, unsigned char payload[static BASE58_PAYLOAD_25])
+{
+	if(cb_b58 <= 0) cb_b58 = strlen(b58);
+	if(cb_b58 == 0 || cb_b58 > BASE58_MAX_LENGTH_25) return -1;
+	
+	uint32_t limbs[BASE58_25_LIMBS] = { 0 };
+	int top = BASE58_25_LIMBS - 1;
+	unsigned char invalid = 0;
+	ssize_t offset = 0;
+	while(offset < cb_b58) {
+		// a leading partial group, then groups of 5 digits
+		int cb_group = (offset == 0 && (cb_b58 % 5))?(cb_b58 % 5):5;
+		uint32_t group = 0;
+		for(int i = 0; i < cb_group; ++i) {
+			unsigned char digit = s_b58_table[(unsigned char)b58[offset + i]];
+			invalid |= digit;
+			group = group * 58 + digit;
+		}
+		offset += cb_group;
+		
+		// limbs = limbs * 58^cb_group + group (limbs above top are still zero)
+		uint64_t carry = group;
+		uint32_t mul = (cb_group == 5)?BASE58_POW5:s_b58_powers[cb_group];
+		for(int i = BASE58_25_LIMBS - 1; i >= top; --i) {
+			carry += (uint64_t)limbs[i] * mul;
+			limbs[i] = (uint32_t)carry;
+			carry >>= 32;
+		}
+		if(carry) {
+			if(top == 0) return -1;
+			limbs[--top] = (uint32_t)carry;
+		}
+	}
+	if(invalid & 0xC0) return -1;	// 0xFF marks a non-base58 character
+	if(limbs[0] > 0xFF) return -1;	// more than 25 bytes
+	
+	payload[0] = limbs[0];
+	for(int i = 1; i < BASE58_25_LIMBS; ++i) store_be32(&payload[1 + (i - 1) * 4], limbs[i]);
+	
+	// exactly one '1' per leading zero byte, as base58_decode() would produce 25 bytes
+	int ones = 0;
+	while(ones < cb_b58 && b58[ones] == '1') ++ones;
+	int zeros = 0;
+	while(zeros < BASE58_PAYLOAD_25 && 0 == payload[zeros]) ++zeros;
+	if(ones != zeros) return -1;
+	return BASE58_PAYLOAD_25;
+}
+
 #if defined(_TEST_BASE58) && defined(_STAND_ALONE)
 size_t base58_encode_legacy(const unsigned char * src, size_t cb_src, char * to, size_t buffer_size)
 {
@@ -312,12 +420,67 @@ static size_t base58_decode_legacy(const char * src, size_t cb_src, unsigned cha
 
 
 #define ROUNDS (100000)
+static int test_vectors(void);
 static int test_encode(void);
 static int test_decode(void);
+static int test_fixed_25(void);
 int main(int argc, char **argv)
 {
+	test_vectors();
 	test_encode();
 	test_decode();
+	test_fixed_25();
+	return 0;
+}
+
+static int test_vectors(void)
+{
+	printf("\n====== %s() ======\n", __FUNCTION__);
+	// bitcoin core: src/test/data/base58_encode_decode.json
+	static const char * vectors[][2] = {
+		{ "61", "2g" },
+		{ "626262", "a3gV" },
+		{ "636363", "aPEr" },
+		{ "73696d706c792061206c6f6e6720737472696e67", "2cFupjhnEsSn59qHXstmK2ffpLv2" },
+		{ "00eb15231dfceb60925886b67d065299925915aeb172c06647", "1NS17iag9jJgTHD1VXjvLCEnZuQ3rJDE9L" },
+		{ "516b6fcd0f", "ABnLTmg" },
+		{ "bf4f89001e670274dd", "3SEo3LWLoPntC" },
+		{ "572e4794", "3EFU7m" },
+		{ "ecac89cad93923c02321", "EJDM8drfXA6uyA" },
+		{ "10c8511e", "Rt5zm" },
+		{ "00000000000000000000", "1111111111" },
+		// Base58Check: genesis block coinbase address
+		{ "0062e907b15cbf27d5425399ebf6f0fb50ebb88f18c29b7d93", "1A1zP1eP5QGefi2DMPTfTL5SLmv7DivfNa" },
+	};
+	
+	for(size_t i = 0; i < (sizeof(vectors) / sizeof(vectors[0])); ++i) {
+		unsigned char data[100] = { 0 };
+		void * p_data = data;
+		ssize_t cb_data = hex2bin(vectors[i][0], -1, &p_data);
+		assert(cb_data > 0);
+		
+		char b58[200] = "";
+		char * p_b58 = b58;
+		ssize_t cb = base58_encode(data, cb_data, &p_b58);
+		printf("encode: %s --> %s\n", vectors[i][0], b58);
+		assert(cb == strlen(vectors[i][1]));
+		assert(0 == strcmp(b58, vectors[i][1]));
+		
+		unsigned char decoded[100] = { 0 };
+		unsigned char * p_decoded = decoded;
+		cb = base58_decode(vectors[i][1], -1, &p_decoded);
+		assert(cb == cb_data);
+		assert(0 == memcmp(decoded, data, cb_data));
+	}
+	
+	// invalid characters: '0', 'O', 'I', 'l', non-ascii
+	static const char * invalid_list[] = { "0", "1O1", "I11", "3EFl7m", "3EF\xff" "7m", };
+	for(size_t i = 0; i < (sizeof(invalid_list) / sizeof(invalid_list[0])); ++i) {
+		unsigned char decoded[100] = { 0 };
+		unsigned char * p_decoded = decoded;
+		ssize_t cb = base58_decode(invalid_list[i], -1, &p_decoded);
+		assert(cb == -1);
+	}
 	return 0;
 }
 
@@ -421,5 +584,131 @@ static int test_decode()
 	return 0;
 }
 
+static int test_fixed_25(void)
+{
+	printf("\n====== %s() ======\n", __FUNCTION__);
+	unsigned char payload[25] = { 0 };
+	void * p_payload = payload;
+	hex2bin("0062e907b15cbf27d5425399ebf6f0fb50ebb88f18c29b7d93", -1, &p_payload);
+	char b58[BASE58_MAX_LENGTH_25 + 1] = "";
+	ssize_t cb = base58_encode_25(payload, b58);
+	assert(cb == 34 && 0 == strcmp(b58, "1A1zP1eP5QGefi2DMPTfTL5SLmv7DivfNa"));
+	
+	unsigned char decoded[25] = { 0 };
+	assert(25 == base58_decode_25(b58, cb, decoded));
+	assert(0 == memcmp(decoded, payload, 25));
+	
+	// random payloads (with 0..25 leading zero bytes) against the generic codec
+	srand(58);
+	for(int i = 0; i < ROUNDS; ++i) {
+		int zeros = (i < 26 * 16)?(i % 26):((rand() % 4)?0:(rand() % 26));
+		for(int j = 0; j < 25; ++j) payload[j] = (j < zeros)?0:(rand() & 0xFF);
+		if(i % 3 == 0) memset(&payload[zeros], 0xFF, 25 - zeros);	// the longest encodings
+		
+		char verify[100] = "";
+		char * p_verify = verify;
+		ssize_t cb_verify = base58_encode(payload, 25, &p_verify);
+		cb = base58_encode_25(payload, b58);
+		assert(cb == cb_verify && cb <= BASE58_MAX_LENGTH_25);
+		assert(0 == strcmp(b58, verify));
+		
+		assert(25 == base58_decode_25(b58, cb, decoded));
+		assert(0 == memcmp(decoded, payload, 25));
+		
+		// one more or one fewer leading '1': not a 25-byte payload any more
+		char shifted[BASE58_MAX_LENGTH_25 + 2] = "1";
+		strcpy(shifted + 1, b58);
+		assert(-1 == base58_decode_25(shifted, cb + 1, decoded) || cb + 1 > BASE58_MAX_LENGTH_25);
+		if(b58[0] == '1') assert(-1 == base58_decode_25(b58 + 1, cb - 1, decoded));
+	}
+	
+	static const char * invalid_list[] = {
+		"1A1zP1eP5QGefi2DMPTfTL5SLmv7DivfN0",	// '0'
+		"1A1zP1eP5QGefi2DMPTfTL5SLmv7DivfNaa",	// > 25 bytes
+		"zzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzz",	// > 2^200
+		"1A1zP1eP5QGefi2DMPTfTL5SLmv7DivfNaaaa",	// too long
+		"2g",	// < 25 bytes
+	};
+	for(size_t i = 0; i < (sizeof(invalid_list) / sizeof(invalid_list[0])); ++i) {
+		assert(-1 == base58_decode_25(invalid_list[i], -1, decoded));
+	}
+	
+	// benchmark
+	hex2bin("0062e907b15cbf27d5425399ebf6f0fb50ebb88f18c29b7d93", -1, &p_payload);
+	double time_elapsed;
+	app_timer_start(NULL);
+	for(int i = 0; i < ROUNDS; ++i) {
+		payload[24] = i;
+		base58_encode_25(payload, b58);
+	}
+	time_elapsed = app_timer_stop(NULL);
+	printf("base58_encode_25(): time_elapsed = %.6f (s)\n", time_elapsed);
+	
+	app_timer_start(NULL);
+	for(int i = 0; i < ROUNDS; ++i) {
+		base58_decode_25(b58, cb, decoded);
+	}
+	time_elapsed = app_timer_stop(NULL);
+	printf("base58_decode_25(): time_elapsed = %.6f (s)\n", time_elapsed);
+	return 0;
+}
+
 #undef ROUNDS
 #endif
+
+
+#if defined(_FUZZ_BASE58)
+/*
+ * libFuzzer entry: 
+ *   clang -fsanitize=fuzzer,address -D_FUZZ_BASE58 ...
+ * any string that decodes must re-encode to itself.
+ */
+int LLVMFuzzerTestOneInput(const uint8_t * data, size_t size)
+{
+	if(size == 0 || size > 256) return 0;
+	char b58[257] = "";
+	memcpy(b58, data, size);
+	if(memchr(b58, '\0', size)) return 0;
+	
+	unsigned char decoded[257] = { 0 };
+	unsigned char * p_decoded = decoded;
+	ssize_t cb = base58_decode(b58, size, &p_decoded);
+	if(cb < 0) return 0;
+	assert(cb <= size);
+	
+	char encoded[400] = "";
+	char * p_encoded = encoded;
+	ssize_t cb_encoded = base58_encode(decoded, cb, &p_encoded);
+	assert(cb_encoded == size);
+	assert(0 == memcmp(encoded, b58, size));
+	
+	// the fixed-width codec accepts exactly the 25-byte payloads
+	unsigned char payload[25];
+	int cb_payload = base58_decode_25(b58, size, payload);
+	assert((cb_payload == 25) == (cb == 25));
+	if(cb_payload == 25) assert(0 == memcmp(payload, decoded, 25));
+	return 0;
+}
+
+#if defined(_STAND_ALONE)
+/* without libFuzzer: feed random printable strings (built by 'make check') */
+int main(int argc, char ** argv)
+{
+	int rounds = (argc > 1)?atoi(argv[1]):100000;
+	unsigned int seed = (argc > 2)?atoi(argv[2]):(unsigned int)time(NULL);
+	printf("fuzz base58: rounds=%d, seed=%u\n", rounds, seed);
+	srand(seed);
+	
+	uint8_t data[64];
+	for(int i = 0; i < rounds; ++i) {
+		size_t size = 1 + rand() % sizeof(data);
+		for(size_t j = 0; j < size; ++j) {
+			// mostly base58 digits, sometimes arbitrary bytes
+			data[j] = (rand() % 16)?s_b58_digits[rand() % 58]:(uint8_t)(1 + rand() % 255);
+		}
+		LLVMFuzzerTestOneInput(data, size);
+	}
+	return 0;
+}
+#endif
+#endif
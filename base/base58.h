@@ -6,9 +6,17 @@
 extern "C" {
 #endif
 
+/* *p_b58 / *p_dst == NULL: the output is allocated with lib_alloc() (see utils/arena.h) */
 ssize_t base58_encode(const void * data, ssize_t length, char ** p_b58);
 ssize_t base58_decode(const char * b58, ssize_t cb_b58, unsigned char ** p_dst);
 
+/* fixed-width 25-byte payloads (Base58Check addresses), no allocation */
+#define BASE58_PAYLOAD_25	(25)
+#define BASE58_MAX_LENGTH_25	(35)
+ssize_t base58_encode_25(const unsigned char payload[static BASE58_PAYLOAD_25], char b58[static BASE58_MAX_LENGTH_25 + 1]);
+/* @return 25, or -1 if b58 is not the encoding of exactly 25 bytes */
+int base58_decode_25(const char * b58, ssize_t cb_b58, unsigned char payload[static BASE58_PAYLOAD_25]);
+
 #ifdef __cplusplus
 }
 #endif
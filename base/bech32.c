@@ -246,3 +246,226 @@ ssize_t bech32_encode(uint8_t version,
 	return (output - bech32);
 }
 
+static const int8_t s_bech32_table[128] = {
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	15, -1, 10, 17, 21, 20, 26, 30,  7,  5, -1, -1, -1, -1, -1, -1,
+	-1, 29, -1, 24, 13, 25,  9,  8, 23, -1, 18, 22, 31, 27, 19, -1,
+	 1,  0,  3, 16, 11, 28, 12, 14,  6,  4,  2, -1, -1, -1, -1, -1,
+	-1, 29, -1, 24, 13, 25,  9,  8, 23, -1, 18, 22, 31, 27, 19, -1,
+	 1,  0,  3, 16, 11, 28, 12, 14,  6,  4,  2, -1, -1, -1, -1, -1,
+};
+
+ssize_t bech32_decode(const char * bech32, ssize_t cb_bech32, 
+	char * hrp, 
+	uint8_t * p_version, 
+	unsigned char * program)
+{
+	assert(bech32 && hrp && p_version && program);
+	if(cb_bech32 < 0) cb_bech32 = strlen(bech32);
+	if(cb_bech32 < 8 || cb_bech32 > 90) return -1;
+	
+	// character set and case
+	int has_lower = 0, has_upper = 0;
+	ssize_t separator = -1;
+	for(ssize_t i = 0; i < cb_bech32; ++i) {
+		unsigned char c = bech32[i];
+		if(c < 33 || c > 126) return -1;
+		if(c >= 'a' && c <= 'z') has_lower = 1;
+		else if(c >= 'A' && c <= 'Z') has_upper = 1;
+		else if(c == '1') separator = i;
+	}
+	if(has_lower && has_upper) return -1;
+	
+	// [ hrp | '1' | data (>= 1) | checksum (6) ]
+	ssize_t cb_hrp = separator;
+	ssize_t cb_data = cb_bech32 - separator - 1;
+	if(cb_hrp < 1 || cb_data < 7) return -1;
+	
+	uint32_t checksum = 1;
+	for(ssize_t i = 0; i < cb_hrp; ++i) {
+		int c = bech32[i];
+		if(c >= 'A' && c <= 'Z') c += 'a' - 'A';
+		hrp[i] = c;
+		checksum = bech32_polymod(checksum) ^ (c >> 5);
+	}
+	hrp[cb_hrp] = '\0';
+	checksum = bech32_polymod(checksum);
+	for(ssize_t i = 0; i < cb_hrp; ++i) {
+		checksum = bech32_polymod(checksum) ^ (hrp[i] & 0x1f);
+	}
+	
+	uint8_t b32[90];
+	const char * data = bech32 + separator + 1;
+	for(ssize_t i = 0; i < cb_data; ++i) {
+		int8_t value = s_bech32_table[(unsigned char)data[i]];
+		if(value < 0) return -1;
+		b32[i] = value;
+		checksum = bech32_polymod(checksum) ^ value;
+	}
+	
+	enum bech32_encode_type encode_type;
+	if(checksum == s_bech32_final_constants[bech32_encode_type_default]) encode_type = bech32_encode_type_default;
+	else if(checksum == s_bech32_final_constants[bech32_encode_type_bech32m]) encode_type = bech32_encode_type_bech32m;
+	else return -1;
+	
+	// witness version
+	uint8_t version = b32[0];
+	if(version > 16) return -1;
+	if(encode_type != ((version > 0)?bech32_encode_type_bech32m:bech32_encode_type_default)) return -1;
+	
+	// witness program: base32 --> base256, at most 4 zero padding bits
+	ssize_t cb_b32 = cb_data - 6 - 1;
+	uint32_t acc = 0;
+	int bits = 0;
+	ssize_t cb_program = 0;
+	for(ssize_t i = 1; i <= cb_b32; ++i) {
+		acc = (acc << 5) | b32[i];
+		bits += 5;
+		if(bits >= 8) {
+			bits -= 8;
+			if(cb_program >= 40) return -1;
+			program[cb_program++] = (acc >> bits) & 0xFF;
+		}
+	}
+	if(bits > 4 || (acc & ((1u << bits) - 1))) return -1;
+	
+	if(cb_program < 2 || cb_program > 40) return -1;
+	if(version == 0 && cb_program != 20 && cb_program != 32) return -1;
+	
+	*p_version = version;
+	return cb_program;
+}
+
+
+#if defined(_TEST_BECH32) && defined(_STAND_ALONE)
+/* BIP173 / BIP350 test vectors */
+int main(int argc, char ** argv)
+{
+	static const char * valid_list[][2] = {
+		{ "BC1QW508D6QEJXTDG4Y5R3ZARVARY0C5XW7KV8F3T4", "0014751e76e8199196d454941c45d1b3a323f1433bd6" },
+		{ "tb1qrp33g0q5c5txsp9arysrx4k6zdkfs4nce4xj0gdcccefvpysxf3q0sl5k7", "00201863143c14c5166804bd19203356da136c985678cd4d27a1b8c6329604903262" },
+		{ "bc1pw508d6qejxtdg4y5r3zarvary0c5xw7kw508d6qejxtdg4y5r3zarvary0c5xw7kt5nd6y", "5128751e76e8199196d454941c45d1b3a323f1433bd6751e76e8199196d454941c45d1b3a323f1433bd6" },
+		{ "BC1SW50QGDZ25J", "6002751e" },
+		{ "bc1zw508d6qejxtdg4y5r3zarvaryvaxxpcs", "5210751e76e8199196d454941c45d1b3a323" },
+		{ "tb1qqqqqp399et2xygdj5xreqhjjvcmzhxw4aywxecjdzew6hylgvsesrxh6hy", "0020000000c4a5cad46221b2a187905e5266362b99d5e91c6ce24d165dab93e86433" },
+		{ "tb1pqqqqp399et2xygdj5xreqhjjvcmzhxw4aywxecjdzew6hylgvsesf3hn0c", "5120000000c4a5cad46221b2a187905e5266362b99d5e91c6ce24d165dab93e86433" },
+		{ "bc1p0xlxvlhemja6c4dqv22uapctqupfhlxm9h8z3k2e72q4k9hcz7vqzk5jj0", "512079be667ef9dcbbac55a06295ce870b07029bfcdb2dce28d959f2815b16f81798" },
+	};
+	static const char * invalid_list[] = {
+		"bc1p0xlxvlhemja6c4dqv22uapctqupfhlxm9h8z3k2e72q4k9hcz7vqh2y7hd",	// bech32 checksum for v1
+		"tb1z0xlxvlhemja6c4dqv22uapctqupfhlxm9h8z3k2e72q4k9hcz7vqglt7rf",	// bech32 checksum for v2
+		"BC1S0XLXVLHEMJA6C4DQV22UAPCTQUPFHLXM9H8Z3K2E72Q4K9HCZ7VQ54WELL",	// bech32 checksum for v16
+		"bc1qw508d6qejxtdg4y5r3zarvary0c5xw7kemeawh",	// bech32m checksum for v0
+		"tb1q0xlxvlhemja6c4dqv22uapctqupfhlxm9h8z3k2e72q4k9hcz7vq24jc47",	// bech32m checksum for v0
+		"bc1p38j9r5y49hruaue7wxjce0updqjuyyx0kh56v8s25huc6995vvpql3jow4",	// invalid character
+		"BC130XLXVLHEMJA6C4DQV22UAPCTQUPFHLXM9H8Z3K2E72Q4K9HCZ7VQ7ZWS8R",	// invalid witness version
+		"bc1pw5dgrnzv",	// invalid program length (1 byte)
+		"bc1p0xlxvlhemja6c4dqv22uapctqupfhlxm9h8z3k2e72q4k9hcz7v8n0nx0muaewav253zgeav",	// invalid program length (41 bytes)
+		"BC1QR508D6QEJXTDG4Y5R3ZARVARYV98GJ9P",	// invalid program length for v0
+		"tb1p0xlxvlhemja6c4dqv22uapctqupfhlxm9h8z3k2e72q4k9hcz7vq47Zagq",	// mixed case
+		"bc1p0xlxvlhemja6c4dqv22uapctqupfhlxm9h8z3k2e72q4k9hcz7v07qwwzcrf",	// zero padding of more than 4 bits
+		"tb1p0xlxvlhemja6c4dqv22uapctqupfhlxm9h8z3k2e72q4k9hcz7vpggkg4j",	// non-zero padding
+		"bc1gmk9yu",	// empty data section
+	};
+	
+	for(size_t i = 0; i < (sizeof(valid_list) / sizeof(valid_list[0])); ++i) {
+		const char * addr = valid_list[i][0];
+		char hrp[84] = "";
+		uint8_t version = 0xff;
+		unsigned char program[40] = { 0 };
+		ssize_t cb_program = bech32_decode(addr, -1, hrp, &version, program);
+		printf("valid[%d]: %s --> hrp=%s, version=%d, cb_program=%d\n", (int)i, addr, hrp, version, (int)cb_program);
+		assert(cb_program > 0);
+		
+		// scriptPubKey: [ OP_n | push(program) ]
+		unsigned char script[42] = { (version > 0)?(0x50 + version):0, cb_program };
+		memcpy(&script[2], program, cb_program);
+		char script_hex[100] = "";
+		char * p_hex = script_hex;
+		bin2hex(script, cb_program + 2, &p_hex);
+		assert(0 == strcmp(script_hex, valid_list[i][1]));
+		
+		// re-encode (lowercase)
+		char encoded[100] = "";
+		ssize_t cb = bech32_encode(version, hrp, program, cb_program, encoded);
+		assert(cb == strlen(addr));
+		assert(0 == strcasecmp(encoded, addr));
+	}
+	
+	for(size_t i = 0; i < (sizeof(invalid_list) / sizeof(invalid_list[0])); ++i) {
+		char hrp[84] = "";
+		uint8_t version = 0;
+		unsigned char program[40] = { 0 };
+		ssize_t cb_program = bech32_decode(invalid_list[i], -1, hrp, &version, program);
+		printf("invalid[%d]: %s --> %d\n", (int)i, invalid_list[i], (int)cb_program);
+		assert(cb_program == -1);
+	}
+	
+	printf("==== %s: PASSED ====\n", __FILE__);
+	return 0;
+}
+#endif
+
+#if defined(_FUZZ_BECH32)
+/*
+ * libFuzzer entry: 
+ *   clang -fsanitize=fuzzer,address -D_FUZZ_BECH32 ...
+ * any address that decodes must re-encode to its lowercase form.
+ */
+int LLVMFuzzerTestOneInput(const uint8_t * data, size_t size)
+{
+	if(size == 0 || size > 128) return 0;
+	char addr[129] = "";
+	memcpy(addr, data, size);
+	
+	char hrp[84] = "";
+	uint8_t version = 0;
+	unsigned char program[40] = { 0 };
+	ssize_t cb_program = bech32_decode(addr, size, hrp, &version, program);
+	if(cb_program < 0) return 0;
+	assert(cb_program >= 2 && cb_program <= 40 && version <= 16);
+	
+	char encoded[100] = "";
+	ssize_t cb = bech32_encode(version, hrp, program, cb_program, encoded);
+	assert(cb == size);
+	assert(0 == strncasecmp(encoded, addr, size));
+	return 0;
+}
+
+#if defined(_STAND_ALONE)
+#include <time.h>
+/* without libFuzzer: mutate valid addresses (built by 'make check') */
+int main(int argc, char ** argv)
+{
+	int rounds = (argc > 1)?atoi(argv[1]):100000;
+	unsigned int seed = (argc > 2)?atoi(argv[2]):(unsigned int)time(NULL);
+	printf("fuzz bech32: rounds=%d, seed=%u\n", rounds, seed);
+	srand(seed);
+	
+	static const char * seeds[] = {
+		"bc1qw508d6qejxtdg4y5r3zarvary0c5xw7kv8f3t4",
+		"bc1p0xlxvlhemja6c4dqv22uapctqupfhlxm9h8z3k2e72q4k9hcz7vqzk5jj0",
+		"BC1SW50QGDZ25J",
+	};
+	uint8_t data[100];
+	for(int i = 0; i < rounds; ++i) {
+		const char * addr = seeds[rand() % (sizeof(seeds) / sizeof(seeds[0]))];
+		size_t size = strlen(addr);
+		memcpy(data, addr, size);
+		
+		int mutations = rand() % 4;
+		for(int m = 0; m < mutations; ++m) {
+			switch(rand() % 3) {
+			case 0: data[rand() % size] = s_bech32_digits[rand() % 32]; break;
+			case 1: data[rand() % size] = (uint8_t)rand(); break;
+			default: if(size > 1) --size; break;
+			}
+		}
+		LLVMFuzzerTestOneInput(data, size);
+	}
+	return 0;
+}
+#endif
+#endif
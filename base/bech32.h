@@ -13,6 +13,18 @@ ssize_t bech32_encode(uint8_t version,
 	const unsigned char * data, size_t length, // pubkey hash
 	char * bech32);
 
+/**
+ * bech32_decode()
+ *   decode and verify a segwit address (BIP173 / BIP350): 
+ *   witness version 0 must use the bech32 checksum, version 1..16 must use bech32m.
+ * @param hrp [out] lowercase human-readable part, at least 84 bytes
+ * @param program [out] witness program, at least 40 bytes
+ * @return the length of the witness program, or -1 if the address is invalid
+**/
+ssize_t bech32_decode(const char * bech32, ssize_t cb_bech32, 
+	char * hrp, 
+	uint8_t * p_version, 
+	unsigned char * program);
 
 
 #ifdef __cplusplus
@@ -0,0 +1,198 @@
+/*
+ * crc32c.c
+ * 
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ * 
+ * The MIT License (MIT)
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to deal 
+ * in the Software without restriction, including without limitation the rights 
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all 
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS 
+ * IN THE SOFTWARE.
+ * 
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+#include <endian.h>
+#include <pthread.h>
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+#include "crc32c.h"
+
+#define CRC32C_POLY	(0x82F63B78)	// 0x1EDC6F41 reflected
+
+static uint32_t s_table[8][256];
+static pthread_once_t s_table_once = PTHREAD_ONCE_INIT;
+
+static void init_table(void)
+{
+	for(uint32_t i = 0; i < 256; ++i) {
+		uint32_t crc = i;
+		for(int k = 0; k < 8; ++k) crc = (crc >> 1) ^ ((crc & 1)?CRC32C_POLY:0);
+		s_table[0][i] = crc;
+	}
+	for(uint32_t i = 0; i < 256; ++i) {
+		for(int t = 1; t < 8; ++t) s_table[t][i] = (s_table[t - 1][i] >> 8) ^ s_table[0][s_table[t - 1][i] & 0xff];
+	}
+}
+
+/* slicing-by-8 */
+static uint32_t crc32c_update_generic(uint32_t crc, const unsigned char * p, size_t length)
+{
+	pthread_once(&s_table_once, init_table);
+	for(; length && ((uintptr_t)p & 7); --length) crc = (crc >> 8) ^ s_table[0][(crc ^ *p++) & 0xff];
+	for(; length >= 8; length -= 8, p += 8) {
+		uint64_t word;
+		memcpy(&word, p, 8);
+		word = le64toh(word) ^ crc;
+		crc = s_table[7][word & 0xff] ^ s_table[6][(word >> 8) & 0xff]
+			^ s_table[5][(word >> 16) & 0xff] ^ s_table[4][(word >> 24) & 0xff]
+			^ s_table[3][(word >> 32) & 0xff] ^ s_table[2][(word >> 40) & 0xff]
+			^ s_table[1][(word >> 48) & 0xff] ^ s_table[0][word >> 56];
+	}
+	for(; length; --length) crc = (crc >> 8) ^ s_table[0][(crc ^ *p++) & 0xff];
+	return crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_update_sse42(uint32_t crc, const unsigned char * p, size_t length)
+{
+	uint64_t crc64 = crc;
+	for(; length && ((uintptr_t)p & 7); --length) crc64 = _mm_crc32_u8(crc64, *p++);
+	for(; length >= 8; length -= 8, p += 8) {
+		uint64_t word;
+		memcpy(&word, p, 8);
+		crc64 = _mm_crc32_u64(crc64, word);
+	}
+	crc = crc64;
+	for(; length; --length) crc = _mm_crc32_u8(crc, *p++);
+	return crc;
+}
+#endif
+
+static int s_has_sse42 = -1;
+int crc32c_has_sse42(void)
+{
+	int has = __atomic_load_n(&s_has_sse42, __ATOMIC_RELAXED);
+	if(__builtin_expect(has < 0, 0)) {
+#if defined(__x86_64__)
+		__builtin_cpu_init();
+		has = __builtin_cpu_supports("sse4.2");
+#else
+		has = 0;
+#endif
+		__atomic_store_n(&s_has_sse42, has, __ATOMIC_RELAXED);
+	}
+	return has;
+}
+
+void crc32c_use_sse42(int enabled)
+{
+	__atomic_store_n(&s_has_sse42, enabled?-1:0, __ATOMIC_RELAXED);
+}
+
+uint32_t crc32c_update(uint32_t crc, const void * data, size_t length)
+{
+	crc = ~crc;
+#if defined(__x86_64__)
+	if(crc32c_has_sse42()) return ~crc32c_update_sse42(crc, data, length);
+#endif
+	return ~crc32c_update_generic(crc, data, length);
+}
+
+
+#if defined(_TEST_CRC32C) && defined(_STAND_ALONE)
+#include <time.h>
+
+static uint32_t ref_crc32c(const unsigned char * p, size_t length)
+{
+	uint32_t crc = ~0u;
+	for(size_t i = 0; i < length; ++i) {
+		crc ^= p[i];
+		for(int k = 0; k < 8; ++k) crc = (crc >> 1) ^ ((crc & 1)?CRC32C_POLY:0);
+	}
+	return ~crc;
+}
+
+static inline uint64_t splitmix64(uint64_t * state)
+{
+	uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+int main(int argc, char ** argv)
+{
+	// RFC 3720 B.4
+	static unsigned char zeros[32], ones[32], incrementing[32];
+	memset(ones, 0xff, sizeof(ones));
+	for(int i = 0; i < 32; ++i) incrementing[i] = i;
+
+	#define SIZE (1 << 20)
+	unsigned char * data = malloc(SIZE + 8);
+	assert(data);
+	uint64_t state = 20211;
+	for(size_t i = 0; i < SIZE + 8; ++i) data[i] = splitmix64(&state);
+
+	for(int pass = 0; pass < 2; ++pass) {
+		crc32c_use_sse42(!pass);
+		const char * impl = crc32c_has_sse42()?"sse4.2":"generic";
+		assert(0xE3069283 == crc32c("123456789", 9));
+		assert(0x8A9136AA == crc32c(zeros, 32));
+		assert(0x62A8AB43 == crc32c(ones, 32));
+		assert(0x46DD794E == crc32c(incrementing, 32));
+		assert(0 == crc32c(NULL, 0));
+
+		// every length and alignment up to 64 bytes, then random splits of a long stream
+		for(size_t offset = 0; offset < 8; ++offset) {
+			for(size_t length = 0; length <= 64; ++length) assert(crc32c(data + offset, length) == ref_crc32c(data + offset, length));
+		}
+		uint32_t expected = ref_crc32c(data, SIZE);
+		for(int round = 0; round < 100; ++round) {
+			uint32_t crc = 0;
+			size_t pos = 0;
+			while(pos < SIZE) {
+				size_t length = splitmix64(&state) % 20000;
+				if(length > SIZE - pos) length = SIZE - pos;
+				crc = crc32c_update(crc, data + pos, length);
+				pos += length;
+			}
+			assert(crc == expected);
+		}
+
+		struct timespec begin, end;
+		clock_gettime(CLOCK_MONOTONIC, &begin);
+		uint32_t crc = 0;
+		for(int i = 0; i < 64; ++i) crc = crc32c_update(crc, data, SIZE);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		double elapsed = (end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) / 1e9;
+		printf("crc32c (%s): %.2f GB/s (crc=%.8x)\n", impl, 64.0 * SIZE / elapsed / 1e9, crc);
+	}
+	crc32c_use_sse42(1);
+	free(data);
+	printf("==== %s: PASSED ====\n", __FILE__);
+	return 0;
+}
+#endif
@@ -0,0 +1,26 @@
+#ifndef CRYPTO_CRC32C_H_
+#define CRYPTO_CRC32C_H_
+
+#include <stdio.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/**
+ * CRC-32C (Castagnoli, the iSCSI / ext4 polynomial 0x1EDC6F41, reflected):
+ *   SSE4.2 crc32 instructions where the cpu has them, a slicing-by-8 table otherwise.
+ *   Streaming: crc = crc32c_update(crc, part, len) over consecutive parts, starting from 0,
+ *   gives the crc of the concatenation.
+**/
+uint32_t crc32c_update(uint32_t crc, const void * data, size_t length);
+#define crc32c(data, length)	crc32c_update(0, data, length)
+
+int crc32c_has_sse42(void);
+void crc32c_use_sse42(int enabled);	// 0: force the table version (tests), otherwise auto-detect
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,363 @@
+/*
+ * hash_fused.c
+ * 
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ * 
+ * The MIT License (MIT)
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to deal 
+ * in the Software without restriction, including without limitation the rights 
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all 
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS 
+ * IN THE SOFTWARE.
+ * 
+ */
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+#include <endian.h>
+
+#include "hash_fused.h"
+#include "sha.h"
+
+#define rotr(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+#define rotl(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+static inline uint32_t load_be32(const unsigned char * p) { uint32_t x; memcpy(&x, p, 4); return be32toh(x); }
+static inline uint32_t load_le32(const unsigned char * p) { uint32_t x; memcpy(&x, p, 4); return le32toh(x); }
+static inline void store_le32(unsigned char * p, uint32_t x) { x = htole32(x); memcpy(p, &x, 4); }
+static inline void store_be32(unsigned char * p, uint32_t x) { x = htobe32(x); memcpy(p, &x, 4); }
+
+/******************************************************************************
+ * SHA-256
+******************************************************************************/
+static const uint32_t s_sha256_iv[8] = {
+	0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+static const uint32_t s_sha256_k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+/**
+ * fully unrolled: constant message words (padding) fold into the schedule.
+ * word0_only: only state[0] is updated, the last round skips the e update
+**/
+static inline __attribute__((always_inline)) void sha256_compress_rounds(uint32_t state[static 8], const uint32_t block[static 16], const int word0_only)
+{
+	uint32_t w[16];
+	memcpy(w, block, sizeof(w));
+
+	uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+	uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+#pragma GCC unroll 64
+	for(int i = 0; i < 64; ++i) {
+		if(i >= 16) {
+			uint32_t w15 = w[(i - 15) & 15], w2 = w[(i - 2) & 15];
+			w[i & 15] += (rotr(w15, 7) ^ rotr(w15, 18) ^ (w15 >> 3)) + w[(i - 7) & 15] + (rotr(w2, 17) ^ rotr(w2, 19) ^ (w2 >> 10));
+		}
+		uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + s_sha256_k[i] + w[i & 15];
+		uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+		if(word0_only && i == 63) {
+			a = t1 + t2;
+			break;
+		}
+		h = g; g = f; f = e; e = d + t1;
+		d = c; c = b; b = a; a = t1 + t2;
+	}
+
+	state[0] += a;
+	if(word0_only) return;
+	state[1] += b; state[2] += c; state[3] += d;
+	state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+#define sha256_compress_generic(state, block) sha256_compress_rounds(state, block, 0)
+
+/* the SHA extensions path lives in sha.c; the inlined generic rounds fold the constant padding words */
+static inline void sha256_compress(uint32_t state[static 8], const uint32_t block[static 16])
+{
+	if(sha256_has_sha_ni()) sha256_transform(state, block);
+	else sha256_compress_generic(state, block);
+}
+
+/* only state[0] is valid on return */
+static inline void sha256_compress_word0(uint32_t state[static 8], const uint32_t block[static 16])
+{
+	if(sha256_has_sha_ni()) sha256_transform(state, block);	// no partial form: rnds2 always updates the whole state
+	else sha256_compress_rounds(state, block, 1);
+}
+
+/******************************************************************************
+ * RIPEMD-160
+******************************************************************************/
+static const uint8_t s_rmd_rl[80] = {
+	0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+	7, 4, 13, 1, 10, 6, 15, 3, 12, 0, 9, 5, 2, 14, 11, 8,
+	3, 10, 14, 4, 9, 15, 8, 1, 2, 7, 0, 6, 13, 11, 5, 12,
+	1, 9, 11, 10, 0, 8, 12, 4, 13, 3, 7, 15, 14, 5, 6, 2,
+	4, 0, 5, 9, 7, 12, 2, 10, 14, 1, 3, 8, 11, 6, 15, 13,
+};
+static const uint8_t s_rmd_rr[80] = {
+	5, 14, 7, 0, 9, 2, 11, 4, 13, 6, 15, 8, 1, 10, 3, 12,
+	6, 11, 3, 7, 0, 13, 5, 10, 14, 15, 8, 12, 4, 9, 1, 2,
+	15, 5, 1, 3, 7, 14, 6, 9, 11, 8, 12, 2, 10, 0, 4, 13,
+	8, 6, 4, 1, 3, 11, 15, 0, 5, 12, 2, 13, 9, 7, 10, 14,
+	12, 15, 10, 4, 1, 5, 8, 7, 6, 2, 13, 14, 0, 3, 9, 11,
+};
+static const uint8_t s_rmd_sl[80] = {
+	11, 14, 15, 12, 5, 8, 7, 9, 11, 13, 14, 15, 6, 7, 9, 8,
+	7, 6, 8, 13, 11, 9, 7, 15, 7, 12, 15, 9, 11, 7, 13, 12,
+	11, 13, 6, 7, 14, 9, 13, 15, 14, 8, 13, 6, 5, 12, 7, 5,
+	11, 12, 14, 15, 14, 15, 9, 8, 9, 14, 5, 6, 8, 6, 5, 12,
+	9, 15, 5, 11, 6, 8, 13, 12, 5, 12, 13, 14, 11, 8, 5, 6,
+};
+static const uint8_t s_rmd_sr[80] = {
+	8, 9, 9, 11, 13, 15, 15, 5, 7, 7, 8, 11, 14, 14, 12, 6,
+	9, 13, 15, 7, 12, 8, 9, 11, 7, 7, 12, 7, 6, 15, 13, 11,
+	9, 7, 15, 11, 8, 6, 6, 14, 12, 13, 5, 14, 13, 13, 7, 5,
+	15, 5, 8, 11, 14, 14, 6, 14, 6, 9, 12, 9, 12, 5, 15, 8,
+	8, 5, 12, 9, 12, 5, 14, 6, 8, 13, 6, 5, 15, 13, 11, 11,
+};
+static const uint32_t s_rmd_kl[5] = { 0x00000000, 0x5A827999, 0x6ED9EBA1, 0x8F1BBCDC, 0xA953FD4E };
+static const uint32_t s_rmd_kr[5] = { 0x50A28BE6, 0x5C4DD124, 0x6D703EF3, 0x7A6D76E9, 0x00000000 };
+static const uint32_t s_rmd_iv[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+
+#define rmd_f(j, x, y, z) (((j) == 0)?((x) ^ (y) ^ (z)) \
+	: ((j) == 1)?(((x) & (y)) | (~(x) & (z))) \
+	: ((j) == 2)?(((x) | ~(y)) ^ (z)) \
+	: ((j) == 3)?(((x) & (z)) | ((y) & ~(z))) \
+	: ((x) ^ ((y) | ~(z))))
+
+static inline __attribute__((always_inline)) void ripemd160_compress(uint32_t state[static 5], const uint32_t block[static 16])
+{
+	uint32_t a1 = state[0], b1 = state[1], c1 = state[2], d1 = state[3], e1 = state[4];
+	uint32_t a2 = a1, b2 = b1, c2 = c1, d2 = d1, e2 = e1;
+
+#pragma GCC unroll 80
+	for(int i = 0; i < 80; ++i) {
+		const int j = i / 16;
+		uint32_t t = rotl(a1 + rmd_f(j, b1, c1, d1) + block[s_rmd_rl[i]] + s_rmd_kl[j], s_rmd_sl[i]) + e1;
+		a1 = e1; e1 = d1; d1 = rotl(c1, 10); c1 = b1; b1 = t;
+
+		t = rotl(a2 + rmd_f(4 - j, b2, c2, d2) + block[s_rmd_rr[i]] + s_rmd_kr[j], s_rmd_sr[i]) + e2;
+		a2 = e2; e2 = d2; d2 = rotl(c2, 10); c2 = b2; b2 = t;
+	}
+
+	uint32_t t = state[1] + c1 + d2;
+	state[1] = state[2] + d1 + e2;
+	state[2] = state[3] + e1 + a2;
+	state[3] = state[4] + a1 + b2;
+	state[4] = state[0] + b1 + c2;
+	state[0] = t;
+}
+
+/******************************************************************************
+ * fused kernels
+******************************************************************************/
+void hash160_33(const unsigned char pubkey[static 33], unsigned char hash[static 20])
+{
+	// SHA-256: one block, [ pubkey(33) | 0x80 | zeros | bit length 264 ]
+	uint32_t w[16] = { [15] = 33 * 8 };
+	for(int i = 0; i < 8; ++i) w[i] = load_be32(&pubkey[i * 4]);
+	w[8] = ((uint32_t)pubkey[32] << 24) | 0x800000;
+
+	uint32_t sha[8];
+	memcpy(sha, s_sha256_iv, sizeof(sha));
+	sha256_compress(sha, w);
+
+	// RIPEMD-160: one block, the byte-swapped SHA-256 state words then [ 0x80 | zeros | bit length 256 ]
+	uint32_t x[16] = { [8] = 0x80, [14] = 32 * 8 };
+	for(int i = 0; i < 8; ++i) x[i] = __builtin_bswap32(sha[i]);
+
+	uint32_t rmd[5];
+	memcpy(rmd, s_rmd_iv, sizeof(rmd));
+	ripemd160_compress(rmd, x);
+	for(int i = 0; i < 5; ++i) store_le32(&hash[i * 4], rmd[i]);
+}
+
+void hash256_checksum_21(const unsigned char payload[static 21], unsigned char checksum[static 4])
+{
+	// first SHA-256: one block, [ payload(21) | 0x80 | zeros | bit length 168 ]
+	uint32_t w[16] = { [15] = 21 * 8 };
+	for(int i = 0; i < 5; ++i) w[i] = load_be32(&payload[i * 4]);
+	w[5] = ((uint32_t)payload[20] << 24) | 0x800000;
+
+	uint32_t sha[8];
+	memcpy(sha, s_sha256_iv, sizeof(sha));
+	sha256_compress(sha, w);
+
+	// second SHA-256: the first digest's state words are the message, then [ 0x80 | zeros | bit length 256 ];
+	// only the first digest word makes it into the checksum
+	uint32_t x[16] = { [8] = 0x80000000, [15] = 32 * 8 };
+	memcpy(x, sha, sizeof(sha));
+	memcpy(sha, s_sha256_iv, sizeof(sha));
+	sha256_compress_word0(sha, x);
+	store_be32(checksum, sha[0]);
+}
+
+
+#if defined(_TEST_HASH_FUSED) && defined(_STAND_ALONE)
+/*
+ * fused kernels against the generic path (sha256_hash + ripemd160_hash) and the multi-lane kernels
+ */
+#include <time.h>
+#include "ripemd.h"
+#include "hash_lanes.h"
+
+static uint64_t s_state = 2021;
+static uint32_t next_random(void)
+{
+	s_state = s_state * 6364136223846793005ULL + 1442695040888963407ULL;
+	return (uint32_t)(s_state >> 32);
+}
+
+static double elapsed(const struct timespec * begin, const struct timespec * end)
+{
+	return (end->tv_sec - begin->tv_sec) + (end->tv_nsec - begin->tv_nsec) / 1e9;
+}
+
+#define ROUNDS (100000)
+int main(int argc, char ** argv)
+{
+	static unsigned char pubkeys[ROUNDS][33];
+	for(int i = 0; i < ROUNDS; ++i) {
+		for(int j = 0; j < 33; ++j) pubkeys[i][j] = (unsigned char)next_random();
+		pubkeys[i][0] = 0x02 | (pubkeys[i][0] & 1);
+	}
+
+	// scalar, with and without the SHA extensions
+	for(int pass = 0; pass < 2; ++pass) {
+		sha256_use_sha_ni(!pass);
+		printf("sha256: %s\n", sha256_has_sha_ni()?"sha extensions":"generic");
+	for(int i = 0; i < ROUNDS; ++i) {
+		unsigned char sha[32], expected[20], hash[20];
+		sha256_hash(pubkeys[i], 33, sha);
+		ripemd160_hash(sha, 32, expected);
+		hash160_33(pubkeys[i], hash);
+		assert(0 == memcmp(hash, expected, 20));
+	}
+	}
+	sha256_use_sha_ni(1);
+
+	// multi-lane
+	for(int i = 0; i + HASH_LANES <= ROUNDS; i += HASH_LANES) {
+		hash_lanes_t block[16] = { { 0 } }, hash[5];
+		for(int lane = 0; lane < HASH_LANES; ++lane) {
+			const unsigned char * pubkey = pubkeys[i + lane];
+			for(int j = 0; j < 8; ++j) block[j][lane] = load_be32(&pubkey[j * 4]);
+			block[8][lane] = ((uint32_t)pubkey[32] << 24) | 0x800000;
+		}
+		block[15] += 33 * 8;
+		hash160_lanes(hash, block);
+		for(int lane = 0; lane < HASH_LANES; ++lane) {
+			unsigned char expected[20];
+			hash160_33(pubkeys[i + lane], expected);
+			for(int j = 0; j < 5; ++j) assert(hash[j][lane] == load_le32(&expected[j * 4]));
+		}
+	}
+
+	// checksums: scalar and multi-lane against two sha256_hash calls, prefixes 0x00 / 0x05 / random
+	for(int pass = 0; pass < 2; ++pass) {
+		sha256_use_sha_ni(!pass);
+		for(int i = 0; i + HASH_LANES <= ROUNDS; i += HASH_LANES) {
+			hash_lanes_t block[16] = { { 0 } }, checksum;
+			unsigned char payloads[HASH_LANES][21];
+			for(int lane = 0; lane < HASH_LANES; ++lane) {
+				unsigned char * payload = payloads[lane];
+				payload[0] = (lane == 0)?0x00:(lane == 1)?0x05:pubkeys[i + lane][32];
+				memcpy(&payload[1], &pubkeys[i + lane][1], 20);
+				for(int j = 0; j < 5; ++j) block[j][lane] = load_be32(&payload[j * 4]);
+				block[5][lane] = ((uint32_t)payload[20] << 24) | 0x800000;
+			}
+			block[15] += 21 * 8;
+			hash256_checksum_lanes(&checksum, block);
+
+			for(int lane = 0; lane < HASH_LANES; ++lane) {
+				unsigned char expected[32], actual[4];
+				sha256_hash(payloads[lane], 21, expected);
+				sha256_hash(expected, 32, expected);
+				hash256_checksum_21(payloads[lane], actual);
+				assert(0 == memcmp(actual, expected, 4));
+				assert(checksum[lane] == load_be32(expected));
+			}
+		}
+	}
+	sha256_use_sha_ni(1);
+
+	struct timespec begin, end;
+	unsigned char hash[20] = { 0 };
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+	for(int i = 0; i < ROUNDS; ++i) {
+		unsigned char sha[32];
+		sha256_hash(pubkeys[i], 33, sha);
+		ripemd160_hash(sha, 32, hash);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	printf("generic hash160: %.2f M keys/s\n", ROUNDS / elapsed(&begin, &end) / 1e6);
+
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+	for(int i = 0; i < ROUNDS; ++i) hash160_33(pubkeys[i], hash);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	printf("hash160_33     : %.2f M keys/s\n", ROUNDS / elapsed(&begin, &end) / 1e6);
+
+	hash_lanes_t block[16] = { { 0 } }, lanes_hash[5];
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+	for(int i = 0; i < ROUNDS; i += HASH_LANES) {
+		hash160_lanes(lanes_hash, block);
+		block[0] = lanes_hash[0];
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	printf("hash160_lanes  : %.2f M keys/s\n", ROUNDS / elapsed(&begin, &end) / 1e6);
+
+	unsigned char checksum[32] = { 0 };
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+	for(int i = 0; i < ROUNDS; ++i) {
+		sha256_hash(pubkeys[i], 21, checksum);
+		sha256_hash(checksum, 32, checksum);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	printf("generic checksum: %.2f M payloads/s\n", ROUNDS / elapsed(&begin, &end) / 1e6);
+
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+	for(int i = 0; i < ROUNDS; ++i) hash256_checksum_21(pubkeys[i], checksum);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	printf("hash256_checksum_21: %.2f M payloads/s\n", ROUNDS / elapsed(&begin, &end) / 1e6);
+
+	hash_lanes_t lanes_checksum;
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+	for(int i = 0; i < ROUNDS; i += HASH_LANES) {
+		hash256_checksum_lanes(&lanes_checksum, block);
+		block[0] = lanes_checksum;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	printf("hash256_checksum_lanes: %.2f M payloads/s\n", ROUNDS / elapsed(&begin, &end) / 1e6);
+	printf("==== %s: PASSED ====\n", __FILE__);
+	return 0;
+}
+#endif
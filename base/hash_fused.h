@@ -0,0 +1,28 @@
+#ifndef CRYPTO_HASH_FUSED_H_
+#define CRYPTO_HASH_FUSED_H_
+
+#include <stdio.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/**
+ * Fused fixed-length kernels:
+ *   the message layout and padding are known in advance, so each hash is a single compression
+ *   with constant padding words, and one digest feeds the next message schedule in registers
+ *   (no init / update / final bookkeeping, no intermediate buffers).
+ *   Multi-lane counterparts: hash_lanes.h
+**/
+
+/* hash160 (RIPEMD-160 of SHA-256) of a 33-byte compressed pubkey */
+void hash160_33(const unsigned char pubkey[static 33], unsigned char hash[static 20]);
+
+/* Base58Check checksum: the first 4 bytes of SHA-256(SHA-256(payload)), 21-byte payloads (prefix | hash160) */
+void hash256_checksum_21(const unsigned char payload[static 21], unsigned char checksum[static 4]);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
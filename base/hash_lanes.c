@@ -0,0 +1,320 @@
+/*
+ * hash_lanes.c
+ * 
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ * 
+ * The MIT License (MIT)
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to deal 
+ * in the Software without restriction, including without limitation the rights 
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all 
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS 
+ * IN THE SOFTWARE.
+ * 
+ */
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+
+#include "hash_lanes.h"
+
+#define HASH_LANES_KERNEL __attribute__((target_clones("avx2", "default")))
+
+// macros rather than inline functions: passing 256-bit vectors by value changes the ABI without AVX
+#define rotr(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+#define rotl(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+/******************************************************************************
+ * SHA-256
+******************************************************************************/
+static const uint32_t s_sha256_iv[8] = {
+	0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+static const uint32_t s_sha256_k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+void sha256_lanes_init(hash_lanes_t state[static 8])
+{
+	for(int i = 0; i < 8; ++i) state[i] = (hash_lanes_t){ 0 } + s_sha256_iv[i];
+}
+
+/* word0_only: only state[0] is updated, the last round skips the e update */
+static inline __attribute__((always_inline)) void sha256_compress_rounds(hash_lanes_t state[static 8], const hash_lanes_t block[static 16], const int word0_only)
+{
+	hash_lanes_t w[16];
+	memcpy(w, block, sizeof(w));
+
+	hash_lanes_t a = state[0], b = state[1], c = state[2], d = state[3];
+	hash_lanes_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+#pragma GCC unroll 64
+	for(int i = 0; i < 64; ++i) {
+		if(i >= 16) {
+			// message schedule, in place over a 16-word window
+			hash_lanes_t w15 = w[(i - 15) & 15], w2 = w[(i - 2) & 15];
+			hash_lanes_t s0 = rotr(w15, 7) ^ rotr(w15, 18) ^ (w15 >> 3);
+			hash_lanes_t s1 = rotr(w2, 17) ^ rotr(w2, 19) ^ (w2 >> 10);
+			w[i & 15] += s0 + w[(i - 7) & 15] + s1;
+		}
+		hash_lanes_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + s_sha256_k[i] + w[i & 15];
+		hash_lanes_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+		if(word0_only && i == 63) {
+			a = t1 + t2;
+			break;
+		}
+		h = g; g = f; f = e; e = d + t1;
+		d = c; c = b; b = a; a = t1 + t2;
+	}
+
+	state[0] += a;
+	if(word0_only) return;
+	state[1] += b; state[2] += c; state[3] += d;
+	state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+#define sha256_compress(state, block) sha256_compress_rounds(state, block, 0)
+
+HASH_LANES_KERNEL
+void sha256_lanes_transform(hash_lanes_t state[static 8], const hash_lanes_t block[static 16])
+{
+	sha256_compress(state, block);
+}
+
+/******************************************************************************
+ * RIPEMD-160
+******************************************************************************/
+// message word and rotation of each step, left and right lines
+static const uint8_t s_rmd_rl[80] = {
+	0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+	7, 4, 13, 1, 10, 6, 15, 3, 12, 0, 9, 5, 2, 14, 11, 8,
+	3, 10, 14, 4, 9, 15, 8, 1, 2, 7, 0, 6, 13, 11, 5, 12,
+	1, 9, 11, 10, 0, 8, 12, 4, 13, 3, 7, 15, 14, 5, 6, 2,
+	4, 0, 5, 9, 7, 12, 2, 10, 14, 1, 3, 8, 11, 6, 15, 13,
+};
+static const uint8_t s_rmd_rr[80] = {
+	5, 14, 7, 0, 9, 2, 11, 4, 13, 6, 15, 8, 1, 10, 3, 12,
+	6, 11, 3, 7, 0, 13, 5, 10, 14, 15, 8, 12, 4, 9, 1, 2,
+	15, 5, 1, 3, 7, 14, 6, 9, 11, 8, 12, 2, 10, 0, 4, 13,
+	8, 6, 4, 1, 3, 11, 15, 0, 5, 12, 2, 13, 9, 7, 10, 14,
+	12, 15, 10, 4, 1, 5, 8, 7, 6, 2, 13, 14, 0, 3, 9, 11,
+};
+static const uint8_t s_rmd_sl[80] = {
+	11, 14, 15, 12, 5, 8, 7, 9, 11, 13, 14, 15, 6, 7, 9, 8,
+	7, 6, 8, 13, 11, 9, 7, 15, 7, 12, 15, 9, 11, 7, 13, 12,
+	11, 13, 6, 7, 14, 9, 13, 15, 14, 8, 13, 6, 5, 12, 7, 5,
+	11, 12, 14, 15, 14, 15, 9, 8, 9, 14, 5, 6, 8, 6, 5, 12,
+	9, 15, 5, 11, 6, 8, 13, 12, 5, 12, 13, 14, 11, 8, 5, 6,
+};
+static const uint8_t s_rmd_sr[80] = {
+	8, 9, 9, 11, 13, 15, 15, 5, 7, 7, 8, 11, 14, 14, 12, 6,
+	9, 13, 15, 7, 12, 8, 9, 11, 7, 7, 12, 7, 6, 15, 13, 11,
+	9, 7, 15, 11, 8, 6, 6, 14, 12, 13, 5, 14, 13, 13, 7, 5,
+	15, 5, 8, 11, 14, 14, 6, 14, 6, 9, 12, 9, 12, 5, 15, 8,
+	8, 5, 12, 9, 12, 5, 14, 6, 8, 13, 6, 5, 15, 13, 11, 11,
+};
+static const uint32_t s_rmd_kl[5] = { 0x00000000, 0x5A827999, 0x6ED9EBA1, 0x8F1BBCDC, 0xA953FD4E };
+static const uint32_t s_rmd_kr[5] = { 0x50A28BE6, 0x5C4DD124, 0x6D703EF3, 0x7A6D76E9, 0x00000000 };
+
+#define rmd_f(j, x, y, z) (((j) == 0)?((x) ^ (y) ^ (z)) \
+	: ((j) == 1)?(((x) & (y)) | (~(x) & (z))) \
+	: ((j) == 2)?(((x) | ~(y)) ^ (z)) \
+	: ((j) == 3)?(((x) & (z)) | ((y) & ~(z))) \
+	: ((x) ^ ((y) | ~(z))))
+
+void ripemd160_lanes_init(hash_lanes_t state[static 5])
+{
+	static const uint32_t iv[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+	for(int i = 0; i < 5; ++i) state[i] = (hash_lanes_t){ 0 } + iv[i];
+}
+
+static inline __attribute__((always_inline)) void ripemd160_compress(hash_lanes_t state[static 5], const hash_lanes_t block[static 16])
+{
+	hash_lanes_t a1 = state[0], b1 = state[1], c1 = state[2], d1 = state[3], e1 = state[4];
+	hash_lanes_t a2 = a1, b2 = b1, c2 = c1, d2 = d1, e2 = e1;
+
+#pragma GCC unroll 80
+	for(int i = 0; i < 80; ++i) {
+		const int j = i / 16;
+		hash_lanes_t t = rotl(a1 + rmd_f(j, b1, c1, d1) + block[s_rmd_rl[i]] + s_rmd_kl[j], s_rmd_sl[i]) + e1;
+		a1 = e1; e1 = d1; d1 = rotl(c1, 10); c1 = b1; b1 = t;
+
+		t = rotl(a2 + rmd_f(4 - j, b2, c2, d2) + block[s_rmd_rr[i]] + s_rmd_kr[j], s_rmd_sr[i]) + e2;
+		a2 = e2; e2 = d2; d2 = rotl(c2, 10); c2 = b2; b2 = t;
+	}
+
+	hash_lanes_t t = state[1] + c1 + d2;
+	state[1] = state[2] + d1 + e2;
+	state[2] = state[3] + e1 + a2;
+	state[3] = state[4] + a1 + b2;
+	state[4] = state[0] + b1 + c2;
+	state[0] = t;
+}
+
+HASH_LANES_KERNEL
+void ripemd160_lanes_transform(hash_lanes_t state[static 5], const hash_lanes_t block[static 16])
+{
+	ripemd160_compress(state, block);
+}
+
+/******************************************************************************
+ * hash160 = RIPEMD-160(SHA-256(m)), single-block messages
+******************************************************************************/
+HASH_LANES_KERNEL
+void hash160_lanes(hash_lanes_t hash[static 5], const hash_lanes_t block[static 16])
+{
+	hash_lanes_t sha[8];
+	sha256_lanes_init(sha);
+	sha256_compress(sha, block);
+
+	// the 32-byte digest is a RIPEMD-160 block of fixed layout: the byte-swapped SHA-256 state words,
+	// then constant padding (0x80, bit length 256); the zero words fold away once unrolled
+	hash_lanes_t x[16] = { { 0 } };
+	for(int i = 0; i < 8; ++i) x[i] = (sha[i] << 24) | ((sha[i] & 0xff00) << 8) | ((sha[i] >> 8) & 0xff00) | (sha[i] >> 24);
+	x[8] += 0x80;
+	x[14] += 256;
+
+	ripemd160_lanes_init(hash);
+	ripemd160_compress(hash, x);
+}
+
+
+/******************************************************************************
+ * hash256 checksum = SHA-256(SHA-256(m))[0..3], single-block messages
+******************************************************************************/
+HASH_LANES_KERNEL
+void hash256_checksum_lanes(hash_lanes_t * checksum, const hash_lanes_t block[static 16])
+{
+	hash_lanes_t sha[8];
+	sha256_lanes_init(sha);
+	sha256_compress(sha, block);
+
+	// second block: the 8 digest words as they are (big-endian words already), then constant padding
+	hash_lanes_t x[16] = { { 0 } };
+	for(int i = 0; i < 8; ++i) x[i] = sha[i];
+	x[8] += 0x80000000;
+	x[15] += 256;
+
+	sha256_lanes_init(sha);
+	sha256_compress_rounds(sha, x, 1);
+	*checksum = sha[0];
+}
+
+#if defined(_TEST_HASH_LANES) && defined(_STAND_ALONE)
+/*
+ * every lane against the scalar SHA-256 / RIPEMD-160, single-block messages of random length
+ */
+#include <time.h>
+#include "sha.h"
+#include "ripemd.h"
+
+static uint64_t s_state = 2021;
+static uint32_t next_random(void)
+{
+	s_state = s_state * 6364136223846793005ULL + 1442695040888963407ULL;
+	return (uint32_t)(s_state >> 32);
+}
+
+/* one padded block per lane: message bytes, 0x80, zeros, 64-bit bit length (big- or little-endian) */
+static void pad_block(unsigned char block[64], const unsigned char * msg, size_t length, int big_endian)
+{
+	memset(block, 0, 64);
+	memcpy(block, msg, length);
+	block[length] = 0x80;
+	uint64_t bits = length * 8;
+	for(int i = 0; i < 8; ++i) block[big_endian?(63 - i):(56 + i)] = (unsigned char)(bits >> (8 * i));
+}
+
+#define ROUNDS (20000)
+int main(int argc, char ** argv)
+{
+	for(int round = 0; round < ROUNDS; ++round) {
+		unsigned char msgs[HASH_LANES][55];
+		size_t lengths[HASH_LANES];
+		hash_lanes_t sha_block[16], rmd_block[16];
+		for(int lane = 0; lane < HASH_LANES; ++lane) {
+			lengths[lane] = next_random() % 56;
+			for(int i = 0; i < 55; ++i) msgs[lane][i] = (unsigned char)next_random();
+
+			unsigned char block[64];
+			pad_block(block, msgs[lane], lengths[lane], 1);
+			for(int i = 0; i < 16; ++i) sha_block[i][lane] = ((uint32_t)block[4 * i] << 24) | ((uint32_t)block[4 * i + 1] << 16)
+				| ((uint32_t)block[4 * i + 2] << 8) | block[4 * i + 3];
+			pad_block(block, msgs[lane], lengths[lane], 0);
+			for(int i = 0; i < 16; ++i) memcpy(&rmd_block[i][lane], &block[4 * i], 4);	// little-endian host
+		}
+
+		hash_lanes_t sha_state[8], rmd_state[5];
+		sha256_lanes_init(sha_state);
+		sha256_lanes_transform(sha_state, sha_block);
+		ripemd160_lanes_init(rmd_state);
+		ripemd160_lanes_transform(rmd_state, rmd_block);
+
+		for(int lane = 0; lane < HASH_LANES; ++lane) {
+			unsigned char expected[32];
+			sha256_hash(msgs[lane], lengths[lane], expected);
+			for(int i = 0; i < 8; ++i) {
+				uint32_t word = ((uint32_t)expected[4 * i] << 24) | ((uint32_t)expected[4 * i + 1] << 16)
+					| ((uint32_t)expected[4 * i + 2] << 8) | expected[4 * i + 3];
+				assert(sha_state[i][lane] == word);
+			}
+			ripemd160_hash(msgs[lane], lengths[lane], expected);
+			for(int i = 0; i < 5; ++i) {
+				uint32_t word;
+				memcpy(&word, &expected[4 * i], 4);
+				assert(rmd_state[i][lane] == word);
+			}
+		}
+	}
+
+	// throughput, keys/s equivalent: one block per lane
+	hash_lanes_t state[8], block[16] = { { 0 } };
+	struct timespec begin, end;
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+	for(int i = 0; i < 100000; ++i) {
+		sha256_lanes_init(state);
+		sha256_lanes_transform(state, block);
+		block[0] = state[0];
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	double seconds = (end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) / 1e9;
+	printf("sha256 lanes: %.1f M blocks/s\n", 100000.0 * HASH_LANES / seconds / 1e6);
+
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+	for(int i = 0; i < 100000; ++i) {
+		ripemd160_lanes_init(state);
+		ripemd160_lanes_transform(state, block);
+		block[0] = state[0];
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	seconds = (end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) / 1e9;
+	printf("ripemd160 lanes: %.1f M blocks/s\n", 100000.0 * HASH_LANES / seconds / 1e6);
+	printf("==== %s: PASSED ====\n", __FILE__);
+	return 0;
+}
+#endif
@@ -0,0 +1,49 @@
+#ifndef CRYPTO_HASH_LANES_H_
+#define CRYPTO_HASH_LANES_H_
+
+#include <stdio.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/**
+ * Multi-lane SHA-256 / RIPEMD-160 compression (structure-of-arrays):
+ *   HASH_LANES independent messages are processed at once, one per vector lane.
+ *   Blocks and states are word-interleaved: block[i][lane] is the i-th message word of that lane
+ *   (big-endian words for SHA-256, little-endian words for RIPEMD-160, as the algorithms read them).
+ *
+ *   Built with GCC vector extensions; the kernels are cloned for AVX2 and picked at load time,
+ *   other targets get the generic (SSE2 / scalar) lowering.
+**/
+
+#define HASH_LANES	(8)
+typedef uint32_t hash_lanes_t __attribute__((vector_size(HASH_LANES * sizeof(uint32_t))));
+
+void sha256_lanes_init(hash_lanes_t state[static 8]);
+void sha256_lanes_transform(hash_lanes_t state[static 8], const hash_lanes_t block[static 16]);
+
+void ripemd160_lanes_init(hash_lanes_t state[static 5]);
+void ripemd160_lanes_transform(hash_lanes_t state[static 5], const hash_lanes_t block[static 16]);
+
+/**
+ * hash160_lanes()
+ *   fused RIPEMD-160(SHA-256(m)) of single-block messages (padded SHA-256 blocks, up to 55 bytes):
+ *   the SHA-256 state words feed the RIPEMD-160 message schedule directly.
+ * @param hash [out] RIPEMD-160 state words (little-endian words of the 20-byte hashes)
+**/
+void hash160_lanes(hash_lanes_t hash[static 5], const hash_lanes_t block[static 16]);
+
+/**
+ * hash256_checksum_lanes()
+ *   the first 4 bytes of SHA-256(SHA-256(m)) (Base58Check checksum) of single-block messages,
+ *   as a big-endian word per lane. The first digest's state words are the second message block,
+ *   and the second compression only finishes the word the checksum needs.
+**/
+void hash256_checksum_lanes(hash_lanes_t * checksum, const hash_lanes_t block[static 16]);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,167 @@
+/*
+ * hmac.c
+ * 
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ * 
+ * The MIT License (MIT)
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to deal 
+ * in the Software without restriction, including without limitation the rights 
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all 
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS 
+ * IN THE SOFTWARE.
+ * 
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+
+#include "hmac.h"
+
+/* key blocks: keys longer than a block are hashed first, then zero-padded and xor'ed with 0x36 / 0x5c */
+#define HMAC_DEFINE(sha, block_size, digest_size) \
+void hmac_##sha##_init(hmac_##sha##_t * ctx, const void * key, size_t key_len) \
+{ \
+	unsigned char pad[block_size] = { 0 }; \
+	if(key_len > block_size) sha##_hash(key, key_len, pad); \
+	else if(key_len) memcpy(pad, key, key_len); \
+	\
+	for(int i = 0; i < block_size; ++i) pad[i] ^= 0x36; \
+	sha##_init(&ctx->inner); \
+	sha##_update(&ctx->inner, pad, block_size); \
+	\
+	for(int i = 0; i < block_size; ++i) pad[i] ^= 0x36 ^ 0x5c; \
+	sha##_init(&ctx->outer); \
+	sha##_update(&ctx->outer, pad, block_size); \
+} \
+void hmac_##sha##_update(hmac_##sha##_t * ctx, const void * msg, size_t cb_msg) \
+{ \
+	sha##_update(&ctx->inner, msg, cb_msg); \
+} \
+void hmac_##sha##_final(hmac_##sha##_t * ctx, unsigned char digest[static digest_size]) \
+{ \
+	unsigned char inner_digest[digest_size]; \
+	sha##_final(&ctx->inner, inner_digest); \
+	sha##_update(&ctx->outer, inner_digest, digest_size); \
+	sha##_final(&ctx->outer, digest); \
+} \
+void hmac_##sha##_hash(const void * key, size_t key_len, const void * msg, size_t cb_msg, unsigned char digest[static digest_size]) \
+{ \
+	hmac_##sha##_t ctx[1]; \
+	hmac_##sha##_init(ctx, key, key_len); \
+	hmac_##sha##_update(ctx, msg, cb_msg); \
+	hmac_##sha##_final(ctx, digest); \
+}
+
+HMAC_DEFINE(sha256, 64, 32)
+HMAC_DEFINE(sha512, 128, 64)
+
+
+#if defined(_TEST_HMAC) && defined(_STAND_ALONE)
+/*
+ * RFC 4231 test cases 1, 2, 6 (key longer than a block), 7,
+ * and (HAVE_GNUTLS) random keys / messages against gnutls
+ */
+#ifdef HAVE_GNUTLS
+#include <gnutls/crypto.h>
+#endif
+#include "utils.h"
+
+static void assert_digest(const unsigned char * digest, size_t size, const char * expected_hex)
+{
+	char hex[129] = "";
+	char * p_hex = hex;
+	bin2hex(digest, size, &p_hex);
+	if(strcmp(hex, expected_hex)) {
+		fprintf(stderr, "digest mismatch:\n  actual  : %s\n  expected: %s\n", hex, expected_hex);
+		abort();
+	}
+}
+
+int main(int argc, char **argv)
+{
+	unsigned char key_0b[20], key_aa[131];
+	memset(key_0b, 0x0b, sizeof(key_0b));
+	memset(key_aa, 0xaa, sizeof(key_aa));
+	static const char * long_key_msg = "Test Using Larger Than Block-Size Key - Hash Key First";
+	static const char * long_msg = "This is a test using a larger than block-size key and a larger than block-size data. "
+		"The key needs to be hashed before being used by the HMAC algorithm.";
+
+	const struct {
+		const void * key;
+		size_t key_len;
+		const char * msg;
+		const char * sha256;
+		const char * sha512;
+	} vectors[] = {
+		{ key_0b, 20, "Hi There",
+			"b0344c61d8db38535ca8afceaf0bf12b881dc200c9833da726e9376c2e32cff7",
+			"87aa7cdea5ef619d4ff0b4241a1d6cb02379f4e2ce4ec2787ad0b30545e17cdedaa833b7d6b8a702038b274eaea3f4e4be9d914eeb61f1702e696c203a126854" },
+		{ "Jefe", 4, "what do ya want for nothing?",
+			"5bdcc146bf60754e6a042426089575c75a003f089d2739839dec58b964ec3843",
+			"164b7a7bfcf819e2e395fbe73b56e0a387bd64222e831fd610270cd7ea2505549758bf75c05a994a6d034f65f8f0e6fdcaeab1a34d4a6b4b636e070a38bce737" },
+		{ key_aa, 131, long_key_msg,
+			"60e431591ee0b67f0d8a26aacbf5b77f8e0bc6213728c5140546040f0ee37f54",
+			"80b24263c7c1a3ebb71493c1dd7be8b49b46d1f41b4aeec1121b013783f8f3526b56d037e05f2598bd0fd2215d6a1e5295e64f73f63f0aec8b915a985d786598" },
+		{ key_aa, 131, long_msg,
+			"9b09ffa71b942fcb27635fbcd5b0e944bfdc63644f0713938a7f51535c3a35e2",
+			"e37b6a775dc87dbaa4dfa9f96e5e3ffddebd71f8867289865df5a32d20cdc944b6022cac3c4982b10d5eeb55c3e4de15134676fb6de0446065c97440fa8c6a58" },
+	};
+
+	unsigned char digest[64];
+	for(size_t i = 0; i < sizeof(vectors) / sizeof(vectors[0]); ++i) {
+		hmac_sha256_hash(vectors[i].key, vectors[i].key_len, vectors[i].msg, strlen(vectors[i].msg), digest);
+		assert_digest(digest, 32, vectors[i].sha256);
+		hmac_sha512_hash(vectors[i].key, vectors[i].key_len, vectors[i].msg, strlen(vectors[i].msg), digest);
+		assert_digest(digest, 64, vectors[i].sha512);
+	}
+
+	// a copied context MACs a second message with the same key
+	hmac_sha256_t keyed[1], ctx[1];
+	hmac_sha256_init(keyed, "Jefe", 4);
+	*ctx = *keyed;
+	hmac_sha256_update(ctx, "what do ya ", 11);
+	hmac_sha256_update(ctx, "want for nothing?", 17);
+	hmac_sha256_final(ctx, digest);
+	assert_digest(digest, 32, vectors[1].sha256);
+	*ctx = *keyed;
+	hmac_sha256_update(ctx, vectors[1].msg, strlen(vectors[1].msg));
+	hmac_sha256_final(ctx, digest);
+	assert_digest(digest, 32, vectors[1].sha256);
+
+#ifdef HAVE_GNUTLS
+	unsigned char key[300], msg[300], expected[64];
+	srand(1);
+	for(size_t i = 0; i < sizeof(key); ++i) key[i] = rand();
+	for(size_t i = 0; i < sizeof(msg); ++i) msg[i] = rand();
+	for(int i = 0; i < 2000; ++i) {
+		size_t key_len = rand() % (sizeof(key) + 1), cb_msg = rand() % (sizeof(msg) + 1);
+		hmac_sha256_hash(key, key_len, msg, cb_msg, digest);
+		gnutls_hmac_fast(GNUTLS_MAC_SHA256, key, key_len, msg, cb_msg, expected);
+		assert(0 == memcmp(digest, expected, 32));
+		hmac_sha512_hash(key, key_len, msg, cb_msg, digest);
+		gnutls_hmac_fast(GNUTLS_MAC_SHA512, key, key_len, msg, cb_msg, expected);
+		assert(0 == memcmp(digest, expected, 64));
+	}
+#endif
+
+	printf("==== %s: PASSED ====\n", __FILE__);
+	return 0;
+}
+#endif
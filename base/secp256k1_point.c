@@ -0,0 +1,248 @@
+/*
+ * secp256k1_point.c
+ * 
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ * 
+ * The MIT License (MIT)
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to deal 
+ * in the Software without restriction, including without limitation the rights 
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all 
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS 
+ * IN THE SOFTWARE.
+ * 
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <gmp.h>
+#include <pthread.h>
+
+#include "secp256k1_point.h"
+
+#define PUBKEY_SIZE	(33)
+
+/* p = 2^256 - 2^32 - 977 */
+static const char * s_field_prime_hex = "fffffffffffffffffffffffffffffffffffffffffffffffffffffffefffffc2f";
+
+static mpz_t s_field_prime;	// read-only once parsed, shared by all threads
+static pthread_once_t s_field_prime_once = PTHREAD_ONCE_INIT;
+
+static void init_field_prime(void)
+{
+	mpz_init_set_str(s_field_prime, s_field_prime_hex, 16);
+}
+
+struct field_scratch
+{
+	mpz_t x;
+	mpz_t rhs;	// x^3 + 7
+};
+
+static void field_scratch_init(struct field_scratch * scratch)
+{
+	pthread_once(&s_field_prime_once, init_field_prime);
+	mpz_init2(scratch->x, 256);
+	mpz_init2(scratch->rhs, 512);
+}
+
+static void field_scratch_clear(struct field_scratch * scratch)
+{
+	mpz_clear(scratch->x);
+	mpz_clear(scratch->rhs);
+}
+
+/* the prefix is checked by the caller */
+static int x_on_curve(struct field_scratch * scratch, const unsigned char x[static 32])
+{
+	mpz_import(scratch->x, 32, 1, 1, 1, 0, x);
+	if(mpz_cmp(scratch->x, s_field_prime) >= 0) return 0;
+	
+	mpz_mul(scratch->rhs, scratch->x, scratch->x);
+	mpz_mod(scratch->rhs, scratch->rhs, s_field_prime);
+	mpz_mul(scratch->rhs, scratch->rhs, scratch->x);
+	mpz_add_ui(scratch->rhs, scratch->rhs, 7);
+	mpz_mod(scratch->rhs, scratch->rhs, s_field_prime);
+	
+	// x^3 + 7 is never 0 (the group has no point of order 2): a square iff the symbol is 1
+	return mpz_jacobi(scratch->rhs, s_field_prime) == 1;
+}
+
+int secp256k1_pubkey_check(const unsigned char pubkey[static PUBKEY_SIZE])
+{
+	if(pubkey[0] != 0x02 && pubkey[0] != 0x03) return -1;
+	struct field_scratch scratch[1];
+	field_scratch_init(scratch);
+	int valid = x_on_curve(scratch, &pubkey[1]);
+	field_scratch_clear(scratch);
+	return valid?0:-1;
+}
+
+size_t secp256k1_pubkeys_check_batch(const unsigned char * pubkeys, size_t stride, size_t count, uint64_t * valid_bitmap)
+{
+	assert(pubkeys && valid_bitmap);
+	if(0 == count) return 0;
+	if(0 == stride) stride = PUBKEY_SIZE;
+	
+	// pass 1: prefixes
+	const size_t num_words = (count + 63) / 64;
+	size_t num_candidates = 0;
+	for(size_t w = 0; w < num_words; ++w) {
+		size_t first = w * 64;
+		size_t n = ((count - first) < 64)?(count - first):64;
+		uint64_t bits = 0;
+		for(size_t i = 0; i < n; ++i) {
+			uint8_t prefix = pubkeys[(first + i) * stride];
+			bits |= (uint64_t)((prefix | 1) == 0x03) << i;
+		}
+		valid_bitmap[w] = bits;
+		num_candidates += __builtin_popcountll(bits);
+	}
+	if(0 == num_candidates) return 0;
+	
+	// pass 2: x < p and x^3 + 7 a square, for the flagged keys only
+	struct field_scratch scratch[1];
+	field_scratch_init(scratch);
+	size_t num_valid = 0;
+	for(size_t w = 0; w < num_words; ++w) {
+		uint64_t bits = valid_bitmap[w];
+		uint64_t pending = bits;
+		while(pending) {
+			int i = __builtin_ctzll(pending);
+			pending &= pending - 1;
+			if(!x_on_curve(scratch, &pubkeys[(w * 64 + i) * stride + 1])) bits &= ~(1ULL << i);
+		}
+		valid_bitmap[w] = bits;
+		num_valid += __builtin_popcountll(bits);
+	}
+	field_scratch_clear(scratch);
+	return num_valid;
+}
+
+
+#if defined(_TEST_SECP256K1_POINT) && defined(_STAND_ALONE)
+#include "utils.h"
+
+/* reference: p = 3 (mod 4), so y = rhs^((p + 1) / 4) is a root whenever one exists */
+static int ref_on_curve(const unsigned char pubkey[static PUBKEY_SIZE])
+{
+	if(pubkey[0] != 0x02 && pubkey[0] != 0x03) return 0;
+	mpz_t p, x, rhs, e, y;
+	mpz_inits(p, x, rhs, e, y, NULL);
+	mpz_set_str(p, s_field_prime_hex, 16);
+	mpz_import(x, 32, 1, 1, 1, 0, &pubkey[1]);
+	int valid = 0;
+	if(mpz_cmp(x, p) < 0) {
+		mpz_powm_ui(rhs, x, 3, p);
+		mpz_add_ui(rhs, rhs, 7);
+		mpz_mod(rhs, rhs, p);
+		mpz_add_ui(e, p, 1);
+		mpz_fdiv_q_2exp(e, e, 2);
+		mpz_powm(y, rhs, e, p);
+		mpz_powm_ui(y, y, 2, p);
+		valid = (mpz_cmp(y, rhs) == 0);
+	}
+	mpz_clears(p, x, rhs, e, y, NULL);
+	return valid;
+}
+
+static inline uint64_t splitmix64(uint64_t * state)
+{
+	uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+static void test_known_keys(void)
+{
+	static const struct {
+		const char * pubkey_hex;
+		int valid;
+	} vectors[] = {
+		{ "0279be667ef9dcbbac55a06295ce870b07029bfcdb2dce28d959f2815b16f81798", 1 },	// G
+		{ "0379be667ef9dcbbac55a06295ce870b07029bfcdb2dce28d959f2815b16f81798", 1 },	// -G
+		{ "02c6047f9441ed7d6d3045406e95c07cd85c778e4b8cef3ca7abac09b95c709ee5", 1 },	// 2G
+		{ "0479be667ef9dcbbac55a06295ce870b07029bfcdb2dce28d959f2815b16f81798", 0 },	// uncompressed prefix
+		{ "0079be667ef9dcbbac55a06295ce870b07029bfcdb2dce28d959f2815b16f81798", 0 },
+		{ "0279be667ef9dcbbac55a06295ce870b07029bfcdb2dce28d959f2815b16f81799", 1 },	// G.x + 1: another point
+		{ "0279be667ef9dcbbac55a06295ce870b07029bfcdb2dce28d959f2815b16f8179c", 0 },	// G.x + 4: not on the curve
+		{ "02fffffffffffffffffffffffffffffffffffffffffffffffffffffffefffffc2f", 0 },	// x = p
+		{ "02ffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff", 0 },	// x > p
+	};
+	
+	for(size_t i = 0; i < sizeof(vectors) / sizeof(vectors[0]); ++i) {
+		unsigned char pubkey[PUBKEY_SIZE];
+		void * p_pubkey = pubkey;
+		assert(PUBKEY_SIZE == hex2bin(vectors[i].pubkey_hex, 66, &p_pubkey));
+		assert(ref_on_curve(pubkey) == vectors[i].valid);
+		assert((0 == secp256k1_pubkey_check(pubkey)) == vectors[i].valid);
+		
+		uint64_t bitmap = ~0ULL;
+		assert(secp256k1_pubkeys_check_batch(pubkey, 0, 1, &bitmap) == vectors[i].valid);
+		assert(bitmap == (uint64_t)vectors[i].valid);
+	}
+	printf("==== %s: PASSED ====\n", __FUNCTION__);
+}
+
+#define NUM_KEYS	(20000 + 37)
+static void test_batch(uint64_t seed)
+{
+	// strided like a record array: [ pubkey | 7 bytes of other fields ]
+	const size_t stride = PUBKEY_SIZE + 7;
+	unsigned char * records = malloc(NUM_KEYS * stride);
+	uint64_t * bitmap = malloc((NUM_KEYS + 63) / 64 * sizeof(uint64_t));
+	assert(records && bitmap);
+	
+	size_t expected_valid = 0;
+	for(size_t i = 0; i < NUM_KEYS; ++i) {
+		unsigned char * pubkey = &records[i * stride];
+		for(size_t k = 0; k < stride; ++k) pubkey[k] = splitmix64(&seed);
+		uint64_t r = splitmix64(&seed);
+		pubkey[0] = (r % 16)?(0x02 | (r >> 8 & 1)):(uint8_t)(r >> 16);	// some bad prefixes
+		if(r % 101 == 0) memset(&pubkey[1], 0xff, 32);	// x >= p
+		expected_valid += ref_on_curve(pubkey);
+	}
+	
+	double time_elapsed;
+	app_timer_start(NULL);
+	size_t num_valid = secp256k1_pubkeys_check_batch(records, stride, NUM_KEYS, bitmap);
+	time_elapsed = app_timer_stop(NULL);
+	assert(num_valid == expected_valid);
+	for(size_t i = 0; i < NUM_KEYS; ++i) {
+		const unsigned char * pubkey = &records[i * stride];
+		int valid = secp256k1_bitmap_test(bitmap, i);
+		assert(valid == ref_on_curve(pubkey));
+		assert(valid == (0 == secp256k1_pubkey_check(pubkey)));
+	}
+	printf("batch: %d keys, %zu valid, %.6f s (%.2f M/s)\n", NUM_KEYS, num_valid, time_elapsed, NUM_KEYS / time_elapsed / 1e6);
+	
+	free(records);
+	free(bitmap);
+	printf("==== %s: PASSED ====\n", __FUNCTION__);
+}
+#undef NUM_KEYS
+
+int main(int argc, char ** argv)
+{
+	uint64_t seed = (argc > 1)?strtoull(argv[1], NULL, 0):20240607;
+	test_known_keys();
+	test_batch(seed);
+	return 0;
+}
+#endif
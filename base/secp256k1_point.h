@@ -0,0 +1,35 @@
+#ifndef CRYPTO_SECP256K1_POINT_H_
+#define CRYPTO_SECP256K1_POINT_H_
+
+#include <stdio.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/**
+ * Curve-point validity of compressed secp256k1 pubkeys [ 0x02 / 0x03 | x (32 bytes, big-endian) ]:
+ *   a 0x02 / 0x03 prefix, x < p, and x^3 + 7 a quadratic residue mod p (Jacobi symbol, GMP),
+ *   i.e. some y with y^2 = x^3 + 7 exists; the prefix only picks its parity, and both exist.
+**/
+
+/* @return 0 if pubkey is a point of the curve, -1 otherwise */
+int secp256k1_pubkey_check(const unsigned char pubkey[static 33]);
+
+/**
+ * secp256k1_pubkeys_check_batch()
+ *   pass 1 flags the keys with a 0x02 / 0x03 prefix (a byte compare per key, no branches);
+ *   pass 2 runs the field arithmetic on the flagged keys only, with one set of GMP integers for the batch.
+ * @param pubkeys the first pubkey, the next ones every 'stride' bytes (e.g. a field of a record array)
+ * @param valid_bitmap [out] (count + 63) / 64 words, bit (i % 64) of word (i / 64) set if key i is valid
+ * @return the number of valid keys
+**/
+size_t secp256k1_pubkeys_check_batch(const unsigned char * pubkeys, size_t stride, size_t count, uint64_t * valid_bitmap);
+
+#define secp256k1_bitmap_test(bitmap, i)	(((bitmap)[(i) / 64] >> ((i) % 64)) & 1)
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,471 @@
+/*
+ * sha.c
+ * 
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ * 
+ * The MIT License (MIT)
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to deal 
+ * in the Software without restriction, including without limitation the rights 
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all 
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS 
+ * IN THE SOFTWARE.
+ * 
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+#include <endian.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "sha.h"
+
+#define rotr32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+#define rotr64(x, n) (((x) >> (n)) | ((x) << (64 - (n))))
+
+/* memcpy loads / stores: the padding blocks are char arrays written with mixed widths */
+static inline uint32_t load_be32(const unsigned char * p) { uint32_t x; memcpy(&x, p, 4); return be32toh(x); }
+static inline uint64_t load_be64(const unsigned char * p) { uint64_t x; memcpy(&x, p, 8); return be64toh(x); }
+static inline void store_be32(unsigned char * p, uint32_t x) { x = htobe32(x); memcpy(p, &x, 4); }
+static inline void store_be64(unsigned char * p, uint64_t x) { x = htobe64(x); memcpy(p, &x, 8); }
+
+/******************************************************************************
+ * SHA-256
+******************************************************************************/
+static const uint32_t s_sha256_iv[8] = {
+	0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+static const uint32_t s_sha256_k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static void sha256_transform_generic(uint32_t state[static 8], const uint32_t block[static 16])
+{
+	uint32_t w[16];
+	memcpy(w, block, sizeof(w));
+
+	uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+	uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+#pragma GCC unroll 64
+	for(int i = 0; i < 64; ++i) {
+		if(i >= 16) {
+			uint32_t w15 = w[(i - 15) & 15], w2 = w[(i - 2) & 15];
+			w[i & 15] += (rotr32(w15, 7) ^ rotr32(w15, 18) ^ (w15 >> 3)) + w[(i - 7) & 15]
+				+ (rotr32(w2, 17) ^ rotr32(w2, 19) ^ (w2 >> 10));
+		}
+		uint32_t t1 = h + (rotr32(e, 6) ^ rotr32(e, 11) ^ rotr32(e, 25)) + ((e & f) ^ (~e & g)) + s_sha256_k[i] + w[i & 15];
+		uint32_t t2 = (rotr32(a, 2) ^ rotr32(a, 13) ^ rotr32(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+		h = g; g = f; f = e; e = d + t1;
+		d = c; c = b; b = a; a = t1 + t2;
+	}
+
+	state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+	state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+#if defined(__x86_64__)
+/* SHA extensions: two rounds per sha256rnds2, the state kept as ABEF / CDGH */
+__attribute__((target("sha,sse4.1")))
+static void sha256_transform_shani(uint32_t state[static 8], const uint32_t block[static 16])
+{
+	__m128i tmp = _mm_loadu_si128((const __m128i *)&state[0]);	// DCBA
+	__m128i state1 = _mm_loadu_si128((const __m128i *)&state[4]);	// HGFE
+	tmp = _mm_shuffle_epi32(tmp, 0xB1);	// CDAB
+	state1 = _mm_shuffle_epi32(state1, 0x1B);	// EFGH
+	__m128i state0 = _mm_alignr_epi8(tmp, state1, 8);	// ABEF
+	state1 = _mm_blend_epi16(state1, tmp, 0xF0);	// CDGH
+	const __m128i abef = state0, cdgh = state1;
+
+	__m128i m[4];
+#pragma GCC unroll 16
+	for(int g = 0; g < 16; ++g) {
+		if(g < 4) m[g] = _mm_loadu_si128((const __m128i *)&block[g * 4]);
+		__m128i msg = _mm_add_epi32(m[g & 3], _mm_loadu_si128((const __m128i *)&s_sha256_k[g * 4]));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+		if(g >= 3 && g < 15) {
+			// w[4(g+1) .. 4(g+1)+3]
+			__m128i next = _mm_add_epi32(m[(g + 1) & 3], _mm_alignr_epi8(m[g & 3], m[(g - 1) & 3], 4));
+			m[(g + 1) & 3] = _mm_sha256msg2_epu32(next, m[g & 3]);
+		}
+		msg = _mm_shuffle_epi32(msg, 0x0E);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+		if(g >= 1 && g < 13) m[(g - 1) & 3] = _mm_sha256msg1_epu32(m[(g - 1) & 3], m[g & 3]);
+	}
+
+	state0 = _mm_add_epi32(state0, abef);
+	state1 = _mm_add_epi32(state1, cdgh);
+	tmp = _mm_shuffle_epi32(state0, 0x1B);	// FEBA
+	state1 = _mm_shuffle_epi32(state1, 0xB1);	// DCHG
+	state0 = _mm_blend_epi16(tmp, state1, 0xF0);	// DCBA
+	state1 = _mm_alignr_epi8(state1, tmp, 8);	// HGFE
+	_mm_storeu_si128((__m128i *)&state[0], state0);
+	_mm_storeu_si128((__m128i *)&state[4], state1);
+}
+#endif
+
+static int s_has_sha_ni = -1;
+int sha256_has_sha_ni(void)
+{
+	int has = __atomic_load_n(&s_has_sha_ni, __ATOMIC_RELAXED);
+	if(__builtin_expect(has < 0, 0)) {
+#if defined(__x86_64__)
+		__builtin_cpu_init();
+		has = __builtin_cpu_supports("sha") && __builtin_cpu_supports("sse4.1");
+#else
+		has = 0;
+#endif
+		__atomic_store_n(&s_has_sha_ni, has, __ATOMIC_RELAXED);
+	}
+	return has;
+}
+
+void sha256_use_sha_ni(int enabled)
+{
+	__atomic_store_n(&s_has_sha_ni, enabled?-1:0, __ATOMIC_RELAXED);
+}
+
+void sha256_transform(uint32_t state[static 8], const uint32_t block[static 16])
+{
+#if defined(__x86_64__)
+	if(sha256_has_sha_ni()) {
+		sha256_transform_shani(state, block);
+		return;
+	}
+#endif
+	sha256_transform_generic(state, block);
+}
+
+static inline void sha256_transform_bytes(uint32_t state[static 8], const unsigned char data[static 64])
+{
+	uint32_t w[16];
+	for(int i = 0; i < 16; ++i) w[i] = load_be32(&data[i * 4]);
+	sha256_transform(state, w);
+}
+
+void sha256_init(sha256_ctx_t * sha)
+{
+	memcpy(sha->s, s_sha256_iv, sizeof(sha->s));
+	sha->bytes = 0;
+}
+
+void sha256_update(sha256_ctx_t * sha, const void * msg, size_t cb_msg)
+{
+	const unsigned char * data = msg;
+	size_t bufsize = sha->bytes % 64;
+	sha->bytes += cb_msg;
+	if(bufsize) {
+		size_t cb = 64 - bufsize;
+		if(cb > cb_msg) cb = cb_msg;
+		memcpy(sha->buf + bufsize, data, cb);
+		data += cb; cb_msg -= cb;
+		if(bufsize + cb < 64) return;
+		sha256_transform_bytes(sha->s, sha->buf);
+	}
+	for(; cb_msg >= 64; data += 64, cb_msg -= 64) sha256_transform_bytes(sha->s, data);
+	if(cb_msg) memcpy(sha->buf, data, cb_msg);
+}
+
+/* [ tail | 0x80 | zeros | bit length (64-bit big-endian) ]: one block, two if the tail is longer than 55 bytes */
+static inline void sha256_pad(uint32_t state[static 8], const unsigned char * tail, size_t cb_tail, uint64_t total_bytes)
+{
+	unsigned char blocks[128] = { 0 };
+	memcpy(blocks, tail, cb_tail);
+	blocks[cb_tail] = 0x80;
+	size_t cb_blocks = (cb_tail < 56)?64:128;
+	store_be64(&blocks[cb_blocks - 8], total_bytes * 8);
+	sha256_transform_bytes(state, blocks);
+	if(cb_blocks > 64) sha256_transform_bytes(state, blocks + 64);
+}
+
+void sha256_final(sha256_ctx_t * sha, unsigned char digest[static 32])
+{
+	sha256_pad(sha->s, sha->buf, sha->bytes % 64, sha->bytes);
+	for(int i = 0; i < 8; ++i) store_be32(&digest[i * 4], sha->s[i]);
+}
+
+/* one-shot: no context, no buffering; messages up to 55 bytes take a single compression */
+void sha256_hash(const void * msg, size_t cb_msg, unsigned char digest[static 32])
+{
+	const unsigned char * data = msg;
+	uint32_t state[8];
+	memcpy(state, s_sha256_iv, sizeof(state));
+	
+	size_t cb_full = cb_msg & ~(size_t)63;
+	for(size_t i = 0; i < cb_full; i += 64) sha256_transform_bytes(state, data + i);
+	sha256_pad(state, data + cb_full, cb_msg - cb_full, cb_msg);
+	for(int i = 0; i < 8; ++i) store_be32(&digest[i * 4], state[i]);
+}
+
+/******************************************************************************
+ * SHA-512
+******************************************************************************/
+static const uint64_t s_sha512_iv[8] = {
+	0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL, 0x3c6ef372fe94f82bULL, 0xa54ff53a5f1d36f1ULL,
+	0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL, 0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL,
+};
+
+static const uint64_t s_sha512_k[80] = {
+	0x428a2f98d728ae22ULL, 0x7137449123ef65cdULL, 0xb5c0fbcfec4d3b2fULL, 0xe9b5dba58189dbbcULL,
+	0x3956c25bf348b538ULL, 0x59f111f1b605d019ULL, 0x923f82a4af194f9bULL, 0xab1c5ed5da6d8118ULL,
+	0xd807aa98a3030242ULL, 0x12835b0145706fbeULL, 0x243185be4ee4b28cULL, 0x550c7dc3d5ffb4e2ULL,
+	0x72be5d74f27b896fULL, 0x80deb1fe3b1696b1ULL, 0x9bdc06a725c71235ULL, 0xc19bf174cf692694ULL,
+	0xe49b69c19ef14ad2ULL, 0xefbe4786384f25e3ULL, 0x0fc19dc68b8cd5b5ULL, 0x240ca1cc77ac9c65ULL,
+	0x2de92c6f592b0275ULL, 0x4a7484aa6ea6e483ULL, 0x5cb0a9dcbd41fbd4ULL, 0x76f988da831153b5ULL,
+	0x983e5152ee66dfabULL, 0xa831c66d2db43210ULL, 0xb00327c898fb213fULL, 0xbf597fc7beef0ee4ULL,
+	0xc6e00bf33da88fc2ULL, 0xd5a79147930aa725ULL, 0x06ca6351e003826fULL, 0x142929670a0e6e70ULL,
+	0x27b70a8546d22ffcULL, 0x2e1b21385c26c926ULL, 0x4d2c6dfc5ac42aedULL, 0x53380d139d95b3dfULL,
+	0x650a73548baf63deULL, 0x766a0abb3c77b2a8ULL, 0x81c2c92e47edaee6ULL, 0x92722c851482353bULL,
+	0xa2bfe8a14cf10364ULL, 0xa81a664bbc423001ULL, 0xc24b8b70d0f89791ULL, 0xc76c51a30654be30ULL,
+	0xd192e819d6ef5218ULL, 0xd69906245565a910ULL, 0xf40e35855771202aULL, 0x106aa07032bbd1b8ULL,
+	0x19a4c116b8d2d0c8ULL, 0x1e376c085141ab53ULL, 0x2748774cdf8eeb99ULL, 0x34b0bcb5e19b48a8ULL,
+	0x391c0cb3c5c95a63ULL, 0x4ed8aa4ae3418acbULL, 0x5b9cca4f7763e373ULL, 0x682e6ff3d6b2b8a3ULL,
+	0x748f82ee5defb2fcULL, 0x78a5636f43172f60ULL, 0x84c87814a1f0ab72ULL, 0x8cc702081a6439ecULL,
+	0x90befffa23631e28ULL, 0xa4506cebde82bde9ULL, 0xbef9a3f7b2c67915ULL, 0xc67178f2e372532bULL,
+	0xca273eceea26619cULL, 0xd186b8c721c0c207ULL, 0xeada7dd6cde0eb1eULL, 0xf57d4f7fee6ed178ULL,
+	0x06f067aa72176fbaULL, 0x0a637dc5a2c898a6ULL, 0x113f9804bef90daeULL, 0x1b710b35131c471bULL,
+	0x28db77f523047d84ULL, 0x32caab7b40c72493ULL, 0x3c9ebe0a15c9bebcULL, 0x431d67c49c100d4cULL,
+	0x4cc5d4becb3e42b6ULL, 0x597f299cfc657e2aULL, 0x5fcb6fab3ad6faecULL, 0x6c44198c4a475817ULL,
+};
+
+static void sha512_transform_bytes(uint64_t state[static 8], const unsigned char data[static 128])
+{
+	uint64_t w[16];
+	for(int i = 0; i < 16; ++i) w[i] = load_be64(&data[i * 8]);
+
+	uint64_t a = state[0], b = state[1], c = state[2], d = state[3];
+	uint64_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+#pragma GCC unroll 80
+	for(int i = 0; i < 80; ++i) {
+		if(i >= 16) {
+			uint64_t w15 = w[(i - 15) & 15], w2 = w[(i - 2) & 15];
+			w[i & 15] += (rotr64(w15, 1) ^ rotr64(w15, 8) ^ (w15 >> 7)) + w[(i - 7) & 15]
+				+ (rotr64(w2, 19) ^ rotr64(w2, 61) ^ (w2 >> 6));
+		}
+		uint64_t t1 = h + (rotr64(e, 14) ^ rotr64(e, 18) ^ rotr64(e, 41)) + ((e & f) ^ (~e & g)) + s_sha512_k[i] + w[i & 15];
+		uint64_t t2 = (rotr64(a, 28) ^ rotr64(a, 34) ^ rotr64(a, 39)) + ((a & b) ^ (a & c) ^ (b & c));
+		h = g; g = f; f = e; e = d + t1;
+		d = c; c = b; b = a; a = t1 + t2;
+	}
+
+	state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+	state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+void sha512_init(sha512_ctx_t * sha)
+{
+	memcpy(sha->s, s_sha512_iv, sizeof(sha->s));
+	sha->bytes = 0;
+}
+
+void sha512_update(sha512_ctx_t * sha, const void * msg, size_t cb_msg)
+{
+	const unsigned char * data = msg;
+	size_t bufsize = sha->bytes % 128;
+	sha->bytes += cb_msg;
+	if(bufsize) {
+		size_t cb = 128 - bufsize;
+		if(cb > cb_msg) cb = cb_msg;
+		memcpy(sha->buf + bufsize, data, cb);
+		data += cb; cb_msg -= cb;
+		if(bufsize + cb < 128) return;
+		sha512_transform_bytes(sha->s, sha->buf);
+	}
+	for(; cb_msg >= 128; data += 128, cb_msg -= 128) sha512_transform_bytes(sha->s, data);
+	if(cb_msg) memcpy(sha->buf, data, cb_msg);
+}
+
+/* 128-bit length field: messages are far below 2^61 bytes, the high half stays zero */
+static inline void sha512_pad(uint64_t state[static 8], const unsigned char * tail, size_t cb_tail, uint64_t total_bytes)
+{
+	unsigned char blocks[256] = { 0 };
+	memcpy(blocks, tail, cb_tail);
+	blocks[cb_tail] = 0x80;
+	size_t cb_blocks = (cb_tail < 112)?128:256;
+	store_be64(&blocks[cb_blocks - 8], total_bytes * 8);
+	sha512_transform_bytes(state, blocks);
+	if(cb_blocks > 128) sha512_transform_bytes(state, blocks + 128);
+}
+
+void sha512_final(sha512_ctx_t * sha, unsigned char digest[static 64])
+{
+	sha512_pad(sha->s, sha->buf, sha->bytes % 128, sha->bytes);
+	for(int i = 0; i < 8; ++i) store_be64(&digest[i * 8], sha->s[i]);
+}
+
+void sha512_hash(const void * msg, size_t cb_msg, unsigned char digest[static 64])
+{
+	const unsigned char * data = msg;
+	uint64_t state[8];
+	memcpy(state, s_sha512_iv, sizeof(state));
+	
+	size_t cb_full = cb_msg & ~(size_t)127;
+	for(size_t i = 0; i < cb_full; i += 128) sha512_transform_bytes(state, data + i);
+	sha512_pad(state, data + cb_full, cb_msg - cb_full, cb_msg);
+	for(int i = 0; i < 8; ++i) store_be64(&digest[i * 8], state[i]);
+}
+
+
+#if defined(_TEST_SHA) && defined(_STAND_ALONE)
+/*
+ * FIPS 180-2 vectors, one-shot against incremental hashing with random splits,
+ * and (HAVE_GNUTLS) against gnutls for every length up to 4 blocks; SHA-NI and generic paths.
+ */
+#include <time.h>
+#ifdef HAVE_GNUTLS
+#include <gnutls/crypto.h>
+#endif
+#include "utils.h"
+
+static void assert_digest(const unsigned char * digest, size_t size, const char * expected_hex)
+{
+	char hex[129] = "";
+	char * p_hex = hex;
+	bin2hex(digest, size, &p_hex);
+	if(strcmp(hex, expected_hex)) {
+		fprintf(stderr, "digest mismatch:\n  actual  : %s\n  expected: %s\n", hex, expected_hex);
+		abort();
+	}
+}
+
+static double elapsed(const struct timespec * begin, const struct timespec * end)
+{
+	return (double)(end->tv_sec - begin->tv_sec) + (double)(end->tv_nsec - begin->tv_nsec) / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+	static const struct {
+		const char * msg;
+		const char * sha256;
+		const char * sha512;
+	} vectors[] = {
+		{ "",
+			"e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855",
+			"cf83e1357eefb8bdf1542850d66d8007d620e4050b5715dc83f4a921d36ce9ce47d0d13c5d85f2b0ff8318d2877eec2f63b931bd47417a81a538327af927da3e" },
+		{ "abc",
+			"ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad",
+			"ddaf35a193617abacc417349ae20413112e6fa4e89a97ea20a9eeee64b55d39a2192992a274fc1a836ba3c23a3feebbd454d4423643ce80e2a9ac94fa54ca49f" },
+		{ "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+			"248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1",
+			"204a8fc6dda82f0a0ced7beb8e08a41657c16ef468b228a8279be331a703c33596fd15c13b1b07f9aa1d3bea57789ca031ad85c7a71dd70354ec631238ca3445" },
+		{ "abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmnhijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu",
+			"cf5b16a778af8380036ce59e7b0492370b249b11e8f07a51afac45037afee9d1",
+			"8e959b75dae313da8cf4f72814fc143f8f7779c6eb9f7fa17299aeadb6889018501d289e4900f7e4331b99dec4b5433ac7d329eeb6dd26545e96e55b874be909" },
+	};
+
+	for(int pass = 0; pass < 2; ++pass) {
+		sha256_use_sha_ni(!pass);
+		printf("sha256: %s\n", sha256_has_sha_ni()?"sha extensions":"generic");
+
+		unsigned char digest[64];
+		for(size_t i = 0; i < sizeof(vectors) / sizeof(vectors[0]); ++i) {
+			sha256_hash(vectors[i].msg, strlen(vectors[i].msg), digest);
+			assert_digest(digest, 32, vectors[i].sha256);
+			sha512_hash(vectors[i].msg, strlen(vectors[i].msg), digest);
+			assert_digest(digest, 64, vectors[i].sha512);
+		}
+
+		// one million 'a'
+		unsigned char block[1000];
+		memset(block, 'a', sizeof(block));
+		sha256_ctx_t sha256[1];
+		sha512_ctx_t sha512[1];
+		sha256_init(sha256);
+		sha512_init(sha512);
+		for(int i = 0; i < 1000; ++i) {
+			sha256_update(sha256, block, sizeof(block));
+			sha512_update(sha512, block, sizeof(block));
+		}
+		sha256_final(sha256, digest);
+		assert_digest(digest, 32, "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+		sha512_final(sha512, digest);
+		assert_digest(digest, 64, "e718483d0ce769644e2e42c7bc15b4638e1f98b13b2044285632a803afa973ebde0ff244877ea60a4cb0432ce577c31beb009c5c2c49aa2e4eadb217ad8cc09b");
+
+		// every length up to 4 SHA-512 blocks, random splits
+		unsigned char msg[512];
+		srand(pass + 1);
+		for(size_t i = 0; i < sizeof(msg); ++i) msg[i] = rand();
+		for(size_t len = 0; len <= sizeof(msg); ++len) {
+			unsigned char one_shot[64], incremental[64];
+			size_t split = len?(rand() % (len + 1)):0;
+
+			sha256_hash(msg, len, one_shot);
+			sha256_init(sha256);
+			sha256_update(sha256, msg, split);
+			sha256_update(sha256, msg + split, len - split);
+			sha256_final(sha256, incremental);
+			assert(0 == memcmp(one_shot, incremental, 32));
+#ifdef HAVE_GNUTLS
+			gnutls_hash_fast(GNUTLS_DIG_SHA256, msg, len, incremental);
+			assert(0 == memcmp(one_shot, incremental, 32));
+#endif
+
+			sha512_hash(msg, len, one_shot);
+			sha512_init(sha512);
+			sha512_update(sha512, msg, split);
+			sha512_update(sha512, msg + split, len - split);
+			sha512_final(sha512, incremental);
+			assert(0 == memcmp(one_shot, incremental, 64));
+#ifdef HAVE_GNUTLS
+			gnutls_hash_fast(GNUTLS_DIG_SHA512, msg, len, incremental);
+			assert(0 == memcmp(one_shot, incremental, 64));
+#endif
+		}
+	}
+	sha256_use_sha_ni(1);
+
+	// per-hash latency of short messages (33-byte pubkeys, 64-byte seeds)
+	enum { ROUNDS = 1000000 };
+	unsigned char digest[64] = { 0 };
+	struct timespec begin, end;
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+	for(int i = 0; i < ROUNDS; ++i) sha256_hash(digest, 33, digest);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	printf("sha256_hash(33)      : %.1f ns\n", elapsed(&begin, &end) / ROUNDS * 1e9);
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+	for(int i = 0; i < ROUNDS; ++i) sha512_hash(digest, 64, digest);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	printf("sha512_hash(64)      : %.1f ns\n", elapsed(&begin, &end) / ROUNDS * 1e9);
+#ifdef HAVE_GNUTLS
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+	for(int i = 0; i < ROUNDS; ++i) gnutls_hash_fast(GNUTLS_DIG_SHA256, digest, 33, digest);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	printf("gnutls sha256(33)    : %.1f ns\n", elapsed(&begin, &end) / ROUNDS * 1e9);
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+	for(int i = 0; i < ROUNDS; ++i) gnutls_hash_fast(GNUTLS_DIG_SHA512, digest, 64, digest);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	printf("gnutls sha512(64)    : %.1f ns\n", elapsed(&begin, &end) / ROUNDS * 1e9);
+#endif
+
+	printf("==== %s: PASSED ====\n", __FILE__);
+	return 0;
+}
+#endif
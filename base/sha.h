@@ -7,46 +7,44 @@ extern "C" {
 #endif
 
 #include <stdint.h>
-#include <gnutls/crypto.h>
 
 #include "ripemd.h"
 
-#define sha_hash(algorithm, msg, cb_msg, digest) gnutls_hash_fast(algorithm, msg, cb_msg, digest)
-#define sha256_hash(msg, cb_msg, digest) sha_hash(GNUTLS_DIG_SHA256, msg, cb_msg, digest)
-#define sha512_hash(msg, cb_msg, digest)   sha_hash(GNUTLS_DIG_SHA512, msg, cb_msg, digest)
-//~ #define ripemd160_hash(msg, cb_msg, digest) sha_hash(GNUTLS_DIG_RMD160, msg, cb_msg, digest)
+/**
+ * SHA-256 / SHA-512, self-contained (no TLS library):
+ *   the one-shot sha*_hash() functions skip the context and its buffering and are the fast path
+ *   for short messages (up to 55 / 111 bytes: a single compression).
+ *   SHA-256 runs on the SHA extensions when the cpu has them.
+**/
 
-typedef struct hash_ctx 
+typedef struct sha256_ctx
 {
-	gnutls_hash_hd_t handle;
-}sha_ctx_t, sha256_ctx_t, sha512_ctx_t;
-
-#define sha_init(ctx, algorithm) gnutls_hash_init(&(ctx)->handle, algorithm)
-#define sha_update(ctx, msg, cb_msg) gnutls_hash(ctx->handle, msg, cb_msg)
-#define sha_final(ctx, digest) gnutls_hash_deinit(ctx->handle, digest)
-
-
-#define sha1_init(ctx)   sha_init(ctx, GNUTLS_DIG_SHA1)
-#define sha224_init(ctx) sha_init(ctx, GNUTLS_DIG_SHA224)
-#define sha256_init(ctx) sha_init(ctx, GNUTLS_DIG_SHA256)
-#define sha384_init(ctx) sha_init(ctx, GNUTLS_DIG_SHA384)
-#define sha512_init(ctx) sha_init(ctx, GNUTLS_DIG_SHA512)
-//~ #define ripemd_init(ctx) sha_init(ctx, GNUTLS_DIG_RMD160)
-
-#define sha1_update(ctx, msg, cb_msg)   sha_update(ctx, msg, cb_msg);
-#define sha224_update(ctx, msg, cb_msg) sha_update(ctx, msg, cb_msg)
-#define sha256_update(ctx, msg, cb_msg) sha_update(ctx, msg, cb_msg)
-#define sha384_update(ctx, msg, cb_msg) sha_update(ctx, msg, cb_msg)
-#define sha512_update(ctx, msg, cb_msg) sha_update(ctx, msg, cb_msg)
-//~ #define ripemd_update(ctx, msg, cb_msg) sha_update(ctx, msg, cb_msg)
-
-
-#define sha1_final(ctx, digest)   sha_final(ctx, digest)
-#define sha224_final(ctx, digest) sha_final(ctx, digest)
-#define sha256_final(ctx, digest) sha_final(ctx, digest)
-#define sha384_final(ctx, digest) sha_final(ctx, digest)
-#define sha512_final(ctx, digest) sha_final(ctx, digest)
-//~ #define ripemd_final(ctx, digest) sha_final(ctx, digest)
+	uint32_t s[8];
+	unsigned char buf[64];
+	uint64_t bytes;
+}sha256_ctx_t;
+
+typedef struct sha512_ctx
+{
+	uint64_t s[8];
+	unsigned char buf[128];
+	uint64_t bytes;
+}sha512_ctx_t;
+
+void sha256_hash(const void * msg, size_t cb_msg, unsigned char digest[static 32]);
+void sha256_init(sha256_ctx_t * sha);
+void sha256_update(sha256_ctx_t * sha, const void * msg, size_t cb_msg);
+void sha256_final(sha256_ctx_t * sha, unsigned char digest[static 32]);
+
+void sha512_hash(const void * msg, size_t cb_msg, unsigned char digest[static 64]);
+void sha512_init(sha512_ctx_t * sha);
+void sha512_update(sha512_ctx_t * sha, const void * msg, size_t cb_msg);
+void sha512_final(sha512_ctx_t * sha, unsigned char digest[static 64]);
+
+/* the SHA-256 block function, big-endian message words (for callers that build padded blocks themselves) */
+void sha256_transform(uint32_t state[static 8], const uint32_t block[static 16]);
+int sha256_has_sha_ni(void);
+void sha256_use_sha_ni(int enabled);	// 0: generic code only (tests / benchmarks), else auto-detect
 
 #ifdef __cplusplus
 }
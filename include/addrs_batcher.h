@@ -0,0 +1,89 @@
+#ifndef BITCOIN_ADDRS_BATCHER_H_
+#define BITCOIN_ADDRS_BATCHER_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "pubkey_to_addrs.h"
+
+/**
+ * Adaptive micro-batching scheduler:
+ *   gathers single-key requests from any number of threads into batches of up to batch_size keys
+ *   for pubkeys_to_addrs_batch(). A batch is dispatched as soon as it is full, or when its oldest
+ *   request has waited deadline_us, whichever comes first.
+ *
+ *   deadline_us trades latency for throughput: 0 dispatches whatever is queued immediately
+ *   (batches only form under contention); a larger deadline fills more lanes per call.
+ *   Check the fill ratio in addrs_batcher_stats against the latency budget.
+**/
+
+#define ADDRS_BATCHER_MAX_BATCH_SIZE	(64)
+
+struct addrs_batcher_config
+{
+	size_t batch_size;	// lanes per batch, 0: default (16), at most ADDRS_BATCHER_MAX_BATCH_SIZE
+	int64_t deadline_us;	// max wait of the oldest queued request, < 0: default (100us)
+	int num_workers;	// threads running the batches, <= 0: 1
+};
+
+struct addrs_batcher_request;
+typedef void (* addrs_batcher_callback)(struct addrs_batcher_request * request, void * user_data);
+
+/**
+ * caller-owned request, must stay valid until completion.
+ * record->pubkey is the input; on completion record holds the result (err_code != 0 on failure)
+ * and only the address slots selected by types_mask are filled.
+**/
+struct addrs_batcher_request
+{
+	struct bitcoin_addrs_record * record;
+	uint32_t types_mask;	// 0: all types
+	addrs_batcher_callback on_completed;	// runs on a worker thread, may be NULL
+	void * user_data;
+
+	// private
+	struct addrs_batcher_request * next;
+	int64_t enqueued_ns;
+};
+
+struct addrs_batcher_stats
+{
+	uint64_t requests;
+	uint64_t batches;
+	uint64_t full_batches;	// dispatched because batch_size was reached
+	uint64_t deadline_batches;	// dispatched because the deadline expired
+	double fill_ratio;	// requests / (batches * batch_size)
+	double mean_wait_us;	// enqueue -> dispatch
+	double max_wait_us;
+	uint64_t batch_sizes[ADDRS_BATCHER_MAX_BATCH_SIZE + 1];	// histogram: batches with n requests
+};
+
+typedef struct addrs_batcher addrs_batcher_t;
+addrs_batcher_t * addrs_batcher_new(const struct addrs_batcher_config * config);
+
+/* completes every queued request, then stops the workers */
+void addrs_batcher_free(addrs_batcher_t * batcher);
+
+/**
+ * addrs_batcher_submit()
+ *   queues the request; request->on_completed is called once it is done
+ * @return 0 on success, -1 if the batcher is shutting down
+**/
+int addrs_batcher_submit(addrs_batcher_t * batcher, struct addrs_batcher_request * request);
+
+/**
+ * addrs_batcher_convert()
+ *   blocking wrapper: queues record and waits for its completion
+ * @return 0 on success, -1 on error (see record->err_code)
+**/
+int addrs_batcher_convert(addrs_batcher_t * batcher, struct bitcoin_addrs_record * record, uint32_t types_mask);
+
+int addrs_batcher_get_stats(addrs_batcher_t * batcher, struct addrs_batcher_stats * stats);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
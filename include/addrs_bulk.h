@@ -0,0 +1,150 @@
+#ifndef BITCOIN_ADDRS_BULK_H_
+#define BITCOIN_ADDRS_BULK_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "addrs_io.h"
+
+/**
+ * Streaming bulk converter:
+ *   input: one hex-encoded compressed pubkey per line ('#' comments and blank lines are skipped),
+ *          or one WIF private key per line (input_format wif, needs libsecp256k1: see privkey_to_addrs.h)
+ *   output: one record per valid key, in input order (see addrs_output.h for the formats)
+ *
+ *   reader thread -> [ chunk slots ] -> worker threads -> writer (calling thread)
+ *   the reader and the writer keep several chunk reads / writes in flight (see addrs_io.h)
+ *
+ *   NUMA sharding (numa_shards != 0): chunk n belongs to shard n % num_shards; each shard owns
+ *   the slots (input and output buffers bound to its node) and the workers (pinned to its node's cpus)
+ *   of its chunks. The writer concatenates the per-shard output segments in input order.
+ *
+ *   huge_pages: the input / output chunk buffers are mapped with 2MB pages to cut dTLB misses on
+ *   large runs; when they are not available the converter falls back (and says so on stderr).
+ *
+ *   checkpoints (checkpoint_file != NULL, regular input and output files only):
+ *   written chunks are committed in input order (a chunk whose write completes early waits for its
+ *   predecessors), the commit watermark being [ input offset after the chunk's last line | output offset |
+ *   crc32c of the output so far ]. A checkpoint thread saves it every checkpoint_interval, after an
+ *   fdatasync of the output; workers and the writer never wait for it.
+ *   resume: the input before the checkpoint's offset and the output are verified against its crcs, the output
+ *   is truncated to its offset, and the run continues from its input offset; the end result is the same
+ *   file as an uninterrupted run.
+**/
+
+enum addrs_bulk_error
+{
+	addrs_bulk_error_pubkey_length,
+	addrs_bulk_error_pubkey_hex,
+	addrs_bulk_error_pubkey_point,	// check_pubkeys: not a point of secp256k1
+	addrs_bulk_error_privkey,
+	addrs_bulk_error_encode,
+	addrs_bulk_error_io,
+
+	addrs_bulk_errors_count
+};
+const char * addrs_bulk_error_to_string(enum addrs_bulk_error err);
+
+enum addrs_bulk_input_format
+{
+	addrs_bulk_input_format_pubkey,	// hex compressed pubkeys
+	addrs_bulk_input_format_wif,
+
+	addrs_bulk_input_formats_count
+};
+enum addrs_bulk_input_format addrs_bulk_input_format_from_string(const char * format);
+const char * addrs_bulk_input_format_to_string(enum addrs_bulk_input_format format);
+
+#define ADDRS_LATENCY_BUCKETS (64)
+/**
+ * latency histogram:
+ *   half-octave buckets over nanoseconds, bucket i covers [2^(i/2), 2^((i+1)/2)) (approx.)
+**/
+struct addrs_latency_histogram
+{
+	uint64_t count;
+	uint64_t sum_ns;
+	uint64_t buckets[ADDRS_LATENCY_BUCKETS];
+};
+double addrs_latency_histogram_quantile(const struct addrs_latency_histogram * hist, double quantile);	// seconds
+
+struct addrs_bulk_metrics
+{
+	double uptime;	// seconds
+	int num_workers;
+	int num_shards;	// NUMA shards, 1: not sharded
+	int huge_pages;	// enum huge_pages_mode (utils.h) the chunk buffers got
+
+	uint64_t keys;
+	uint64_t errors[addrs_bulk_errors_count];
+	uint64_t bytes_read;
+	uint64_t bytes_written;
+	uint64_t chunks_read;
+	uint64_t chunks_written;
+
+	uint64_t input_queue_depth;	// chunks read but not yet claimed by a worker
+	uint64_t output_queue_depth;	// chunks claimed but not yet written
+
+	struct addrs_latency_histogram key_latency;	// per-key conversion time
+	struct addrs_latency_histogram chunk_latency;	// chunk read -> chunk written
+};
+
+struct addrs_bulk_config
+{
+	const char * input_file;	// NULL or "-": stdin
+	const char * output_file;	// NULL or "-": stdout
+	int num_threads;	// <= 0: number of online cpus
+	size_t chunk_size;	// 0: default (1MB)
+	uint32_t types_mask;	// 0: all address types
+	int format;	// enum addrs_output_format, 0: text
+	enum addrs_io_backend io_backend;	// 0: auto (io_uring if available, else pread / pwrite)
+	int numa_shards;	// 0: off, < 0: one shard per NUMA node, n > 0: n shards over the nodes (round-robin)
+	int huge_pages;	// enum huge_pages_mode (utils.h) for the chunk buffers, 0: regular pages
+	int input_format;	// enum addrs_bulk_input_format, 0: pubkeys
+	int check_pubkeys;	// validate the pubkeys (prefix and curve point) before hashing, skip the invalid ones
+	const char * checkpoint_file;	// NULL: no checkpoints
+	double checkpoint_interval;	// seconds, <= 0: default (30s)
+	int resume;	// continue from checkpoint_file (started from scratch when there is none yet)
+};
+
+struct addrs_bulk_checkpoint
+{
+	uint64_t in_offset;	// input bytes consumed (always a line boundary)
+	uint64_t out_offset;	// output bytes durable, header included
+	uint64_t keys;	// keys converted so far, over all the resumed runs
+	uint32_t out_crc;	// crc32c of output[0 .. out_offset)
+	uint32_t in_crc;	// crc32c of the input window ending at in_offset (the last 64KB at most): the same input
+	uint32_t config_crc;	// output format, address types, input format and pubkey checks the run used
+};
+
+/**
+ * addrs_bulk_checkpoint_load()
+ * @return 0: loaded, 1: no such file, -1: unreadable or corrupted
+**/
+int addrs_bulk_checkpoint_load(const char * path, struct addrs_bulk_checkpoint * checkpoint);
+
+typedef struct addrs_bulk addrs_bulk_t;
+addrs_bulk_t * addrs_bulk_new(const struct addrs_bulk_config * config);
+void addrs_bulk_free(addrs_bulk_t * bulk);
+
+/**
+ * addrs_bulk_run()
+ *   blocks until the whole input has been converted and written
+ * @return 0 on success, -1 on I/O error
+**/
+int addrs_bulk_run(addrs_bulk_t * bulk);
+enum addrs_io_backend addrs_bulk_get_io_backend(const addrs_bulk_t * bulk);	// the backend in use once running
+
+/**
+ * addrs_bulk_get_metrics()
+ *   lock-free snapshot, safe to call from any thread while addrs_bulk_run() is in progress
+**/
+int addrs_bulk_get_metrics(addrs_bulk_t * bulk, struct addrs_bulk_metrics * metrics);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
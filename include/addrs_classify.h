@@ -0,0 +1,94 @@
+#ifndef BITCOIN_ADDRS_CLASSIFY_H_
+#define BITCOIN_ADDRS_CLASSIFY_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "pubkey_to_addrs.h"
+
+/**
+ * Address classifier / validator for mixed lists (legacy, p2sh, bech32, bech32m, garbage):
+ *   1. length and leading characters pick the only encoding an address can have
+ *      ('1' '3' 'm' 'n' '2': Base58Check, "bc1" "tb1" "bcrt1": segwit), everything else is rejected;
+ *   2. a branchless character-set pass over the whole string, 32 bytes per vector step;
+ *   3. only then the decoders: base58_decode_25() with the Base58Check checksums 8 addresses
+ *      per multi-lane call (hash_lanes.h), and bech32_decode() (BIP173 / BIP350 rules).
+ *   Garbage is mostly dropped in steps 1 and 2, before any big-number or checksum work.
+**/
+
+enum addrs_network
+{
+	addrs_network_unknown,
+	addrs_network_mainnet,
+	addrs_network_testnet,	// also signet, and regtest for Base58Check addresses (same version bytes)
+	addrs_network_regtest,	// "bcrt" segwit addresses
+
+	addrs_networks_count
+};
+const char * addrs_network_to_string(enum addrs_network network);
+
+enum addrs_class_type
+{
+	addrs_class_type_invalid,
+	addrs_class_type_p2pkh,
+	addrs_class_type_p2sh,
+	addrs_class_type_p2wpkh,
+	addrs_class_type_p2wsh,
+	addrs_class_type_p2tr,
+	addrs_class_type_witness_unknown,	// segwit v1 (not 32 bytes) .. v16, valid but without a defined script
+
+	addrs_class_types_count
+};
+const char * addrs_class_type_to_string(enum addrs_class_type type);
+
+enum addrs_class_error
+{
+	addrs_class_error_none,
+	addrs_class_error_length,
+	addrs_class_error_prefix,	// leading characters of no known address kind
+	addrs_class_error_charset,
+	addrs_class_error_encoding,	// not a 25-byte Base58Check payload / unknown version byte / bad segwit structure
+	addrs_class_error_checksum,
+
+	addrs_class_errors_count
+};
+const char * addrs_class_error_to_string(enum addrs_class_error err);
+
+#define ADDRS_CLASS_MAX_PROGRAM_SIZE	(40)
+
+struct addrs_class
+{
+	uint8_t type;	// enum addrs_class_type, addrs_class_type_invalid: see err_code
+	uint8_t network;	// enum addrs_network
+	int8_t err_code;	// enum addrs_class_error
+	uint8_t witness_version;	// segwit only
+	uint8_t cb_program;	// hash160 (p2pkh / p2sh) or witness program
+	unsigned char program[ADDRS_CLASS_MAX_PROGRAM_SIZE];
+};
+
+/**
+ * addrs_classify()
+ * @param cb_addr -1: strlen(addr)
+ * @return 0 if valid, or the (positive) enum addrs_class_error also stored in cls->err_code
+**/
+int addrs_classify(const char * addr, ssize_t cb_addr, struct addrs_class * cls);
+
+/**
+ * addrs_classify_batch()
+ * @param lengths may be NULL (strlen)
+ * @return the number of valid addresses
+**/
+ssize_t addrs_classify_batch(const char * const * addrs, const size_t * lengths, size_t count, struct addrs_class * classes);
+
+/* @param pool NULL: the process-wide default pool (utils/thread_pool.h) */
+struct thread_pool;
+ssize_t addrs_classify_batch_parallel(struct thread_pool * pool, const char * const * addrs, const size_t * lengths, size_t count,
+	struct addrs_class * classes);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,51 @@
+#ifndef BITCOIN_ADDRS_CLIENT_H_
+#define BITCOIN_ADDRS_CLIENT_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "addrs_protocol.h"
+
+/**
+ * Pipelining client for the conversion daemon.
+ *
+ *   addrs_client_send() only buffers a request; addrs_client_flush() (or any receive) sends them.
+ *   Responses arrive in request order. Keep the number of unanswered requests bounded
+ *   (a few thousand) so neither side blocks on a full socket buffer.
+ *
+ * One client per thread: a client is not thread-safe.
+**/
+
+typedef struct addrs_client addrs_client_t;
+addrs_client_t * addrs_client_connect(const char * socket_path);
+void addrs_client_close(addrs_client_t * client);
+int addrs_client_get_fd(const addrs_client_t * client);
+
+int addrs_client_send(addrs_client_t * client, uint32_t id, const unsigned char pubkey[static BITCOIN_ADDRS_PUBKEY_SIZE], uint32_t types_mask);
+int addrs_client_flush(addrs_client_t * client);
+
+/**
+ * addrs_client_recv()
+ *   flushes pending requests, then waits for the next response
+ * @param timeout_ms -1: wait forever, 0: poll
+ * @return 1: got a response, 0: timeout, -1: error or connection closed
+**/
+int addrs_client_recv(addrs_client_t * client, struct addrs_protocol_response * response, int timeout_ms);
+
+/**
+ * addrs_client_convert()
+ *   converts count keys with at most 'window' requests in flight (0: default)
+ * @return the number of responses with status ok, or -1 on a connection error
+**/
+ssize_t addrs_client_convert(addrs_client_t * client,
+	const unsigned char (* pubkeys)[BITCOIN_ADDRS_PUBKEY_SIZE], size_t count, uint32_t types_mask,
+	size_t window,
+	struct addrs_protocol_response * responses);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,57 @@
+#ifndef BITCOIN_ADDRS_DAEMON_H_
+#define BITCOIN_ADDRS_DAEMON_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Conversion daemon:
+ *   listens on a unix domain socket and serves the protocol in addrs_protocol.h.
+ *
+ *   Connections are spread over num_threads event loops (epoll, edge-triggered).
+ *   Each loop drains every ready connection, coalesces the decoded requests into one batch
+ *   (pubkeys_to_addrs_batch), then writes the responses back; no timer is involved,
+ *   so an idle daemon answers a single request immediately.
+**/
+
+struct addrs_daemon_config
+{
+	const char * socket_path;
+	int num_threads;	// event loops, <= 0: number of online cpus
+	int backlog;	// listen() backlog, <= 0: SOMAXCONN
+};
+
+struct addrs_daemon_stats
+{
+	uint64_t connections;	// accepted
+	uint64_t requests;
+	uint64_t batches;
+	uint64_t errors;	// protocol errors (connection closed) and rejected requests
+};
+
+typedef struct addrs_daemon addrs_daemon_t;
+addrs_daemon_t * addrs_daemon_new(const struct addrs_daemon_config * config);
+void addrs_daemon_free(addrs_daemon_t * daemon);
+
+/**
+ * addrs_daemon_run()
+ *   binds the socket and blocks until addrs_daemon_stop()
+ * @return 0 on a clean shutdown, -1 if the socket cannot be set up
+**/
+int addrs_daemon_run(addrs_daemon_t * daemon);
+
+/**
+ * addrs_daemon_stop()
+ *   async-signal-safe, may be called from any thread or a signal handler
+**/
+void addrs_daemon_stop(addrs_daemon_t * daemon);
+
+int addrs_daemon_get_stats(addrs_daemon_t * daemon, struct addrs_daemon_stats * stats);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,79 @@
+#ifndef BITCOIN_ADDRS_IO_H_
+#define BITCOIN_ADDRS_IO_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/uio.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Asynchronous file I/O for the bulk converter.
+ *
+ * backends:
+ *   io_uring: reads / writes are queued to the kernel and complete in any order,
+ *             buffers registered with addrs_io_register_buffers() use the fixed-buffer opcodes
+ *   sync:     pread / pwrite (read / write when offset < 0), executed at submit time,
+ *             completions are queued and returned by the next addrs_io_wait()
+ *
+ * One addrs_io_t per thread: submit / wait are not thread-safe.
+ * Like the kernel, a completion may report a short transfer; resubmitting the remainder is up to the caller.
+**/
+
+enum addrs_io_backend
+{
+	addrs_io_backend_auto,	// io_uring if the kernel supports it, otherwise sync
+	addrs_io_backend_uring,
+	addrs_io_backend_sync,
+
+	addrs_io_backends_count
+};
+enum addrs_io_backend addrs_io_backend_from_string(const char * name);	// -1 if unknown
+const char * addrs_io_backend_to_string(enum addrs_io_backend backend);
+
+struct addrs_io_completion
+{
+	uint64_t user_data;
+	ssize_t result;	// bytes transferred, or -errno
+};
+
+typedef struct addrs_io addrs_io_t;
+
+/**
+ * addrs_io_new()
+ * @param queue_depth max number of operations in flight
+ * @return NULL if an explicitly requested io_uring backend is unavailable
+**/
+addrs_io_t * addrs_io_new(enum addrs_io_backend backend, unsigned int queue_depth);
+void addrs_io_free(addrs_io_t * io);
+enum addrs_io_backend addrs_io_get_backend(const addrs_io_t * io);
+
+/**
+ * addrs_io_register_buffers()
+ *   io_uring: pins the buffers, buf_index i in submit calls refers to iovecs[i]
+ *   sync: no-op
+ * @return 0 on success, -1 on failure (the buffers can still be used with buf_index = -1)
+**/
+int addrs_io_register_buffers(addrs_io_t * io, const struct iovec * iovecs, unsigned int count);
+
+/**
+ * addrs_io_submit_read() / addrs_io_submit_write()
+ * @param offset file offset, -1: the current file position (pipes, ttys)
+ * @param buf_index registered buffer index, or -1
+ * @return 0 on success, -1 if the queue is full
+**/
+int addrs_io_submit_read(addrs_io_t * io, int fd, void * buf, size_t size, int64_t offset, int buf_index, uint64_t user_data);
+int addrs_io_submit_write(addrs_io_t * io, int fd, const void * buf, size_t size, int64_t offset, int buf_index, uint64_t user_data);
+
+/**
+ * addrs_io_wait()
+ *   submits all queued operations, then waits for at least min_complete completions
+ * @return the number of completions stored, or -1 on error
+**/
+int addrs_io_wait(addrs_io_t * io, struct addrs_io_completion * completions, unsigned int max_completions, unsigned int min_complete);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
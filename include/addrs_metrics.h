@@ -0,0 +1,43 @@
+#ifndef BITCOIN_ADDRS_METRICS_H_
+#define BITCOIN_ADDRS_METRICS_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "addrs_bulk.h"
+
+/**
+ * Prometheus text exposition of the bulk converter metrics.
+ *
+ * Two publishing targets are supported:
+ *   textfile: rewritten every interval (tmpfile + rename), for node_exporter's textfile collector
+ *   socket:   a local unix domain socket, each connection receives the latest exposition and is closed
+**/
+
+typedef int (* addrs_metrics_source_func)(void * user_data, struct addrs_bulk_metrics * metrics);
+
+/**
+ * addrs_metrics_format()
+ * @param keys_per_second throughput gauge, computed by the caller from two snapshots
+ * @return the length of the exposition text, or -1 if the buffer is too small
+**/
+ssize_t addrs_metrics_format(const struct addrs_bulk_metrics * metrics, double keys_per_second, char * buf, size_t size);
+
+typedef struct addrs_metrics_exporter addrs_metrics_exporter_t;
+addrs_metrics_exporter_t * addrs_metrics_exporter_new(addrs_metrics_source_func get_metrics, void * user_data,
+	const char * textfile, 	// optional
+	const char * socket_path,	// optional
+	double interval	// seconds
+);
+void addrs_metrics_exporter_free(addrs_metrics_exporter_t * exporter);
+
+int addrs_metrics_exporter_start(addrs_metrics_exporter_t * exporter);
+void addrs_metrics_exporter_stop(addrs_metrics_exporter_t * exporter);	// publishes a final snapshot
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,99 @@
+#ifndef BITCOIN_ADDRS_OUTPUT_H_
+#define BITCOIN_ADDRS_OUTPUT_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "pubkey_to_addrs.h"
+
+/**
+ * Output formats:
+ *   text:   pubkey_hex addr addr ...                          (one line per key)
+ *   csv:    pubkey,hash160,<type>,...                          (header line + one row per key)
+ *   jsonl:  {"pubkey":"..","hash160":"..","<type>":"..",...}   (one object per line)
+ *   binary: addrs_output_binary_header + fixed-width addrs_output_binary_record[]
+ *
+ * Only the selected address types are emitted (text / csv / jsonl);
+ * binary records always carry every slot, unselected slots are zero-filled.
+ *
+ * Formatting never allocates: the caller provides a buffer with at least
+ * addrs_output_max_record_size() bytes per record.
+**/
+
+enum addrs_output_format
+{
+	addrs_output_format_text,
+	addrs_output_format_csv,
+	addrs_output_format_jsonl,
+	addrs_output_format_binary,
+
+	addrs_output_formats_count
+};
+enum addrs_output_format addrs_output_format_from_string(const char * name);	// -1 if unknown
+const char * addrs_output_format_to_string(enum addrs_output_format format);
+
+/**
+ * binary layout (host byte order, little-endian on all supported targets):
+ *   the file starts with one header, followed by (file_size - header_size) / record_size records,
+ *   so a loader can mmap the file and index records directly.
+**/
+#define ADDRS_OUTPUT_BINARY_MAGIC	"BTCADDR1"
+
+struct addrs_output_binary_header
+{
+	char magic[8];
+	uint32_t header_size;	// sizeof(struct addrs_output_binary_header)
+	uint32_t record_size;	// sizeof(struct addrs_output_binary_record)
+	uint32_t types_mask;	// address types present in the records
+	uint32_t num_types;	// bitcoin_address_types_count
+	uint32_t addr_slot_size;	// BITCOIN_ADDRS_MAX_LENGTH
+	uint32_t reserved[9];
+};
+
+struct addrs_output_binary_record
+{
+	unsigned char pubkey[BITCOIN_ADDRS_PUBKEY_SIZE];
+	unsigned char hash160[BITCOIN_ADDRS_HASH160_SIZE];
+	uint8_t types_mask;
+	uint8_t cb_addrs[bitcoin_address_types_count];
+	uint8_t reserved[64 - BITCOIN_ADDRS_PUBKEY_SIZE - BITCOIN_ADDRS_HASH160_SIZE - 1 - bitcoin_address_types_count];
+	char addrs[bitcoin_address_types_count][BITCOIN_ADDRS_MAX_LENGTH];	// '\0' padded
+};
+
+/**
+ * addrs_output_max_record_size()
+ * @return an upper bound of the bytes produced by addrs_output_format_record()
+**/
+size_t addrs_output_max_record_size(enum addrs_output_format format, uint32_t types_mask);
+
+/**
+ * addrs_output_format_header()
+ *   csv: the column names line, binary: struct addrs_output_binary_header, others: nothing
+ * @return the header length, or -1 if the buffer is too small
+**/
+ssize_t addrs_output_format_header(enum addrs_output_format format, uint32_t types_mask, char * buf, size_t size);
+
+/**
+ * addrs_output_format_record()
+ * @param buf at least addrs_output_max_record_size() bytes
+ * @return the number of bytes written (no terminating '\0')
+**/
+size_t addrs_output_format_record(enum addrs_output_format format, uint32_t types_mask,
+	const struct bitcoin_addrs_record * record, char * buf);
+
+/**
+ * addrs_output_format_records()
+ *   formats every record with err_code == 0, records with errors are skipped
+ * @param buf at least count * addrs_output_max_record_size() bytes
+ * @return the number of bytes written
+**/
+size_t addrs_output_format_records(enum addrs_output_format format, uint32_t types_mask,
+	const struct bitcoin_addrs_record * records, size_t count, char * buf);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
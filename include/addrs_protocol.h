@@ -0,0 +1,83 @@
+#ifndef BITCOIN_ADDRS_PROTOCOL_H_
+#define BITCOIN_ADDRS_PROTOCOL_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "pubkey_to_addrs.h"
+
+/**
+ * Daemon wire protocol (unix domain stream socket), all integers little-endian.
+ *
+ * every frame: le32 length (bytes following the length field) + body
+ *
+ * request body:
+ *   le32 id            echoed in the response
+ *   u8   types_mask    BITCOIN_ADDRESS_TYPE_MASK() bits, 0: all types
+ *   u8   pubkey[33]    compressed pubkey
+ *
+ * response body:
+ *   le32 id
+ *   u8   status        enum addrs_protocol_status
+ *   u8   types_mask    address types present
+ *   u8   hash160[20]
+ *   for each type in types_mask (ascending):  u8 length, char address[length]
+ *
+ * Requests may be pipelined; responses on a connection come back in request order.
+**/
+
+#define ADDRS_PROTOCOL_LENGTH_SIZE	(4)
+#define ADDRS_PROTOCOL_REQUEST_SIZE	(4 + 1 + BITCOIN_ADDRS_PUBKEY_SIZE)
+#define ADDRS_PROTOCOL_RESPONSE_MAX_SIZE	(4 + 1 + 1 + BITCOIN_ADDRS_HASH160_SIZE + bitcoin_address_types_count * BITCOIN_ADDRS_MAX_LENGTH)
+#define ADDRS_PROTOCOL_MAX_FRAME_SIZE	(4096)	// larger length fields are a protocol error
+
+enum addrs_protocol_status
+{
+	addrs_protocol_status_ok,
+	addrs_protocol_status_bad_request,
+	addrs_protocol_status_invalid_pubkey,
+	addrs_protocol_status_encode_error,
+};
+const char * addrs_protocol_status_to_string(enum addrs_protocol_status status);
+
+struct addrs_protocol_request
+{
+	uint32_t id;
+	uint32_t types_mask;
+	unsigned char pubkey[BITCOIN_ADDRS_PUBKEY_SIZE];
+};
+
+struct addrs_protocol_response
+{
+	uint32_t id;
+	int status;
+	uint32_t types_mask;
+	unsigned char hash160[BITCOIN_ADDRS_HASH160_SIZE];
+	uint8_t cb_addrs[bitcoin_address_types_count];
+	char addrs[bitcoin_address_types_count][BITCOIN_ADDRS_MAX_LENGTH];	// '\0' terminated
+};
+
+/**
+ * encoders write a complete frame (length prefix included)
+ * @param buf at least ADDRS_PROTOCOL_LENGTH_SIZE + ADDRS_PROTOCOL_{REQUEST_SIZE, RESPONSE_MAX_SIZE} bytes
+ * @return the frame size
+**/
+size_t addrs_protocol_encode_request(const struct addrs_protocol_request * request, unsigned char * buf);
+size_t addrs_protocol_encode_response(uint32_t id, int status, uint32_t types_mask,
+	const struct bitcoin_addrs_record * record,	// NULL if status != ok
+	unsigned char * buf);
+
+/**
+ * decoders parse one frame from the beginning of buf
+ * @return the frame size consumed, 0 if the frame is incomplete, -1 on a malformed frame
+**/
+ssize_t addrs_protocol_decode_request(const unsigned char * buf, size_t length, struct addrs_protocol_request * request);
+ssize_t addrs_protocol_decode_response(const unsigned char * buf, size_t length, struct addrs_protocol_response * response);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,94 @@
+#ifndef BITCOIN_ADDRS_STATS_H_
+#define BITCOIN_ADDRS_STATS_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Hot-path instrumentation.
+ *
+ * Compiled in only when BITCOIN_ADDRS_STATS is defined (make STATS=1).
+ * Otherwise the ADDRS_STATS_* hooks expand to nothing and the query functions
+ * report an empty snapshot.
+ *
+ * Each thread owns a cacheline-aligned block of counters, so recording never
+ * shares a cacheline with another thread; blocks are summed on demand.
+**/
+
+enum addrs_stats_stage
+{
+	addrs_stats_stage_hex_parse,
+	addrs_stats_stage_pubkey_check,	// curve-point validation
+	addrs_stats_stage_sha256,
+	addrs_stats_stage_ripemd160,
+	addrs_stats_stage_hash160,	// fused SHA-256 + RIPEMD-160 kernels
+	addrs_stats_stage_checksum,
+	addrs_stats_stage_base58_encode,
+	addrs_stats_stage_bech32_encode,
+	addrs_stats_stage_output,
+
+	addrs_stats_stages_count
+};
+
+enum addrs_stats_error
+{
+	addrs_stats_error_pubkey_length,
+	addrs_stats_error_pubkey_hex,
+	addrs_stats_error_pubkey_point,	// prefix is not 02 / 03, or x is not on secp256k1
+	addrs_stats_error_privkey,	// WIF does not decode, uncompressed, or not a valid secret key
+	addrs_stats_error_multisig,	// invalid m / n or a key set with a non-compressed pubkey
+	addrs_stats_error_encode,
+	addrs_stats_error_output,
+
+	addrs_stats_errors_count
+};
+
+struct addrs_stats_snapshot
+{
+	int num_threads;
+	uint64_t ticks[addrs_stats_stages_count];
+	uint64_t calls[addrs_stats_stages_count];
+	uint64_t errors[addrs_stats_errors_count];
+};
+
+int addrs_stats_enabled(void);
+const char * addrs_stats_stage_to_string(enum addrs_stats_stage stage);
+const char * addrs_stats_error_to_string(enum addrs_stats_error err);
+
+void addrs_stats_snapshot(struct addrs_stats_snapshot * snapshot);
+void addrs_stats_reset(void);
+void addrs_stats_dump(const struct addrs_stats_snapshot * snapshot, FILE * fp);
+
+#if defined(BITCOIN_ADDRS_STATS)
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+static inline uint64_t addrs_stats_ticks(void) { return __rdtsc(); }
+#else
+#include <time.h>
+static inline uint64_t addrs_stats_ticks(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+#endif
+
+void addrs_stats_add_ticks(enum addrs_stats_stage stage, uint64_t ticks);
+void addrs_stats_add_error(enum addrs_stats_error err);
+
+#define ADDRS_STATS_BEGIN(name) uint64_t name##_ticks_begin = addrs_stats_ticks()
+#define ADDRS_STATS_END(name, stage) addrs_stats_add_ticks(stage, addrs_stats_ticks() - name##_ticks_begin)
+#define ADDRS_STATS_ERROR(err) addrs_stats_add_error(err)
+#else
+#define ADDRS_STATS_BEGIN(name)
+#define ADDRS_STATS_END(name, stage)
+#define ADDRS_STATS_ERROR(err)
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+#endif
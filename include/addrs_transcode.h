@@ -0,0 +1,68 @@
+#ifndef BITCOIN_ADDRS_TRANSCODE_H_
+#define BITCOIN_ADDRS_TRANSCODE_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "pubkey_to_addrs.h"
+
+/**
+ * Address transcoding: the same key hash in another single-key format, without the pubkey:
+ *   p2pkh (Base58Check, version 0x00) <-> bech32 (p2wpkh, witness v0)
+ *
+ *   The 20-byte program is decoded and re-encoded as is; hash160() is never called.
+ *   The only hashing left is the Base58Check checksum (verified when decoding, computed when encoding),
+ *   at most one per address, 8 addresses per multi-lane call (hash_lanes.h).
+ *
+ *   p2sh-p2wpkh is neither a source (its payload is a script hash) nor a target (that takes hash160 of
+ *   the witness script): such addresses are reported as unsupported.
+**/
+
+enum addrs_transcode_error
+{
+	addrs_transcode_error_none,
+	addrs_transcode_error_invalid,	// neither a Base58Check 25-byte payload nor a valid segwit address
+	addrs_transcode_error_checksum,	// Base58Check checksum mismatch
+	addrs_transcode_error_unsupported,	// a valid address, but not a mainnet p2pkh / p2wpkh one
+
+	addrs_transcode_errors_count
+};
+const char * addrs_transcode_error_to_string(enum addrs_transcode_error err);
+
+struct addrs_transcode_record
+{
+	char addr[BITCOIN_ADDRS_MAX_LENGTH];	// input: '\0'-terminated address
+	int8_t err_code;	// enum addrs_transcode_error
+	uint8_t from_type;	// enum bitcoin_address_type of addr
+	unsigned char hash160[BITCOIN_ADDRS_HASH160_SIZE];
+	uint8_t cb_transcoded;
+	char transcoded[BITCOIN_ADDRS_MAX_LENGTH];
+};
+
+/**
+ * addrs_transcode()
+ * @param to_type bitcoin_address_type_p2pkh or bitcoin_address_type_bech32
+ * @param p_addr *p_addr == NULL: the address is allocated with lib_alloc() (see utils/arena.h)
+ * @return the length of the transcoded address, or -(enum addrs_transcode_error)
+**/
+ssize_t addrs_transcode(const char * addr, enum bitcoin_address_type to_type, char ** p_addr);
+
+/**
+ * addrs_transcode_batch()
+ *   fills everything but addr in each record
+ * @return the number of records transcoded without error, or -1 if to_type is not a target type
+**/
+ssize_t addrs_transcode_batch(struct addrs_transcode_record * records, size_t count, enum bitcoin_address_type to_type);
+
+/* @param pool NULL: the process-wide default pool (utils/thread_pool.h) */
+struct thread_pool;
+ssize_t addrs_transcode_batch_parallel(struct thread_pool * pool, struct addrs_transcode_record * records, size_t count,
+	enum bitcoin_address_type to_type);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
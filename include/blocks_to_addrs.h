@@ -0,0 +1,94 @@
+#ifndef BITCOIN_ADDRS_BLOCKS_TO_ADDRS_H_
+#define BITCOIN_ADDRS_BLOCKS_TO_ADDRS_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "pubkey_to_addrs.h"
+
+/**
+ * Raw block files (a node's blocks/blk*.dat) -> pubkeys and addresses:
+ *   every file is mapped and walked block by block ([ network magic | u32 size | block ]) on its own
+ *   pool task; transactions are parsed in place and each key-derived item is collected:
+ *
+ *   outputs:  <33 / 65-byte pubkey> OP_CHECKSIG (p2pk), p2pkh and p2wpkh hashes
+ *   inputs:   the pubkey of a p2wpkh / p2sh-p2wpkh spend (2-item witness ending with a compressed pubkey)
+ *
+ *   Items are deduplicated per file while parsing, then merged in file order (first appearance wins),
+ *   and only the unique ones are hashed (hash160) and encoded, in parallel.
+ *   A malformed block contributes nothing and is skipped by its size field; the zero padding
+ *   at the end of a preallocated file ends it.
+**/
+
+enum block_item_type
+{
+	block_item_type_p2pk,	// compressed pubkey of a p2pk output -> p2pkh address
+	block_item_type_p2pk_uncompressed,	// uncompressed pubkey of a p2pk output -> p2pkh address of the 65-byte form
+	block_item_type_p2pkh,	// output hash -> p2pkh address
+	block_item_type_p2wpkh,	// output hash -> bech32 address
+	block_item_type_witness_pubkey,	// pubkey of a p2wpkh spend -> bech32 address
+	block_item_type_p2sh_witness_pubkey,	// pubkey of a p2sh-p2wpkh spend -> p2sh-p2wpkh address
+
+	block_item_types_count
+};
+enum block_item_type block_item_type_from_string(const char * type);
+const char * block_item_type_to_string(enum block_item_type type);
+
+#define BLOCK_ITEM_MAX_DATA_SIZE	(65)
+
+struct block_item
+{
+	uint8_t type;	// enum block_item_type
+	uint8_t cb_data;
+	unsigned char data[BLOCK_ITEM_MAX_DATA_SIZE];	// pubkey (33 / 65 bytes) or hash160 (20 bytes), as found
+	unsigned char hash160[BITCOIN_ADDRS_HASH160_SIZE];	// address payload (the p2sh script hash for p2sh-p2wpkh spends)
+	uint32_t file_index;	// first file it appeared in
+	int8_t err_code;	// 0: ok
+	uint8_t cb_addr;
+	char addr[BITCOIN_ADDRS_MAX_LENGTH];
+};
+
+struct blocks_extract_config
+{
+	unsigned char network_magic[4];	// all zero: mainnet (f9 be b4 d9)
+	unsigned char xor_key[8];	// blocks/xor.dat (Bitcoin Core 28+), all zero: files are not obfuscated
+	struct thread_pool * pool;	// NULL: the process-wide default pool (utils/thread_pool.h)
+};
+
+struct blocks_extract_stats
+{
+	uint64_t files;
+	uint64_t bytes;
+	uint64_t blocks;
+	uint64_t malformed_blocks;	// skipped
+	uint64_t transactions;
+	uint64_t inputs;
+	uint64_t outputs;
+	uint64_t items;	// found, repeats included
+	uint64_t unique_items;
+	double elapsed;	// seconds
+};
+
+/**
+ * blocks_read_xor_key()
+ * @return 0: key read from blocks_dir/xor.dat, 1: no xor.dat (key zeroed), -1: unreadable
+**/
+int blocks_read_xor_key(const char * blocks_dir, unsigned char xor_key[static 8]);
+
+/**
+ * blocks_extract()
+ * @param config may be NULL
+ * @param p_items [out] the unique items in order of first appearance, release with free()
+ * @param stats may be NULL
+ * @return the number of unique items, or -1 if a file can't be read (nothing is returned then)
+**/
+ssize_t blocks_extract(const char * const * paths, size_t num_paths, const struct blocks_extract_config * config,
+	struct block_item ** p_items, struct blocks_extract_stats * stats);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,73 @@
+#ifndef BITCOIN_ADDRS_DESCRIPTOR_TO_ADDRS_H_
+#define BITCOIN_ADDRS_DESCRIPTOR_TO_ADDRS_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "pubkey_to_addrs.h"
+
+/**
+ * Output descriptors (BIP380..383) -> addresses:
+ *   descriptor_compile() parses a descriptor once into a flat plan: every key's fixed derivation
+ *   steps are applied up front (the cached parent: parsed point + HMAC-SHA512 keyed with its chain code),
+ *   the script template and the encoder are chosen once. Executing the plan over an index range only
+ *   runs one public child derivation per ranged key and index, then the batch encoders
+ *   (pubkeys_to_addrs_batch() / multisigs_to_addrs_batch()), block by block.
+ *
+ * supported (mainnet):
+ *   pkh(KEY)  wpkh(KEY)  sh(wpkh(KEY))
+ *   sh(MULTI)  wsh(MULTI)  sh(wsh(MULTI))
+ *     MULTI: multi(k,KEY,...) / sortedmulti(k,KEY,...), at most 15 keys
+ *     KEY:   [origin] followed by a compressed hex pubkey, or an xpub with unhardened steps (xpub/0/1),
+ *            the last one may be the '*' wildcard (ranged descriptors)
+ *   an optional '#checksum' suffix is verified.
+ *
+ *   Deriving from an xpub needs libsecp256k1 (see privkey_to_addrs.h); without it only hex keys
+ *   and xpubs without steps compile.
+**/
+
+#define DESCRIPTOR_CHECKSUM_LENGTH	(8)
+
+/* @return 0 on success, -1 if the descriptor has a character outside the descriptor charset */
+int descriptor_checksum(const char * descriptor, size_t cb_descriptor, char checksum[static DESCRIPTOR_CHECKSUM_LENGTH + 1]);
+
+typedef struct descriptor_plan descriptor_plan_t;
+
+/**
+ * descriptor_compile()
+ * @param p_error may be NULL; on failure set to a static description of the problem
+ * @return the plan, or NULL on error
+**/
+descriptor_plan_t * descriptor_compile(const char * descriptor, const char ** p_error);
+void descriptor_plan_free(descriptor_plan_t * plan);
+
+int descriptor_plan_is_ranged(const descriptor_plan_t * plan);	// 0: every index gives the same address
+const char * descriptor_plan_get_address_type(const descriptor_plan_t * plan);	// bitcoin_address_type / multisig_address_type name
+
+struct descriptor_address
+{
+	uint32_t index;
+	int8_t err_code;	// 0: ok
+	uint8_t cb_addr;
+	char addr[BITCOIN_ADDRS_MAX_LENGTH];
+};
+
+/**
+ * descriptor_plan_execute()
+ *   addrs[i] gets the address at index first_index + i; the plan is read-only (threads may share it)
+ * @return the number of addresses derived without error
+**/
+ssize_t descriptor_plan_execute(const descriptor_plan_t * plan, uint32_t first_index, size_t count, struct descriptor_address * addrs);
+
+/* @param pool NULL: the process-wide default pool (utils/thread_pool.h) */
+struct thread_pool;
+ssize_t descriptor_plan_execute_parallel(struct thread_pool * pool,
+	const descriptor_plan_t * plan, uint32_t first_index, size_t count, struct descriptor_address * addrs);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,81 @@
+#ifndef BITCOIN_ADDRS_MULTISIG_TO_ADDRS_H_
+#define BITCOIN_ADDRS_MULTISIG_TO_ADDRS_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "pubkey_to_addrs.h"
+
+/**
+ * M-of-N multisig key sets -> addresses:
+ *   script: OP_m <pubkey_1> ... <pubkey_n> OP_n OP_CHECKMULTISIG
+ *   with the pubkeys sorted lexicographically (BIP67) unless MULTISIG_KEEP_ORDER is given.
+ *
+ *   p2sh:        Base58Check( 0x05 | hash160(script) )
+ *   p2wsh:       Bech32( v0, sha256(script) )
+ *   p2sh-p2wsh:  Base58Check( 0x05 | hash160( 0x00 0x20 sha256(script) ) )
+ *
+ *   The script is built on the stack and hashed once with SHA-256; p2sh reuses that digest for its hash160.
+ *   Key sets are limited to 15 compressed pubkeys (the 520-byte P2SH redeem script limit).
+**/
+
+enum multisig_address_type
+{
+	multisig_address_type_p2sh,
+	multisig_address_type_p2wsh,
+	multisig_address_type_p2sh_p2wsh,
+
+	multisig_address_types_count
+};
+enum multisig_address_type multisig_address_type_from_string(const char * type);
+const char * multisig_address_type_to_string(enum multisig_address_type type);
+
+#define MULTISIG_MAX_KEYS	(15)
+#define MULTISIG_SCRIPT_MAX_SIZE	(3 + MULTISIG_MAX_KEYS * (1 + BITCOIN_ADDRS_PUBKEY_SIZE))	// 513 bytes
+
+#define MULTISIG_ADDRESS_TYPE_MASK(type)	(1u << (type))
+#define MULTISIG_ADDRESS_TYPES_ALL	((1u << multisig_address_types_count) - 1)
+
+enum multisig_flags
+{
+	MULTISIG_KEEP_ORDER = 1,	// use the keys in the given order (descriptor multi()), not BIP67 sorted
+};
+
+/**
+ * multisig_script()
+ *   pubkeys must be compressed (0x02 / 0x03 prefix); the input array is not modified
+ * @return the script length, or -1 if m, n or a pubkey is invalid
+**/
+ssize_t multisig_script(unsigned int m, unsigned int n, const unsigned char (* pubkeys)[BITCOIN_ADDRS_PUBKEY_SIZE], int flags,
+	unsigned char script[static MULTISIG_SCRIPT_MAX_SIZE]);
+
+struct multisig_record
+{
+	uint8_t m, n;	// input: 1 <= m <= n <= MULTISIG_MAX_KEYS
+	unsigned char pubkeys[MULTISIG_MAX_KEYS][BITCOIN_ADDRS_PUBKEY_SIZE];	// input: n compressed pubkeys
+	unsigned char script_sha256[32];	// the p2wsh witness program
+	int8_t err_code;	// 0: ok
+	uint8_t cb_addrs[multisig_address_types_count];
+	char addrs[multisig_address_types_count][BITCOIN_ADDRS_MAX_LENGTH];
+};
+
+/**
+ * multisigs_to_addrs_batch()
+ *   fills script_sha256 and the address slots selected by types_mask for each record
+ * @param flags enum multisig_flags
+ * @return the number of records converted without error
+**/
+ssize_t multisigs_to_addrs_batch(struct multisig_record * records, size_t count, uint32_t types_mask, int flags);
+
+/* @param pool NULL: the process-wide default pool (utils/thread_pool.h) */
+struct thread_pool;
+ssize_t multisigs_to_addrs_batch_parallel(struct thread_pool * pool,
+	struct multisig_record * records, size_t count, uint32_t types_mask, int flags);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,75 @@
+#ifndef BITCOIN_ADDRS_PRIVKEY_TO_ADDRS_H_
+#define BITCOIN_ADDRS_PRIVKEY_TO_ADDRS_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "pubkey_to_addrs.h"
+
+/**
+ * Private keys (WIF) -> addresses:
+ *   WIF: Base58Check( 0x80 | privkey(32) [ | 0x01 (compressed pubkey) ] )
+ *
+ *   pubkeys are computed with libsecp256k1 (generator multiplication on the precomputed table),
+ *   one context per thread, created on first use. Without libsecp256k1 (no HAVE_LIBSECP256K1 at build time)
+ *   only the WIF codec is available and every key fails.
+ *
+ *   The address types of this library are defined over compressed pubkeys:
+ *   WIFs of uncompressed keys are rejected.
+**/
+
+#define BITCOIN_ADDRS_PRIVKEY_SIZE	(32)
+#define BITCOIN_ADDRS_WIF_MAX_LENGTH	(52)	// compressed: 52 chars, uncompressed: 51
+
+/**
+ * wif_decode()
+ *   no allocation; checks the length, digits, version byte, compression flag and checksum
+ * @param p_compressed may be NULL
+ * @return 0 on success, -1 on error
+**/
+int wif_decode(const char * wif, size_t cb_wif, unsigned char privkey[static BITCOIN_ADDRS_PRIVKEY_SIZE], int * p_compressed);
+
+/* *p_wif == NULL: the string is allocated with lib_alloc() (see utils/arena.h) */
+ssize_t wif_encode(const unsigned char privkey[static BITCOIN_ADDRS_PRIVKEY_SIZE], int compressed, char ** p_wif);
+
+int privkey_to_addrs_is_supported(void);	// 1 if built with libsecp256k1
+
+/* @return 0 on success, -1 if privkey is not a valid secret key (0 or >= n) or libsecp256k1 is missing */
+int privkey_to_pubkey(const unsigned char privkey[static BITCOIN_ADDRS_PRIVKEY_SIZE], unsigned char pubkey[static BITCOIN_ADDRS_PUBKEY_SIZE]);
+
+/**
+ * public-key arithmetic (BIP32 public derivation), libsecp256k1 only:
+ *   a parsed point keeps the decompressed form, so a parent key used for many children is parsed once
+**/
+struct bitcoin_addrs_point
+{
+	unsigned char data[64];	// opaque (secp256k1_pubkey)
+};
+
+/* @return 0 on success, -1 if pubkey is not a valid compressed point or libsecp256k1 is missing */
+int pubkey_parse(const unsigned char pubkey[static BITCOIN_ADDRS_PUBKEY_SIZE], struct bitcoin_addrs_point * point);
+
+/* child = parent + tweak * G; @return 0 on success, -1 if tweak >= n or the sum is the point at infinity */
+int pubkey_tweak_add(const struct bitcoin_addrs_point * parent, const unsigned char tweak[static 32],
+	unsigned char child[static BITCOIN_ADDRS_PUBKEY_SIZE]);
+
+/**
+ * privkeys_to_addrs_batch()
+ *   decodes wifs[i] into records[i].pubkey, then converts the records as pubkeys_to_addrs_batch() does,
+ *   in cache-sized blocks. Records whose WIF does not decode get err_code != 0 and no addresses.
+ * @return the number of records converted without error
+**/
+ssize_t privkeys_to_addrs_batch(const char * const * wifs, struct bitcoin_addrs_record * records, size_t count, uint32_t types_mask);
+
+/* @param pool NULL: the process-wide default pool (utils/thread_pool.h) */
+struct thread_pool;
+ssize_t privkeys_to_addrs_batch_parallel(struct thread_pool * pool,
+	const char * const * wifs, struct bitcoin_addrs_record * records, size_t count, uint32_t types_mask);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
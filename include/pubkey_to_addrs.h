@@ -2,6 +2,7 @@
 #define BITCOIN_ADDRS_PUBKEY_TO_ADDRS_H_
 
 #include <stdio.h>
+#include <stdint.h>
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -17,10 +18,116 @@ enum bitcoin_address_type
 enum bitcoin_address_type bitcoin_address_type_from_string(const char * type);
 const char * bitcoin_address_type_to_string(enum bitcoin_address_type type);
 
+/* Base58Check version bytes (mainnet) */
+enum bitcoin_address_prefix
+{
+	bitcoin_address_prefix_p2pkh = 0x00,
+	bitcoin_address_prefix_p2sh = 0x05,
+	bitcoin_address_prefix_privkey = 0x80,	// WIF
+};
+
+/* *p_addr == NULL: the address is allocated with lib_alloc() (see utils/arena.h) */
 ssize_t pubkey_to_p2pkh(const char * pubkey_hex, char ** p_addr);
 ssize_t pubkey_to_p2sh_p2wpkh(const char * pubkey_hex, char ** p_addr);
 ssize_t pubkey_to_bech32(const char * pubkey_hex, char ** p_addr);
 
+/*
+ * batch api
+ */
+#define BITCOIN_ADDRS_PUBKEY_SIZE	(33)
+#define BITCOIN_ADDRS_HASH160_SIZE	(20)
+#define BITCOIN_ADDRS_MAX_LENGTH	(64)	// address slot size, including the terminating '\0'
+
+#define BITCOIN_ADDRESS_TYPE_MASK(type)	(1u << (type))
+#define BITCOIN_ADDRESS_TYPES_ALL	((1u << bitcoin_address_types_count) - 1)
+
+/**
+ * types_mask flag of the batch api: check that each pubkey is a point of the curve first
+ * (0x02 / 0x03 prefix, then x^3 + 7 a square mod p, batched: see base/secp256k1_point.h);
+ * the records of other keys get err_code BITCOIN_ADDRS_ERR_PUBKEY and no address.
+ * Without it the pubkeys are trusted (hashed as they are).
+**/
+#define BITCOIN_ADDRS_CHECK_PUBKEYS	(1u << 31)
+
+/* bitcoin_addrs_record.err_code */
+#define BITCOIN_ADDRS_ERR_ENCODE	(-1)
+#define BITCOIN_ADDRS_ERR_PUBKEY	(-2)	// not a point of the curve (BITCOIN_ADDRS_CHECK_PUBKEYS)
+
+/*
+ * encoders of precomputed hashes (mainnet, no pubkey hashing), shared with the script engines (multisig_to_addrs.h)
+ * *p_addr == NULL: the address is allocated with lib_alloc()
+ */
+ssize_t hash160_to_p2pkh(const unsigned char hash[static BITCOIN_ADDRS_HASH160_SIZE], char ** p_addr);
+ssize_t script_hash_to_p2sh(const unsigned char script_hash[static BITCOIN_ADDRS_HASH160_SIZE], char ** p_addr);	// hash160(redeem_script)
+ssize_t witness_program_to_segwit(uint8_t version, const unsigned char * program, size_t cb_program, char ** p_addr);	// 2..40 bytes
+
+struct bitcoin_addrs_record
+{
+	unsigned char pubkey[BITCOIN_ADDRS_PUBKEY_SIZE];	// input: compressed pubkey
+	unsigned char hash160[BITCOIN_ADDRS_HASH160_SIZE];
+	int8_t err_code;	// 0: ok
+	uint8_t cb_addrs[bitcoin_address_types_count];
+	char addrs[bitcoin_address_types_count][BITCOIN_ADDRS_MAX_LENGTH];
+};
+
+/**
+ * pubkeys_to_addrs_batch()
+ *   fills hash160 and the address slots selected by types_mask for each record.
+ *   records[i].pubkey must be set by the caller.
+ * @param types_mask address types, optionally | BITCOIN_ADDRS_CHECK_PUBKEYS
+ * @return the number of records converted without error
+**/
+ssize_t pubkeys_to_addrs_batch(struct bitcoin_addrs_record * records, size_t count, uint32_t types_mask);
+
+/**
+ * pubkeys_to_addrs_batch_parallel()
+ *   same as pubkeys_to_addrs_batch(), with the records spread over a work-stealing pool (utils/thread_pool.h)
+ * @param pool NULL: the process-wide default pool
+**/
+struct thread_pool;
+ssize_t pubkeys_to_addrs_batch_parallel(struct thread_pool * pool, struct bitcoin_addrs_record * records, size_t count, uint32_t types_mask);
+
+/*
+ * scriptPubKeys and Electrum scripthashes (the protocol's address index key: sha256(scriptPubKey), byte-reversed)
+ *   p2pkh:        OP_DUP OP_HASH160 <hash160> OP_EQUALVERIFY OP_CHECKSIG   (25 bytes)
+ *   p2sh-p2wpkh:  OP_HASH160 <hash160(OP_0 <hash160>)> OP_EQUAL          (23 bytes)
+ *   bech32:       OP_0 <hash160>                                           (22 bytes)
+ */
+#define BITCOIN_ADDRS_SCRIPT_MAX_SIZE	(25)
+#define ELECTRUM_SCRIPTHASH_SIZE	(32)
+
+/* @return the script length, or -1 if type is unknown */
+ssize_t hash160_to_script_pubkey(enum bitcoin_address_type type, const unsigned char hash[static BITCOIN_ADDRS_HASH160_SIZE],
+	unsigned char script[static BITCOIN_ADDRS_SCRIPT_MAX_SIZE]);
+void electrum_scripthash(const unsigned char * script, size_t cb_script, unsigned char scripthash[static ELECTRUM_SCRIPTHASH_SIZE]);
+
+/**
+ * pubkey_to_script_pubkey()
+ * @param scripthash may be NULL
+ * @return the script length, or -1 if the pubkey or the type is invalid
+**/
+ssize_t pubkey_to_script_pubkey(const char * pubkey_hex, enum bitcoin_address_type type,
+	unsigned char script[static BITCOIN_ADDRS_SCRIPT_MAX_SIZE], unsigned char * scripthash);
+
+struct bitcoin_addrs_scripts
+{
+	uint8_t cb_scripts[bitcoin_address_types_count];	// 0: type not selected, or the record has an error
+	unsigned char scripts[bitcoin_address_types_count][BITCOIN_ADDRS_SCRIPT_MAX_SIZE];
+	unsigned char scripthashes[bitcoin_address_types_count][ELECTRUM_SCRIPTHASH_SIZE];
+};
+
+/**
+ * pubkeys_to_scripts_batch()
+ *   scripts[i] gets the scriptPubKeys and scripthashes of records[i], built from the hash160
+ *   that pubkeys_to_addrs_batch() already stored in the record (no pubkey is hashed again);
+ *   a record with an error gets zeroed scripts and scripthashes, its hash160 is not read
+ * @return the number of records without error
+**/
+ssize_t pubkeys_to_scripts_batch(const struct bitcoin_addrs_record * records, size_t count, uint32_t types_mask,
+	struct bitcoin_addrs_scripts * scripts);
+ssize_t pubkeys_to_scripts_batch_parallel(struct thread_pool * pool, const struct bitcoin_addrs_record * records, size_t count,
+	uint32_t types_mask, struct bitcoin_addrs_scripts * scripts);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,120 @@
+#ifndef BITCOIN_ADDRS_UTXO_SNAPSHOT_H_
+#define BITCOIN_ADDRS_UTXO_SNAPSHOT_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "pubkey_to_addrs.h"
+
+/**
+ * Offline UTXO snapshot scanner:
+ *   reads a Bitcoin Core 'dumptxoutset' file (v28+ format: "utxo\xff" magic, coins grouped by txid;
+ *   or the earlier format: one outpoint per coin) and matches every scriptPubKey against a key set.
+ *
+ *   The file is mapped and split into chunks parsed in parallel. Records carry no sync marks:
+ *   a chunk worker finds its first record boundary speculatively (several consecutive records must
+ *   parse with canonical encodings, sane amounts / sizes and ascending outpoints), and the chunk seams
+ *   are verified in file order afterwards: a chunk whose start does not continue its predecessor
+ *   is parsed again from the right offset. Nothing is allocated per output.
+**/
+
+/* what a key set entry is compared with */
+enum utxo_key_kind
+{
+	utxo_key_kind_pubkey_hash,	// hash160(compressed pubkey): p2pk, p2pkh, p2wpkh
+	utxo_key_kind_script_hash,	// hash160(redeem script): p2sh
+	utxo_key_kind_witness_script_hash,	// sha256(witness script): p2wsh
+
+	utxo_key_kinds_count
+};
+
+typedef struct utxo_keyset utxo_keyset_t;
+utxo_keyset_t * utxo_keyset_new(size_t capacity);	// capacity: expected number of keys (a hint, the set grows)
+void utxo_keyset_free(utxo_keyset_t * set);
+size_t utxo_keyset_get_count(const utxo_keyset_t * set);
+
+/**
+ * utxo_keyset_add()
+ * @param key 20 bytes, or 32 bytes for utxo_key_kind_witness_script_hash
+ * @param tag reported with the matches (e.g. the index of the key in the caller's list)
+ * @return 0: added, 1: already in the set (the first tag is kept)
+**/
+int utxo_keyset_add(utxo_keyset_t * set, enum utxo_key_kind kind, const unsigned char * key, uint32_t tag);
+
+/* @return 1 if found (*p_tag set, may be NULL), 0 otherwise */
+int utxo_keyset_find(const utxo_keyset_t * set, enum utxo_key_kind kind, const unsigned char * key, uint32_t * p_tag);
+
+/* every output type of a converted record: hash160 (p2pk / p2pkh / p2wpkh) and the p2sh-p2wpkh script hash */
+void utxo_keyset_add_record(utxo_keyset_t * set, const struct bitcoin_addrs_record * record, uint32_t tag);
+
+/* the p2sh / p2wsh / p2sh-p2wsh hashes of a converted multisig record (multisig_to_addrs.h) */
+struct multisig_record;
+void utxo_keyset_add_multisig(utxo_keyset_t * set, const struct multisig_record * record, uint32_t tag);
+
+/*
+ * scan
+ */
+enum utxo_match_type
+{
+	utxo_match_type_p2pk,
+	utxo_match_type_p2pk_uncompressed,	// output with the uncompressed form of a key in the set
+	utxo_match_type_p2pkh,
+	utxo_match_type_p2sh,
+	utxo_match_type_p2wpkh,
+	utxo_match_type_p2wsh,
+
+	utxo_match_types_count
+};
+const char * utxo_match_type_to_string(enum utxo_match_type type);
+
+struct utxo_match
+{
+	unsigned char txid[32];	// serialized (internal) byte order: reverse it for display
+	uint32_t vout;
+	uint32_t height;
+	int coinbase;
+	uint64_t amount;	// satoshis
+	enum utxo_match_type type;
+	uint32_t tag;	// of the key set entry
+};
+
+/* called on the calling thread, in file order */
+typedef void (* utxo_match_callback)(const struct utxo_match * match, void * user_data);
+
+struct utxo_scan_config
+{
+	size_t chunk_size;	// 0: 64MB
+	struct thread_pool * pool;	// NULL: the process-wide default pool (utils/thread_pool.h)
+};
+
+struct utxo_scan_stats
+{
+	int format_version;	// 0: pre-v28 format, else the snapshot metadata version
+	unsigned char base_blockhash[32];
+	uint64_t coins_count;	// from the metadata
+	uint64_t coins;	// parsed
+	uint64_t bytes;
+	uint64_t matches;
+	uint64_t match_amounts[utxo_match_types_count];	// satoshis
+	uint64_t chunks;
+	uint64_t reparsed_chunks;	// chunks whose speculative start was wrong
+	double elapsed;	// seconds
+};
+
+/**
+ * utxo_snapshot_scan()
+ * @param config may be NULL
+ * @param stats may be NULL
+ * @return 0 on success, -1 if the file can't be read, is malformed, or holds another number of coins
+ *         than its metadata says (matches reported up to the error are kept)
+**/
+int utxo_snapshot_scan(const char * path, const utxo_keyset_t * set, const struct utxo_scan_config * config,
+	utxo_match_callback on_match, void * user_data, struct utxo_scan_stats * stats);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
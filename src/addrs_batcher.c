@@ -0,0 +1,449 @@
+/*
+ * addrs_batcher.c
+ *
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ *
+ * The MIT License (MIT)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "pubkey_to_addrs.h"
+#include "addrs_batcher.h"
+
+#define BATCHER_DEFAULT_BATCH_SIZE	(16)
+#define BATCHER_DEFAULT_DEADLINE_US	(100)
+
+struct addrs_batcher
+{
+	size_t batch_size;
+	int64_t deadline_ns;
+	int num_workers;
+	pthread_t * workers;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;	// CLOCK_MONOTONIC
+	int quit;
+
+	// pending requests (FIFO)
+	struct addrs_batcher_request * head;
+	struct addrs_batcher_request * tail;
+	size_t count;
+
+	// stats, updated under the mutex at dispatch time
+	uint64_t requests;
+	uint64_t batches;
+	uint64_t full_batches;
+	uint64_t deadline_batches;
+	int64_t total_wait_ns;
+	int64_t max_wait_ns;
+	uint64_t batch_sizes[ADDRS_BATCHER_MAX_BATCH_SIZE + 1];
+};
+
+static inline int64_t get_time_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void run_batch(struct addrs_batcher_request ** requests, size_t count)
+{
+	struct bitcoin_addrs_record records[ADDRS_BATCHER_MAX_BATCH_SIZE];
+	uint32_t types_mask = 0;
+	for(size_t i = 0; i < count; ++i) {
+		memcpy(records[i].pubkey, requests[i]->record->pubkey, BITCOIN_ADDRS_PUBKEY_SIZE);
+		types_mask |= requests[i]->types_mask;
+	}
+	pubkeys_to_addrs_batch(records, count, types_mask | BITCOIN_ADDRS_CHECK_PUBKEYS);
+
+	for(size_t i = 0; i < count; ++i) {
+		struct addrs_batcher_request * request = requests[i];
+		struct bitcoin_addrs_record * record = request->record;
+		memcpy(record->hash160, records[i].hash160, BITCOIN_ADDRS_HASH160_SIZE);
+		record->err_code = records[i].err_code;	// BITCOIN_ADDRS_ERR_PUBKEY: not a point of secp256k1
+		for(int type = 0; type < bitcoin_address_types_count; ++type) {
+			if(!record->err_code && (request->types_mask & BITCOIN_ADDRESS_TYPE_MASK(type))) {
+				record->cb_addrs[type] = records[i].cb_addrs[type];
+				memcpy(record->addrs[type], records[i].addrs[type], records[i].cb_addrs[type] + 1);
+			}else {
+				record->cb_addrs[type] = 0;
+				record->addrs[type][0] = '\0';
+			}
+		}
+		if(request->on_completed) request->on_completed(request, request->user_data);	// may release request
+	}
+}
+
+static void * worker_thread(void * user_data)
+{
+	addrs_batcher_t * batcher = user_data;
+	struct addrs_batcher_request * batch[ADDRS_BATCHER_MAX_BATCH_SIZE];
+
+	pthread_mutex_lock(&batcher->mutex);
+	while(1) {
+		if(0 == batcher->count) {
+			if(batcher->quit) break;
+			pthread_cond_wait(&batcher->cond, &batcher->mutex);
+			continue;
+		}
+
+		int64_t now = get_time_ns();
+		int64_t deadline = batcher->head->enqueued_ns + batcher->deadline_ns;
+		int is_full = (batcher->count >= batcher->batch_size);
+		if(!is_full && !batcher->quit && now < deadline) {
+			struct timespec abstime = { .tv_sec = deadline / 1000000000LL, .tv_nsec = deadline % 1000000000LL };
+			pthread_cond_timedwait(&batcher->cond, &batcher->mutex, &abstime);
+			continue;
+		}
+
+		// dispatch the oldest requests
+		size_t count = 0;
+		while(batcher->head && count < batcher->batch_size) {
+			struct addrs_batcher_request * request = batcher->head;
+			batcher->head = request->next;
+			int64_t wait_ns = now - request->enqueued_ns;
+			batcher->total_wait_ns += wait_ns;
+			if(wait_ns > batcher->max_wait_ns) batcher->max_wait_ns = wait_ns;
+			batch[count++] = request;
+		}
+		if(NULL == batcher->head) batcher->tail = NULL;
+		batcher->count -= count;
+
+		batcher->requests += count;
+		++batcher->batches;
+		++batcher->batch_sizes[count];
+		if(is_full) ++batcher->full_batches;
+		else ++batcher->deadline_batches;
+
+		// let another worker arm the next deadline or take the next full batch
+		if(batcher->count > 0) pthread_cond_signal(&batcher->cond);
+
+		pthread_mutex_unlock(&batcher->mutex);
+		run_batch(batch, count);
+		pthread_mutex_lock(&batcher->mutex);
+	}
+	pthread_mutex_unlock(&batcher->mutex);
+	return NULL;
+}
+
+addrs_batcher_t * addrs_batcher_new(const struct addrs_batcher_config * config)
+{
+	addrs_batcher_t * batcher = calloc(1, sizeof(*batcher));
+	assert(batcher);
+
+	size_t batch_size = config?config->batch_size:0;
+	int64_t deadline_us = config?config->deadline_us:-1;
+	int num_workers = config?config->num_workers:0;
+	if(0 == batch_size) batch_size = BATCHER_DEFAULT_BATCH_SIZE;
+	if(batch_size > ADDRS_BATCHER_MAX_BATCH_SIZE) batch_size = ADDRS_BATCHER_MAX_BATCH_SIZE;
+	if(deadline_us < 0) deadline_us = BATCHER_DEFAULT_DEADLINE_US;
+	if(num_workers <= 0) num_workers = 1;
+
+	batcher->batch_size = batch_size;
+	batcher->deadline_ns = deadline_us * 1000;
+	batcher->num_workers = num_workers;
+
+	pthread_mutex_init(&batcher->mutex, NULL);
+	pthread_condattr_t attr;
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&batcher->cond, &attr);
+	pthread_condattr_destroy(&attr);
+
+	batcher->workers = calloc(num_workers, sizeof(*batcher->workers));
+	assert(batcher->workers);
+	for(int i = 0; i < num_workers; ++i) {
+		int rc = pthread_create(&batcher->workers[i], NULL, worker_thread, batcher);
+		assert(0 == rc);
+	}
+	return batcher;
+}
+
+void addrs_batcher_free(addrs_batcher_t * batcher)
+{
+	if(NULL == batcher) return;
+	pthread_mutex_lock(&batcher->mutex);
+	batcher->quit = 1;
+	pthread_cond_broadcast(&batcher->cond);
+	pthread_mutex_unlock(&batcher->mutex);
+
+	for(int i = 0; i < batcher->num_workers; ++i) pthread_join(batcher->workers[i], NULL);
+	free(batcher->workers);
+
+	pthread_cond_destroy(&batcher->cond);
+	pthread_mutex_destroy(&batcher->mutex);
+	free(batcher);
+}
+
+int addrs_batcher_submit(addrs_batcher_t * batcher, struct addrs_batcher_request * request)
+{
+	assert(batcher && request && request->record);
+	if(0 == request->types_mask) request->types_mask = BITCOIN_ADDRESS_TYPES_ALL;
+	request->next = NULL;
+
+	pthread_mutex_lock(&batcher->mutex);
+	if(batcher->quit) {
+		pthread_mutex_unlock(&batcher->mutex);
+		return -1;
+	}
+	request->enqueued_ns = get_time_ns();
+	if(batcher->tail) batcher->tail->next = request;
+	else batcher->head = request;
+	batcher->tail = request;
+	++batcher->count;
+
+	// first request: a worker arms the deadline; full batch: dispatch now
+	if(batcher->count == 1 || batcher->count >= batcher->batch_size) pthread_cond_signal(&batcher->cond);
+	pthread_mutex_unlock(&batcher->mutex);
+	return 0;
+}
+
+struct blocking_wait
+{
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	int done;
+};
+
+static void on_blocking_completed(struct addrs_batcher_request * request, void * user_data)
+{
+	struct blocking_wait * wait = user_data;
+	pthread_mutex_lock(&wait->mutex);
+	wait->done = 1;
+	pthread_cond_signal(&wait->cond);
+	pthread_mutex_unlock(&wait->mutex);
+}
+
+int addrs_batcher_convert(addrs_batcher_t * batcher, struct bitcoin_addrs_record * record, uint32_t types_mask)
+{
+	struct blocking_wait wait = { .mutex = PTHREAD_MUTEX_INITIALIZER, .cond = PTHREAD_COND_INITIALIZER };
+	struct addrs_batcher_request request = {
+		.record = record,
+		.types_mask = types_mask,
+		.on_completed = on_blocking_completed,
+		.user_data = &wait,
+	};
+	int rc = addrs_batcher_submit(batcher, &request);
+	if(0 == rc) {
+		pthread_mutex_lock(&wait.mutex);
+		while(!wait.done) pthread_cond_wait(&wait.cond, &wait.mutex);
+		pthread_mutex_unlock(&wait.mutex);
+		rc = record->err_code?-1:0;
+	}
+	pthread_cond_destroy(&wait.cond);
+	pthread_mutex_destroy(&wait.mutex);
+	return rc;
+}
+
+int addrs_batcher_get_stats(addrs_batcher_t * batcher, struct addrs_batcher_stats * stats)
+{
+	assert(batcher && stats);
+	memset(stats, 0, sizeof(*stats));
+	pthread_mutex_lock(&batcher->mutex);
+	stats->requests = batcher->requests;
+	stats->batches = batcher->batches;
+	stats->full_batches = batcher->full_batches;
+	stats->deadline_batches = batcher->deadline_batches;
+	stats->mean_wait_us = batcher->requests?((double)batcher->total_wait_ns / batcher->requests / 1000.0):0.0;
+	stats->max_wait_us = batcher->max_wait_ns / 1000.0;
+	memcpy(stats->batch_sizes, batcher->batch_sizes, sizeof(stats->batch_sizes));
+	pthread_mutex_unlock(&batcher->mutex);
+
+	if(stats->batches) stats->fill_ratio = (double)stats->requests / ((double)stats->batches * batcher->batch_size);
+	return 0;
+}
+
+#if defined(_TEST_ADDRS_BATCHER) && defined(_STAND_ALONE)
+/*
+ * concurrent blocking callers and async submitters; every result must match a direct
+ * pubkeys_to_addrs_batch() call restricted to the requested types
+ */
+#include "secp256k1_point.h"
+
+#define NUM_KEYS	(4000)
+#define NUM_CALLERS	(4)
+
+static struct bitcoin_addrs_record s_expected[NUM_KEYS];
+
+static void random_pubkey(uint64_t * state, unsigned char pubkey[static BITCOIN_ADDRS_PUBKEY_SIZE])
+{
+	for(int j = 0; j < BITCOIN_ADDRS_PUBKEY_SIZE; ++j) {
+		*state = *state * 6364136223846793005ULL + 1442695040888963407ULL;
+		pubkey[j] = *state >> 56;
+	}
+	pubkey[0] = 0x02 | (pubkey[0] & 1);
+	while(0 != secp256k1_pubkey_check(pubkey)) ++pubkey[BITCOIN_ADDRS_PUBKEY_SIZE - 1];	// a point of the curve
+}
+
+static void check_record(const struct bitcoin_addrs_record * record, size_t index, uint32_t types_mask)
+{
+	const struct bitcoin_addrs_record * expected = &s_expected[index];
+	assert(0 == record->err_code);
+	assert(0 == memcmp(record->hash160, expected->hash160, BITCOIN_ADDRS_HASH160_SIZE));
+	for(int type = 0; type < bitcoin_address_types_count; ++type) {
+		if(types_mask & BITCOIN_ADDRESS_TYPE_MASK(type)) {
+			assert(record->cb_addrs[type] == expected->cb_addrs[type]);
+			assert(0 == strcmp(record->addrs[type], expected->addrs[type]));
+		}else {
+			assert(0 == record->cb_addrs[type]);
+		}
+	}
+}
+
+struct caller_context
+{
+	addrs_batcher_t * batcher;
+	int index;
+};
+
+static void * caller_thread(void * user_data)
+{
+	struct caller_context * ctx = user_data;
+	uint32_t types_mask = (ctx->index < bitcoin_address_types_count)?BITCOIN_ADDRESS_TYPE_MASK(ctx->index):BITCOIN_ADDRESS_TYPES_ALL;
+	for(size_t i = ctx->index; i < NUM_KEYS; i += NUM_CALLERS) {
+		struct bitcoin_addrs_record record[1];
+		memset(record, 0, sizeof(record));
+		memcpy(record->pubkey, s_expected[i].pubkey, BITCOIN_ADDRS_PUBKEY_SIZE);
+		int rc = addrs_batcher_convert(ctx->batcher, record, types_mask);
+		assert(0 == rc);
+		check_record(record, i, types_mask);
+	}
+	return NULL;
+}
+
+static pthread_mutex_t s_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_cond = PTHREAD_COND_INITIALIZER;
+static size_t s_num_completed;
+
+static void on_completed(struct addrs_batcher_request * request, void * user_data)
+{
+	check_record(request->record, (size_t)(uintptr_t)user_data, BITCOIN_ADDRESS_TYPES_ALL);
+	pthread_mutex_lock(&s_mutex);
+	++s_num_completed;
+	pthread_cond_signal(&s_cond);
+	pthread_mutex_unlock(&s_mutex);
+}
+
+static void print_stats(const char * title, addrs_batcher_t * batcher, struct addrs_batcher_stats * stats)
+{
+	addrs_batcher_get_stats(batcher, stats);
+	printf("%-10s requests=%lu, batches=%lu (full=%lu, deadline=%lu), fill_ratio=%.3f, wait(us): mean=%.1f, max=%.1f\n",
+		title, (unsigned long)stats->requests, (unsigned long)stats->batches,
+		(unsigned long)stats->full_batches, (unsigned long)stats->deadline_batches,
+		stats->fill_ratio, stats->mean_wait_us, stats->max_wait_us);
+}
+
+int main(int argc, char ** argv)
+{
+	uint64_t state = 2021;
+	for(size_t i = 0; i < NUM_KEYS; ++i) random_pubkey(&state, s_expected[i].pubkey);
+	ssize_t num_ok = pubkeys_to_addrs_batch(s_expected, NUM_KEYS, BITCOIN_ADDRESS_TYPES_ALL);
+	assert(num_ok == NUM_KEYS);
+
+	struct addrs_batcher_stats stats[1];
+
+	// 1. blocking callers from several threads, each with its own types_mask
+	struct addrs_batcher_config config = { .batch_size = 16, .deadline_us = 200, .num_workers = 2 };
+	addrs_batcher_t * batcher = addrs_batcher_new(&config);
+	struct caller_context callers[NUM_CALLERS];
+	pthread_t threads[NUM_CALLERS];
+	for(int i = 0; i < NUM_CALLERS; ++i) {
+		callers[i] = (struct caller_context){ .batcher = batcher, .index = i };
+		int rc = pthread_create(&threads[i], NULL, caller_thread, &callers[i]);
+		assert(0 == rc);
+	}
+	for(int i = 0; i < NUM_CALLERS; ++i) pthread_join(threads[i], NULL);
+	print_stats("blocking:", batcher, stats);
+	assert(stats->requests == NUM_KEYS);
+	uint64_t total = 0;
+	for(int i = 0; i <= ADDRS_BATCHER_MAX_BATCH_SIZE; ++i) total += stats->batch_sizes[i] * i;
+	assert(total == NUM_KEYS);
+
+	// 2. async submits: every batch but the last is full
+	struct addrs_batcher_request * requests = calloc(NUM_KEYS, sizeof(*requests));
+	struct bitcoin_addrs_record * records = calloc(NUM_KEYS, sizeof(*records));
+	assert(requests && records);
+	for(size_t i = 0; i < NUM_KEYS; ++i) {
+		memcpy(records[i].pubkey, s_expected[i].pubkey, BITCOIN_ADDRS_PUBKEY_SIZE);
+		requests[i] = (struct addrs_batcher_request){
+			.record = &records[i], .on_completed = on_completed, .user_data = (void *)(uintptr_t)i,
+		};
+		int rc = addrs_batcher_submit(batcher, &requests[i]);
+		assert(0 == rc);
+	}
+	pthread_mutex_lock(&s_mutex);
+	while(s_num_completed < NUM_KEYS) pthread_cond_wait(&s_cond, &s_mutex);
+	pthread_mutex_unlock(&s_mutex);
+	print_stats("async:", batcher, stats);
+	assert(stats->requests == 2 * NUM_KEYS);
+	assert(stats->full_batches >= (NUM_KEYS / 16) / 2);
+	addrs_batcher_free(batcher);
+
+	// 3. a lone request waits for the deadline, then goes out in a batch of one
+	config = (struct addrs_batcher_config){ .batch_size = 16, .deadline_us = 5000 };
+	batcher = addrs_batcher_new(&config);
+	struct bitcoin_addrs_record record[1];
+	memcpy(record->pubkey, s_expected[0].pubkey, BITCOIN_ADDRS_PUBKEY_SIZE);
+	int64_t begin_ns = get_time_ns();
+	int rc = addrs_batcher_convert(batcher, record, 0);
+	int64_t elapsed_ns = get_time_ns() - begin_ns;
+	assert(0 == rc);
+	check_record(record, 0, BITCOIN_ADDRESS_TYPES_ALL);
+	print_stats("deadline:", batcher, stats);
+	assert(elapsed_ns >= config.deadline_us * 1000);
+	assert(stats->deadline_batches == 1 && stats->batch_sizes[1] == 1);
+
+	// invalid keys are reported per request: a bad prefix, x off the curve
+	record->pubkey[0] = 0x04;
+	rc = addrs_batcher_convert(batcher, record, 0);
+	assert(-1 == rc && record->err_code == BITCOIN_ADDRS_ERR_PUBKEY);
+	memcpy(record->pubkey, s_expected[0].pubkey, BITCOIN_ADDRS_PUBKEY_SIZE);
+	while(0 == secp256k1_pubkey_check(record->pubkey)) ++record->pubkey[BITCOIN_ADDRS_PUBKEY_SIZE - 1];
+	rc = addrs_batcher_convert(batcher, record, 0);
+	assert(-1 == rc && record->err_code == BITCOIN_ADDRS_ERR_PUBKEY);
+	for(int type = 0; type < bitcoin_address_types_count; ++type) assert(0 == record->cb_addrs[type]);
+	addrs_batcher_free(batcher);
+
+	// 4. deadline 0: no waiting
+	config = (struct addrs_batcher_config){ .deadline_us = 0 };
+	batcher = addrs_batcher_new(&config);
+	memcpy(record->pubkey, s_expected[1].pubkey, BITCOIN_ADDRS_PUBKEY_SIZE);
+	rc = addrs_batcher_convert(batcher, record, 0);
+	assert(0 == rc);
+	check_record(record, 1, BITCOIN_ADDRESS_TYPES_ALL);
+	print_stats("immediate:", batcher, stats);
+	addrs_batcher_free(batcher);
+
+	free(requests);
+	free(records);
+	return 0;
+}
+#endif
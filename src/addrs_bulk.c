@@ -0,0 +1,1672 @@
+/*
+ * addrs_bulk.c
+ *
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ *
+ * The MIT License (MIT)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+#include <endian.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/stat.h>
+
+#include "utils.h"
+#include "arena.h"
+#include "pubkey_to_addrs.h"
+#include "privkey_to_addrs.h"
+#include "crc32c.h"
+#include "addrs_stats.h"
+#include "addrs_output.h"
+#include "addrs_io.h"
+#include "addrs_bulk.h"
+
+#define BULK_DEFAULT_CHUNK_SIZE	(1 << 20)
+#define BULK_BATCH_SIZE		(64)
+#define BULK_CACHELINE_SIZE	(64)
+#define BULK_MAX_COMPLETIONS	(64)
+#define BULK_DEFAULT_CHECKPOINT_INTERVAL	(30.0)	// seconds
+#define BULK_VERIFY_BLOCK_SIZE	(1 << 20)
+#define BULK_INPUT_WINDOW_SIZE	(1 << 16)	// input bytes before the checkpoint's offset that identify the input
+
+static const char * s_error_names[addrs_bulk_errors_count] = {
+	[addrs_bulk_error_pubkey_length] = "pubkey_length",
+	[addrs_bulk_error_pubkey_hex] = "pubkey_hex",
+	[addrs_bulk_error_pubkey_point] = "pubkey_point",
+	[addrs_bulk_error_privkey] = "privkey",
+	[addrs_bulk_error_encode] = "encode",
+	[addrs_bulk_error_io] = "io",
+};
+
+static const char * s_input_format_names[addrs_bulk_input_formats_count] = {
+	[addrs_bulk_input_format_pubkey] = "pubkey",
+	[addrs_bulk_input_format_wif] = "wif",
+};
+
+enum addrs_bulk_input_format addrs_bulk_input_format_from_string(const char * format)
+{
+	if(NULL == format) return -1;
+	for(int i = 0; i < addrs_bulk_input_formats_count; ++i) {
+		if(strcasecmp(format, s_input_format_names[i]) == 0) return i;
+	}
+	return -1;
+}
+
+const char * addrs_bulk_input_format_to_string(enum addrs_bulk_input_format format)
+{
+	if(format < 0 || format >= addrs_bulk_input_formats_count) return NULL;
+	return s_input_format_names[format];
+}
+
+const char * addrs_bulk_error_to_string(enum addrs_bulk_error err)
+{
+	if(err < 0 || err >= addrs_bulk_errors_count) return NULL;
+	return s_error_names[err];
+}
+
+static inline uint64_t get_time_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/******************************************************************************
+ * latency histogram
+******************************************************************************/
+static inline int latency_bucket_index(uint64_t ns)
+{
+	if(ns < 2) return 0;
+	int msb = 63 - __builtin_clzll(ns);
+	int index = msb * 2 + (int)((ns >> (msb - 1)) & 1);
+	if(index >= ADDRS_LATENCY_BUCKETS) index = ADDRS_LATENCY_BUCKETS - 1;
+	return index;
+}
+
+static inline double latency_bucket_upper_bound(int index)
+{
+	// even index: [2^m, 1.5 * 2^m), odd index: [1.5 * 2^m, 2^(m+1))
+	double base = (double)(1ULL << (index / 2));
+	return (index & 1)?(base * 2.0):(base * 1.5);
+}
+
+double addrs_latency_histogram_quantile(const struct addrs_latency_histogram * hist, double quantile)
+{
+	assert(hist);
+	if(0 == hist->count) return 0.0;
+
+	uint64_t total = 0;
+	for(int i = 0; i < ADDRS_LATENCY_BUCKETS; ++i) total += hist->buckets[i];
+	if(0 == total) return 0.0;
+
+	double target = quantile * (double)total;
+	uint64_t accumulated = 0;
+	for(int i = 0; i < ADDRS_LATENCY_BUCKETS; ++i) {
+		accumulated += hist->buckets[i];
+		if((double)accumulated >= target) return latency_bucket_upper_bound(i) / 1e9;
+	}
+	return latency_bucket_upper_bound(ADDRS_LATENCY_BUCKETS - 1) / 1e9;
+}
+
+#define relaxed_load(p) __atomic_load_n(p, __ATOMIC_RELAXED)
+#define relaxed_store(p, value) __atomic_store_n(p, value, __ATOMIC_RELAXED)
+#define relaxed_add(p, value) relaxed_store(p, relaxed_load(p) + (value))
+
+static inline void latency_histogram_add(struct addrs_latency_histogram * hist, uint64_t ns, uint64_t weight)
+{
+	// single writer per histogram
+	relaxed_add(&hist->count, weight);
+	relaxed_add(&hist->sum_ns, ns * weight);
+	relaxed_add(&hist->buckets[latency_bucket_index(ns)], weight);
+}
+
+static void latency_histogram_merge(struct addrs_latency_histogram * dst, const struct addrs_latency_histogram * src)
+{
+	dst->count += relaxed_load(&src->count);
+	dst->sum_ns += relaxed_load(&src->sum_ns);
+	for(int i = 0; i < ADDRS_LATENCY_BUCKETS; ++i) dst->buckets[i] += relaxed_load(&src->buckets[i]);
+}
+
+/******************************************************************************
+ * addrs_bulk
+******************************************************************************/
+enum bulk_slot_state
+{
+	bulk_slot_state_free,
+	bulk_slot_state_reading,	// owned by the reader, read in flight
+	bulk_slot_state_filled,
+	bulk_slot_state_claimed,
+	bulk_slot_state_done,
+	bulk_slot_state_writing,	// owned by the writer, write in flight
+};
+
+/*
+ * in_buf: [ carry area (chunk_size) | read area (chunk_size) ]
+ *   reads land in the read area, the unfinished line of the previous chunk is copied
+ *   right in front of it, so in_data = read area - cb_carry.
+ */
+struct bulk_slot
+{
+	enum bulk_slot_state state;
+	uint64_t seq;
+	uint64_t filled_ns;
+
+	char * in_buf;
+	char * in_data;
+	size_t in_len;
+
+	char * out_buf;
+	size_t out_size;
+	size_t out_len;
+	int64_t in_end;	// input offset right after the chunk's last complete line (seekable input)
+	uint64_t num_keys;
+
+	// async I/O progress
+	int64_t io_offset;	// output file offset, -1: current position
+	size_t io_len;	// bytes transferred so far
+	int io_done;
+	int io_error;
+};
+
+/* per-thread counters, written only by the owner thread */
+struct bulk_counters
+{
+	uint64_t keys;
+	uint64_t errors[addrs_bulk_errors_count];
+	uint64_t bytes;
+	uint64_t chunks;
+	struct addrs_latency_histogram latency;
+}__attribute__((aligned(BULK_CACHELINE_SIZE)));
+
+struct bulk_worker
+{
+	addrs_bulk_t * bulk;
+	pthread_t th;
+	int shard;
+	struct bulk_counters * counters;
+	arena_t * arena;	// per-batch scratch of the library calls, reset after every flush
+	struct bitcoin_addrs_record records[BULK_BATCH_SIZE];
+};
+
+struct addrs_bulk
+{
+	struct addrs_bulk_config config;
+	size_t max_record_size;	// output bytes per key, upper bound
+	int fd_in;
+	int fd_out;
+	int64_t in_offset;	// -1: not seekable (pipe), reads are serialized
+	int64_t out_offset;	// -1: not seekable or O_APPEND, writes are serialized
+	uint64_t start_ns;
+
+	enum addrs_io_backend io_backend;	// resolved by addrs_bulk_run()
+	enum huge_pages_mode huge_pages;	// obtained for the chunk buffers
+	addrs_io_t * io_in;	// owned by the reader thread
+	addrs_io_t * io_out;	// owned by the writer
+	int in_registered;	// slot read areas registered with io_in
+	int out_registered;
+	struct iovec * out_iovecs;	// output buffers as registered with io_out
+
+	pthread_mutex_t mutex;
+	pthread_cond_t * cond_filled;	// per shard
+	pthread_cond_t cond_done;
+	pthread_cond_t cond_free;
+
+	// chunk seq -> slot (seq % num_slots) -> shard (seq % num_shards); num_slots is a multiple of num_shards
+	int num_shards;
+	int * shard_nodes;	// NULL: not sharded
+	cpu_set_t * shard_cpus;
+
+	size_t num_slots;
+	struct bulk_slot * slots;
+	uint64_t next_fill;
+	uint64_t * next_claim;	// per shard, the next chunk of that shard
+	uint64_t num_claimed;
+	uint64_t next_write;
+	int eof;
+	int quit;
+
+	// checkpoints: chunks are committed in input order once written
+	uint64_t next_commit;	// writer only
+	struct addrs_bulk_checkpoint committed;	// the commit watermark, guarded by mutex
+	struct addrs_bulk_checkpoint durable;	// the last one saved, checkpoint thread only
+	int resumed;
+	int checkpoint_quit;
+	pthread_cond_t cond_checkpoint;
+	pthread_t checkpointer;
+
+	pthread_t reader;
+	struct bulk_counters * reader_counters;	// bytes/chunks read, io errors
+	struct bulk_counters * writer_counters;	// bytes/chunks written, chunk latency
+
+	int num_workers;
+	struct bulk_worker * workers;
+	struct bulk_counters * worker_counters;
+};
+
+static struct bulk_counters * bulk_counters_new(size_t count)
+{
+	struct bulk_counters * counters = aligned_alloc(BULK_CACHELINE_SIZE, sizeof(*counters) * count);
+	assert(counters);
+	memset(counters, 0, sizeof(*counters) * count);
+	return counters;
+}
+
+/* chunk buffer: page-aligned, the untouched pages preferring the given node (node < 0: no preference) */
+static void * buffer_alloc(addrs_bulk_t * bulk, size_t size, int node)
+{
+	enum huge_pages_mode obtained = huge_pages_none;
+	void * buf = page_alloc(size, bulk->config.huge_pages, node, &obtained);
+	assert(buf);
+	if(obtained < bulk->huge_pages) bulk->huge_pages = obtained;
+	return buf;
+}
+
+static int slot_node(const addrs_bulk_t * bulk, const struct bulk_slot * slot)
+{
+	if(NULL == bulk->shard_nodes) return -1;
+	return bulk->shard_nodes[(slot - bulk->slots) % bulk->num_shards];
+}
+
+/* shards over the host's NUMA nodes, workers are assigned round-robin */
+static void setup_shards(addrs_bulk_t * bulk)
+{
+	int num_shards = bulk->config.numa_shards;
+	bulk->num_shards = 1;
+	if(0 == num_shards) return;
+
+	int * cpus = calloc(CPU_SETSIZE, sizeof(*cpus));
+	int * cpu_nodes = calloc(CPU_SETSIZE, sizeof(*cpu_nodes));
+	assert(cpus && cpu_nodes);
+	int num_nodes = 1;
+	int num_cpus = get_cpu_topology(cpus, cpu_nodes, CPU_SETSIZE, &num_nodes);
+
+	if(num_shards < 0) num_shards = num_nodes;
+	if(num_shards > bulk->num_workers) num_shards = bulk->num_workers;	// every shard needs a worker
+	bulk->num_shards = num_shards;
+	bulk->shard_nodes = calloc(num_shards, sizeof(*bulk->shard_nodes));
+	bulk->shard_cpus = calloc(num_shards, sizeof(*bulk->shard_cpus));
+	assert(bulk->shard_nodes && bulk->shard_cpus);
+	for(int shard = 0; shard < num_shards; ++shard) {
+		int node = shard % num_nodes;
+		bulk->shard_nodes[shard] = node;
+		CPU_ZERO(&bulk->shard_cpus[shard]);
+		for(int i = 0; i < num_cpus; ++i) if(cpu_nodes[i] == node) CPU_SET(cpus[i], &bulk->shard_cpus[shard]);
+	}
+	free(cpus);
+	free(cpu_nodes);
+}
+
+static inline void slot_reserve(addrs_bulk_t * bulk, struct bulk_slot * slot, size_t size)
+{
+	if((slot->out_len + size) <= slot->out_size) return;
+	size_t new_size = slot->out_size?(slot->out_size * 2):(1 << 20);
+	while(new_size < (slot->out_len + size)) new_size *= 2;
+	char * out_buf = page_alloc(new_size, bulk->config.huge_pages, slot_node(bulk, slot), NULL);
+	assert(out_buf);
+	memcpy(out_buf, slot->out_buf, slot->out_len);
+	page_free(slot->out_buf, slot->out_size, bulk->config.huge_pages);
+	slot->out_buf = out_buf;
+	slot->out_size = new_size;
+}
+
+addrs_bulk_t * addrs_bulk_new(const struct addrs_bulk_config * config)
+{
+	assert(config);
+	addrs_bulk_t * bulk = calloc(1, sizeof(*bulk));
+	assert(bulk);
+
+	bulk->config = *config;
+	if(bulk->config.chunk_size == 0) bulk->config.chunk_size = BULK_DEFAULT_CHUNK_SIZE;
+	if(bulk->config.types_mask == 0) bulk->config.types_mask = BITCOIN_ADDRESS_TYPES_ALL;
+	if(NULL == bulk->config.checkpoint_file) bulk->config.resume = 0;
+	bulk->max_record_size = addrs_output_max_record_size(bulk->config.format, bulk->config.types_mask);
+
+	int num_workers = bulk->config.num_threads;
+	if(num_workers <= 0) num_workers = sysconf(_SC_NPROCESSORS_ONLN);
+	if(num_workers <= 0) num_workers = 1;
+	bulk->num_workers = num_workers;
+	bulk->fd_in = -1;
+	bulk->fd_out = -1;
+	bulk->io_backend = bulk->config.io_backend;
+	if(bulk->config.huge_pages < 0 || bulk->config.huge_pages >= huge_pages_modes_count) bulk->config.huge_pages = huge_pages_none;
+	bulk->huge_pages = bulk->config.huge_pages;
+
+	setup_shards(bulk);
+	const int num_shards = bulk->num_shards;
+
+	pthread_mutex_init(&bulk->mutex, NULL);
+	bulk->cond_filled = calloc(num_shards, sizeof(*bulk->cond_filled));
+	bulk->next_claim = calloc(num_shards, sizeof(*bulk->next_claim));
+	assert(bulk->cond_filled && bulk->next_claim);
+	for(int shard = 0; shard < num_shards; ++shard) {
+		pthread_cond_init(&bulk->cond_filled[shard], NULL);
+		bulk->next_claim[shard] = shard;
+	}
+	pthread_cond_init(&bulk->cond_done, NULL);
+	pthread_cond_init(&bulk->cond_free, NULL);
+	pthread_cond_init(&bulk->cond_checkpoint, NULL);
+
+	// each slot carries at most 2 chunks: the unfinished line of the previous chunk + a new chunk
+	bulk->num_slots = num_workers * 2 + 2;
+	bulk->num_slots = (bulk->num_slots + num_shards - 1) / num_shards * num_shards;
+	// pre-size the output buffers for a full chunk of minimal lines (66 hex digits / 52-char WIFs + '\n'),
+	// formatting then never reallocates in the steady state
+	size_t min_line_size = (bulk->config.input_format == addrs_bulk_input_format_wif)?(BITCOIN_ADDRS_WIF_MAX_LENGTH + 1)
+		:(BITCOIN_ADDRS_PUBKEY_SIZE * 2 + 1);
+	size_t out_size = (bulk->config.chunk_size / min_line_size + BULK_BATCH_SIZE) * bulk->max_record_size;
+	bulk->slots = calloc(bulk->num_slots, sizeof(*bulk->slots));
+	assert(bulk->slots);
+	for(size_t i = 0; i < bulk->num_slots; ++i) {
+		struct bulk_slot * slot = &bulk->slots[i];
+		int node = slot_node(bulk, slot);
+		slot->in_buf = buffer_alloc(bulk, bulk->config.chunk_size * 2, node);
+		slot->out_buf = buffer_alloc(bulk, out_size, node);
+		slot->out_size = out_size;
+	}
+	if(bulk->huge_pages < bulk->config.huge_pages) {
+		if(bulk->huge_pages == huge_pages_transparent) {
+			fprintf(stderr, "[bulk]: MAP_HUGETLB failed (no huge pages reserved in /proc/sys/vm/nr_hugepages?), "
+				"falling back to transparent huge pages\n");
+		}else {
+			fprintf(stderr, "[bulk]: huge pages unavailable (transparent huge pages disabled?), "
+				"falling back to regular pages\n");
+		}
+	}
+
+	bulk->reader_counters = bulk_counters_new(1);
+	bulk->writer_counters = bulk_counters_new(1);
+	bulk->worker_counters = bulk_counters_new(num_workers);
+	bulk->workers = calloc(num_workers, sizeof(*bulk->workers));
+	assert(bulk->workers);
+	for(int i = 0; i < num_workers; ++i) {
+		bulk->workers[i].bulk = bulk;
+		bulk->workers[i].shard = i % num_shards;
+		bulk->workers[i].counters = &bulk->worker_counters[i];
+	}
+	return bulk;
+}
+
+void addrs_bulk_free(addrs_bulk_t * bulk)
+{
+	if(NULL == bulk) return;
+	for(size_t i = 0; i < bulk->num_slots; ++i) {
+		page_free(bulk->slots[i].in_buf, bulk->config.chunk_size * 2, bulk->config.huge_pages);
+		page_free(bulk->slots[i].out_buf, bulk->slots[i].out_size, bulk->config.huge_pages);
+	}
+	free(bulk->slots);
+	free(bulk->out_iovecs);
+	free(bulk->workers);
+	free(bulk->worker_counters);
+	free(bulk->reader_counters);
+	free(bulk->writer_counters);
+	free(bulk->shard_nodes);
+	free(bulk->shard_cpus);
+
+	pthread_mutex_destroy(&bulk->mutex);
+	for(int shard = 0; shard < bulk->num_shards; ++shard) pthread_cond_destroy(&bulk->cond_filled[shard]);
+	free(bulk->cond_filled);
+	free(bulk->next_claim);
+	pthread_cond_destroy(&bulk->cond_done);
+	pthread_cond_destroy(&bulk->cond_free);
+	pthread_cond_destroy(&bulk->cond_checkpoint);
+	free(bulk);
+}
+
+static int write_fully(int fd, const char * buf, size_t size)
+{
+	while(size > 0) {
+		ssize_t cb = write(fd, buf, size);
+		if(cb < 0) {
+			if(errno == EINTR) continue;
+			return -1;
+		}
+		buf += cb;
+		size -= cb;
+	}
+	return 0;
+}
+
+static inline int io_retryable(ssize_t result)
+{
+	return (result == -EINTR || result == -EAGAIN);
+}
+
+static void submit_slot_read(addrs_bulk_t * bulk, struct bulk_slot * slot)
+{
+	const size_t chunk_size = bulk->config.chunk_size;
+	char * read_area = slot->in_buf + chunk_size;
+	int64_t offset = -1;
+	if(bulk->in_offset >= 0) offset = bulk->in_offset + (int64_t)(slot->seq * chunk_size) + slot->io_len;
+
+	int buf_index = bulk->in_registered?(int)(slot - bulk->slots):-1;
+	int rc = addrs_io_submit_read(bulk->io_in, bulk->fd_in,
+		read_area + slot->io_len, chunk_size - slot->io_len, offset, buf_index, slot->seq);
+	assert(0 == rc);	// in flight <= num_slots == queue depth
+}
+
+/*
+ * reader:
+ *   keeps a read in flight for every free slot (one at a time for pipes), reads complete in any order,
+ *   chunks are handed to the workers in file order once the unfinished line of the previous one is prepended.
+ */
+static void * reader_thread(void * user_data)
+{
+	addrs_bulk_t * bulk = user_data;
+	struct bulk_counters * counters = bulk->reader_counters;
+	const size_t chunk_size = bulk->config.chunk_size;
+	const size_t num_slots = bulk->num_slots;
+	const unsigned int max_in_flight = (bulk->in_offset < 0)?1:num_slots;
+
+	char * carry = malloc(chunk_size);
+	assert(carry);
+	size_t cb_carry = 0;
+
+	uint64_t next_submit = 0;	// next chunk to read
+	uint64_t next_publish = 0;	// next chunk to hand to the workers
+	uint64_t eof_seq = UINT64_MAX;	// the chunk that reached the end of the input (or failed)
+	unsigned int in_flight = 0;
+	struct addrs_io_completion completions[BULK_MAX_COMPLETIONS];
+
+	while(1) {
+		// start reads into free slots
+		uint64_t first = next_submit;
+		pthread_mutex_lock(&bulk->mutex);
+		int quit = bulk->quit;
+		while(!quit && eof_seq == UINT64_MAX && in_flight < max_in_flight) {
+			struct bulk_slot * slot = &bulk->slots[next_submit % num_slots];
+			if(slot->state != bulk_slot_state_free) break;
+			slot->state = bulk_slot_state_reading;
+			slot->seq = next_submit++;
+			slot->io_len = 0;
+			slot->io_done = 0;
+			slot->io_error = 0;
+			++in_flight;
+		}
+		if(0 == in_flight) {
+			if(quit || eof_seq != UINT64_MAX) {
+				pthread_mutex_unlock(&bulk->mutex);
+				break;
+			}
+			// every slot is busy with the workers or the writer
+			pthread_cond_wait(&bulk->cond_free, &bulk->mutex);
+			pthread_mutex_unlock(&bulk->mutex);
+			continue;
+		}
+		pthread_mutex_unlock(&bulk->mutex);
+
+		for(uint64_t seq = first; seq < next_submit; ++seq) submit_slot_read(bulk, &bulk->slots[seq % num_slots]);
+
+		int n = addrs_io_wait(bulk->io_in, completions, BULK_MAX_COMPLETIONS, 1);
+		assert(n >= 0);
+		for(int i = 0; i < n; ++i) {
+			uint64_t seq = completions[i].user_data;
+			ssize_t result = completions[i].result;
+			struct bulk_slot * slot = &bulk->slots[seq % num_slots];
+			assert(slot->state == bulk_slot_state_reading && slot->seq == seq);
+
+			if(io_retryable(result)) {
+				submit_slot_read(bulk, slot);
+				continue;
+			}
+			if(result < 0) {
+				errno = -result;
+				perror("read");
+				relaxed_add(&counters->errors[addrs_bulk_error_io], 1);
+				slot->io_error = 1;
+			}else {
+				slot->io_len += result;
+				relaxed_add(&counters->bytes, result);
+				if(result > 0 && slot->io_len < chunk_size && seq < eof_seq) {
+					submit_slot_read(bulk, slot);	// short read: fill the rest of the chunk
+					continue;
+				}
+			}
+			if((result <= 0) && seq < eof_seq) eof_seq = seq;
+			slot->io_done = 1;
+			--in_flight;
+		}
+
+		// hand completed chunks to the workers, in order
+		while(next_publish < next_submit) {
+			struct bulk_slot * slot = &bulk->slots[next_publish % num_slots];
+			if(!slot->io_done) break;
+
+			size_t in_len = 0;
+			if(next_publish <= eof_seq) {
+				char * read_area = slot->in_buf + chunk_size;
+				slot->in_data = read_area - cb_carry;
+				memcpy(slot->in_data, carry, cb_carry);
+				in_len = cb_carry + slot->io_len;
+				cb_carry = 0;
+
+				if(next_publish != eof_seq) {
+					// keep the unfinished last line for the next chunk
+					char * p_end = slot->in_data + in_len;
+					char * p = p_end;
+					while(p > slot->in_data && p[-1] != '\n') --p;
+					if(p > slot->in_data && (size_t)(p_end - p) < chunk_size) {
+						cb_carry = p_end - p;
+						memcpy(carry, p, cb_carry);
+						in_len -= cb_carry;
+					}
+				}
+				if(bulk->in_offset >= 0) slot->in_end = bulk->in_offset + (int64_t)(slot->seq * chunk_size + slot->io_len - cb_carry);
+			}
+			++next_publish;
+
+			pthread_mutex_lock(&bulk->mutex);
+			if(0 == in_len) {
+				// empty tail, or a read issued past the end of the input
+				slot->state = bulk_slot_state_free;
+			}else {
+				assert(slot->seq == bulk->next_fill);
+				slot->in_len = in_len;
+				slot->out_len = 0;
+				slot->num_keys = 0;
+				slot->filled_ns = get_time_ns();
+				slot->state = bulk_slot_state_filled;
+				__atomic_store_n(&bulk->next_fill, bulk->next_fill + 1, __ATOMIC_RELEASE);
+				pthread_cond_signal(&bulk->cond_filled[slot->seq % bulk->num_shards]);
+				relaxed_add(&counters->chunks, 1);
+			}
+			pthread_mutex_unlock(&bulk->mutex);
+		}
+	}
+
+	pthread_mutex_lock(&bulk->mutex);
+	bulk->eof = 1;
+	for(int shard = 0; shard < bulk->num_shards; ++shard) pthread_cond_broadcast(&bulk->cond_filled[shard]);
+	pthread_cond_broadcast(&bulk->cond_done);
+	pthread_mutex_unlock(&bulk->mutex);
+
+	free(carry);
+	return NULL;
+}
+
+static void flush_records(struct bulk_worker * worker, struct bulk_slot * slot, size_t count)
+{
+	addrs_bulk_t * bulk = worker->bulk;
+	struct bulk_counters * counters = worker->counters;
+	const uint32_t types_mask = bulk->config.types_mask;
+	if(0 == count) return;
+
+	uint64_t begin_ns = get_time_ns();
+	pubkeys_to_addrs_batch(worker->records, count, types_mask | (bulk->config.check_pubkeys?BITCOIN_ADDRS_CHECK_PUBKEYS:0));
+	uint64_t end_ns = get_time_ns();
+	latency_histogram_add(&counters->latency, (end_ns - begin_ns) / count, count);
+
+	uint64_t num_keys = 0;
+	for(size_t i = 0; i < count; ++i) {
+		int err_code = worker->records[i].err_code;
+		if(err_code == BITCOIN_ADDRS_ERR_PUBKEY) relaxed_add(&counters->errors[addrs_bulk_error_pubkey_point], 1);
+		else if(err_code) relaxed_add(&counters->errors[addrs_bulk_error_encode], 1);
+		else ++num_keys;
+	}
+
+	ADDRS_STATS_BEGIN(output);
+	slot_reserve(bulk, slot, count * bulk->max_record_size);
+	slot->out_len += addrs_output_format_records(bulk->config.format, types_mask,
+		worker->records, count, slot->out_buf + slot->out_len);
+	ADDRS_STATS_END(output, addrs_stats_stage_output);
+	relaxed_add(&counters->keys, num_keys);
+	slot->num_keys += num_keys;
+	if(worker->arena) arena_reset(worker->arena);
+}
+
+/* WIF line -> compressed pubkey (the private key only lives on the stack) */
+static int parse_wif(const char * line, size_t cb_line, unsigned char pubkey[static BITCOIN_ADDRS_PUBKEY_SIZE])
+{
+	unsigned char privkey[BITCOIN_ADDRS_PRIVKEY_SIZE];
+	int compressed = 0;
+	int rc = wif_decode(line, cb_line, privkey, &compressed);
+	if(0 == rc) rc = compressed?privkey_to_pubkey(privkey, pubkey):-1;
+	explicit_bzero(privkey, sizeof(privkey));
+	return rc;
+}
+
+static void process_chunk(struct bulk_worker * worker, struct bulk_slot * slot)
+{
+	struct bulk_counters * counters = worker->counters;
+	const int wif_input = (worker->bulk->config.input_format == addrs_bulk_input_format_wif);
+	const char * p = slot->in_data;
+	const char * p_end = p + slot->in_len;
+	size_t count = 0;
+
+	while(p < p_end) {
+		const char * line = p;
+		const char * eol = memchr(p, '\n', p_end - p);
+		if(NULL == eol) eol = p_end;
+		p = eol + 1;
+
+		// trim
+		while(line < eol && (*line == ' ' || *line == '\t')) ++line;
+		const char * line_end = eol;
+		while(line_end > line && (line_end[-1] == '\r' || line_end[-1] == ' ' || line_end[-1] == '\t')) --line_end;
+		if(line == line_end || line[0] == '#') continue;
+
+		if(wif_input) {
+			if(parse_wif(line, line_end - line, worker->records[count].pubkey) != 0) {
+				ADDRS_STATS_ERROR(addrs_stats_error_privkey);
+				relaxed_add(&counters->errors[addrs_bulk_error_privkey], 1);
+				continue;
+			}
+			if(++count == BULK_BATCH_SIZE) {
+				flush_records(worker, slot, count);
+				count = 0;
+			}
+			continue;
+		}
+
+		if((line_end - line) != (BITCOIN_ADDRS_PUBKEY_SIZE * 2)) {
+			ADDRS_STATS_ERROR(addrs_stats_error_pubkey_length);
+			relaxed_add(&counters->errors[addrs_bulk_error_pubkey_length], 1);
+			continue;
+		}
+
+		void * pubkey = worker->records[count].pubkey;
+		ADDRS_STATS_BEGIN(hex_parse);
+		ssize_t cb = hex2bin(line, BITCOIN_ADDRS_PUBKEY_SIZE * 2, &pubkey);
+		ADDRS_STATS_END(hex_parse, addrs_stats_stage_hex_parse);
+		if(cb != BITCOIN_ADDRS_PUBKEY_SIZE) {
+			ADDRS_STATS_ERROR(addrs_stats_error_pubkey_hex);
+			relaxed_add(&counters->errors[addrs_bulk_error_pubkey_hex], 1);
+			continue;
+		}
+
+		if(++count == BULK_BATCH_SIZE) {
+			flush_records(worker, slot, count);
+			count = 0;
+		}
+	}
+	flush_records(worker, slot, count);
+	relaxed_add(&counters->chunks, 1);
+}
+
+static void * worker_thread(void * user_data)
+{
+	struct bulk_worker * worker = user_data;
+	addrs_bulk_t * bulk = worker->bulk;
+	const int shard = worker->shard;
+	uint64_t * next_claim = &bulk->next_claim[shard];
+	if(bulk->shard_cpus) pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &bulk->shard_cpus[shard]);
+
+	// created after pinning, so that its pages are first touched on the worker's node
+	worker->arena = arena_new(0, 0);
+	arena_attach(worker->arena);
+
+	while(1) {
+		pthread_mutex_lock(&bulk->mutex);
+		while(!bulk->quit && *next_claim >= bulk->next_fill && !bulk->eof) {
+			pthread_cond_wait(&bulk->cond_filled[shard], &bulk->mutex);
+		}
+		if(bulk->quit || *next_claim >= bulk->next_fill) {
+			// eof and nothing left to claim
+			pthread_mutex_unlock(&bulk->mutex);
+			break;
+		}
+		struct bulk_slot * slot = &bulk->slots[*next_claim % bulk->num_slots];
+		assert(slot->state == bulk_slot_state_filled && slot->seq == *next_claim);
+		slot->state = bulk_slot_state_claimed;
+		*next_claim += bulk->num_shards;
+		__atomic_store_n(&bulk->num_claimed, bulk->num_claimed + 1, __ATOMIC_RELEASE);
+		pthread_mutex_unlock(&bulk->mutex);
+
+		process_chunk(worker, slot);
+
+		pthread_mutex_lock(&bulk->mutex);
+		slot->state = bulk_slot_state_done;
+		pthread_cond_signal(&bulk->cond_done);
+		pthread_mutex_unlock(&bulk->mutex);
+	}
+	arena_attach(NULL);
+	arena_free(worker->arena);
+	worker->arena = NULL;
+	return NULL;
+}
+
+static int open_files(addrs_bulk_t * bulk)
+{
+	const char * input_file = bulk->config.input_file;
+	const char * output_file = bulk->config.output_file;
+
+	if(NULL == input_file || strcmp(input_file, "-") == 0) bulk->fd_in = STDIN_FILENO;
+	else {
+		bulk->fd_in = open(input_file, O_RDONLY);
+		if(bulk->fd_in < 0) {
+			fprintf(stderr, "open input file '%s' failed: %s\n", input_file, strerror(errno));
+			return -1;
+		}
+	}
+
+	if(NULL == output_file || strcmp(output_file, "-") == 0) bulk->fd_out = STDOUT_FILENO;
+	else {
+		// resuming keeps the converted part, read back, verified and truncated by resume_files()
+		int flags = bulk->config.resume?O_RDWR:(O_WRONLY | O_TRUNC);
+		bulk->fd_out = open(output_file, flags | O_CREAT, 0644);
+		if(bulk->fd_out < 0) {
+			fprintf(stderr, "open output file '%s' failed: %s\n", output_file, strerror(errno));
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static void close_files(addrs_bulk_t * bulk)
+{
+	if(bulk->fd_in > STDERR_FILENO) close(bulk->fd_in);
+	if(bulk->fd_out > STDERR_FILENO) close(bulk->fd_out);
+	bulk->fd_in = -1;
+	bulk->fd_out = -1;
+}
+
+/******************************************************************************
+ * checkpoints
+ *   file: [ magic (8) | in_offset | out_offset | keys (u64 LE) | out_crc | in_crc | config_crc (u32 LE) | crc32c of the rest ]
+******************************************************************************/
+static const unsigned char s_checkpoint_magic[8] = "P2ACKPT1";
+#define CHECKPOINT_FILE_SIZE	(8 + 8 * 3 + 4 * 4)
+
+static uint32_t config_crc(const struct addrs_bulk_config * config)
+{
+	uint32_t fields[4] = {
+		htole32(config->format), htole32(config->types_mask), htole32(config->input_format), htole32(config->check_pubkeys != 0),
+	};
+	return crc32c(fields, sizeof(fields));
+}
+
+/* crc32c of input[in_offset - BULK_INPUT_WINDOW_SIZE .. in_offset) (from 0 when in_offset is smaller) */
+static int input_window_crc(int fd_in, uint64_t in_offset, uint32_t * p_crc)
+{
+	size_t size = (in_offset < BULK_INPUT_WINDOW_SIZE)?in_offset:BULK_INPUT_WINDOW_SIZE;
+	char * window = malloc(size + 1);
+	assert(window);
+	size_t cb_window = 0;
+	while(cb_window < size) {
+		ssize_t cb = pread(fd_in, window + cb_window, size - cb_window, in_offset - size + cb_window);
+		if(cb < 0 && errno == EINTR) continue;
+		if(cb <= 0) break;
+		cb_window += cb;
+	}
+	*p_crc = crc32c(window, cb_window);
+	free(window);
+	return (cb_window == size)?0:-1;
+}
+
+int addrs_bulk_checkpoint_load(const char * path, struct addrs_bulk_checkpoint * checkpoint)
+{
+	assert(path && checkpoint);
+	unsigned char data[CHECKPOINT_FILE_SIZE + 1];
+	int fd = open(path, O_RDONLY);
+	if(fd < 0) return (errno == ENOENT)?1:-1;
+	ssize_t cb = read(fd, data, sizeof(data));
+	close(fd);
+	if(cb != CHECKPOINT_FILE_SIZE || memcmp(data, s_checkpoint_magic, 8) != 0) return -1;
+
+	uint64_t u64[3];
+	uint32_t u32[4];
+	memcpy(u64, data + 8, sizeof(u64));
+	memcpy(u32, data + 8 + sizeof(u64), sizeof(u32));
+	if(le32toh(u32[3]) != crc32c(data, CHECKPOINT_FILE_SIZE - 4)) return -1;
+	checkpoint->in_offset = le64toh(u64[0]);
+	checkpoint->out_offset = le64toh(u64[1]);
+	checkpoint->keys = le64toh(u64[2]);
+	checkpoint->out_crc = le32toh(u32[0]);
+	checkpoint->in_crc = le32toh(u32[1]);
+	checkpoint->config_crc = le32toh(u32[2]);
+	return 0;
+}
+
+/*
+ * the output is made durable first, then the checkpoint replaces the previous one atomically (rename);
+ * the input window crc is filled in here, off the writer
+ */
+static int checkpoint_save(addrs_bulk_t * bulk, struct addrs_bulk_checkpoint * checkpoint)
+{
+	const char * path = bulk->config.checkpoint_file;
+	if(fdatasync(bulk->fd_out) != 0) {
+		perror("fdatasync");
+		return -1;
+	}
+	if(input_window_crc(bulk->fd_in, checkpoint->in_offset, &checkpoint->in_crc) != 0) {
+		perror("read input");
+		return -1;
+	}
+
+	unsigned char data[CHECKPOINT_FILE_SIZE];
+	uint64_t u64[3] = { htole64(checkpoint->in_offset), htole64(checkpoint->out_offset), htole64(checkpoint->keys) };
+	uint32_t u32[4] = { htole32(checkpoint->out_crc), htole32(checkpoint->in_crc), htole32(checkpoint->config_crc) };
+	memcpy(data, s_checkpoint_magic, 8);
+	memcpy(data + 8, u64, sizeof(u64));
+	memcpy(data + 8 + sizeof(u64), u32, sizeof(u32));
+	u32[3] = htole32(crc32c(data, CHECKPOINT_FILE_SIZE - 4));
+	memcpy(data + CHECKPOINT_FILE_SIZE - 4, &u32[3], 4);
+
+	size_t cb_path = strlen(path);
+	char * tmp_path = malloc(cb_path + sizeof(".tmp"));
+	assert(tmp_path);
+	memcpy(tmp_path, path, cb_path);
+	memcpy(tmp_path + cb_path, ".tmp", sizeof(".tmp"));
+
+	int rc = -1;
+	int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if(fd >= 0) {
+		if(write_fully(fd, (const char *)data, sizeof(data)) == 0 && fsync(fd) == 0) rc = 0;
+		close(fd);
+	}
+	if(0 == rc) rc = rename(tmp_path, path);
+	if(rc) {
+		fprintf(stderr, "[bulk]: save checkpoint '%s' failed: %s\n", path, strerror(errno));
+		unlink(tmp_path);
+	}else {
+		// the rename itself
+		const char * slash = strrchr(path, '/');
+		char * dir = strndup(path, slash?(size_t)(slash - path + 1):0);
+		assert(dir);
+		int fd_dir = open(dir[0]?dir:".", O_RDONLY | O_DIRECTORY);
+		if(fd_dir >= 0) {
+			fsync(fd_dir);
+			close(fd_dir);
+		}
+		free(dir);
+	}
+	free(tmp_path);
+	return rc;
+}
+
+/*
+ * checkpoint thread:
+ *   every interval, saves the commit watermark if it moved; the writer only takes the mutex to advance it,
+ *   so a slow fdatasync delays the checkpoint, never the conversion.
+ */
+static void * checkpoint_thread(void * user_data)
+{
+	addrs_bulk_t * bulk = user_data;
+	double interval = bulk->config.checkpoint_interval;
+	if(interval <= 0) interval = BULK_DEFAULT_CHECKPOINT_INTERVAL;
+	const uint64_t interval_ns = (uint64_t)(interval * 1e9);
+
+	pthread_mutex_lock(&bulk->mutex);
+	while(!bulk->checkpoint_quit) {
+		struct timespec deadline;
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		uint64_t ns = deadline.tv_nsec + interval_ns;
+		deadline.tv_sec += ns / 1000000000ULL;
+		deadline.tv_nsec = ns % 1000000000ULL;
+		int rc = 0;
+		while(!bulk->checkpoint_quit && rc != ETIMEDOUT) rc = pthread_cond_timedwait(&bulk->cond_checkpoint, &bulk->mutex, &deadline);
+		if(bulk->checkpoint_quit) break;
+
+		struct addrs_bulk_checkpoint committed = bulk->committed;
+		pthread_mutex_unlock(&bulk->mutex);
+		if(committed.in_offset != bulk->durable.in_offset && checkpoint_save(bulk, &committed) == 0) bulk->durable = committed;
+		pthread_mutex_lock(&bulk->mutex);
+	}
+	pthread_mutex_unlock(&bulk->mutex);
+	return NULL;
+}
+
+/*
+ * resume: the output up to the checkpoint must hash to its crc, whatever follows it (chunks written
+ * after the last checkpoint) is truncated, and both files are positioned at the checkpoint's offsets
+ */
+static int resume_files(addrs_bulk_t * bulk)
+{
+	const char * path = bulk->config.checkpoint_file;
+	struct addrs_bulk_checkpoint checkpoint[1];
+	int rc = addrs_bulk_checkpoint_load(path, checkpoint);
+	if(rc > 0) {
+		fprintf(stderr, "[bulk]: no checkpoint '%s' yet, starting from the beginning\n", path);
+		struct stat st[1];
+		if(fstat(bulk->fd_out, st) == 0 && S_ISREG(st->st_mode) && ftruncate(bulk->fd_out, 0) != 0) {
+			perror("ftruncate");
+			return -1;
+		}
+		return 0;
+	}
+	if(rc < 0) {
+		fprintf(stderr, "[bulk]: invalid checkpoint '%s'\n", path);
+		return -1;
+	}
+	if(checkpoint->config_crc != config_crc(&bulk->config)) {
+		fprintf(stderr, "[bulk]: checkpoint '%s' was made with another output format, address types or input format\n", path);
+		return -1;
+	}
+
+	struct stat st[1];
+	if(fstat(bulk->fd_in, st) != 0 || !S_ISREG(st->st_mode) || (uint64_t)st->st_size < checkpoint->in_offset) {
+		fprintf(stderr, "[bulk]: the input does not match checkpoint '%s' (not a file, or shorter)\n", path);
+		return -1;
+	}
+	uint32_t in_crc = 0;
+	if(input_window_crc(bulk->fd_in, checkpoint->in_offset, &in_crc) != 0 || in_crc != checkpoint->in_crc) {
+		fprintf(stderr, "[bulk]: the input does not match checkpoint '%s' (other data before offset %lu)\n",
+			path, (unsigned long)checkpoint->in_offset);
+		return -1;
+	}
+	if(fstat(bulk->fd_out, st) != 0 || !S_ISREG(st->st_mode) || (uint64_t)st->st_size < checkpoint->out_offset) {
+		fprintf(stderr, "[bulk]: the output does not match checkpoint '%s' (not a file, or shorter)\n", path);
+		return -1;
+	}
+
+	char * buf = malloc(BULK_VERIFY_BLOCK_SIZE);
+	assert(buf);
+	uint32_t crc = 0;
+	for(uint64_t offset = 0; offset < checkpoint->out_offset; ) {
+		size_t size = checkpoint->out_offset - offset;
+		if(size > BULK_VERIFY_BLOCK_SIZE) size = BULK_VERIFY_BLOCK_SIZE;
+		ssize_t cb = pread(bulk->fd_out, buf, size, offset);
+		if(cb < 0 && errno == EINTR) continue;
+		if(cb <= 0) {
+			perror("read output");
+			break;
+		}
+		crc = crc32c_update(crc, buf, cb);
+		offset += cb;
+	}
+	free(buf);
+	if(crc != checkpoint->out_crc) {
+		fprintf(stderr, "[bulk]: the output does not match checkpoint '%s' (crc32c %.8x, expected %.8x)\n",
+			path, crc, checkpoint->out_crc);
+		return -1;
+	}
+
+	if(ftruncate(bulk->fd_out, checkpoint->out_offset) != 0
+		|| lseek(bulk->fd_out, checkpoint->out_offset, SEEK_SET) < 0
+		|| lseek(bulk->fd_in, checkpoint->in_offset, SEEK_SET) < 0) {
+		perror("resume");
+		return -1;
+	}
+	fprintf(stderr, "[bulk]: resuming at input offset %lu, output offset %lu (%lu keys converted before)\n",
+		(unsigned long)checkpoint->in_offset, (unsigned long)checkpoint->out_offset, (unsigned long)checkpoint->keys);
+	bulk->committed = *checkpoint;
+	bulk->durable = *checkpoint;
+	bulk->resumed = 1;
+	return 0;
+}
+
+static void bulk_abort(addrs_bulk_t * bulk)
+{
+	// stop the reader and the workers, the writer drains the chunks already claimed
+	pthread_mutex_lock(&bulk->mutex);
+	bulk->quit = 1;
+	pthread_cond_broadcast(&bulk->cond_free);
+	for(int shard = 0; shard < bulk->num_shards; ++shard) pthread_cond_broadcast(&bulk->cond_filled[shard]);
+	pthread_mutex_unlock(&bulk->mutex);
+}
+
+static void submit_slot_write(addrs_bulk_t * bulk, struct bulk_slot * slot)
+{
+	// a buffer grown by slot_reserve() after registration is no longer the registered one
+	size_t index = slot - bulk->slots;
+	const struct iovec * iov = &bulk->out_iovecs[index];
+	int buf_index = -1;
+	if(bulk->out_registered && iov->iov_base == (void *)slot->out_buf && slot->out_len <= iov->iov_len) buf_index = index;
+
+	int64_t offset = (slot->io_offset < 0)?-1:(slot->io_offset + (int64_t)slot->io_len);
+	int rc = addrs_io_submit_write(bulk->io_out, bulk->fd_out,
+		slot->out_buf + slot->io_len, slot->out_len - slot->io_len, offset, buf_index, slot->seq);
+	assert(0 == rc);	// in flight <= num_slots == queue depth
+}
+
+/*
+ * commit the finished chunks in input order and free their slots: a chunk whose write completes before
+ * its predecessors' keeps its slot until they are done, so the watermark always covers a prefix of the output
+ */
+static void commit_written_slots(addrs_bulk_t * bulk, int err)
+{
+	struct bulk_counters * counters = bulk->writer_counters;
+	const int checkpoints = (NULL != bulk->config.checkpoint_file) && !err;
+	while(bulk->next_commit < bulk->next_write) {
+		struct bulk_slot * slot = &bulk->slots[bulk->next_commit % bulk->num_slots];
+		assert(slot->state == bulk_slot_state_writing && slot->seq == bulk->next_commit);
+		if(!slot->io_done) break;
+		++bulk->next_commit;
+		relaxed_add(&counters->chunks, 1);
+		latency_histogram_add(&counters->latency, get_time_ns() - slot->filled_ns, 1);
+
+		// the writer is the only one advancing the watermark, reading it needs no lock
+		uint32_t out_crc = checkpoints?crc32c_update(bulk->committed.out_crc, slot->out_buf, slot->out_len):0;
+		pthread_mutex_lock(&bulk->mutex);
+		if(checkpoints) {
+			bulk->committed.in_offset = slot->in_end;
+			bulk->committed.out_offset += slot->out_len;
+			bulk->committed.out_crc = out_crc;
+			bulk->committed.keys += slot->num_keys;
+		}
+		slot->state = bulk_slot_state_free;
+		pthread_cond_signal(&bulk->cond_free);
+		pthread_mutex_unlock(&bulk->mutex);
+	}
+}
+
+/*
+ * reap write completions: resubmit short writes, commit the finished ones
+ * @return the number of writes completed
+ */
+static unsigned int reap_writes(addrs_bulk_t * bulk, unsigned int min_complete, int * p_err)
+{
+	struct bulk_counters * counters = bulk->writer_counters;
+	struct addrs_io_completion completions[BULK_MAX_COMPLETIONS];
+	unsigned int num_completed = 0;
+
+	int n = addrs_io_wait(bulk->io_out, completions, BULK_MAX_COMPLETIONS, min_complete);
+	assert(n >= 0);
+	for(int i = 0; i < n; ++i) {
+		uint64_t seq = completions[i].user_data;
+		ssize_t result = completions[i].result;
+		struct bulk_slot * slot = &bulk->slots[seq % bulk->num_slots];
+		assert(slot->state == bulk_slot_state_writing && slot->seq == seq);
+
+		if(io_retryable(result)) {
+			submit_slot_write(bulk, slot);
+			continue;
+		}
+		if(result > 0) {
+			slot->io_len += result;
+			relaxed_add(&counters->bytes, result);
+			if(slot->io_len < slot->out_len) {
+				submit_slot_write(bulk, slot);
+				continue;
+			}
+		}else {
+			errno = result?-result:ENOSPC;
+			perror("write");
+			relaxed_add(&counters->errors[addrs_bulk_error_io], 1);
+			if(!*p_err) bulk_abort(bulk);
+			*p_err = 1;
+		}
+		slot->io_done = 1;
+		++num_completed;
+	}
+	commit_written_slots(bulk, *p_err);
+	return num_completed;
+}
+
+/*
+ * writer (calling thread):
+ *   chunks are written in input order at increasing file offsets, several writes in flight
+ *   (one at a time when the output has no offsets), slots are freed as their writes are committed.
+ */
+static int writer_run(addrs_bulk_t * bulk)
+{
+	const size_t num_slots = bulk->num_slots;
+	const unsigned int max_in_flight = (bulk->out_offset < 0)?1:num_slots;
+	int64_t out_offset = bulk->out_offset;
+	unsigned int in_flight = 0;
+	int err = 0;
+
+	while(1) {
+		int ready = 0;
+		int finished = 0;
+		struct bulk_slot * slot = NULL;
+
+		pthread_mutex_lock(&bulk->mutex);
+		while(1) {
+			slot = &bulk->slots[bulk->next_write % num_slots];
+			int current = (slot->seq == bulk->next_write);
+			ready = (current && slot->state == bulk_slot_state_done);
+			finished = (bulk->eof && bulk->next_write == bulk->next_fill)
+				|| (bulk->quit && !(current && (ready || slot->state == bulk_slot_state_claimed)));
+			if(ready || finished || in_flight > 0) break;
+			pthread_cond_wait(&bulk->cond_done, &bulk->mutex);
+		}
+		if(ready && in_flight < max_in_flight) {
+			slot->state = bulk_slot_state_writing;
+			__atomic_store_n(&bulk->next_write, bulk->next_write + 1, __ATOMIC_RELEASE);
+		}else ready = 0;
+		pthread_mutex_unlock(&bulk->mutex);
+
+		if(ready) {
+			slot->io_done = 0;
+			if(err || 0 == slot->out_len) {
+				slot->io_done = 1;
+				commit_written_slots(bulk, err);
+				continue;
+			}
+			slot->io_offset = out_offset;
+			slot->io_len = 0;
+			if(out_offset >= 0) out_offset += slot->out_len;
+			submit_slot_write(bulk, slot);
+			++in_flight;
+
+			// start the write now, pick up whatever has already completed
+			in_flight -= reap_writes(bulk, 0, &err);
+			continue;
+		}
+
+		if(in_flight > 0) {
+			in_flight -= reap_writes(bulk, 1, &err);
+			continue;
+		}
+		if(finished) break;
+	}
+	return err;
+}
+
+static int setup_io(addrs_bulk_t * bulk)
+{
+	struct stat st[1];
+	const size_t chunk_size = bulk->config.chunk_size;
+
+	// offsets allow several reads / writes in flight; pipes, ttys and O_APPEND files are serialized
+	bulk->in_offset = -1;
+	if(fstat(bulk->fd_in, st) == 0 && S_ISREG(st->st_mode)) bulk->in_offset = lseek(bulk->fd_in, 0, SEEK_CUR);
+	bulk->out_offset = -1;
+	int flags = fcntl(bulk->fd_out, F_GETFL);
+	if(fstat(bulk->fd_out, st) == 0 && S_ISREG(st->st_mode) && flags >= 0 && !(flags & O_APPEND)) {
+		bulk->out_offset = lseek(bulk->fd_out, 0, SEEK_CUR);
+	}
+
+	bulk->io_in = addrs_io_new(bulk->config.io_backend, bulk->num_slots);
+	if(NULL == bulk->io_in) return -1;
+	bulk->io_backend = addrs_io_get_backend(bulk->io_in);
+	bulk->io_out = addrs_io_new(bulk->io_backend, bulk->num_slots);
+	if(NULL == bulk->io_out) return -1;
+
+	struct iovec * in_iovecs = calloc(bulk->num_slots, sizeof(*in_iovecs));
+	assert(in_iovecs);
+	free(bulk->out_iovecs);
+	bulk->out_iovecs = calloc(bulk->num_slots, sizeof(*bulk->out_iovecs));
+	assert(bulk->out_iovecs);
+	for(size_t i = 0; i < bulk->num_slots; ++i) {
+		in_iovecs[i].iov_base = bulk->slots[i].in_buf + chunk_size;
+		in_iovecs[i].iov_len = chunk_size;
+		bulk->out_iovecs[i].iov_base = bulk->slots[i].out_buf;
+		bulk->out_iovecs[i].iov_len = bulk->slots[i].out_size;
+	}
+
+	// registration may fail (e.g. RLIMIT_MEMLOCK), plain reads / writes still work
+	bulk->in_registered = (addrs_io_register_buffers(bulk->io_in, in_iovecs, bulk->num_slots) == 0);
+	bulk->out_registered = (addrs_io_register_buffers(bulk->io_out, bulk->out_iovecs, bulk->num_slots) == 0);
+	free(in_iovecs);
+	return 0;
+}
+
+static void cleanup_io(addrs_bulk_t * bulk)
+{
+	addrs_io_free(bulk->io_in);
+	addrs_io_free(bulk->io_out);
+	bulk->io_in = NULL;
+	bulk->io_out = NULL;
+	bulk->in_registered = 0;
+	bulk->out_registered = 0;
+}
+
+int addrs_bulk_run(addrs_bulk_t * bulk)
+{
+	assert(bulk);
+	struct bulk_counters * counters = bulk->writer_counters;
+	int rc = open_files(bulk);
+	if(0 == rc && bulk->config.resume) rc = resume_files(bulk);
+	if(rc) {
+		close_files(bulk);
+		return -1;
+	}
+
+	char header[4096];
+	ssize_t cb_header = addrs_output_format_header(bulk->config.format, bulk->config.types_mask, header, sizeof(header));
+	assert(cb_header >= 0);
+	if(cb_header > 0 && !bulk->resumed) {
+		bulk->committed.out_crc = crc32c(header, cb_header);
+		if(write_fully(bulk->fd_out, header, cb_header)) {
+			perror("write");
+			relaxed_add(&counters->errors[addrs_bulk_error_io], 1);
+			close_files(bulk);
+			return -1;
+		}
+		relaxed_add(&counters->bytes, cb_header);
+	}
+
+	rc = setup_io(bulk);
+	const int checkpoints = (NULL != bulk->config.checkpoint_file);
+	if(0 == rc && checkpoints && (bulk->in_offset < 0 || bulk->out_offset < 0)) {
+		fprintf(stderr, "[bulk]: checkpoints need a regular input file and output file\n");
+		rc = -1;
+	}
+	if(rc) {
+		cleanup_io(bulk);
+		close_files(bulk);
+		return -1;
+	}
+	if(checkpoints) {
+		bulk->committed.in_offset = bulk->in_offset;
+		bulk->committed.out_offset = bulk->out_offset;
+		bulk->committed.config_crc = config_crc(&bulk->config);
+		if(!bulk->resumed) bulk->durable = bulk->committed;
+	}
+
+	__atomic_store_n(&bulk->start_ns, get_time_ns(), __ATOMIC_RELEASE);
+	rc = pthread_create(&bulk->reader, NULL, reader_thread, bulk);
+	assert(0 == rc);
+	if(checkpoints) {
+		rc = pthread_create(&bulk->checkpointer, NULL, checkpoint_thread, bulk);
+		assert(0 == rc);
+	}
+	for(int i = 0; i < bulk->num_workers; ++i) {
+		rc = pthread_create(&bulk->workers[i].th, NULL, worker_thread, &bulk->workers[i]);
+		assert(0 == rc);
+	}
+
+	int err = writer_run(bulk);
+
+	pthread_join(bulk->reader, NULL);
+	for(int i = 0; i < bulk->num_workers; ++i) pthread_join(bulk->workers[i].th, NULL);
+	if(checkpoints) {
+		pthread_mutex_lock(&bulk->mutex);
+		bulk->checkpoint_quit = 1;
+		pthread_cond_signal(&bulk->cond_checkpoint);
+		pthread_mutex_unlock(&bulk->mutex);
+		pthread_join(bulk->checkpointer, NULL);
+
+		// the last committed chunk, also after an error (resume then continues from there)
+		if(bulk->committed.in_offset != bulk->durable.in_offset && checkpoint_save(bulk, &bulk->committed) == 0) {
+			bulk->durable = bulk->committed;
+		}
+	}
+
+	if(relaxed_load(&bulk->reader_counters->errors[addrs_bulk_error_io])) err = 1;
+	cleanup_io(bulk);
+	close_files(bulk);
+	return err?-1:0;
+}
+
+enum addrs_io_backend addrs_bulk_get_io_backend(const addrs_bulk_t * bulk)
+{
+	assert(bulk);
+	return bulk->io_backend;
+}
+
+int addrs_bulk_get_metrics(addrs_bulk_t * bulk, struct addrs_bulk_metrics * metrics)
+{
+	assert(bulk && metrics);
+	memset(metrics, 0, sizeof(*metrics));
+
+	uint64_t start_ns = __atomic_load_n(&bulk->start_ns, __ATOMIC_ACQUIRE);
+	if(start_ns) metrics->uptime = (double)(get_time_ns() - start_ns) / 1e9;
+	metrics->num_workers = bulk->num_workers;
+	metrics->num_shards = bulk->num_shards;
+	metrics->huge_pages = bulk->huge_pages;
+
+	for(int i = 0; i < bulk->num_workers; ++i) {
+		const struct bulk_counters * counters = &bulk->worker_counters[i];
+		metrics->keys += relaxed_load(&counters->keys);
+		for(int e = 0; e < addrs_bulk_errors_count; ++e) metrics->errors[e] += relaxed_load(&counters->errors[e]);
+		latency_histogram_merge(&metrics->key_latency, &counters->latency);
+	}
+
+	const struct bulk_counters * reader = bulk->reader_counters;
+	const struct bulk_counters * writer = bulk->writer_counters;
+	metrics->bytes_read = relaxed_load(&reader->bytes);
+	metrics->chunks_read = relaxed_load(&reader->chunks);
+	metrics->bytes_written = relaxed_load(&writer->bytes);
+	metrics->chunks_written = relaxed_load(&writer->chunks);
+	metrics->errors[addrs_bulk_error_io] += relaxed_load(&reader->errors[addrs_bulk_error_io]) + relaxed_load(&writer->errors[addrs_bulk_error_io]);
+	latency_histogram_merge(&metrics->chunk_latency, &writer->latency);
+
+	uint64_t next_fill = __atomic_load_n(&bulk->next_fill, __ATOMIC_ACQUIRE);
+	uint64_t num_claimed = __atomic_load_n(&bulk->num_claimed, __ATOMIC_ACQUIRE);
+	uint64_t next_write = __atomic_load_n(&bulk->next_write, __ATOMIC_ACQUIRE);
+	if(next_fill >= num_claimed) metrics->input_queue_depth = next_fill - num_claimed;
+	if(num_claimed >= next_write) metrics->output_queue_depth = num_claimed - next_write;
+	return 0;
+}
+
+
+#if defined(_TEST_ADDRS_BULK) && defined(_STAND_ALONE)
+/*
+ * end-to-end: small chunk sizes force lines to straddle chunk boundaries,
+ * the output must equal the single-key conversion of every valid line, in order
+ */
+static char * build_input(size_t num_keys, size_t * p_cb_input, char ** p_expected, size_t * p_cb_expected)
+{
+	char * input = malloc(num_keys * 128 + 64);
+	char * expected = malloc(num_keys * 256);
+	assert(input && expected);
+	char * p = input;
+	char * q = expected;
+
+	uint64_t state = 12345;
+	for(size_t i = 0; i < num_keys; ++i) {
+		struct bitcoin_addrs_record record[1];
+		for(int j = 0; j < BITCOIN_ADDRS_PUBKEY_SIZE; ++j) {
+			state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+			record->pubkey[j] = state >> 56;
+		}
+		record->pubkey[0] = 0x02 | (record->pubkey[0] & 1);
+
+		switch(i % 7) {
+		case 1: p += sprintf(p, "# comment %zu\n", i); break;
+		case 3: p += sprintf(p, "  \t\n"); break;
+		case 5: p += sprintf(p, "0279be\n"); break;	// pubkey_length error
+		default: break;
+		}
+		char * hex = p;
+		p += bin2hex(record->pubkey, BITCOIN_ADDRS_PUBKEY_SIZE, &hex);
+		p += sprintf(p, (i % 11 == 0)?"\r\n":"\n");
+
+		ssize_t num_ok = pubkeys_to_addrs_batch(record, 1, BITCOIN_ADDRESS_TYPES_ALL);
+		assert(num_ok == 1);
+		q += addrs_output_format_record(addrs_output_format_text, BITCOIN_ADDRESS_TYPES_ALL, record, q);
+	}
+	--p;	// no newline after the last key
+	*p_cb_input = p - input;
+	*p_expected = expected;
+	*p_cb_expected = q - expected;
+	return input;
+}
+
+/* WIF keys; every 9th line is preceded by an uncompressed WIF or a corrupted one (privkey errors) */
+static char * build_wif_input(size_t num_keys, size_t * p_cb_input, char ** p_expected, size_t * p_cb_expected, size_t * p_num_errors)
+{
+	char * input = malloc(num_keys * 128 + 64);
+	char * expected = malloc(num_keys * 256);
+	assert(input && expected);
+	char * p = input;
+	char * q = expected;
+	size_t num_errors = 0;
+
+	uint64_t state = 54321;
+	for(size_t i = 0; i < num_keys; ++i) {
+		unsigned char privkey[BITCOIN_ADDRS_PRIVKEY_SIZE];
+		for(int j = 0; j < BITCOIN_ADDRS_PRIVKEY_SIZE; ++j) {
+			state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+			privkey[j] = state >> 56;
+		}
+		privkey[0] &= 0x7f;
+
+		if(i % 9 == 0) {
+			char * wif = p;
+			p += wif_encode(privkey, (i % 2), &wif);
+			if(i % 2) p[-1] = (p[-1] == 'z')?'y':'z';	// checksum mismatch
+			*p++ = '\n';
+			++num_errors;
+		}
+		char * wif = p;
+		p += wif_encode(privkey, 1, &wif);
+		*p++ = '\n';
+
+		struct bitcoin_addrs_record record[1];
+		if(privkey_to_pubkey(privkey, record->pubkey) == 0) {
+			ssize_t num_ok = pubkeys_to_addrs_batch(record, 1, BITCOIN_ADDRESS_TYPES_ALL);
+			assert(num_ok == 1);
+			q += addrs_output_format_record(addrs_output_format_text, BITCOIN_ADDRESS_TYPES_ALL, record, q);
+		}else {
+			++num_errors;	// built without libsecp256k1
+		}
+	}
+	*p_cb_input = p - input;
+	*p_expected = expected;
+	*p_cb_expected = q - expected;
+	*p_num_errors = num_errors;
+	return input;
+}
+
+static char * read_file(const char * path, size_t * p_size)
+{
+	FILE * fp = fopen(path, "rb");
+	assert(fp);
+	fseek(fp, 0, SEEK_END);
+	size_t size = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	char * data = malloc(size + 1);
+	assert(data);
+	size_t cb = fread(data, 1, size, fp);
+	assert(cb == size);
+	fclose(fp);
+	*p_size = size;
+	return data;
+}
+
+static void write_file(const char * path, const char * data, size_t size)
+{
+	FILE * fp = fopen(path, "wb");
+	assert(fp);
+	size_t cb = fwrite(data, 1, size, fp);
+	assert(cb == size);
+	fclose(fp);
+}
+
+static int run_checkpointed(const char * input_file, const char * output_file, const char * checkpoint_file,
+	int resume, int format, uint64_t * p_keys)
+{
+	struct addrs_bulk_config config = {
+		.input_file = input_file,
+		.output_file = output_file,
+		.num_threads = 3,
+		.chunk_size = 4096,
+		.format = format,
+		.checkpoint_file = checkpoint_file,
+		.checkpoint_interval = 0.001,
+		.resume = resume,
+	};
+	addrs_bulk_t * bulk = addrs_bulk_new(&config);
+	assert(bulk);
+	int rc = addrs_bulk_run(bulk);
+	struct addrs_bulk_metrics metrics[1];
+	addrs_bulk_get_metrics(bulk, metrics);
+	if(p_keys) *p_keys = metrics->keys;
+	addrs_bulk_free(bulk);
+	return rc;
+}
+
+/*
+ * checkpoints: a complete run, a run over the first half of the input whose output then gets
+ * a torn tail (writes after the last checkpoint), resumed over the whole input; a corrupted output
+ * or other options must refuse to resume
+ */
+static void test_checkpoint(const char * input_file, const char * output_file,
+	const char * input, size_t cb_input, const char * expected, size_t cb_expected, size_t num_keys)
+{
+	char checkpoint_file[] = "/tmp/test_addrs_bulk.ckpt.XXXXXX";
+	int fd = mkstemp(checkpoint_file);
+	assert(fd >= 0);
+	close(fd);
+	unlink(checkpoint_file);
+
+	struct addrs_bulk_checkpoint checkpoint[1];
+	uint64_t keys = 0;
+	size_t cb_output = 0;
+	char * output = NULL;
+	assert(1 == addrs_bulk_checkpoint_load(checkpoint_file, checkpoint));
+
+	// complete run, then resuming it has nothing left to do
+	for(int resume = 0; resume < 2; ++resume) {
+		assert(0 == run_checkpointed(input_file, output_file, checkpoint_file, resume, 0, &keys));
+		assert(keys == (resume?0:num_keys));
+		assert(0 == addrs_bulk_checkpoint_load(checkpoint_file, checkpoint));
+		assert(checkpoint->in_offset == cb_input && checkpoint->out_offset == cb_expected);
+		assert(checkpoint->keys == num_keys && checkpoint->out_crc == crc32c(expected, cb_expected));
+		output = read_file(output_file, &cb_output);
+		assert(cb_output == cb_expected && 0 == memcmp(output, expected, cb_expected));
+		free(output);
+	}
+
+	// the first half, resumed without a checkpoint: starts over (the stale output is dropped)
+	unlink(checkpoint_file);
+	const char * half = memchr(input + cb_input / 2, '\n', cb_input - cb_input / 2);
+	assert(half);
+	size_t cb_half = half + 1 - input;
+	write_file(input_file, input, cb_half);
+	assert(0 == run_checkpointed(input_file, output_file, checkpoint_file, 1, 0, &keys));
+	assert(0 == addrs_bulk_checkpoint_load(checkpoint_file, checkpoint));
+	assert(checkpoint->in_offset == cb_half && checkpoint->keys == keys);
+	output = read_file(output_file, &cb_output);
+	assert(checkpoint->out_offset == cb_output && 0 == memcmp(output, expected, cb_output));
+	uint64_t half_keys = keys;
+
+	// a torn tail past the checkpoint, then the whole input
+	static const char torn[] = "0279be667ef9dcbbac55a0 1BgGZ9tcN4rm9K";
+	output = realloc(output, cb_output + sizeof(torn));
+	assert(output);
+	memcpy(output + cb_output, torn, sizeof(torn));
+	write_file(output_file, output, cb_output + sizeof(torn));
+
+	// refused: other options, another input of the same size (the last key before the checkpoint changed),
+	// a corrupted output
+	assert(-1 == run_checkpointed(input_file, output_file, checkpoint_file, 1, addrs_output_format_csv, NULL));
+	char * other_input = malloc(cb_input);
+	assert(other_input);
+	memcpy(other_input, input, cb_input);
+	other_input[cb_half - 3] = (other_input[cb_half - 3] == '0')?'1':'0';
+	write_file(input_file, other_input, cb_input);
+	free(other_input);
+	assert(-1 == run_checkpointed(input_file, output_file, checkpoint_file, 1, 0, NULL));
+	write_file(input_file, input, cb_input);
+	output[cb_output / 2] ^= 1;
+	write_file(output_file, output, cb_output + sizeof(torn));
+	assert(-1 == run_checkpointed(input_file, output_file, checkpoint_file, 1, 0, NULL));
+	output[cb_output / 2] ^= 1;
+	write_file(output_file, output, cb_output + sizeof(torn));
+	free(output);
+
+	assert(0 == run_checkpointed(input_file, output_file, checkpoint_file, 1, 0, &keys));
+	printf("checkpoint: resumed at %zu / %zu bytes, keys=%lu + %lu\n", cb_half, cb_input,
+		(unsigned long)half_keys, (unsigned long)keys);
+	assert(half_keys + keys == num_keys);
+	assert(0 == addrs_bulk_checkpoint_load(checkpoint_file, checkpoint));
+	assert(checkpoint->in_offset == cb_input && checkpoint->out_offset == cb_expected && checkpoint->keys == num_keys);
+	output = read_file(output_file, &cb_output);
+	assert(cb_output == cb_expected && 0 == memcmp(output, expected, cb_expected));
+	free(output);
+	unlink(checkpoint_file);
+}
+
+int main(int argc, char ** argv)
+{
+	char input_file[] = "/tmp/test_addrs_bulk.in.XXXXXX";
+	char output_file[] = "/tmp/test_addrs_bulk.out.XXXXXX";
+	int fd = mkstemp(input_file);
+	assert(fd >= 0);
+	close(fd);
+	fd = mkstemp(output_file);
+	assert(fd >= 0);
+	close(fd);
+
+	size_t num_keys = 20000;
+	size_t cb_input = 0, cb_expected = 0;
+	char * expected = NULL;
+	char * input = build_input(num_keys, &cb_input, &expected, &cb_expected);
+	FILE * fp = fopen(input_file, "wb");
+	assert(fp);
+	fwrite(input, 1, cb_input, fp);
+	fclose(fp);
+
+	static const size_t chunk_sizes[] = { 67, 100, 4096, 65536, 0 };
+	static const enum addrs_io_backend backends[] = { addrs_io_backend_sync, addrs_io_backend_auto };
+	// NUMA shards: off, one per host node, and more shards than nodes (round-robin over the nodes)
+	static const int numa_shards[] = { 0, -1, 2, 3 };
+	for(size_t n = 0; n < sizeof(numa_shards) / sizeof(numa_shards[0]); ++n)
+	for(size_t b = 0; b < sizeof(backends) / sizeof(backends[0]); ++b) {
+		for(size_t c = 0; c < sizeof(chunk_sizes) / sizeof(chunk_sizes[0]); ++c) {
+			if(numa_shards[n] && (b > 0 || chunk_sizes[c] == 67)) continue;
+			struct addrs_bulk_config config = {
+				.input_file = input_file,
+				.output_file = output_file,
+				.num_threads = 3,
+				.chunk_size = chunk_sizes[c],
+				.io_backend = backends[b],
+				.numa_shards = numa_shards[n],
+				.huge_pages = (int)((c + n) % huge_pages_modes_count),	// falls back where unavailable
+			};
+			addrs_bulk_t * bulk = addrs_bulk_new(&config);
+			assert(bulk);
+			int rc = addrs_bulk_run(bulk);
+			assert(0 == rc);
+
+			struct addrs_bulk_metrics metrics[1];
+			addrs_bulk_get_metrics(bulk, metrics);
+			printf("io=%-8s shards=%d huge_pages=%-7s chunk_size=%-6zu keys=%lu, length_errors=%lu, bytes_read=%lu\n",
+				addrs_io_backend_to_string(addrs_bulk_get_io_backend(bulk)), metrics->num_shards,
+				huge_pages_mode_to_string(metrics->huge_pages), chunk_sizes[c],
+				(unsigned long)metrics->keys, (unsigned long)metrics->errors[addrs_bulk_error_pubkey_length],
+				(unsigned long)metrics->bytes_read);
+			assert(metrics->keys == num_keys);
+			assert(metrics->bytes_read == cb_input);
+			assert(metrics->errors[addrs_bulk_error_pubkey_length] == (num_keys + 1) / 7);
+
+			size_t cb_output = 0;
+			char * output = read_file(output_file, &cb_output);
+			assert(cb_output == cb_expected);
+			assert(0 == memcmp(output, expected, cb_expected));
+			free(output);
+			addrs_bulk_free(bulk);
+		}
+	}
+	test_checkpoint(input_file, output_file, input, cb_input, expected, cb_expected, num_keys);
+
+	free(input);
+	free(expected);
+
+	// WIF input
+	size_t num_wif_errors = 0;
+	num_keys = 2000;
+	input = build_wif_input(num_keys, &cb_input, &expected, &cb_expected, &num_wif_errors);
+	fp = fopen(input_file, "wb");
+	assert(fp);
+	fwrite(input, 1, cb_input, fp);
+	fclose(fp);
+	for(size_t c = 0; c < sizeof(chunk_sizes) / sizeof(chunk_sizes[0]); ++c) {
+		struct addrs_bulk_config config = {
+			.input_file = input_file,
+			.output_file = output_file,
+			.num_threads = 3,
+			.chunk_size = chunk_sizes[c],
+			.input_format = addrs_bulk_input_format_wif,
+		};
+		addrs_bulk_t * bulk = addrs_bulk_new(&config);
+		assert(bulk);
+		int rc = addrs_bulk_run(bulk);
+		assert(0 == rc);
+
+		struct addrs_bulk_metrics metrics[1];
+		addrs_bulk_get_metrics(bulk, metrics);
+		printf("input=wif chunk_size=%-6zu keys=%lu, privkey_errors=%lu\n", chunk_sizes[c],
+			(unsigned long)metrics->keys, (unsigned long)metrics->errors[addrs_bulk_error_privkey]);
+		assert(metrics->errors[addrs_bulk_error_privkey] == num_wif_errors);
+		assert(metrics->keys + num_wif_errors == num_keys + (num_keys + 8) / 9);
+
+		size_t cb_output = 0;
+		char * output = read_file(output_file, &cb_output);
+		assert(cb_output == cb_expected);
+		assert(0 == memcmp(output, expected, cb_expected));
+		free(output);
+		addrs_bulk_free(bulk);
+	}
+
+	unlink(input_file);
+	unlink(output_file);
+	free(input);
+	free(expected);
+	printf("==== %s: PASSED ====\n", __FILE__);
+	return 0;
+}
+#endif
@@ -0,0 +1,576 @@
+/*
+ * addrs_classify.c
+ * 
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ * 
+ * The MIT License (MIT)
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to deal 
+ * in the Software without restriction, including without limitation the rights 
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all 
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS 
+ * IN THE SOFTWARE.
+ * 
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <endian.h>
+
+#include "sha.h"
+#include "hash_lanes.h"
+#include "hash_fused.h"
+#include "base58.h"
+#include "bech32.h"
+#include "utils.h"
+#include "thread_pool.h"
+
+#include "addrs_classify.h"
+
+#define BASE58_MIN_LENGTH	(25)
+#define SEGWIT_MIN_LENGTH	(14)	// "bc1" | version | 2-byte program (4) | checksum (6)
+#define SEGWIT_MAX_LENGTH	(90)
+#define HASH160_SIZE	(BITCOIN_ADDRS_HASH160_SIZE)
+#define CHECKSUM_SIZE	(4)
+
+static inline uint32_t load_be32(const unsigned char * p) { uint32_t x; memcpy(&x, p, 4); return be32toh(x); }
+
+static const char * s_network_names[addrs_networks_count] = {
+	[addrs_network_unknown] = "unknown",
+	[addrs_network_mainnet] = "mainnet",
+	[addrs_network_testnet] = "testnet",
+	[addrs_network_regtest] = "regtest",
+};
+
+static const char * s_type_names[addrs_class_types_count] = {
+	[addrs_class_type_invalid] = "invalid",
+	[addrs_class_type_p2pkh] = "p2pkh",
+	[addrs_class_type_p2sh] = "p2sh",
+	[addrs_class_type_p2wpkh] = "p2wpkh",
+	[addrs_class_type_p2wsh] = "p2wsh",
+	[addrs_class_type_p2tr] = "p2tr",
+	[addrs_class_type_witness_unknown] = "witness-unknown",
+};
+
+static const char * s_error_names[addrs_class_errors_count] = {
+	[addrs_class_error_none] = "ok",
+	[addrs_class_error_length] = "length",
+	[addrs_class_error_prefix] = "prefix",
+	[addrs_class_error_charset] = "charset",
+	[addrs_class_error_encoding] = "encoding",
+	[addrs_class_error_checksum] = "checksum",
+};
+
+const char * addrs_network_to_string(enum addrs_network network)
+{
+	if(network < 0 || network >= addrs_networks_count) return NULL;
+	return s_network_names[network];
+}
+
+const char * addrs_class_type_to_string(enum addrs_class_type type)
+{
+	if(type < 0 || type >= addrs_class_types_count) return NULL;
+	return s_type_names[type];
+}
+
+const char * addrs_class_error_to_string(enum addrs_class_error err)
+{
+	if(err < 0 || err >= addrs_class_errors_count) return NULL;
+	return s_error_names[err];
+}
+
+/* multi-lane checksums unless the scalar kernel runs on SHA extensions (same policy as pubkey_to_addrs.c) */
+static int s_lanes_checksums = -1;
+static inline int use_lanes_checksums(void)
+{
+	int lanes = __atomic_load_n(&s_lanes_checksums, __ATOMIC_RELAXED);
+	if(lanes < 0) {
+		lanes = !sha256_has_sha_ni();
+		__atomic_store_n(&s_lanes_checksums, lanes, __ATOMIC_RELAXED);
+	}
+	return lanes;
+}
+
+/*
+ * character-set pass: every byte of a zero-padded copy is tested with range compares
+ * (no table lookups), 32 bytes per step, and the out-of-place bytes are OR-ed together.
+ */
+#define CHARSET_BLOCK	(32)
+#define CHARSET_BUFFER_SIZE	(96)	// >= SEGWIT_MAX_LENGTH, a multiple of CHARSET_BLOCK
+typedef uint8_t charset_vec_t __attribute__((vector_size(CHARSET_BLOCK)));
+typedef int8_t charset_mask_t __attribute__((vector_size(CHARSET_BLOCK)));
+
+static const charset_vec_t s_iota = {
+	 0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15,
+	16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31,
+};
+
+#define in_range(c, lo, hi)	((charset_mask_t)(((c) - (uint8_t)(lo)) <= (uint8_t)((hi) - (lo))))
+
+/* 1-9 A-H J-N P-Z a-k m-z */
+#define base58_valid(c)	(in_range(c, '1', '9') \
+	| (in_range(c, 'A', 'Z') & (charset_mask_t)((c) != 'I') & (charset_mask_t)((c) != 'O')) \
+	| (in_range(c, 'a', 'z') & (charset_mask_t)((c) != 'l')))
+
+/* bech32 data part, either case: 0 2-9 and the letters but b i o (lower: c | 0x20) */
+#define bech32_valid(c, lower)	((in_range(lower, 'a', 'z') & (charset_mask_t)((lower) != 'b') \
+		& (charset_mask_t)((lower) != 'i') & (charset_mask_t)((lower) != 'o')) \
+	| (charset_mask_t)((c) == '0') | in_range(c, '2', '9'))
+
+/**
+ * charset_check()
+ *   cloned for AVX2 (one 32-byte compare per step) and picked at load time, like the hash_lanes.h kernels
+ * @return 0 if buf[begin, end) is all in the character set
+**/
+__attribute__((target_clones("avx2", "default")))
+static int charset_check(const unsigned char buf[static CHARSET_BUFFER_SIZE], size_t begin, size_t end, int segwit)
+{
+	charset_mask_t bad = { 0 };
+	for(size_t offset = 0; offset < end; offset += CHARSET_BLOCK) {
+		charset_vec_t c;
+		memcpy(&c, buf + offset, CHARSET_BLOCK);
+		charset_vec_t index = s_iota + (uint8_t)offset;
+		charset_mask_t need = (charset_mask_t)(index >= (uint8_t)begin) & (charset_mask_t)(index < (uint8_t)end);
+		if(segwit) {
+			charset_vec_t lower = c | 0x20;
+			bad |= need & ~bech32_valid(c, lower);
+		}else {
+			bad |= need & ~base58_valid(c);
+		}
+	}
+	uint64_t words[CHARSET_BLOCK / 8];
+	memcpy(words, &bad, sizeof(words));
+	return (words[0] | words[1] | words[2] | words[3]) != 0;
+}
+
+/* Base58Check version bytes -> type / network */
+static int base58_version_class(uint8_t version, struct addrs_class * cls)
+{
+	switch(version) {
+	case 0x00: cls->type = addrs_class_type_p2pkh; cls->network = addrs_network_mainnet; return 0;
+	case 0x05: cls->type = addrs_class_type_p2sh; cls->network = addrs_network_mainnet; return 0;
+	case 0x6f: cls->type = addrs_class_type_p2pkh; cls->network = addrs_network_testnet; return 0;
+	case 0xc4: cls->type = addrs_class_type_p2sh; cls->network = addrs_network_testnet; return 0;
+	default: break;
+	}
+	return -1;
+}
+
+static int segwit_class(const char * hrp, uint8_t version, size_t cb_program, struct addrs_class * cls)
+{
+	if(0 == strcmp(hrp, "bc")) cls->network = addrs_network_mainnet;
+	else if(0 == strcmp(hrp, "tb")) cls->network = addrs_network_testnet;
+	else if(0 == strcmp(hrp, "bcrt")) cls->network = addrs_network_regtest;
+	else return -1;
+	
+	if(version == 0) cls->type = (cb_program == HASH160_SIZE)?addrs_class_type_p2wpkh:addrs_class_type_p2wsh;
+	else if(version == 1 && cb_program == 32) cls->type = addrs_class_type_p2tr;
+	else cls->type = addrs_class_type_witness_unknown;
+	return 0;
+}
+
+static inline int reject(struct addrs_class * cls, enum addrs_class_error err)
+{
+	cls->type = addrs_class_type_invalid;
+	cls->network = addrs_network_unknown;
+	cls->err_code = err;
+	cls->cb_program = 0;
+	return err;
+}
+
+/**
+ * classify_prefix()
+ * @return 1: Base58Check, 2: segwit (*p_cb_hrp: hrp length), or -(enum addrs_class_error)
+**/
+static int classify_prefix(const unsigned char * addr, size_t cb_addr, size_t * p_cb_hrp)
+{
+	switch(addr[0]) {
+	case '1': case '3': case 'm': case 'n': case '2':
+		if(cb_addr < BASE58_MIN_LENGTH || cb_addr > BASE58_MAX_LENGTH_25) return -addrs_class_error_length;
+		return 1;
+	default: break;
+	}
+	
+	if(cb_addr < SEGWIT_MIN_LENGTH || cb_addr > SEGWIT_MAX_LENGTH) return -addrs_class_error_length;
+	uint32_t head = ((uint32_t)addr[0] << 24) | ((uint32_t)addr[1] << 16) | ((uint32_t)addr[2] << 8) | addr[3];
+	head |= 0x20202000;	// the first 3 characters in lowercase (digits keep their value)
+	if((head >> 8) == (('b' << 16) | ('c' << 8) | '1') || (head >> 8) == (('t' << 16) | ('b' << 8) | '1')) {
+		*p_cb_hrp = 2;
+		return 2;
+	}
+	if(head == (('b' << 24) | ('c' << 16) | ('r' << 8) | 't') && addr[4] == '1') {
+		*p_cb_hrp = 4;
+		return 2;
+	}
+	return -addrs_class_error_prefix;
+}
+
+struct checksum_lanes
+{
+	size_t num_lanes;
+	struct addrs_class * classes[HASH_LANES];
+	unsigned char payloads[HASH_LANES][BASE58_PAYLOAD_25];
+};
+
+/* verify the pending Base58Check checksums */
+static ssize_t flush_checksums(struct checksum_lanes * pending, int lanes_checksums)
+{
+	if(0 == pending->num_lanes) return 0;
+	hash_lanes_t checksums;
+	if(lanes_checksums) {
+		hash_lanes_t block[16];
+		memset(block, 0, sizeof(block));
+		for(size_t lane = 0; lane < pending->num_lanes; ++lane) {
+			const unsigned char * payload = pending->payloads[lane];
+			for(int i = 0; i < 5; ++i) block[i][lane] = load_be32(&payload[i * 4]);
+			block[5][lane] = ((uint32_t)payload[20] << 24) | 0x800000;
+		}
+		block[15] += (uint32_t)((1 + HASH160_SIZE) * 8);
+		hash256_checksum_lanes(&checksums, block);
+	}
+	
+	ssize_t num_ok = 0;
+	for(size_t lane = 0; lane < pending->num_lanes; ++lane) {
+		const unsigned char * payload = pending->payloads[lane];
+		struct addrs_class * cls = pending->classes[lane];
+		uint32_t checksum;
+		if(lanes_checksums) checksum = htobe32(checksums[lane]);
+		else hash256_checksum_21(payload, (unsigned char *)&checksum);
+		
+		if(memcmp(&payload[1 + HASH160_SIZE], &checksum, CHECKSUM_SIZE) != 0) {
+			reject(cls, addrs_class_error_checksum);
+			continue;
+		}
+		cls->err_code = addrs_class_error_none;
+		cls->cb_program = HASH160_SIZE;
+		memcpy(cls->program, &payload[1], HASH160_SIZE);
+		++num_ok;
+	}
+	pending->num_lanes = 0;
+	return num_ok;
+}
+
+/**
+ * classify_one()
+ * @return 1: valid, 0: rejected, -1: Base58Check checksum queued in pending
+**/
+static int classify_one(const char * addr, size_t cb_addr, struct addrs_class * cls, struct checksum_lanes * pending)
+{
+	cls->witness_version = 0;
+	if(cb_addr < SEGWIT_MIN_LENGTH || cb_addr > SEGWIT_MAX_LENGTH) return (reject(cls, addrs_class_error_length), 0);
+	
+	unsigned char buf[CHARSET_BUFFER_SIZE] __attribute__((aligned(CHARSET_BLOCK)));
+	memcpy(buf, addr, cb_addr);
+	memset(buf + cb_addr, 0, sizeof(buf) - cb_addr);
+	
+	size_t cb_hrp = 0;
+	int encoding = classify_prefix(buf, cb_addr, &cb_hrp);
+	if(encoding < 0) return (reject(cls, -encoding), 0);
+	
+	if(encoding == 2) {
+		if(charset_check(buf, cb_hrp + 1, cb_addr, 1)) return (reject(cls, addrs_class_error_charset), 0);
+		
+		char hrp[84];
+		uint8_t version = 0;
+		ssize_t cb_program = bech32_decode(addr, cb_addr, hrp, &version, cls->program);
+		if(cb_program < 0) return (reject(cls, addrs_class_error_checksum), 0);	// checksum, case mixing or padding
+		if(segwit_class(hrp, version, cb_program, cls) < 0) return (reject(cls, addrs_class_error_prefix), 0);
+		cls->err_code = addrs_class_error_none;
+		cls->witness_version = version;
+		cls->cb_program = cb_program;
+		return 1;
+	}
+	
+	if(charset_check(buf, 0, cb_addr, 0)) return (reject(cls, addrs_class_error_charset), 0);
+	unsigned char * payload = pending->payloads[pending->num_lanes];
+	if(base58_decode_25(addr, cb_addr, payload) < 0 || base58_version_class(payload[0], cls) < 0) {
+		return (reject(cls, addrs_class_error_encoding), 0);
+	}
+	pending->classes[pending->num_lanes++] = cls;
+	return -1;
+}
+
+ssize_t addrs_classify_batch(const char * const * addrs, const size_t * lengths, size_t count, struct addrs_class * classes)
+{
+	assert(addrs && classes);
+	const int lanes_checksums = use_lanes_checksums();
+	struct checksum_lanes pending[1];
+	pending->num_lanes = 0;
+	
+	ssize_t num_ok = 0;
+	for(size_t i = 0; i < count; ++i) {
+		size_t cb_addr = lengths?lengths[i]:strlen(addrs[i]);
+		int rc = classify_one(addrs[i], cb_addr, &classes[i], pending);
+		if(rc > 0) ++num_ok;
+		if(pending->num_lanes == HASH_LANES) num_ok += flush_checksums(pending, lanes_checksums);
+	}
+	num_ok += flush_checksums(pending, lanes_checksums);
+	return num_ok;
+}
+
+int addrs_classify(const char * addr, ssize_t cb_addr, struct addrs_class * cls)
+{
+	assert(addr && cls);
+	size_t length = (cb_addr < 0)?strlen(addr):(size_t)cb_addr;
+	addrs_classify_batch(&addr, &length, 1, cls);
+	return cls->err_code;
+}
+
+struct parallel_batch
+{
+	const char * const * addrs;
+	const size_t * lengths;
+	struct addrs_class * classes;
+	ssize_t num_ok;
+};
+
+static void classify_range(size_t begin, size_t end, void * user_data)
+{
+	struct parallel_batch * batch = user_data;
+	ssize_t num_ok = addrs_classify_batch(batch->addrs + begin, batch->lengths?(batch->lengths + begin):NULL, end - begin,
+		batch->classes + begin);
+	__atomic_add_fetch(&batch->num_ok, num_ok, __ATOMIC_RELAXED);
+}
+
+ssize_t addrs_classify_batch_parallel(struct thread_pool * pool, const char * const * addrs, const size_t * lengths, size_t count,
+	struct addrs_class * classes)
+{
+	assert(addrs && classes);
+	if(NULL == pool) pool = thread_pool_default();
+	
+	struct parallel_batch batch = { .addrs = addrs, .lengths = lengths, .classes = classes };
+	thread_pool_parallel_for(pool, 0, count, 0, classify_range, &batch);
+	return batch.num_ok;
+}
+
+
+#if defined(_TEST_ADDRS_CLASSIFY) && defined(_STAND_ALONE)
+static inline uint64_t splitmix64(uint64_t * state)
+{
+	uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+static void test_known_vectors(void)
+{
+	static const struct {
+		const char * addr;
+		enum addrs_class_error err;
+		enum addrs_class_type type;
+		enum addrs_network network;
+		const char * program_hex;
+	} vectors[] = {
+		{ "1A1zP1eP5QGefi2DMPTfTL5SLmv7DivfNa", 0, addrs_class_type_p2pkh, addrs_network_mainnet, "62e907b15cbf27d5425399ebf6f0fb50ebb88f18" },
+		{ "38bxLNKsRnCTXcfQggeDYJ6vMjKnQZa9Dy", 0, addrs_class_type_p2sh, addrs_network_mainnet, "4bd3cdf65b220f74c976ea415c609ccbf0120072" },
+		{ "mpXwg4jMtRhuSpVq4xS3HFHmCmWp9NyGKt", 0, addrs_class_type_p2pkh, addrs_network_testnet, "62e907b15cbf27d5425399ebf6f0fb50ebb88f18" },
+		{ "2N2GDNJ4rEm6NxfMC9ck8VuRdheQzXWaNZv", 0, addrs_class_type_p2sh, addrs_network_testnet, "62e907b15cbf27d5425399ebf6f0fb50ebb88f18" },
+		{ "BC1QW508D6QEJXTDG4Y5R3ZARVARY0C5XW7KV8F3T4", 0, addrs_class_type_p2wpkh, addrs_network_mainnet, "751e76e8199196d454941c45d1b3a323f1433bd6" },
+		{ "tb1qrp33g0q5c5txsp9arysrx4k6zdkfs4nce4xj0gdcccefvpysxf3q0sl5k7", 0, addrs_class_type_p2wsh, addrs_network_testnet,
+			"1863143c14c5166804bd19203356da136c985678cd4d27a1b8c6329604903262" },
+		{ "bcrt1qvt5s0v2uhuna2sjnn84ldu8m2r4m3rccaqhe07", 0, addrs_class_type_p2wpkh, addrs_network_regtest, "62e907b15cbf27d5425399ebf6f0fb50ebb88f18" },
+		{ "bc1p0xlxvlhemja6c4dqv22uapctqupfhlxm9h8z3k2e72q4k9hcz7vqzk5jj0", 0, addrs_class_type_p2tr, addrs_network_mainnet,
+			"79be667ef9dcbbac55a06295ce870b07029bfcdb2dce28d959f2815b16f81798" },
+		{ "BC1SW50QGDZ25J", 0, addrs_class_type_witness_unknown, addrs_network_mainnet, "751e" },
+		{ "bc1pw508d6qejxtdg4y5r3zarvary0c5xw7kw508d6qejxtdg4y5r3zarvary0c5xw7kt5nd6y", 0, addrs_class_type_witness_unknown, addrs_network_mainnet,
+			"751e76e8199196d454941c45d1b3a323f1433bd6751e76e8199196d454941c45d1b3a323f1433bd6" },
+		
+		{ "", addrs_class_error_length },
+		{ "hello world", addrs_class_error_length },
+		{ "1A1zP1eP5QGefi2DMPTfTL5SLmv7DivfNaaaa", addrs_class_error_length },
+		{ "1A1zP1eP5QGefi2DMPTfTL5SLmv7DivfNb", addrs_class_error_checksum },
+		{ "1A1zP1eP5QGefi2DMPTfTL5SLmv7DivfN0", addrs_class_error_charset },
+		{ "1A1zP1eP5QGefi2DMPTfTL5SLmv7Div Na", addrs_class_error_charset },
+		{ "11A1zP1eP5QGefi2DMPTfTL5SLmv7DivfNa", addrs_class_error_encoding },	// 26 bytes
+		{ "xA1zP1eP5QGefi2DMPTfTL5SLmv7DivfNa", addrs_class_error_prefix },
+		{ "5HueCGU8rMjxEXxiPuD5BDku4MkFqeZyd4dZ1jvhTVqvbTLvyTJ", addrs_class_error_prefix },	// WIF
+		{ "tc1p0xlxvlhemja6c4dqv22uapctqupfhlxm9h8z3k2e72q4k9hcz7vq5zuyut", addrs_class_error_prefix },	// unknown hrp
+		{ "bc1p0xlxvlhemja6c4dqv22uapctqupfhlxm9h8z3k2e72q4k9hcz7vqh2y7hd", addrs_class_error_checksum },	// v1 with a bech32 checksum
+		{ "bc1zw508d6qejxtdg4y5r3zarvaryvqyzf3du", addrs_class_error_checksum },	// v2 with a bech32 checksum
+		{ "BC1QR508D6QEJXTDG4Y5R3ZARVARYV98GJ9P", addrs_class_error_checksum },	// v0, 16-byte program
+		{ "bc1qw508d6qejxtdg4y5r3zarvary0c5xw7kv8f3t5", addrs_class_error_checksum },
+		{ "tb1qrp33g0q5c5txsp9arysrx4k6zdkfs4nce4xj0gdcccefvpysxf3q0sL5k7", addrs_class_error_checksum },	// mixed case
+		{ "bc1qw508d6qejxtdg4y5r3zarvary0c5xw7kv8f3tb", addrs_class_error_charset },
+		{ "bc1qw508d6qejxtdg4y5r3zarvary0c5xw7kv8f31", addrs_class_error_charset },
+	};
+	
+	for(size_t i = 0; i < sizeof(vectors) / sizeof(vectors[0]); ++i) {
+		struct addrs_class cls[1];
+		memset(cls, 0xA5, sizeof(cls));
+		int err = addrs_classify(vectors[i].addr, -1, cls);
+		printf("%-64s %s %s %s\n", vectors[i].addr, addrs_network_to_string(cls->network), addrs_class_type_to_string(cls->type),
+			addrs_class_error_to_string(err));
+		assert(err == vectors[i].err && cls->err_code == err);
+		if(err) {
+			assert(cls->type == addrs_class_type_invalid && cls->network == addrs_network_unknown && cls->cb_program == 0);
+			continue;
+		}
+		assert(cls->type == vectors[i].type && cls->network == vectors[i].network);
+		
+		unsigned char program[ADDRS_CLASS_MAX_PROGRAM_SIZE];
+		void * p_program = program;
+		ssize_t cb_program = hex2bin(vectors[i].program_hex, -1, &p_program);
+		assert(cb_program == cls->cb_program);
+		assert(0 == memcmp(program, cls->program, cb_program));
+	}
+	printf("==== %s: PASSED ====\n", __FUNCTION__);
+}
+
+/* reference: the generic (allocating, byte-wise) Base58 decoder and SHA-256 */
+static int ref_base58check_valid(const char * addr)
+{
+	unsigned char payload[100];
+	unsigned char * p_payload = payload;
+	size_t cb_addr = strlen(addr);
+	if(cb_addr == 0 || cb_addr > 64) return 0;
+	if(base58_decode(addr, cb_addr, &p_payload) != 25) return 0;
+	if(payload[0] != 0x00 && payload[0] != 0x05 && payload[0] != 0x6f && payload[0] != 0xc4) return 0;
+	unsigned char hash[32];
+	sha256_hash(payload, 21, hash);
+	sha256_hash(hash, 32, hash);
+	return 0 == memcmp(hash, &payload[21], 4);
+}
+
+#define NUM_ADDRS	(200000)
+#define ADDR_SLOT	(100)
+static void test_random(uint64_t seed)
+{
+	static const char * b58_digits = "123456789ABCDEFGHJKLMNPQRSTUVWXYZabcdefghijkmnopqrstuvwxyz";
+	static const char * bech32_digits = "qpzry9x8gf2tvdw0s3jn54khce6mua7l";
+	char (*addrs)[ADDR_SLOT] = calloc(NUM_ADDRS, ADDR_SLOT);
+	const char ** ptrs = calloc(NUM_ADDRS, sizeof(*ptrs));
+	struct addrs_class * classes = calloc(NUM_ADDRS, sizeof(*classes));
+	struct addrs_class * expected = calloc(NUM_ADDRS, sizeof(*expected));
+	assert(addrs && ptrs && classes && expected);
+	
+	// 1/4 valid addresses of every kind, 1/4 with one digit replaced, 1/2 garbage
+	for(size_t i = 0; i < NUM_ADDRS; ++i) {
+		char * addr = addrs[i];
+		struct addrs_class * cls = &expected[i];
+		ptrs[i] = addr;
+		uint64_t r = splitmix64(&seed);
+		int kind = r % 8;
+		if(kind < 4) {
+			unsigned char program[32];
+			for(int k = 0; k < 32; ++k) program[k] = splitmix64(&seed);
+			int form = (r >> 8) % 6;
+			cls->cb_program = 20;
+			cls->witness_version = 0;
+			switch(form) {
+			case 0: hash160_to_p2pkh(program, &addr); cls->type = addrs_class_type_p2pkh; cls->network = addrs_network_mainnet; break;
+			case 1: script_hash_to_p2sh(program, &addr); cls->type = addrs_class_type_p2sh; cls->network = addrs_network_mainnet; break;
+			case 2: bech32_encode(0, "bc", program, 20, addr); cls->type = addrs_class_type_p2wpkh; cls->network = addrs_network_mainnet; break;
+			case 3: bech32_encode(0, "tb", program, 32, addr); cls->type = addrs_class_type_p2wsh; cls->network = addrs_network_testnet; cls->cb_program = 32; break;
+			case 4: bech32_encode(1, "bc", program, 32, addr); cls->type = addrs_class_type_p2tr; cls->network = addrs_network_mainnet;
+				cls->cb_program = 32; cls->witness_version = 1; break;
+			default: bech32_encode(1, "bcrt", program, 32, addr); cls->type = addrs_class_type_p2tr; cls->network = addrs_network_regtest;
+				cls->cb_program = 32; cls->witness_version = 1; break;
+			}
+			memcpy(cls->program, program, cls->cb_program);
+			
+			if(kind >= 2) {
+				// a substitution after the prefix: always caught by bech32, by Base58Check unless the 32-bit checksum collides
+				int segwit = form >= 2;
+				size_t cb = strlen(addr);
+				size_t pos = (segwit?5:1) + (r >> 16) % (cb - (segwit?5:1));
+				const char * digits = segwit?bech32_digits:b58_digits;
+				char c = digits[(r >> 32) % (segwit?32:58)];
+				if(c == addr[pos]) c = (c == digits[0])?digits[1]:digits[0];
+				addr[pos] = c;
+				cls->type = addrs_class_type_invalid;
+			}
+		}else {
+			// garbage: random lengths, mostly from the alphabets, sometimes with a plausible prefix
+			size_t cb = 1 + (r >> 8) % 80;
+			int segwit = (r >> 16) & 1;
+			for(size_t k = 0; k < cb; ++k) {
+				uint64_t x = splitmix64(&seed);
+				addr[k] = (x % 16)?(segwit?bech32_digits[(x >> 8) % 32]:b58_digits[(x >> 8) % 58]):(char)(1 + (x >> 8) % 255);
+			}
+			addr[cb] = '\0';
+			if(kind == 7) memcpy(addr, segwit?"bc1q":"1", segwit?4:1);
+			cls->type = addrs_class_type_invalid;
+		}
+	}
+	
+	for(int lanes = 0; lanes < 2; ++lanes) {
+		s_lanes_checksums = lanes;
+		for(int parallel = 0; parallel < 2; ++parallel) {
+			memset(classes, 0xA5, NUM_ADDRS * sizeof(*classes));
+			ssize_t num_ok = parallel?addrs_classify_batch_parallel(NULL, ptrs, NULL, NUM_ADDRS, classes)
+				:addrs_classify_batch(ptrs, NULL, NUM_ADDRS, classes);
+			ssize_t expected_ok = 0;
+			for(size_t i = 0; i < NUM_ADDRS; ++i) {
+				const struct addrs_class * cls = &classes[i];
+				assert((cls->err_code == 0) == (cls->type != addrs_class_type_invalid));
+				if(expected[i].type != addrs_class_type_invalid) {
+					++expected_ok;
+					assert(cls->err_code == 0);
+					assert(cls->type == expected[i].type && cls->network == expected[i].network);
+					assert(cls->witness_version == expected[i].witness_version);
+					assert(cls->cb_program == expected[i].cb_program && 0 == memcmp(cls->program, expected[i].program, cls->cb_program));
+					continue;
+				}
+				// garbage and corrupted addresses: agree with the reference decoders
+				char hrp[84];
+				uint8_t version;
+				unsigned char program[40];
+				const char * addr = addrs[i];
+				int valid = ref_base58check_valid(addr);
+				if(!valid && bech32_decode(addr, -1, hrp, &version, program) >= 0) {
+					valid = (0 == strcmp(hrp, "bc") || 0 == strcmp(hrp, "tb") || 0 == strcmp(hrp, "bcrt"));
+				}
+				assert(valid == (cls->err_code == 0));
+				expected_ok += valid;
+			}
+			assert(num_ok == expected_ok);
+		}
+	}
+	s_lanes_checksums = -1;
+	
+	// reject-heavy throughput: this mix (3/4 invalid), one thread
+	size_t * lengths = calloc(NUM_ADDRS, sizeof(*lengths));
+	assert(lengths);
+	for(size_t i = 0; i < NUM_ADDRS; ++i) lengths[i] = strlen(addrs[i]);
+	ssize_t num_ok = 0;
+	double time_elapsed;
+	app_timer_start(NULL);
+	for(int round = 0; round < 5; ++round) num_ok = addrs_classify_batch(ptrs, lengths, NUM_ADDRS, classes);
+	time_elapsed = app_timer_stop(NULL);
+	printf("classify: %d addresses (%ld valid) x 5, %.6f s (%.2f M/s per core)\n", NUM_ADDRS, (long)num_ok,
+		time_elapsed, 5.0 * NUM_ADDRS / time_elapsed / 1e6);
+	
+	free(lengths);
+	free(addrs);
+	free(ptrs);
+	free(classes);
+	free(expected);
+	printf("==== %s: PASSED ====\n", __FUNCTION__);
+}
+#undef NUM_ADDRS
+#undef ADDR_SLOT
+
+int main(int argc, char ** argv)
+{
+	uint64_t seed = (argc > 1)?strtoull(argv[1], NULL, 0):20240607;
+	test_known_vectors();
+	test_random(seed);
+	return 0;
+}
+#endif
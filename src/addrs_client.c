@@ -0,0 +1,403 @@
+/*
+ * addrs_client.c
+ *
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ *
+ * The MIT License (MIT)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "pubkey_to_addrs.h"
+#include "addrs_protocol.h"
+#include "addrs_client.h"
+
+#define CLIENT_BUFFER_SIZE	(64 * 1024)
+#define CLIENT_DEFAULT_WINDOW	(256)
+
+struct addrs_client
+{
+	int fd;
+
+	unsigned char * out_buf;
+	size_t out_size;
+	size_t out_len;
+
+	unsigned char * in_buf;
+	size_t in_size;
+	size_t in_start;
+	size_t in_len;
+};
+
+addrs_client_t * addrs_client_connect(const char * socket_path)
+{
+	assert(socket_path);
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if(strlen(socket_path) >= sizeof(addr.sun_path)) {
+		errno = ENAMETOOLONG;
+		return NULL;
+	}
+	strcpy(addr.sun_path, socket_path);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if(fd < 0) return NULL;
+	if(connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+		int err = errno;
+		close(fd);
+		errno = err;
+		return NULL;
+	}
+
+	addrs_client_t * client = calloc(1, sizeof(*client));
+	assert(client);
+	client->fd = fd;
+	client->out_size = CLIENT_BUFFER_SIZE;
+	client->out_buf = malloc(client->out_size);
+	client->in_size = CLIENT_BUFFER_SIZE;
+	client->in_buf = malloc(client->in_size);
+	assert(client->out_buf && client->in_buf);
+	return client;
+}
+
+void addrs_client_close(addrs_client_t * client)
+{
+	if(NULL == client) return;
+	if(client->fd >= 0) close(client->fd);
+	free(client->out_buf);
+	free(client->in_buf);
+	free(client);
+}
+
+int addrs_client_get_fd(const addrs_client_t * client)
+{
+	assert(client);
+	return client->fd;
+}
+
+int addrs_client_flush(addrs_client_t * client)
+{
+	assert(client);
+	size_t pos = 0;
+	while(pos < client->out_len) {
+		ssize_t cb = send(client->fd, client->out_buf + pos, client->out_len - pos, MSG_NOSIGNAL);
+		if(cb < 0) {
+			if(errno == EINTR) continue;
+			return -1;
+		}
+		pos += cb;
+	}
+	client->out_len = 0;
+	return 0;
+}
+
+int addrs_client_send(addrs_client_t * client, uint32_t id, const unsigned char pubkey[static BITCOIN_ADDRS_PUBKEY_SIZE], uint32_t types_mask)
+{
+	assert(client);
+	if((client->out_len + ADDRS_PROTOCOL_LENGTH_SIZE + ADDRS_PROTOCOL_REQUEST_SIZE) > client->out_size) {
+		if(addrs_client_flush(client) != 0) return -1;
+	}
+
+	struct addrs_protocol_request request = { .id = id, .types_mask = types_mask };
+	memcpy(request.pubkey, pubkey, BITCOIN_ADDRS_PUBKEY_SIZE);
+	client->out_len += addrs_protocol_encode_request(&request, client->out_buf + client->out_len);
+	return 0;
+}
+
+int addrs_client_recv(addrs_client_t * client, struct addrs_protocol_response * response, int timeout_ms)
+{
+	assert(client && response);
+	if(client->out_len > 0 && addrs_client_flush(client) != 0) return -1;
+
+	while(1) {
+		ssize_t cb_frame = addrs_protocol_decode_response(client->in_buf + client->in_start, client->in_len - client->in_start, response);
+		if(cb_frame < 0) return -1;
+		if(cb_frame > 0) {
+			client->in_start += cb_frame;
+			if(client->in_start == client->in_len) client->in_start = client->in_len = 0;
+			return 1;
+		}
+
+		// incomplete frame: compact, then read more
+		if(client->in_start > 0) {
+			memmove(client->in_buf, client->in_buf + client->in_start, client->in_len - client->in_start);
+			client->in_len -= client->in_start;
+			client->in_start = 0;
+		}
+
+		if(timeout_ms >= 0) {
+			struct pollfd pfd = { .fd = client->fd, .events = POLLIN };
+			int rc = poll(&pfd, 1, timeout_ms);
+			if(rc < 0) {
+				if(errno == EINTR) continue;
+				return -1;
+			}
+			if(rc == 0) return 0;
+		}
+
+		ssize_t cb = recv(client->fd, client->in_buf + client->in_len, client->in_size - client->in_len, 0);
+		if(cb < 0) {
+			if(errno == EINTR) continue;
+			return -1;
+		}
+		if(cb == 0) return -1;
+		client->in_len += cb;
+	}
+}
+
+ssize_t addrs_client_convert(addrs_client_t * client,
+	const unsigned char (* pubkeys)[BITCOIN_ADDRS_PUBKEY_SIZE], size_t count, uint32_t types_mask,
+	size_t window,
+	struct addrs_protocol_response * responses)
+{
+	assert(client && pubkeys && responses);
+	if(0 == window) window = CLIENT_DEFAULT_WINDOW;
+
+	size_t num_sent = 0;
+	size_t num_received = 0;
+	ssize_t num_ok = 0;
+	while(num_received < count) {
+		while(num_sent < count && (num_sent - num_received) < window) {
+			if(addrs_client_send(client, (uint32_t)num_sent, pubkeys[num_sent], types_mask) != 0) return -1;
+			++num_sent;
+		}
+
+		struct addrs_protocol_response * response = &responses[num_received];
+		if(addrs_client_recv(client, response, -1) != 1) return -1;
+		if(response->id != (uint32_t)num_received) return -1;	// out of order: protocol violation
+		if(response->status == addrs_protocol_status_ok) ++num_ok;
+		++num_received;
+	}
+	return num_ok;
+}
+
+#if defined(_ADDRS_LOADGEN) && defined(_STAND_ALONE)
+/*
+ * open-loop load generator:
+ *   every connection sends at a fixed schedule (rate / connections) regardless of responses,
+ *   latency is measured from the scheduled send time, so a stalled daemon shows up in the
+ *   tail instead of silently lowering the offered load (coordinated omission).
+ */
+#include <pthread.h>
+#include <time.h>
+#include <signal.h>
+
+#define LOADGEN_NUM_KEYS	(4096)
+
+struct loadgen_context
+{
+	pthread_t th;
+	const char * socket_path;
+	double rate;	// requests per second on this connection
+	double duration;
+	size_t window;
+	const unsigned char (* pubkeys)[BITCOIN_ADDRS_PUBKEY_SIZE];
+
+	uint64_t * latencies;	// ns
+	size_t num_latencies;
+	size_t max_latencies;
+	uint64_t num_sent;
+	uint64_t num_errors;
+	int failed;
+};
+
+static inline uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void * loadgen_thread(void * user_data)
+{
+	struct loadgen_context * ctx = user_data;
+	addrs_client_t * client = addrs_client_connect(ctx->socket_path);
+	if(NULL == client) {
+		perror("connect");
+		ctx->failed = 1;
+		return NULL;
+	}
+
+	const double interval = 1e9 / ctx->rate;
+	const uint64_t total = (uint64_t)(ctx->rate * ctx->duration);
+	uint64_t * scheduled = calloc(ctx->window, sizeof(*scheduled));	// indexed by id % window
+	assert(scheduled);
+
+	uint64_t num_received = 0;
+	const uint64_t start = now_ns();
+	while(num_received < total) {
+		uint64_t now = now_ns();
+		while(ctx->num_sent < total && (ctx->num_sent - num_received) < ctx->window) {
+			uint64_t due = start + (uint64_t)(ctx->num_sent * interval);
+			if(due > now) break;
+			uint32_t id = (uint32_t)ctx->num_sent;
+			scheduled[id % ctx->window] = due;
+			if(addrs_client_send(client, id, ctx->pubkeys[id % LOADGEN_NUM_KEYS], BITCOIN_ADDRESS_TYPES_ALL) != 0) goto label_failed;
+			++ctx->num_sent;
+		}
+		if(addrs_client_flush(client) != 0) goto label_failed;
+
+		// wait for a response or the next due time, whichever comes first
+		struct timespec timeout = { 0, 0 };
+		if(ctx->num_sent < total && (ctx->num_sent - num_received) < ctx->window) {
+			uint64_t due = start + (uint64_t)(ctx->num_sent * interval);
+			now = now_ns();
+			if(due > now) timeout.tv_nsec = due - now;
+		}else {
+			timeout.tv_sec = 1;
+		}
+		if(ctx->num_sent > num_received) {
+			struct pollfd pfd = { .fd = addrs_client_get_fd(client), .events = POLLIN };
+			int rc = ppoll(&pfd, 1, &timeout, NULL);
+			if(rc < 0 && errno != EINTR) goto label_failed;
+		}else if(timeout.tv_sec || timeout.tv_nsec) {
+			nanosleep(&timeout, NULL);
+		}
+
+		struct addrs_protocol_response response[1];
+		int rc = 0;
+		while(num_received < ctx->num_sent && (rc = addrs_client_recv(client, response, 0)) == 1) {
+			uint64_t done = now_ns();
+			if(response->id != (uint32_t)num_received) goto label_failed;
+			if(response->status != addrs_protocol_status_ok) ++ctx->num_errors;
+			if(ctx->num_latencies < ctx->max_latencies) {
+				ctx->latencies[ctx->num_latencies++] = done - scheduled[response->id % ctx->window];
+			}
+			++num_received;
+		}
+		if(rc < 0) goto label_failed;
+	}
+	free(scheduled);
+	addrs_client_close(client);
+	return NULL;
+
+label_failed:
+	fprintf(stderr, "[loadgen]: connection failed after %lu requests\n", (unsigned long)ctx->num_sent);
+	ctx->failed = 1;
+	free(scheduled);
+	addrs_client_close(client);
+	return NULL;
+}
+
+static int compare_u64(const void * a, const void * b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+	return (x > y) - (x < y);
+}
+
+static inline double percentile_us(const uint64_t * sorted, size_t count, double p)
+{
+	if(0 == count) return 0;
+	size_t index = (size_t)(p * (count - 1) + 0.5);
+	return sorted[index] / 1000.0;
+}
+
+int main(int argc, char ** argv)
+{
+	if(argc < 2) {
+		fprintf(stderr, "usage: %s <socket> [connections=4] [rate=100000] [seconds=5] [window=256]\n", argv[0]);
+		return 1;
+	}
+	const char * socket_path = argv[1];
+	int num_conns = (argc > 2)?atoi(argv[2]):4;
+	double rate = (argc > 3)?atof(argv[3]):100000;
+	double duration = (argc > 4)?atof(argv[4]):5;
+	size_t window = (argc > 5)?strtoul(argv[5], NULL, 10):256;
+	if(num_conns <= 0 || rate <= 0 || duration <= 0 || 0 == window) {
+		fprintf(stderr, "invalid arguments\n");
+		return 1;
+	}
+	signal(SIGPIPE, SIG_IGN);
+
+	static unsigned char pubkeys[LOADGEN_NUM_KEYS][BITCOIN_ADDRS_PUBKEY_SIZE];
+	uint64_t state = 2021;
+	for(int i = 0; i < LOADGEN_NUM_KEYS; ++i) {
+		for(int j = 0; j < BITCOIN_ADDRS_PUBKEY_SIZE; ++j) {
+			state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+			pubkeys[i][j] = state >> 56;
+		}
+		pubkeys[i][0] = 0x02 | (pubkeys[i][0] & 1);
+	}
+
+	struct loadgen_context * contexts = calloc(num_conns, sizeof(*contexts));
+	assert(contexts);
+	for(int i = 0; i < num_conns; ++i) {
+		struct loadgen_context * ctx = &contexts[i];
+		ctx->socket_path = socket_path;
+		ctx->rate = rate / num_conns;
+		ctx->duration = duration;
+		ctx->window = window;
+		ctx->pubkeys = (const unsigned char (*)[BITCOIN_ADDRS_PUBKEY_SIZE])pubkeys;
+		ctx->max_latencies = (size_t)(ctx->rate * duration) + 1;
+		ctx->latencies = malloc(ctx->max_latencies * sizeof(*ctx->latencies));
+		assert(ctx->latencies);
+	}
+
+	uint64_t start = now_ns();
+	for(int i = 0; i < num_conns; ++i) {
+		int rc = pthread_create(&contexts[i].th, NULL, loadgen_thread, &contexts[i]);
+		assert(0 == rc);
+	}
+
+	size_t total = 0;
+	uint64_t num_errors = 0;
+	int failed = 0;
+	for(int i = 0; i < num_conns; ++i) {
+		pthread_join(contexts[i].th, NULL);
+		total += contexts[i].num_latencies;
+		num_errors += contexts[i].num_errors;
+		failed |= contexts[i].failed;
+	}
+	double elapsed = (now_ns() - start) / 1e9;
+
+	uint64_t * latencies = malloc((total + 1) * sizeof(*latencies));
+	assert(latencies);
+	size_t count = 0;
+	for(int i = 0; i < num_conns; ++i) {
+		memcpy(latencies + count, contexts[i].latencies, contexts[i].num_latencies * sizeof(*latencies));
+		count += contexts[i].num_latencies;
+		free(contexts[i].latencies);
+	}
+	qsort(latencies, count, sizeof(*latencies), compare_u64);
+
+	printf("[loadgen]: connections=%d, offered=%.0f req/s, achieved=%.0f req/s, responses=%zu, errors=%lu\n",
+		num_conns, rate, count / elapsed, count, (unsigned long)num_errors);
+	printf("[loadgen]: latency(us) p50=%.1f, p99=%.1f, p99.9=%.1f, max=%.1f\n",
+		percentile_us(latencies, count, 0.50), percentile_us(latencies, count, 0.99),
+		percentile_us(latencies, count, 0.999), count?(latencies[count - 1] / 1000.0):0);
+
+	free(latencies);
+	free(contexts);
+	return failed;
+}
+#endif
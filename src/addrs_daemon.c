@@ -0,0 +1,651 @@
+/*
+ * addrs_daemon.c
+ *
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ *
+ * The MIT License (MIT)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include "arena.h"
+#include "pubkey_to_addrs.h"
+#include "addrs_protocol.h"
+#include "addrs_daemon.h"
+
+#define DAEMON_BATCH_SIZE	(256)
+#define DAEMON_MAX_EVENTS	(64)
+#define DAEMON_READ_SIZE	(64 * 1024)
+#define DAEMON_MAX_PENDING_OUTPUT	(4 << 20)	// stop reading from a client that does not consume its responses
+#define DAEMON_CACHELINE_SIZE	(64)
+
+#define relaxed_load(p) __atomic_load_n(p, __ATOMIC_RELAXED)
+#define relaxed_store(p, value) __atomic_store_n(p, value, __ATOMIC_RELAXED)
+#define relaxed_add(p, value) relaxed_store(p, relaxed_load(p) + (value))
+
+// epoll tags for the non-connection fds
+static char s_listener_tag;
+static char s_stop_tag;
+
+struct daemon_loop;
+struct daemon_conn
+{
+	int fd;
+	struct daemon_loop * loop;
+	struct daemon_conn * prev;
+	struct daemon_conn * next;
+	struct daemon_conn * next_touched;
+	int touched;
+	int closing;
+	int write_failed;
+	int read_paused;
+
+	unsigned char * in_buf;
+	size_t in_size;
+	size_t in_len;
+
+	unsigned char * out_buf;
+	size_t out_size;
+	size_t out_start;
+	size_t out_len;
+};
+
+struct daemon_request
+{
+	struct daemon_conn * conn;
+	uint32_t id;
+	uint32_t types_mask;
+	int status;
+};
+
+/* per-loop counters, written only by the loop thread */
+struct daemon_counters
+{
+	uint64_t connections;
+	uint64_t requests;
+	uint64_t batches;
+	uint64_t errors;
+}__attribute__((aligned(DAEMON_CACHELINE_SIZE)));
+
+struct daemon_loop
+{
+	addrs_daemon_t * daemon;
+	pthread_t th;
+	int epfd;
+
+	pthread_mutex_t mutex;	// conns list (the acceptor adds connections owned by other loops)
+	struct daemon_conn * conns;
+	struct daemon_conn * touched;
+
+	size_t batch_count;
+	uint32_t batch_types_mask;
+	struct daemon_request requests[DAEMON_BATCH_SIZE];
+	struct bitcoin_addrs_record records[DAEMON_BATCH_SIZE];
+	arena_t * arena;	// scratch of the library calls, reset after every batch
+
+	struct daemon_counters counters;
+};
+
+struct addrs_daemon
+{
+	struct addrs_daemon_config config;
+	int listen_fd;
+	int stop_fd;	// eventfd, readable once stopped; never read, so every loop sees it
+
+	int num_loops;
+	struct daemon_loop * loops;
+	unsigned int next_loop;
+};
+
+addrs_daemon_t * addrs_daemon_new(const struct addrs_daemon_config * config)
+{
+	assert(config && config->socket_path);
+	addrs_daemon_t * daemon = calloc(1, sizeof(*daemon));
+	assert(daemon);
+	daemon->config = *config;
+	daemon->listen_fd = -1;
+
+	int num_loops = config->num_threads;
+	if(num_loops <= 0) num_loops = sysconf(_SC_NPROCESSORS_ONLN);
+	if(num_loops <= 0) num_loops = 1;
+	daemon->num_loops = num_loops;
+
+	daemon->stop_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	assert(daemon->stop_fd >= 0);
+
+	daemon->loops = aligned_alloc(DAEMON_CACHELINE_SIZE, sizeof(*daemon->loops) * num_loops);
+	assert(daemon->loops);
+	memset(daemon->loops, 0, sizeof(*daemon->loops) * num_loops);
+	for(int i = 0; i < num_loops; ++i) {
+		struct daemon_loop * loop = &daemon->loops[i];
+		loop->daemon = daemon;
+		loop->epfd = -1;
+		pthread_mutex_init(&loop->mutex, NULL);
+	}
+	return daemon;
+}
+
+void addrs_daemon_free(addrs_daemon_t * daemon)
+{
+	if(NULL == daemon) return;
+	for(int i = 0; i < daemon->num_loops; ++i) pthread_mutex_destroy(&daemon->loops[i].mutex);
+	free(daemon->loops);
+	if(daemon->stop_fd >= 0) close(daemon->stop_fd);
+	free(daemon);
+}
+
+void addrs_daemon_stop(addrs_daemon_t * daemon)
+{
+	uint64_t value = 1;
+	ssize_t cb = write(daemon->stop_fd, &value, sizeof(value));
+	(void)cb;
+}
+
+int addrs_daemon_get_stats(addrs_daemon_t * daemon, struct addrs_daemon_stats * stats)
+{
+	assert(daemon && stats);
+	memset(stats, 0, sizeof(*stats));
+	for(int i = 0; i < daemon->num_loops; ++i) {
+		const struct daemon_counters * counters = &daemon->loops[i].counters;
+		stats->connections += relaxed_load(&counters->connections);
+		stats->requests += relaxed_load(&counters->requests);
+		stats->batches += relaxed_load(&counters->batches);
+		stats->errors += relaxed_load(&counters->errors);
+	}
+	return 0;
+}
+
+/******************************************************************************
+ * connections
+******************************************************************************/
+static inline void buffer_reserve(unsigned char ** p_buf, size_t * p_size, size_t length)
+{
+	if(length <= *p_size) return;
+	size_t new_size = *p_size?(*p_size * 2):DAEMON_READ_SIZE;
+	while(new_size < length) new_size *= 2;
+	*p_buf = realloc(*p_buf, new_size);
+	assert(*p_buf);
+	*p_size = new_size;
+}
+
+static inline void conn_touch(struct daemon_loop * loop, struct daemon_conn * conn)
+{
+	if(conn->touched) return;
+	conn->touched = 1;
+	conn->next_touched = loop->touched;
+	loop->touched = conn;
+}
+
+static void conn_close(struct daemon_conn * conn)
+{
+	struct daemon_loop * loop = conn->loop;
+	epoll_ctl(loop->epfd, EPOLL_CTL_DEL, conn->fd, NULL);
+	close(conn->fd);
+
+	pthread_mutex_lock(&loop->mutex);
+	if(conn->prev) conn->prev->next = conn->next;
+	else loop->conns = conn->next;
+	if(conn->next) conn->next->prev = conn->prev;
+	pthread_mutex_unlock(&loop->mutex);
+
+	free(conn->in_buf);
+	free(conn->out_buf);
+	free(conn);
+}
+
+static void conn_flush(struct daemon_conn * conn)
+{
+	while(!conn->write_failed && conn->out_start < conn->out_len) {
+		ssize_t cb = send(conn->fd, conn->out_buf + conn->out_start, conn->out_len - conn->out_start, MSG_NOSIGNAL);
+		if(cb < 0) {
+			if(errno == EINTR) continue;
+			if(errno == EAGAIN || errno == EWOULDBLOCK) return;	// EPOLLOUT will resume
+			conn->write_failed = 1;
+			conn->closing = 1;
+			break;
+		}
+		conn->out_start += cb;
+	}
+	conn->out_start = 0;
+	conn->out_len = 0;
+}
+
+/******************************************************************************
+ * batching
+******************************************************************************/
+static void batch_flush(struct daemon_loop * loop)
+{
+	size_t count = loop->batch_count;
+	if(0 == count) return;
+
+	pubkeys_to_addrs_batch(loop->records, count, loop->batch_types_mask | BITCOIN_ADDRS_CHECK_PUBKEYS);
+	if(loop->arena) arena_reset(loop->arena);
+
+	for(size_t i = 0; i < count; ++i) {
+		struct daemon_request * request = &loop->requests[i];
+		const struct bitcoin_addrs_record * record = &loop->records[i];
+		struct daemon_conn * conn = request->conn;
+
+		int status = request->status;
+		if(status == addrs_protocol_status_ok && record->err_code) {
+			status = (record->err_code == BITCOIN_ADDRS_ERR_PUBKEY)?addrs_protocol_status_invalid_pubkey
+				:addrs_protocol_status_encode_error;
+		}
+		if(status != addrs_protocol_status_ok) relaxed_add(&loop->counters.errors, 1);
+
+		buffer_reserve(&conn->out_buf, &conn->out_size, conn->out_len + ADDRS_PROTOCOL_LENGTH_SIZE + ADDRS_PROTOCOL_RESPONSE_MAX_SIZE);
+		conn->out_len += addrs_protocol_encode_response(request->id, status, request->types_mask,
+			(status == addrs_protocol_status_ok)?record:NULL,
+			conn->out_buf + conn->out_len);
+		conn_touch(loop, conn);
+	}
+
+	relaxed_add(&loop->counters.requests, count);
+	relaxed_add(&loop->counters.batches, 1);
+	loop->batch_count = 0;
+	loop->batch_types_mask = 0;
+}
+
+static void batch_add(struct daemon_loop * loop, struct daemon_conn * conn, const struct addrs_protocol_request * request)
+{
+	size_t index = loop->batch_count++;
+	struct daemon_request * pending = &loop->requests[index];
+	pending->conn = conn;
+	pending->id = request->id;
+	pending->types_mask = request->types_mask?request->types_mask:BITCOIN_ADDRESS_TYPES_ALL;
+	pending->status = addrs_protocol_status_ok;
+
+	// rejected requests keep their place, responses go out in request order;
+	// keys off the curve are flagged by the batch (BITCOIN_ADDRS_CHECK_PUBKEYS)
+	if(pending->types_mask & ~BITCOIN_ADDRESS_TYPES_ALL) pending->status = addrs_protocol_status_bad_request;
+	else if(request->pubkey[0] != 0x02 && request->pubkey[0] != 0x03) pending->status = addrs_protocol_status_invalid_pubkey;
+	else loop->batch_types_mask |= pending->types_mask;
+
+	memcpy(loop->records[index].pubkey, request->pubkey, BITCOIN_ADDRS_PUBKEY_SIZE);
+	if(loop->batch_count == DAEMON_BATCH_SIZE) batch_flush(loop);
+}
+
+static void conn_read(struct daemon_loop * loop, struct daemon_conn * conn)
+{
+	conn_touch(loop, conn);
+	while(!conn->closing) {
+		if((conn->out_len - conn->out_start) > DAEMON_MAX_PENDING_OUTPUT) {
+			conn->read_paused = 1;
+			return;
+		}
+
+		buffer_reserve(&conn->in_buf, &conn->in_size, conn->in_len + DAEMON_READ_SIZE);
+		ssize_t cb = read(conn->fd, conn->in_buf + conn->in_len, conn->in_size - conn->in_len);
+		if(cb < 0) {
+			if(errno == EINTR) continue;
+			if(errno == EAGAIN || errno == EWOULDBLOCK) return;
+			conn->closing = 1;
+			return;
+		}
+		if(cb == 0) {
+			conn->closing = 1;	// peer closed, pending responses are still sent
+			return;
+		}
+		conn->in_len += cb;
+
+		size_t pos = 0;
+		while(pos < conn->in_len) {
+			struct addrs_protocol_request request;
+			ssize_t cb_frame = addrs_protocol_decode_request(conn->in_buf + pos, conn->in_len - pos, &request);
+			if(cb_frame == 0) break;
+			if(cb_frame < 0) {
+				relaxed_add(&loop->counters.errors, 1);
+				conn->closing = 1;
+				break;
+			}
+			pos += cb_frame;
+			batch_add(loop, conn, &request);
+		}
+		if(pos > 0) {
+			memmove(conn->in_buf, conn->in_buf + pos, conn->in_len - pos);
+			conn->in_len -= pos;
+		}
+	}
+}
+
+/*
+ * end of an event round: answer the coalesced batch, flush every touched connection
+ */
+static void loop_finish_round(struct daemon_loop * loop)
+{
+	batch_flush(loop);
+	while(loop->touched) {
+		struct daemon_conn * conn = loop->touched;
+		loop->touched = conn->next_touched;
+		conn->touched = 0;
+
+		conn_flush(conn);
+		if(conn->read_paused && !conn->closing && (conn->out_len - conn->out_start) <= (DAEMON_MAX_PENDING_OUTPUT / 2)) {
+			conn->read_paused = 0;
+			conn_read(loop, conn);	// re-touches conn
+			batch_flush(loop);
+			continue;
+		}
+		if(conn->closing && (conn->write_failed || conn->out_start == conn->out_len)) conn_close(conn);
+	}
+}
+
+static void accept_connections(addrs_daemon_t * daemon, struct daemon_loop * acceptor)
+{
+	while(1) {
+		int fd = accept4(daemon->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if(fd < 0) {
+			if(errno == EINTR) continue;
+			if(errno != EAGAIN && errno != EWOULDBLOCK) perror("accept");
+			return;
+		}
+
+		struct daemon_loop * loop = &daemon->loops[daemon->next_loop++ % daemon->num_loops];
+		struct daemon_conn * conn = calloc(1, sizeof(*conn));
+		assert(conn);
+		conn->fd = fd;
+		conn->loop = loop;
+
+		pthread_mutex_lock(&loop->mutex);
+		conn->next = loop->conns;
+		if(loop->conns) loop->conns->prev = conn;
+		loop->conns = conn;
+		pthread_mutex_unlock(&loop->mutex);
+
+		struct epoll_event ev = { .events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET, .data.ptr = conn };
+		int rc = epoll_ctl(loop->epfd, EPOLL_CTL_ADD, fd, &ev);
+		assert(0 == rc);
+		relaxed_add(&acceptor->counters.connections, 1);
+	}
+}
+
+static void * loop_thread(void * user_data)
+{
+	struct daemon_loop * loop = user_data;
+	addrs_daemon_t * daemon = loop->daemon;
+	struct epoll_event events[DAEMON_MAX_EVENTS];
+	loop->arena = arena_new(0, 0);
+	arena_attach(loop->arena);
+
+	int quit = 0;
+	while(!quit) {
+		int n = epoll_wait(loop->epfd, events, DAEMON_MAX_EVENTS, -1);
+		if(n < 0) {
+			if(errno == EINTR) continue;
+			perror("epoll_wait");
+			break;
+		}
+		for(int i = 0; i < n; ++i) {
+			void * tag = events[i].data.ptr;
+			if(tag == &s_stop_tag) {
+				quit = 1;
+				continue;
+			}
+			if(tag == &s_listener_tag) {
+				accept_connections(daemon, loop);
+				continue;
+			}
+
+			struct daemon_conn * conn = tag;
+			if(events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) conn_read(loop, conn);
+			else conn_touch(loop, conn);	// EPOLLOUT: pending responses can be written
+		}
+		loop_finish_round(loop);
+	}
+	arena_attach(NULL);
+	arena_free(loop->arena);
+	loop->arena = NULL;
+	return NULL;
+}
+
+static int listen_socket(addrs_daemon_t * daemon)
+{
+	const char * socket_path = daemon->config.socket_path;
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if(strlen(socket_path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "[daemon]: socket path too long: '%s'\n", socket_path);
+		return -1;
+	}
+	strcpy(addr.sun_path, socket_path);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if(fd < 0) {
+		perror("socket");
+		return -1;
+	}
+
+	int backlog = daemon->config.backlog;
+	if(backlog <= 0) backlog = SOMAXCONN;
+	unlink(socket_path);
+	if(bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, backlog) != 0) {
+		fprintf(stderr, "[daemon]: bind/listen '%s' failed: %s\n", socket_path, strerror(errno));
+		close(fd);
+		return -1;
+	}
+	daemon->listen_fd = fd;
+	return 0;
+}
+
+int addrs_daemon_run(addrs_daemon_t * daemon)
+{
+	assert(daemon);
+	if(listen_socket(daemon) != 0) return -1;
+
+	for(int i = 0; i < daemon->num_loops; ++i) {
+		struct daemon_loop * loop = &daemon->loops[i];
+		loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+		assert(loop->epfd >= 0);
+
+		struct epoll_event ev = { .events = EPOLLIN, .data.ptr = &s_stop_tag };
+		int rc = epoll_ctl(loop->epfd, EPOLL_CTL_ADD, daemon->stop_fd, &ev);
+		assert(0 == rc);
+	}
+	struct epoll_event ev = { .events = EPOLLIN, .data.ptr = &s_listener_tag };
+	int rc = epoll_ctl(daemon->loops[0].epfd, EPOLL_CTL_ADD, daemon->listen_fd, &ev);
+	assert(0 == rc);
+
+	// loop 0 (acceptor) runs in the calling thread
+	for(int i = 1; i < daemon->num_loops; ++i) {
+		rc = pthread_create(&daemon->loops[i].th, NULL, loop_thread, &daemon->loops[i]);
+		assert(0 == rc);
+	}
+	loop_thread(&daemon->loops[0]);
+	for(int i = 1; i < daemon->num_loops; ++i) pthread_join(daemon->loops[i].th, NULL);
+
+	close(daemon->listen_fd);
+	daemon->listen_fd = -1;
+	unlink(daemon->config.socket_path);
+
+	for(int i = 0; i < daemon->num_loops; ++i) {
+		struct daemon_loop * loop = &daemon->loops[i];
+		while(loop->conns) conn_close(loop->conns);
+		close(loop->epfd);
+		loop->epfd = -1;
+	}
+	return 0;
+}
+
+#if defined(_TEST_ADDRS_DAEMON) && defined(_STAND_ALONE)
+#include "addrs_client.h"
+#include "secp256k1_point.h"
+/*
+ * loopback: a daemon thread, pipelined clients, rejected requests in the middle of the stream,
+ * a client that sends a malformed frame; every answer is checked against pubkeys_to_addrs_batch()
+ */
+static void * daemon_thread(void * daemon)
+{
+	int rc = addrs_daemon_run(daemon);
+	assert(0 == rc);
+	return NULL;
+}
+
+static addrs_client_t * connect_retry(const char * socket_path)
+{
+	for(int i = 0; i < 1000; ++i) {
+		addrs_client_t * client = addrs_client_connect(socket_path);
+		if(client) return client;
+		usleep(1000);
+	}
+	return NULL;
+}
+
+static void random_pubkey(uint64_t * state, unsigned char pubkey[static BITCOIN_ADDRS_PUBKEY_SIZE])
+{
+	for(int j = 0; j < BITCOIN_ADDRS_PUBKEY_SIZE; ++j) {
+		*state = *state * 6364136223846793005ULL + 1442695040888963407ULL;
+		pubkey[j] = *state >> 56;
+	}
+	pubkey[0] = 0x02 | (pubkey[0] & 1);
+	while(0 != secp256k1_pubkey_check(pubkey)) ++pubkey[BITCOIN_ADDRS_PUBKEY_SIZE - 1];	// a point of the curve
+}
+
+static void check_response(const struct addrs_protocol_response * response, const struct bitcoin_addrs_record * expected, uint32_t types_mask)
+{
+	assert(response->status == addrs_protocol_status_ok);
+	assert(response->types_mask == types_mask);
+	assert(0 == memcmp(response->hash160, expected->hash160, BITCOIN_ADDRS_HASH160_SIZE));
+	for(int type = 0; type < bitcoin_address_types_count; ++type) {
+		if(!(types_mask & BITCOIN_ADDRESS_TYPE_MASK(type))) {
+			assert(response->cb_addrs[type] == 0);
+			continue;
+		}
+		assert(response->cb_addrs[type] == expected->cb_addrs[type]);
+		assert(0 == strcmp(response->addrs[type], expected->addrs[type]));
+	}
+}
+
+int main(int argc, char ** argv)
+{
+	char socket_path[100] = "";
+	snprintf(socket_path, sizeof(socket_path), "/tmp/test_addrs_daemon.%d.sock", (int)getpid());
+
+	struct addrs_daemon_config config = { .socket_path = socket_path, .num_threads = 2 };
+	addrs_daemon_t * daemon = addrs_daemon_new(&config);
+	assert(daemon);
+	pthread_t th;
+	int rc = pthread_create(&th, NULL, daemon_thread, daemon);
+	assert(0 == rc);
+
+	size_t num_keys = 20000;
+	struct bitcoin_addrs_record * expected = calloc(num_keys, sizeof(*expected));
+	unsigned char (* pubkeys)[BITCOIN_ADDRS_PUBKEY_SIZE] = calloc(num_keys, BITCOIN_ADDRS_PUBKEY_SIZE);
+	struct addrs_protocol_response * responses = calloc(num_keys, sizeof(*responses));
+	assert(expected && pubkeys && responses);
+	uint64_t state = 2021;
+	for(size_t i = 0; i < num_keys; ++i) {
+		random_pubkey(&state, expected[i].pubkey);
+		memcpy(pubkeys[i], expected[i].pubkey, BITCOIN_ADDRS_PUBKEY_SIZE);
+	}
+	ssize_t num_ok = pubkeys_to_addrs_batch(expected, num_keys, BITCOIN_ADDRESS_TYPES_ALL);
+	assert(num_ok == (ssize_t)num_keys);
+
+	// 1. pipelined conversion, several windows and masks
+	addrs_client_t * client = connect_retry(socket_path);
+	assert(client);
+	static const size_t windows[] = { 1, 64, 1000, 8000 };
+	for(size_t w = 0; w < sizeof(windows) / sizeof(windows[0]); ++w) {
+		uint32_t types_mask = (w & 1)?BITCOIN_ADDRESS_TYPE_MASK(w % bitcoin_address_types_count):BITCOIN_ADDRESS_TYPES_ALL;
+		size_t count = (windows[w] == 1)?1000:num_keys;
+		num_ok = addrs_client_convert(client, (const unsigned char (*)[BITCOIN_ADDRS_PUBKEY_SIZE])pubkeys, count, types_mask, windows[w], responses);
+		assert(num_ok == (ssize_t)count);
+		for(size_t i = 0; i < count; ++i) check_response(&responses[i], &expected[i], types_mask);
+		printf("window=%-5zu types_mask=0x%x: %zu responses ok\n", windows[w], types_mask, count);
+	}
+
+	// 2. rejected requests keep their place in the stream
+	uint64_t num_rejected = 0;
+	for(uint32_t i = 0; i < 300; ++i) {
+		unsigned char pubkey[BITCOIN_ADDRS_PUBKEY_SIZE];
+		memcpy(pubkey, pubkeys[i], sizeof(pubkey));
+		uint32_t types_mask = 0;
+		if(i % 3 == 1) pubkey[0] = 0x04;
+		else if(i % 7 == 4) {
+			while(0 == secp256k1_pubkey_check(pubkey)) ++pubkey[BITCOIN_ADDRS_PUBKEY_SIZE - 1];	// off the curve
+		}
+		if(i % 5 == 2) types_mask = 0x80;
+		rc = addrs_client_send(client, 1000000 + i, pubkey, types_mask);
+		assert(0 == rc);
+	}
+	for(uint32_t i = 0; i < 300; ++i) {
+		struct addrs_protocol_response response[1];
+		rc = addrs_client_recv(client, response, 5000);
+		assert(1 == rc);
+		assert(response->id == 1000000 + i);
+		if(i % 5 == 2) assert(response->status == addrs_protocol_status_bad_request);
+		else if(i % 3 == 1 || i % 7 == 4) assert(response->status == addrs_protocol_status_invalid_pubkey);
+		else check_response(response, &expected[i], BITCOIN_ADDRESS_TYPES_ALL);
+		if(response->status != addrs_protocol_status_ok) {
+			assert(response->types_mask == 0);
+			++num_rejected;
+		}
+	}
+
+	// 3. a malformed frame closes only the offending connection
+	addrs_client_t * bad_client = connect_retry(socket_path);
+	assert(bad_client);
+	static const unsigned char bad_frame[8] = { 0xff, 0xff, 0xff, 0xff };
+	ssize_t cb = send(addrs_client_get_fd(bad_client), bad_frame, sizeof(bad_frame), MSG_NOSIGNAL);
+	assert(cb == sizeof(bad_frame));
+	struct addrs_protocol_response response[1];
+	rc = addrs_client_recv(bad_client, response, 5000);
+	assert(-1 == rc);
+	addrs_client_close(bad_client);
+
+	num_ok = addrs_client_convert(client, (const unsigned char (*)[BITCOIN_ADDRS_PUBKEY_SIZE])pubkeys, 100, 0, 0, responses);
+	assert(num_ok == 100);
+	addrs_client_close(client);
+
+	addrs_daemon_stop(daemon);
+	pthread_join(th, NULL);
+	assert(0 != access(socket_path, F_OK));
+
+	struct addrs_daemon_stats stats[1];
+	addrs_daemon_get_stats(daemon, stats);
+	printf("connections=%lu, requests=%lu, batches=%lu, errors=%lu\n",
+		(unsigned long)stats->connections, (unsigned long)stats->requests,
+		(unsigned long)stats->batches, (unsigned long)stats->errors);
+	assert(stats->connections == 2);
+	assert(stats->requests == 1000 + num_keys * 3 + 300 + 100);
+	assert(stats->errors == num_rejected + 1);	// + the malformed frame
+	addrs_daemon_free(daemon);
+
+	free(expected);
+	free(pubkeys);
+	free(responses);
+	return 0;
+}
+#endif
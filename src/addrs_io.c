@@ -0,0 +1,481 @@
+/*
+ * addrs_io.c
+ *
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ *
+ * The MIT License (MIT)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#include "addrs_io.h"
+
+static const char * s_backend_names[addrs_io_backends_count] = {
+	[addrs_io_backend_auto] = "auto",
+	[addrs_io_backend_uring] = "io_uring",
+	[addrs_io_backend_sync] = "sync",
+};
+
+enum addrs_io_backend addrs_io_backend_from_string(const char * name)
+{
+	if(NULL == name) return -1;
+	for(int i = 0; i < addrs_io_backends_count; ++i) {
+		if(strcmp(name, s_backend_names[i]) == 0) return i;
+	}
+	return -1;
+}
+
+const char * addrs_io_backend_to_string(enum addrs_io_backend backend)
+{
+	if(backend < 0 || backend >= addrs_io_backends_count) return NULL;
+	return s_backend_names[backend];
+}
+
+/******************************************************************************
+ * io_uring (raw syscalls, no liburing dependency)
+******************************************************************************/
+struct uring
+{
+	int fd;
+	unsigned int sq_entries;
+
+	void * sq_ring;
+	size_t cb_sq_ring;
+	void * cq_ring;
+	size_t cb_cq_ring;	// 0: shared with sq_ring (IORING_FEAT_SINGLE_MMAP)
+	struct io_uring_sqe * sqes;
+	size_t cb_sqes;
+
+	unsigned int * sq_head;
+	unsigned int * sq_tail;
+	unsigned int * sq_mask;
+	unsigned int * sq_array;
+	unsigned int * cq_head;
+	unsigned int * cq_tail;
+	unsigned int * cq_mask;
+	struct io_uring_cqe * cqes;
+
+	unsigned int sqe_tail;	// local tail, published on submit
+	unsigned int to_submit;
+};
+
+static inline int sys_io_uring_setup(unsigned int entries, struct io_uring_params * params)
+{
+	return syscall(__NR_io_uring_setup, entries, params);
+}
+static inline int sys_io_uring_enter(int fd, unsigned int to_submit, unsigned int min_complete, unsigned int flags)
+{
+	return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+static inline int sys_io_uring_register(int fd, unsigned int opcode, const void * arg, unsigned int nr_args)
+{
+	return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static void uring_cleanup(struct uring * ring)
+{
+	if(ring->sqes) munmap(ring->sqes, ring->cb_sqes);
+	if(ring->cq_ring && ring->cb_cq_ring) munmap(ring->cq_ring, ring->cb_cq_ring);
+	if(ring->sq_ring) munmap(ring->sq_ring, ring->cb_sq_ring);
+	if(ring->fd >= 0) close(ring->fd);
+	memset(ring, 0, sizeof(*ring));
+	ring->fd = -1;
+}
+
+static int uring_probe_ops(int fd)
+{
+	// IORING_OP_READ / IORING_OP_WRITE need 5.6+
+	size_t cb_probe = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+	struct io_uring_probe * probe = calloc(1, cb_probe);
+	assert(probe);
+
+	int ok = 0;
+	if(sys_io_uring_register(fd, IORING_REGISTER_PROBE, probe, 256) == 0) {
+		static const int required_ops[] = { IORING_OP_READ, IORING_OP_WRITE, IORING_OP_READ_FIXED, IORING_OP_WRITE_FIXED };
+		ok = 1;
+		for(size_t i = 0; i < sizeof(required_ops) / sizeof(required_ops[0]); ++i) {
+			int op = required_ops[i];
+			if(op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) ok = 0;
+		}
+	}
+	free(probe);
+	return ok?0:-1;
+}
+
+static int uring_init(struct uring * ring, unsigned int entries)
+{
+	memset(ring, 0, sizeof(*ring));
+	ring->fd = -1;
+
+	struct io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	int fd = sys_io_uring_setup(entries, &params);
+	if(fd < 0) return -1;
+	ring->fd = fd;
+
+	if(uring_probe_ops(fd) != 0) {
+		uring_cleanup(ring);
+		errno = ENOTSUP;
+		return -1;
+	}
+
+	ring->sq_entries = params.sq_entries;
+	ring->cb_sq_ring = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+	size_t cb_cq_ring = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	int single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP);
+	if(single_mmap && cb_cq_ring > ring->cb_sq_ring) ring->cb_sq_ring = cb_cq_ring;
+
+	ring->sq_ring = mmap(NULL, ring->cb_sq_ring, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	if(ring->sq_ring == MAP_FAILED) {
+		ring->sq_ring = NULL;
+		uring_cleanup(ring);
+		return -1;
+	}
+	if(single_mmap) ring->cq_ring = ring->sq_ring;
+	else {
+		ring->cq_ring = mmap(NULL, cb_cq_ring, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+		if(ring->cq_ring == MAP_FAILED) {
+			ring->cq_ring = NULL;
+			uring_cleanup(ring);
+			return -1;
+		}
+		ring->cb_cq_ring = cb_cq_ring;
+	}
+
+	ring->cb_sqes = params.sq_entries * sizeof(struct io_uring_sqe);
+	ring->sqes = mmap(NULL, ring->cb_sqes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+	if(ring->sqes == MAP_FAILED) {
+		ring->sqes = NULL;
+		uring_cleanup(ring);
+		return -1;
+	}
+
+	char * sq = ring->sq_ring;
+	char * cq = ring->cq_ring;
+	ring->sq_head = (unsigned int *)(sq + params.sq_off.head);
+	ring->sq_tail = (unsigned int *)(sq + params.sq_off.tail);
+	ring->sq_mask = (unsigned int *)(sq + params.sq_off.ring_mask);
+	ring->sq_array = (unsigned int *)(sq + params.sq_off.array);
+	ring->cq_head = (unsigned int *)(cq + params.cq_off.head);
+	ring->cq_tail = (unsigned int *)(cq + params.cq_off.tail);
+	ring->cq_mask = (unsigned int *)(cq + params.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+	ring->sqe_tail = *ring->sq_tail;
+	return 0;
+}
+
+static void uring_prep(struct uring * ring, int opcode, int fd, const void * buf, size_t size, int64_t offset, int buf_index, uint64_t user_data)
+{
+	unsigned int index = ring->sqe_tail & *ring->sq_mask;
+	struct io_uring_sqe * sqe = &ring->sqes[index];
+	memset(sqe, 0, sizeof(*sqe));
+
+	if(buf_index >= 0) {
+		opcode = (opcode == IORING_OP_READ)?IORING_OP_READ_FIXED:IORING_OP_WRITE_FIXED;
+		sqe->buf_index = buf_index;
+	}
+	sqe->opcode = opcode;
+	sqe->fd = fd;
+	sqe->off = (offset < 0)?(uint64_t)-1:(uint64_t)offset;	// -1: current file position
+	sqe->addr = (uint64_t)(uintptr_t)buf;
+	sqe->len = size;
+	sqe->user_data = user_data;
+
+	ring->sq_array[index] = index;
+	++ring->sqe_tail;
+	++ring->to_submit;
+}
+
+static int uring_reap(struct uring * ring, struct addrs_io_completion * completions, unsigned int max_completions)
+{
+	unsigned int head = *ring->cq_head;
+	unsigned int tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+	unsigned int count = 0;
+	while(head != tail && count < max_completions) {
+		const struct io_uring_cqe * cqe = &ring->cqes[head & *ring->cq_mask];
+		completions[count].user_data = cqe->user_data;
+		completions[count].result = cqe->res;
+		++count;
+		++head;
+	}
+	__atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+	return count;
+}
+
+/******************************************************************************
+ * addrs_io
+******************************************************************************/
+struct addrs_io
+{
+	enum addrs_io_backend backend;
+	unsigned int queue_depth;
+	unsigned int in_flight;	// submitted (or queued) but not yet returned by addrs_io_wait()
+
+	struct uring ring;
+
+	// sync backend: completed operations, returned by the next wait
+	struct addrs_io_completion * completions;
+	unsigned int completions_head;
+	unsigned int num_completions;
+};
+
+addrs_io_t * addrs_io_new(enum addrs_io_backend backend, unsigned int queue_depth)
+{
+	assert(backend >= 0 && backend < addrs_io_backends_count);
+	if(queue_depth == 0) queue_depth = 1;
+
+	addrs_io_t * io = calloc(1, sizeof(*io));
+	assert(io);
+	io->queue_depth = queue_depth;
+	io->ring.fd = -1;
+
+	if(backend != addrs_io_backend_sync) {
+		if(uring_init(&io->ring, queue_depth) == 0) backend = addrs_io_backend_uring;
+		else {
+			if(backend == addrs_io_backend_uring) {
+				fprintf(stderr, "io_uring unavailable: %s\n", strerror(errno));
+				free(io);
+				return NULL;
+			}
+			fprintf(stderr, "[io]: io_uring unavailable (%s), falling back to pread/pwrite\n", strerror(errno));
+			backend = addrs_io_backend_sync;
+		}
+	}
+	io->backend = backend;
+
+	if(backend == addrs_io_backend_sync) {
+		io->completions = calloc(queue_depth, sizeof(*io->completions));
+		assert(io->completions);
+	}
+	return io;
+}
+
+void addrs_io_free(addrs_io_t * io)
+{
+	if(NULL == io) return;
+	if(io->backend == addrs_io_backend_uring) {
+		// the caller must have reaped every operation, buffers may be freed right after this call
+		assert(0 == io->in_flight);
+		uring_cleanup(&io->ring);
+	}
+	free(io->completions);
+	free(io);
+}
+
+enum addrs_io_backend addrs_io_get_backend(const addrs_io_t * io)
+{
+	assert(io);
+	return io->backend;
+}
+
+int addrs_io_register_buffers(addrs_io_t * io, const struct iovec * iovecs, unsigned int count)
+{
+	assert(io);
+	if(io->backend != addrs_io_backend_uring) return 0;
+	int rc = sys_io_uring_register(io->ring.fd, IORING_REGISTER_BUFFERS, iovecs, count);
+	return (rc == 0)?0:-1;
+}
+
+static void sync_complete(addrs_io_t * io, uint64_t user_data, ssize_t result)
+{
+	assert(io->num_completions < io->queue_depth);
+	unsigned int index = (io->completions_head + io->num_completions) % io->queue_depth;
+	io->completions[index].user_data = user_data;
+	io->completions[index].result = result;
+	++io->num_completions;
+}
+
+int addrs_io_submit_read(addrs_io_t * io, int fd, void * buf, size_t size, int64_t offset, int buf_index, uint64_t user_data)
+{
+	assert(io);
+	if(io->in_flight >= io->queue_depth) return -1;
+	++io->in_flight;
+
+	if(io->backend == addrs_io_backend_uring) {
+		uring_prep(&io->ring, IORING_OP_READ, fd, buf, size, offset, buf_index, user_data);
+		return 0;
+	}
+
+	ssize_t cb = 0;
+	do {
+		cb = (offset < 0)?read(fd, buf, size):pread(fd, buf, size, offset);
+	}while(cb < 0 && errno == EINTR);
+	sync_complete(io, user_data, (cb < 0)?-errno:cb);
+	return 0;
+}
+
+int addrs_io_submit_write(addrs_io_t * io, int fd, const void * buf, size_t size, int64_t offset, int buf_index, uint64_t user_data)
+{
+	assert(io);
+	if(io->in_flight >= io->queue_depth) return -1;
+	++io->in_flight;
+
+	if(io->backend == addrs_io_backend_uring) {
+		uring_prep(&io->ring, IORING_OP_WRITE, fd, buf, size, offset, buf_index, user_data);
+		return 0;
+	}
+
+	ssize_t cb = 0;
+	do {
+		cb = (offset < 0)?write(fd, buf, size):pwrite(fd, buf, size, offset);
+	}while(cb < 0 && errno == EINTR);
+	sync_complete(io, user_data, (cb < 0)?-errno:cb);
+	return 0;
+}
+
+int addrs_io_wait(addrs_io_t * io, struct addrs_io_completion * completions, unsigned int max_completions, unsigned int min_complete)
+{
+	assert(io && completions);
+	if(min_complete > io->in_flight) min_complete = io->in_flight;
+	if(min_complete > max_completions) min_complete = max_completions;
+
+	if(io->backend == addrs_io_backend_sync) {
+		unsigned int count = 0;
+		while(count < max_completions && io->num_completions > 0) {
+			completions[count++] = io->completions[io->completions_head];
+			io->completions_head = (io->completions_head + 1) % io->queue_depth;
+			--io->num_completions;
+		}
+		io->in_flight -= count;
+		return count;
+	}
+
+	struct uring * ring = &io->ring;
+	__atomic_store_n(ring->sq_tail, ring->sqe_tail, __ATOMIC_RELEASE);
+
+	unsigned int count = uring_reap(ring, completions, max_completions);
+	while(ring->to_submit > 0 || count < min_complete) {
+		unsigned int wait_nr = (count < min_complete)?(min_complete - count):0;
+		int rc = sys_io_uring_enter(ring->fd, ring->to_submit, wait_nr, wait_nr?IORING_ENTER_GETEVENTS:0);
+		if(rc < 0) {
+			if(errno == EINTR || errno == EAGAIN || errno == EBUSY) continue;
+			perror("io_uring_enter");
+			io->in_flight -= count;
+			return count?(int)count:-1;
+		}
+		ring->to_submit -= rc;
+		count += uring_reap(ring, completions + count, max_completions - count);
+	}
+	io->in_flight -= count;
+	return count;
+}
+
+
+#if defined(_TEST_ADDRS_IO) && defined(_STAND_ALONE)
+#include <fcntl.h>
+
+/* write a file in out-of-order chunks, read it back in chunks, through each backend */
+static void test_backend(enum addrs_io_backend backend, const char * path)
+{
+	#define NUM_CHUNKS (16)
+	#define CHUNK_SIZE (64 * 1024)
+	addrs_io_t * io = addrs_io_new(backend, NUM_CHUNKS);
+	if(NULL == io) {
+		printf("backend %s: unavailable, skipped\n", addrs_io_backend_to_string(backend));
+		return;
+	}
+	printf("backend %s: %s\n", addrs_io_backend_to_string(backend), addrs_io_backend_to_string(addrs_io_get_backend(io)));
+
+	static unsigned char data[NUM_CHUNKS][CHUNK_SIZE];
+	static unsigned char readback[NUM_CHUNKS][CHUNK_SIZE];
+	for(int i = 0; i < NUM_CHUNKS; ++i) {
+		for(int j = 0; j < CHUNK_SIZE; ++j) data[i][j] = (unsigned char)(i * 131 + j * 7);
+	}
+	memset(readback, 0, sizeof(readback));
+
+	struct iovec iovecs[NUM_CHUNKS];
+	for(int i = 0; i < NUM_CHUNKS; ++i) {
+		iovecs[i].iov_base = readback[i];
+		iovecs[i].iov_len = CHUNK_SIZE;
+	}
+	int registered = (addrs_io_register_buffers(io, iovecs, NUM_CHUNKS) == 0);
+
+	int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	assert(fd >= 0);
+
+	// reverse order writes
+	for(int i = NUM_CHUNKS - 1; i >= 0; --i) {
+		int rc = addrs_io_submit_write(io, fd, data[i], CHUNK_SIZE, (int64_t)i * CHUNK_SIZE, -1, i);
+		assert(0 == rc);
+	}
+	assert(-1 == addrs_io_submit_write(io, fd, data[0], CHUNK_SIZE, 0, -1, 0));	// queue full
+
+	struct addrs_io_completion completions[NUM_CHUNKS];
+	int num_done = 0;
+	while(num_done < NUM_CHUNKS) {
+		int n = addrs_io_wait(io, completions, NUM_CHUNKS, 1);
+		assert(n > 0);
+		for(int i = 0; i < n; ++i) assert(completions[i].result == CHUNK_SIZE);
+		num_done += n;
+	}
+
+	for(int i = 0; i < NUM_CHUNKS; ++i) {
+		int rc = addrs_io_submit_read(io, fd, readback[i], CHUNK_SIZE, (int64_t)i * CHUNK_SIZE, registered?i:-1, i);
+		assert(0 == rc);
+	}
+	num_done = 0;
+	while(num_done < NUM_CHUNKS) {
+		int n = addrs_io_wait(io, completions, NUM_CHUNKS, NUM_CHUNKS - num_done);
+		assert(n > 0);
+		for(int i = 0; i < n; ++i) assert(completions[i].result == CHUNK_SIZE && completions[i].user_data < NUM_CHUNKS);
+		num_done += n;
+	}
+	assert(0 == memcmp(data, readback, sizeof(data)));
+
+	// read past the end
+	int rc = addrs_io_submit_read(io, fd, readback[0], CHUNK_SIZE, (int64_t)NUM_CHUNKS * CHUNK_SIZE, -1, 0);
+	assert(0 == rc);
+	int n = addrs_io_wait(io, completions, 1, 1);
+	assert(n == 1 && completions[0].result == 0);
+
+	close(fd);
+	unlink(path);
+	addrs_io_free(io);
+	#undef NUM_CHUNKS
+	#undef CHUNK_SIZE
+}
+
+int main(int argc, char ** argv)
+{
+	char path[] = "/tmp/test_addrs_io.XXXXXX";
+	int fd = mkstemp(path);
+	assert(fd >= 0);
+	close(fd);
+
+	test_backend(addrs_io_backend_sync, path);
+	test_backend(addrs_io_backend_auto, path);
+	test_backend(addrs_io_backend_uring, path);
+
+	printf("==== %s: PASSED ====\n", __FILE__);
+	return 0;
+}
+#endif
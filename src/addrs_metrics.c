@@ -0,0 +1,436 @@
+/*
+ * addrs_metrics.c
+ *
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ *
+ * The MIT License (MIT)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "addrs_stats.h"
+#include "addrs_bulk.h"
+#include "addrs_metrics.h"
+
+#define METRICS_PREFIX "pubkey_to_addrs_"
+#define METRICS_BUFFER_SIZE (64 * 1024)
+
+struct metrics_buffer
+{
+	char * data;
+	size_t size;
+	size_t length;
+	int overflow;
+};
+
+static void metrics_append(struct metrics_buffer * buf, const char * fmt, ...)
+{
+	if(buf->overflow) return;
+	va_list args;
+	va_start(args, fmt);
+	int cb = vsnprintf(buf->data + buf->length, buf->size - buf->length, fmt, args);
+	va_end(args);
+	if(cb < 0 || (size_t)cb >= (buf->size - buf->length)) {
+		buf->overflow = 1;
+		return;
+	}
+	buf->length += cb;
+}
+
+#define metrics_header(buf, name, type, help) \
+	metrics_append(buf, "# HELP " METRICS_PREFIX name " " help "\n# TYPE " METRICS_PREFIX name " " type "\n")
+
+static void format_summary(struct metrics_buffer * buf, const char * name, const struct addrs_latency_histogram * hist)
+{
+	static const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+	for(size_t i = 0; i < sizeof(quantiles) / sizeof(quantiles[0]); ++i) {
+		metrics_append(buf, METRICS_PREFIX "%s{quantile=\"%g\"} %.9f\n", name, quantiles[i],
+			addrs_latency_histogram_quantile(hist, quantiles[i]));
+	}
+	metrics_append(buf, METRICS_PREFIX "%s_sum %.9f\n", name, (double)hist->sum_ns / 1e9);
+	metrics_append(buf, METRICS_PREFIX "%s_count %lu\n", name, (unsigned long)hist->count);
+}
+
+ssize_t addrs_metrics_format(const struct addrs_bulk_metrics * metrics, double keys_per_second, char * data, size_t size)
+{
+	assert(metrics && data && size > 0);
+	struct metrics_buffer buf[1] = {{ .data = data, .size = size }};
+
+	metrics_header(buf, "uptime_seconds", "gauge", "Seconds since the bulk conversion started.");
+	metrics_append(buf, METRICS_PREFIX "uptime_seconds %.3f\n", metrics->uptime);
+
+	metrics_header(buf, "workers", "gauge", "Number of conversion worker threads.");
+	metrics_append(buf, METRICS_PREFIX "workers %d\n", metrics->num_workers);
+
+	metrics_header(buf, "keys_total", "counter", "Public keys converted.");
+	metrics_append(buf, METRICS_PREFIX "keys_total %lu\n", (unsigned long)metrics->keys);
+
+	metrics_header(buf, "keys_per_second", "gauge", "Conversion throughput over the last publishing interval.");
+	metrics_append(buf, METRICS_PREFIX "keys_per_second %.3f\n", keys_per_second);
+
+	metrics_header(buf, "errors_total", "counter", "Rejected input lines and I/O failures.");
+	for(int i = 0; i < addrs_bulk_errors_count; ++i) {
+		metrics_append(buf, METRICS_PREFIX "errors_total{type=\"%s\"} %lu\n",
+			addrs_bulk_error_to_string(i), (unsigned long)metrics->errors[i]);
+	}
+
+	metrics_header(buf, "bytes_total", "counter", "Bytes read from the input and written to the output.");
+	metrics_append(buf, METRICS_PREFIX "bytes_total{direction=\"read\"} %lu\n", (unsigned long)metrics->bytes_read);
+	metrics_append(buf, METRICS_PREFIX "bytes_total{direction=\"written\"} %lu\n", (unsigned long)metrics->bytes_written);
+
+	metrics_header(buf, "chunks_total", "counter", "Input chunks read and output chunks written.");
+	metrics_append(buf, METRICS_PREFIX "chunks_total{direction=\"read\"} %lu\n", (unsigned long)metrics->chunks_read);
+	metrics_append(buf, METRICS_PREFIX "chunks_total{direction=\"written\"} %lu\n", (unsigned long)metrics->chunks_written);
+
+	metrics_header(buf, "queue_depth", "gauge", "Chunks waiting for a worker (input) or for the writer (output).");
+	metrics_append(buf, METRICS_PREFIX "queue_depth{queue=\"input\"} %lu\n", (unsigned long)metrics->input_queue_depth);
+	metrics_append(buf, METRICS_PREFIX "queue_depth{queue=\"output\"} %lu\n", (unsigned long)metrics->output_queue_depth);
+
+	metrics_header(buf, "key_latency_seconds", "summary", "Per-key conversion time.");
+	format_summary(buf, "key_latency_seconds", &metrics->key_latency);
+
+	metrics_header(buf, "chunk_latency_seconds", "summary", "Time from a chunk being read to it being written.");
+	format_summary(buf, "chunk_latency_seconds", &metrics->chunk_latency);
+
+	if(addrs_stats_enabled()) {
+		struct addrs_stats_snapshot stats[1];
+		addrs_stats_snapshot(stats);
+		metrics_header(buf, "stage_ticks_total", "counter", "CPU ticks spent per pipeline stage.");
+		for(int i = 0; i < addrs_stats_stages_count; ++i) {
+			metrics_append(buf, METRICS_PREFIX "stage_ticks_total{stage=\"%s\"} %lu\n",
+				addrs_stats_stage_to_string(i), (unsigned long)stats->ticks[i]);
+		}
+	}
+
+	if(buf->overflow) return -1;
+	return buf->length;
+}
+
+/******************************************************************************
+ * exporter
+******************************************************************************/
+struct addrs_metrics_exporter
+{
+	addrs_metrics_source_func get_metrics;
+	void * user_data;
+	char * textfile;
+	char * socket_path;
+	double interval;
+
+	int listen_fd;
+	int wakeup_fds[2];
+	pthread_t th;
+	int running;
+
+	// throughput is derived from the previous tick
+	uint64_t last_keys;
+	double last_uptime;
+	double keys_per_second;
+
+	char * buf;
+};
+
+addrs_metrics_exporter_t * addrs_metrics_exporter_new(addrs_metrics_source_func get_metrics, void * user_data,
+	const char * textfile, const char * socket_path, double interval)
+{
+	assert(get_metrics);
+	if(NULL == textfile && NULL == socket_path) return NULL;
+
+	addrs_metrics_exporter_t * exporter = calloc(1, sizeof(*exporter));
+	assert(exporter);
+	exporter->get_metrics = get_metrics;
+	exporter->user_data = user_data;
+	if(textfile) exporter->textfile = strdup(textfile);
+	if(socket_path) exporter->socket_path = strdup(socket_path);
+	exporter->interval = (interval > 0)?interval:10.0;
+	exporter->listen_fd = -1;
+	exporter->wakeup_fds[0] = -1;
+	exporter->wakeup_fds[1] = -1;
+
+	exporter->buf = malloc(METRICS_BUFFER_SIZE);
+	assert(exporter->buf);
+	return exporter;
+}
+
+void addrs_metrics_exporter_free(addrs_metrics_exporter_t * exporter)
+{
+	if(NULL == exporter) return;
+	addrs_metrics_exporter_stop(exporter);
+	free(exporter->textfile);
+	free(exporter->socket_path);
+	free(exporter->buf);
+	free(exporter);
+}
+
+static ssize_t exporter_render(addrs_metrics_exporter_t * exporter, int update_rate)
+{
+	struct addrs_bulk_metrics metrics[1];
+	memset(metrics, 0, sizeof(metrics));
+	exporter->get_metrics(exporter->user_data, metrics);
+
+	if(update_rate) {
+		double elapsed = metrics->uptime - exporter->last_uptime;
+		if(elapsed > 0) exporter->keys_per_second = (double)(metrics->keys - exporter->last_keys) / elapsed;
+		exporter->last_keys = metrics->keys;
+		exporter->last_uptime = metrics->uptime;
+	}
+	return addrs_metrics_format(metrics, exporter->keys_per_second, exporter->buf, METRICS_BUFFER_SIZE);
+}
+
+static int write_textfile(addrs_metrics_exporter_t * exporter, const char * text, size_t length)
+{
+	// textfile collectors may read at any time: write to a temp file then rename atomically
+	char tmp_file[4096] = "";
+	snprintf(tmp_file, sizeof(tmp_file), "%s.%d.tmp", exporter->textfile, (int)getpid());
+
+	FILE * fp = fopen(tmp_file, "w");
+	if(NULL == fp) {
+		fprintf(stderr, "[metrics]: open '%s' failed: %s\n", tmp_file, strerror(errno));
+		return -1;
+	}
+	size_t cb = fwrite(text, 1, length, fp);
+	int rc = fclose(fp);
+	if(cb != length || rc != 0) {
+		unlink(tmp_file);
+		return -1;
+	}
+	if(rename(tmp_file, exporter->textfile) != 0) {
+		fprintf(stderr, "[metrics]: rename '%s' failed: %s\n", tmp_file, strerror(errno));
+		unlink(tmp_file);
+		return -1;
+	}
+	return 0;
+}
+
+static void serve_client(addrs_metrics_exporter_t * exporter, int fd)
+{
+	ssize_t length = exporter_render(exporter, 0);
+	if(length > 0) {
+		const char * p = exporter->buf;
+		while(length > 0) {
+			ssize_t cb = send(fd, p, length, MSG_NOSIGNAL);
+			if(cb < 0 && errno == EINTR) continue;
+			if(cb <= 0) break;
+			p += cb;
+			length -= cb;
+		}
+	}
+	close(fd);
+}
+
+static void * exporter_thread(void * user_data)
+{
+	addrs_metrics_exporter_t * exporter = user_data;
+	const int timeout_ms = (int)(exporter->interval * 1000);
+	struct timespec next_tick;
+	clock_gettime(CLOCK_MONOTONIC, &next_tick);
+
+	while(1) {
+		struct pollfd pfds[2] = {
+			[0] = { .fd = exporter->wakeup_fds[0], .events = POLLIN },
+			[1] = { .fd = exporter->listen_fd, .events = POLLIN },
+		};
+		int n = poll(pfds, (exporter->listen_fd >= 0)?2:1, timeout_ms);
+		if(n < 0 && errno != EINTR) {
+			perror("[metrics]: poll");
+			break;
+		}
+		if(n > 0 && (pfds[0].revents & POLLIN)) break;	// stop requested
+		if(n > 0 && (pfds[1].revents & POLLIN)) {
+			int fd = accept(exporter->listen_fd, NULL, NULL);
+			if(fd >= 0) serve_client(exporter, fd);
+		}
+
+		struct timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		double elapsed = (double)(now.tv_sec - next_tick.tv_sec) + (double)(now.tv_nsec - next_tick.tv_nsec) / 1e9;
+		if(elapsed < exporter->interval) continue;
+		next_tick = now;
+
+		ssize_t length = exporter_render(exporter, 1);
+		if(length > 0 && exporter->textfile) write_textfile(exporter, exporter->buf, length);
+	}
+	return NULL;
+}
+
+static int listen_unix_socket(const char * socket_path)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	if(strlen(socket_path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "[metrics]: socket path too long: %s\n", socket_path);
+		return -1;
+	}
+	strcpy(addr.sun_path, socket_path);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if(fd < 0) {
+		perror("[metrics]: socket");
+		return -1;
+	}
+	unlink(socket_path);
+	if(bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 16) != 0) {
+		fprintf(stderr, "[metrics]: bind/listen '%s' failed: %s\n", socket_path, strerror(errno));
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+int addrs_metrics_exporter_start(addrs_metrics_exporter_t * exporter)
+{
+	assert(exporter);
+	if(exporter->running) return 0;
+
+	if(exporter->socket_path) {
+		exporter->listen_fd = listen_unix_socket(exporter->socket_path);
+		if(exporter->listen_fd < 0) return -1;
+	}
+	if(pipe2(exporter->wakeup_fds, O_CLOEXEC) != 0) {
+		perror("[metrics]: pipe");
+		return -1;
+	}
+
+	int rc = pthread_create(&exporter->th, NULL, exporter_thread, exporter);
+	if(rc) return -1;
+	exporter->running = 1;
+	return 0;
+}
+
+void addrs_metrics_exporter_stop(addrs_metrics_exporter_t * exporter)
+{
+	if(NULL == exporter || !exporter->running) return;
+
+	ssize_t cb = write(exporter->wakeup_fds[1], "q", 1);
+	(void)cb;
+	pthread_join(exporter->th, NULL);
+	exporter->running = 0;
+
+	// final snapshot
+	ssize_t length = exporter_render(exporter, 1);
+	if(length > 0 && exporter->textfile) write_textfile(exporter, exporter->buf, length);
+
+	close(exporter->wakeup_fds[0]);
+	close(exporter->wakeup_fds[1]);
+	exporter->wakeup_fds[0] = exporter->wakeup_fds[1] = -1;
+	if(exporter->listen_fd >= 0) {
+		close(exporter->listen_fd);
+		exporter->listen_fd = -1;
+		unlink(exporter->socket_path);
+	}
+}
+
+
+#if defined(_TEST_ADDRS_METRICS) && defined(_STAND_ALONE)
+/*
+ * scraper stand-in: connects to the exporter socket like a collector would,
+ * and checks the exposition text.
+ */
+static int fake_metrics_source(void * user_data, struct addrs_bulk_metrics * metrics)
+{
+	uint64_t * p_keys = user_data;
+	metrics->uptime = 2.0;
+	metrics->num_workers = 4;
+	metrics->keys = *p_keys;
+	metrics->errors[addrs_bulk_error_pubkey_hex] = 3;
+	metrics->input_queue_depth = 5;
+	metrics->key_latency.count = 100;
+	metrics->key_latency.sum_ns = 100 * 4000;
+	metrics->key_latency.buckets[24] = 90;	// 4096..6144 ns
+	metrics->key_latency.buckets[30] = 10;	// 32768..49152 ns
+	return 0;
+}
+
+static ssize_t scrape(const char * socket_path, char * buf, size_t size)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path) - 1);
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	assert(fd >= 0);
+	int rc = connect(fd, (struct sockaddr *)&addr, sizeof(addr));
+	assert(0 == rc);
+
+	size_t length = 0;
+	ssize_t cb = 0;
+	while(length < size - 1 && (cb = read(fd, buf + length, size - 1 - length)) > 0) length += cb;
+	buf[length] = '\0';
+	close(fd);
+	return length;
+}
+
+int main(int argc, char ** argv)
+{
+	char socket_path[100] = "";
+	char textfile[100] = "";
+	snprintf(socket_path, sizeof(socket_path), "/tmp/test_addrs_metrics.%d.sock", (int)getpid());
+	snprintf(textfile, sizeof(textfile), "/tmp/test_addrs_metrics.%d.prom", (int)getpid());
+
+	uint64_t keys = 1000;
+	addrs_metrics_exporter_t * exporter = addrs_metrics_exporter_new(fake_metrics_source, &keys, textfile, socket_path, 0.05);
+	assert(exporter);
+	int rc = addrs_metrics_exporter_start(exporter);
+	assert(0 == rc);
+
+	static char text[METRICS_BUFFER_SIZE];
+	ssize_t length = scrape(socket_path, text, sizeof(text));
+	assert(length > 0);
+	printf("%s", text);
+
+	assert(strstr(text, "# TYPE pubkey_to_addrs_keys_total counter\n"));
+	assert(strstr(text, "pubkey_to_addrs_keys_total 1000\n"));
+	assert(strstr(text, "pubkey_to_addrs_errors_total{type=\"pubkey_hex\"} 3\n"));
+	assert(strstr(text, "pubkey_to_addrs_queue_depth{queue=\"input\"} 5\n"));
+	assert(strstr(text, "pubkey_to_addrs_key_latency_seconds{quantile=\"0.5\"} 0.000006144\n"));
+	assert(strstr(text, "pubkey_to_addrs_key_latency_seconds{quantile=\"0.99\"} 0.000049152\n"));
+	assert(strstr(text, "pubkey_to_addrs_key_latency_seconds_count 100\n"));
+
+	keys = 2000;
+	addrs_metrics_exporter_stop(exporter);
+
+	// the final snapshot is written to the textfile
+	FILE * fp = fopen(textfile, "r");
+	assert(fp);
+	length = fread(text, 1, sizeof(text) - 1, fp);
+	fclose(fp);
+	text[length] = '\0';
+	assert(strstr(text, "pubkey_to_addrs_keys_total 2000\n"));
+	assert(access(socket_path, F_OK) != 0);
+
+	unlink(textfile);
+	addrs_metrics_exporter_free(exporter);
+	printf("==== %s: PASSED ====\n", __FILE__);
+	return 0;
+}
+#endif
@@ -0,0 +1,351 @@
+/*
+ * addrs_output.c
+ *
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ *
+ * The MIT License (MIT)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "utils.h"
+#include "pubkey_to_addrs.h"
+#include "addrs_output.h"
+
+_Static_assert(sizeof(struct addrs_output_binary_header) == 64, "binary header layout changed");
+_Static_assert(sizeof(struct addrs_output_binary_record) == 64 + bitcoin_address_types_count * BITCOIN_ADDRS_MAX_LENGTH,
+	"binary record layout changed");
+
+#define PUBKEY_HEX_SIZE		(BITCOIN_ADDRS_PUBKEY_SIZE * 2)
+#define HASH160_HEX_SIZE	(BITCOIN_ADDRS_HASH160_SIZE * 2)
+#define JSON_KEY_MAX_SIZE	(32)
+
+/*
+ * field separators, built once from the address type names:
+ *   csv:   column names
+ *   jsonl: ',"<type>":"'
+ */
+static char s_json_keys[bitcoin_address_types_count][JSON_KEY_MAX_SIZE];
+static size_t s_cb_json_keys[bitcoin_address_types_count];
+static pthread_once_t s_keys_once = PTHREAD_ONCE_INIT;
+
+static void init_keys(void)
+{
+	for(int type = 0; type < bitcoin_address_types_count; ++type) {
+		const char * name = bitcoin_address_type_to_string(type);
+		int cb = snprintf(s_json_keys[type], JSON_KEY_MAX_SIZE, ",\"%s\":\"", name);
+		assert(cb > 0 && cb < JSON_KEY_MAX_SIZE);
+		s_cb_json_keys[type] = cb;
+	}
+}
+
+static inline char * append(char * p, const void * data, size_t size)
+{
+	memcpy(p, data, size);
+	return p + size;
+}
+#define append_literal(p, literal) append(p, literal, sizeof(literal) - 1)
+
+static inline char * append_hex(char * p, const void * data, size_t size)
+{
+	char * hex = p;
+	return p + bin2hex(data, size, &hex);
+}
+
+/******************************************************************************
+ * text
+******************************************************************************/
+static size_t text_max_record_size(uint32_t types_mask)
+{
+	(void)types_mask;
+	return PUBKEY_HEX_SIZE + bitcoin_address_types_count * BITCOIN_ADDRS_MAX_LENGTH + 1;
+}
+
+static size_t text_format_record(uint32_t types_mask, const struct bitcoin_addrs_record * record, char * buf)
+{
+	char * p = append_hex(buf, record->pubkey, BITCOIN_ADDRS_PUBKEY_SIZE);
+	for(int type = 0; type < bitcoin_address_types_count; ++type) {
+		if(!(types_mask & BITCOIN_ADDRESS_TYPE_MASK(type))) continue;
+		*p++ = ' ';
+		p = append(p, record->addrs[type], record->cb_addrs[type]);
+	}
+	*p++ = '\n';
+	return p - buf;
+}
+
+/******************************************************************************
+ * csv
+******************************************************************************/
+static size_t csv_max_record_size(uint32_t types_mask)
+{
+	(void)types_mask;
+	return PUBKEY_HEX_SIZE + 1 + HASH160_HEX_SIZE + bitcoin_address_types_count * BITCOIN_ADDRS_MAX_LENGTH + 1;
+}
+
+static ssize_t csv_format_header(uint32_t types_mask, char * buf, size_t size)
+{
+	size_t cb_total = 0;
+	int cb = snprintf(buf, size, "pubkey,hash160");
+	if(cb < 0 || (size_t)cb >= size) return -1;
+	cb_total = cb;
+
+	for(int type = 0; type < bitcoin_address_types_count; ++type) {
+		if(!(types_mask & BITCOIN_ADDRESS_TYPE_MASK(type))) continue;
+		cb = snprintf(buf + cb_total, size - cb_total, ",%s", bitcoin_address_type_to_string(type));
+		if(cb < 0 || (size_t)cb >= (size - cb_total)) return -1;
+		cb_total += cb;
+	}
+	if((cb_total + 1) >= size) return -1;
+	buf[cb_total++] = '\n';
+	return cb_total;
+}
+
+static size_t csv_format_record(uint32_t types_mask, const struct bitcoin_addrs_record * record, char * buf)
+{
+	// base58 / bech32 alphabets need no quoting
+	char * p = append_hex(buf, record->pubkey, BITCOIN_ADDRS_PUBKEY_SIZE);
+	*p++ = ',';
+	p = append_hex(p, record->hash160, BITCOIN_ADDRS_HASH160_SIZE);
+	for(int type = 0; type < bitcoin_address_types_count; ++type) {
+		if(!(types_mask & BITCOIN_ADDRESS_TYPE_MASK(type))) continue;
+		*p++ = ',';
+		p = append(p, record->addrs[type], record->cb_addrs[type]);
+	}
+	*p++ = '\n';
+	return p - buf;
+}
+
+/******************************************************************************
+ * jsonl
+******************************************************************************/
+static size_t jsonl_max_record_size(uint32_t types_mask)
+{
+	(void)types_mask;
+	return sizeof("{\"pubkey\":\"\",\"hash160\":\"\"}\n") + PUBKEY_HEX_SIZE + HASH160_HEX_SIZE
+		+ bitcoin_address_types_count * (JSON_KEY_MAX_SIZE + BITCOIN_ADDRS_MAX_LENGTH + 1);
+}
+
+static size_t jsonl_format_record(uint32_t types_mask, const struct bitcoin_addrs_record * record, char * buf)
+{
+	char * p = append_literal(buf, "{\"pubkey\":\"");
+	p = append_hex(p, record->pubkey, BITCOIN_ADDRS_PUBKEY_SIZE);
+	p = append_literal(p, "\",\"hash160\":\"");
+	p = append_hex(p, record->hash160, BITCOIN_ADDRS_HASH160_SIZE);
+	*p++ = '"';
+	for(int type = 0; type < bitcoin_address_types_count; ++type) {
+		if(!(types_mask & BITCOIN_ADDRESS_TYPE_MASK(type))) continue;
+		p = append(p, s_json_keys[type], s_cb_json_keys[type]);
+		p = append(p, record->addrs[type], record->cb_addrs[type]);
+		*p++ = '"';
+	}
+	p = append_literal(p, "}\n");
+	return p - buf;
+}
+
+/******************************************************************************
+ * binary
+******************************************************************************/
+static size_t binary_max_record_size(uint32_t types_mask)
+{
+	(void)types_mask;
+	return sizeof(struct addrs_output_binary_record);
+}
+
+static ssize_t binary_format_header(uint32_t types_mask, char * buf, size_t size)
+{
+	struct addrs_output_binary_header header;
+	if(size < sizeof(header)) return -1;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, ADDRS_OUTPUT_BINARY_MAGIC, sizeof(header.magic));
+	header.header_size = sizeof(struct addrs_output_binary_header);
+	header.record_size = sizeof(struct addrs_output_binary_record);
+	header.types_mask = types_mask;
+	header.num_types = bitcoin_address_types_count;
+	header.addr_slot_size = BITCOIN_ADDRS_MAX_LENGTH;
+	memcpy(buf, &header, sizeof(header));
+	return sizeof(header);
+}
+
+static size_t binary_format_record(uint32_t types_mask, const struct bitcoin_addrs_record * record, char * buf)
+{
+	struct addrs_output_binary_record * dst = (struct addrs_output_binary_record *)buf;
+	memcpy(dst->pubkey, record->pubkey, BITCOIN_ADDRS_PUBKEY_SIZE);
+	memcpy(dst->hash160, record->hash160, BITCOIN_ADDRS_HASH160_SIZE);
+	dst->types_mask = types_mask;
+	memset(dst->reserved, 0, sizeof(dst->reserved));
+	for(int type = 0; type < bitcoin_address_types_count; ++type) {
+		size_t cb_addr = (types_mask & BITCOIN_ADDRESS_TYPE_MASK(type))?record->cb_addrs[type]:0;
+		dst->cb_addrs[type] = cb_addr;
+		memcpy(dst->addrs[type], record->addrs[type], cb_addr);
+		memset(dst->addrs[type] + cb_addr, 0, BITCOIN_ADDRS_MAX_LENGTH - cb_addr);
+	}
+	return sizeof(*dst);
+}
+
+/******************************************************************************
+ * formats table
+******************************************************************************/
+struct output_format_ops
+{
+	const char * name;
+	size_t (* max_record_size)(uint32_t types_mask);
+	ssize_t (* format_header)(uint32_t types_mask, char * buf, size_t size);	// optional
+	size_t (* format_record)(uint32_t types_mask, const struct bitcoin_addrs_record * record, char * buf);
+};
+
+static const struct output_format_ops s_formats[addrs_output_formats_count] = {
+	[addrs_output_format_text] = { "text", text_max_record_size, NULL, text_format_record },
+	[addrs_output_format_csv] = { "csv", csv_max_record_size, csv_format_header, csv_format_record },
+	[addrs_output_format_jsonl] = { "jsonl", jsonl_max_record_size, NULL, jsonl_format_record },
+	[addrs_output_format_binary] = { "binary", binary_max_record_size, binary_format_header, binary_format_record },
+};
+
+static inline const struct output_format_ops * get_ops(enum addrs_output_format format)
+{
+	assert(format >= 0 && format < addrs_output_formats_count);
+	pthread_once(&s_keys_once, init_keys);
+	return &s_formats[format];
+}
+
+enum addrs_output_format addrs_output_format_from_string(const char * name)
+{
+	if(NULL == name) return -1;
+	for(int i = 0; i < addrs_output_formats_count; ++i) {
+		if(strcmp(name, s_formats[i].name) == 0) return i;
+	}
+	return -1;
+}
+
+const char * addrs_output_format_to_string(enum addrs_output_format format)
+{
+	if(format < 0 || format >= addrs_output_formats_count) return NULL;
+	return s_formats[format].name;
+}
+
+size_t addrs_output_max_record_size(enum addrs_output_format format, uint32_t types_mask)
+{
+	return get_ops(format)->max_record_size(types_mask);
+}
+
+ssize_t addrs_output_format_header(enum addrs_output_format format, uint32_t types_mask, char * buf, size_t size)
+{
+	const struct output_format_ops * ops = get_ops(format);
+	if(NULL == ops->format_header) return 0;
+	return ops->format_header(types_mask, buf, size);
+}
+
+size_t addrs_output_format_record(enum addrs_output_format format, uint32_t types_mask,
+	const struct bitcoin_addrs_record * record, char * buf)
+{
+	assert(record && buf);
+	return get_ops(format)->format_record(types_mask, record, buf);
+}
+
+size_t addrs_output_format_records(enum addrs_output_format format, uint32_t types_mask,
+	const struct bitcoin_addrs_record * records, size_t count, char * buf)
+{
+	assert(records && buf);
+	const struct output_format_ops * ops = get_ops(format);
+	char * p = buf;
+	for(size_t i = 0; i < count; ++i) {
+		if(records[i].err_code) continue;
+		p += ops->format_record(types_mask, &records[i], p);
+	}
+	return p - buf;
+}
+
+
+#if defined(_TEST_ADDRS_OUTPUT) && defined(_STAND_ALONE)
+int main(int argc, char ** argv)
+{
+	// generator point G
+	struct bitcoin_addrs_record record[1];
+	memset(record, 0, sizeof(record));
+	void * pubkey = record->pubkey;
+	hex2bin("0279be667ef9dcbbac55a06295ce870b07029bfcdb2dce28d959f2815b16f81798", PUBKEY_HEX_SIZE, &pubkey);
+	ssize_t num_ok = pubkeys_to_addrs_batch(record, 1, BITCOIN_ADDRESS_TYPES_ALL);
+	assert(num_ok == 1);
+
+	static const char * expected[addrs_output_formats_count] = {
+		[addrs_output_format_text] = "0279be667ef9dcbbac55a06295ce870b07029bfcdb2dce28d959f2815b16f81798 "
+			"1BgGZ9tcN4rm9KBzDn7KprQz87SZ26SAMH 3JvL6Ymt8MVWiCNHC7oWU6nLeHNJKLZGLN bc1qw508d6qejxtdg4y5r3zarvary0c5xw7kv8f3t4\n",
+		[addrs_output_format_csv] = "0279be667ef9dcbbac55a06295ce870b07029bfcdb2dce28d959f2815b16f81798,"
+			"751e76e8199196d454941c45d1b3a323f1433bd6,"
+			"1BgGZ9tcN4rm9KBzDn7KprQz87SZ26SAMH,3JvL6Ymt8MVWiCNHC7oWU6nLeHNJKLZGLN,bc1qw508d6qejxtdg4y5r3zarvary0c5xw7kv8f3t4\n",
+		[addrs_output_format_jsonl] = "{\"pubkey\":\"0279be667ef9dcbbac55a06295ce870b07029bfcdb2dce28d959f2815b16f81798\","
+			"\"hash160\":\"751e76e8199196d454941c45d1b3a323f1433bd6\","
+			"\"p2pkh\":\"1BgGZ9tcN4rm9KBzDn7KprQz87SZ26SAMH\",\"p2sh-p2wpkh\":\"3JvL6Ymt8MVWiCNHC7oWU6nLeHNJKLZGLN\","
+			"\"bech32\":\"bc1qw508d6qejxtdg4y5r3zarvary0c5xw7kv8f3t4\"}\n",
+	};
+
+	char buf[4096];
+	for(int format = 0; format < addrs_output_formats_count; ++format) {
+		size_t max_size = addrs_output_max_record_size(format, BITCOIN_ADDRESS_TYPES_ALL);
+		assert(max_size < sizeof(buf));
+		memset(buf, 0xcc, sizeof(buf));
+		size_t cb = addrs_output_format_record(format, BITCOIN_ADDRESS_TYPES_ALL, record, buf);
+		assert(cb > 0 && cb <= max_size);
+		if(expected[format]) {
+			printf("%-6s: %.*s", addrs_output_format_to_string(format), (int)cb, buf);
+			assert(cb == strlen(expected[format]));
+			assert(0 == memcmp(buf, expected[format], cb));
+		}
+	}
+
+	// csv header with a single type
+	ssize_t cb_header = addrs_output_format_header(addrs_output_format_csv,
+		BITCOIN_ADDRESS_TYPE_MASK(bitcoin_address_type_bech32), buf, sizeof(buf));
+	assert(cb_header == strlen("pubkey,hash160,bech32\n"));
+	assert(0 == memcmp(buf, "pubkey,hash160,bech32\n", cb_header));
+
+	// binary: header + record, read back as an mmap loader would
+	uint32_t types_mask = BITCOIN_ADDRESS_TYPE_MASK(bitcoin_address_type_p2pkh) | BITCOIN_ADDRESS_TYPE_MASK(bitcoin_address_type_bech32);
+	cb_header = addrs_output_format_header(addrs_output_format_binary, types_mask, buf, sizeof(buf));
+	assert(cb_header == sizeof(struct addrs_output_binary_header));
+	size_t cb = addrs_output_format_records(addrs_output_format_binary, types_mask, record, 1, buf + cb_header);
+	assert(cb == sizeof(struct addrs_output_binary_record));
+
+	const struct addrs_output_binary_header * header = (void *)buf;
+	const struct addrs_output_binary_record * binary = (void *)(buf + header->header_size);
+	assert(0 == memcmp(header->magic, ADDRS_OUTPUT_BINARY_MAGIC, 8));
+	assert(header->record_size == cb && header->types_mask == types_mask);
+	assert(0 == memcmp(binary->pubkey, record->pubkey, BITCOIN_ADDRS_PUBKEY_SIZE));
+	assert(0 == memcmp(binary->hash160, record->hash160, BITCOIN_ADDRS_HASH160_SIZE));
+	assert(0 == strcmp(binary->addrs[bitcoin_address_type_p2pkh], "1BgGZ9tcN4rm9KBzDn7KprQz87SZ26SAMH"));
+	assert(binary->cb_addrs[bitcoin_address_type_p2sh_p2pkh] == 0 && binary->addrs[bitcoin_address_type_p2sh_p2pkh][0] == '\0');
+	assert(0 == strcmp(binary->addrs[bitcoin_address_type_bech32], "bc1qw508d6qejxtdg4y5r3zarvary0c5xw7kv8f3t4"));
+
+	// records with errors are skipped
+	record->err_code = -1;
+	assert(0 == addrs_output_format_records(addrs_output_format_jsonl, types_mask, record, 1, buf));
+
+	printf("==== %s: PASSED ====\n", __FILE__);
+	return 0;
+}
+#endif
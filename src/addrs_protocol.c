@@ -0,0 +1,154 @@
+/*
+ * addrs_protocol.c
+ *
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ *
+ * The MIT License (MIT)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+#include <endian.h>
+
+#include "pubkey_to_addrs.h"
+#include "addrs_protocol.h"
+
+static const char * s_status_names[] = {
+	[addrs_protocol_status_ok] = "ok",
+	[addrs_protocol_status_bad_request] = "bad_request",
+	[addrs_protocol_status_invalid_pubkey] = "invalid_pubkey",
+	[addrs_protocol_status_encode_error] = "encode_error",
+};
+
+const char * addrs_protocol_status_to_string(enum addrs_protocol_status status)
+{
+	if(status < 0 || status > addrs_protocol_status_encode_error) return NULL;
+	return s_status_names[status];
+}
+
+static inline void put_le32(unsigned char * p, uint32_t value)
+{
+	value = htole32(value);
+	memcpy(p, &value, 4);
+}
+
+static inline uint32_t get_le32(const unsigned char * p)
+{
+	uint32_t value;
+	memcpy(&value, p, 4);
+	return le32toh(value);
+}
+
+size_t addrs_protocol_encode_request(const struct addrs_protocol_request * request, unsigned char * buf)
+{
+	assert(request && buf);
+	unsigned char * p = buf;
+	put_le32(p, ADDRS_PROTOCOL_REQUEST_SIZE); p += 4;
+	put_le32(p, request->id); p += 4;
+	*p++ = (uint8_t)request->types_mask;
+	memcpy(p, request->pubkey, BITCOIN_ADDRS_PUBKEY_SIZE); p += BITCOIN_ADDRS_PUBKEY_SIZE;
+	return p - buf;
+}
+
+size_t addrs_protocol_encode_response(uint32_t id, int status, uint32_t types_mask,
+	const struct bitcoin_addrs_record * record, unsigned char * buf)
+{
+	assert(buf);
+	if(status != addrs_protocol_status_ok || NULL == record) types_mask = 0;
+
+	unsigned char * p = buf + ADDRS_PROTOCOL_LENGTH_SIZE;
+	put_le32(p, id); p += 4;
+	*p++ = (uint8_t)status;
+	*p++ = (uint8_t)types_mask;
+	if(record) memcpy(p, record->hash160, BITCOIN_ADDRS_HASH160_SIZE);
+	else memset(p, 0, BITCOIN_ADDRS_HASH160_SIZE);
+	p += BITCOIN_ADDRS_HASH160_SIZE;
+
+	for(int type = 0; type < bitcoin_address_types_count; ++type) {
+		if(!(types_mask & BITCOIN_ADDRESS_TYPE_MASK(type))) continue;
+		size_t cb_addr = record->cb_addrs[type];
+		*p++ = (uint8_t)cb_addr;
+		memcpy(p, record->addrs[type], cb_addr);
+		p += cb_addr;
+	}
+
+	size_t cb_body = p - buf - ADDRS_PROTOCOL_LENGTH_SIZE;
+	put_le32(buf, cb_body);
+	return p - buf;
+}
+
+/* @return the body length, 0: incomplete, -1: malformed */
+static inline ssize_t parse_length(const unsigned char * buf, size_t length, size_t min_body_size)
+{
+	if(length < ADDRS_PROTOCOL_LENGTH_SIZE) return 0;
+	uint32_t cb_body = get_le32(buf);
+	if(cb_body < min_body_size || cb_body > ADDRS_PROTOCOL_MAX_FRAME_SIZE) return -1;
+	if(length < (ADDRS_PROTOCOL_LENGTH_SIZE + cb_body)) return 0;
+	return cb_body;
+}
+
+ssize_t addrs_protocol_decode_request(const unsigned char * buf, size_t length, struct addrs_protocol_request * request)
+{
+	assert(buf && request);
+	ssize_t cb_body = parse_length(buf, length, ADDRS_PROTOCOL_REQUEST_SIZE);
+	if(cb_body <= 0) return cb_body;
+
+	// trailing bytes (newer protocol revisions) are skipped
+	const unsigned char * p = buf + ADDRS_PROTOCOL_LENGTH_SIZE;
+	request->id = get_le32(p); p += 4;
+	request->types_mask = *p++;
+	memcpy(request->pubkey, p, BITCOIN_ADDRS_PUBKEY_SIZE);
+	return ADDRS_PROTOCOL_LENGTH_SIZE + cb_body;
+}
+
+ssize_t addrs_protocol_decode_response(const unsigned char * buf, size_t length, struct addrs_protocol_response * response)
+{
+	assert(buf && response);
+	ssize_t cb_body = parse_length(buf, length, 4 + 1 + 1 + BITCOIN_ADDRS_HASH160_SIZE);
+	if(cb_body <= 0) return cb_body;
+
+	const unsigned char * p = buf + ADDRS_PROTOCOL_LENGTH_SIZE;
+	const unsigned char * p_end = p + cb_body;
+	response->id = get_le32(p); p += 4;
+	response->status = *p++;
+	response->types_mask = *p++;
+	memcpy(response->hash160, p, BITCOIN_ADDRS_HASH160_SIZE);
+	p += BITCOIN_ADDRS_HASH160_SIZE;
+
+	memset(response->cb_addrs, 0, sizeof(response->cb_addrs));
+	for(int type = 0; type < bitcoin_address_types_count; ++type) {
+		response->addrs[type][0] = '\0';
+		if(!(response->types_mask & BITCOIN_ADDRESS_TYPE_MASK(type))) continue;
+		if(p >= p_end) return -1;
+		size_t cb_addr = *p++;
+		if(cb_addr >= BITCOIN_ADDRS_MAX_LENGTH || (p + cb_addr) > p_end) return -1;
+		memcpy(response->addrs[type], p, cb_addr);
+		response->addrs[type][cb_addr] = '\0';
+		response->cb_addrs[type] = cb_addr;
+		p += cb_addr;
+	}
+	return ADDRS_PROTOCOL_LENGTH_SIZE + cb_body;
+}
@@ -0,0 +1,237 @@
+/*
+ * addrs_stats.c
+ *
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ *
+ * The MIT License (MIT)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "addrs_stats.h"
+
+static const char * s_stage_names[addrs_stats_stages_count] = {
+	[addrs_stats_stage_hex_parse] = "hex_parse",
+	[addrs_stats_stage_pubkey_check] = "pubkey_check",
+	[addrs_stats_stage_sha256] = "sha256",
+	[addrs_stats_stage_ripemd160] = "ripemd160",
+	[addrs_stats_stage_hash160] = "hash160",
+	[addrs_stats_stage_checksum] = "checksum",
+	[addrs_stats_stage_base58_encode] = "base58_encode",
+	[addrs_stats_stage_bech32_encode] = "bech32_encode",
+	[addrs_stats_stage_output] = "output",
+};
+
+static const char * s_error_names[addrs_stats_errors_count] = {
+	[addrs_stats_error_pubkey_length] = "pubkey_length",
+	[addrs_stats_error_pubkey_hex] = "pubkey_hex",
+	[addrs_stats_error_pubkey_point] = "pubkey_point",
+	[addrs_stats_error_privkey] = "privkey",
+	[addrs_stats_error_multisig] = "multisig",
+	[addrs_stats_error_encode] = "encode",
+	[addrs_stats_error_output] = "output",
+};
+
+const char * addrs_stats_stage_to_string(enum addrs_stats_stage stage)
+{
+	if(stage < 0 || stage >= addrs_stats_stages_count) return NULL;
+	return s_stage_names[stage];
+}
+
+const char * addrs_stats_error_to_string(enum addrs_stats_error err)
+{
+	if(err < 0 || err >= addrs_stats_errors_count) return NULL;
+	return s_error_names[err];
+}
+
+#if defined(BITCOIN_ADDRS_STATS)
+
+#define STATS_CACHELINE_SIZE (64)
+
+/**
+ * per-thread counters:
+ *   only the owner thread writes to a block, readers sum all blocks with relaxed loads.
+ *   blocks are never freed; a block released by an exited thread is reused by the next new thread,
+ *   so the accumulated values survive thread churn.
+**/
+struct stats_counters
+{
+	uint64_t ticks[addrs_stats_stages_count];
+	uint64_t calls[addrs_stats_stages_count];
+	uint64_t errors[addrs_stats_errors_count];
+
+	struct stats_counters * next;
+	int in_use;
+}__attribute__((aligned(STATS_CACHELINE_SIZE)));
+
+static struct stats_counters * s_counters_list;
+static __thread struct stats_counters * t_counters;
+
+static pthread_once_t s_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t s_key;
+
+static void on_thread_exit(void * user_data)
+{
+	struct stats_counters * counters = user_data;
+	if(counters) __atomic_store_n(&counters->in_use, 0, __ATOMIC_RELEASE);
+}
+static void init_key(void)
+{
+	int rc = pthread_key_create(&s_key, on_thread_exit);
+	assert(0 == rc);
+}
+
+static struct stats_counters * claim_counters(void)
+{
+	pthread_once(&s_key_once, init_key);
+
+	// try to reuse a block released by an exited thread
+	struct stats_counters * counters = __atomic_load_n(&s_counters_list, __ATOMIC_ACQUIRE);
+	for(; counters; counters = counters->next) {
+		int in_use = 0;
+		if(__atomic_compare_exchange_n(&counters->in_use, &in_use, 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) break;
+	}
+
+	if(NULL == counters) {
+		counters = aligned_alloc(STATS_CACHELINE_SIZE, sizeof(*counters));
+		assert(counters);
+		memset(counters, 0, sizeof(*counters));
+		counters->in_use = 1;
+
+		// lock-free push
+		struct stats_counters * head = __atomic_load_n(&s_counters_list, __ATOMIC_RELAXED);
+		do {
+			counters->next = head;
+		}while(!__atomic_compare_exchange_n(&s_counters_list, &head, counters, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+	}
+
+	pthread_setspecific(s_key, counters);
+	t_counters = counters;
+	return counters;
+}
+
+static inline struct stats_counters * get_counters(void)
+{
+	struct stats_counters * counters = t_counters;
+	if(__builtin_expect(NULL == counters, 0)) counters = claim_counters();
+	return counters;
+}
+
+#define relaxed_add(p, value) __atomic_store_n(p, __atomic_load_n(p, __ATOMIC_RELAXED) + (value), __ATOMIC_RELAXED)
+
+void addrs_stats_add_ticks(enum addrs_stats_stage stage, uint64_t ticks)
+{
+	struct stats_counters * counters = get_counters();
+	relaxed_add(&counters->ticks[stage], ticks);
+	relaxed_add(&counters->calls[stage], 1);
+}
+
+void addrs_stats_add_error(enum addrs_stats_error err)
+{
+	struct stats_counters * counters = get_counters();
+	relaxed_add(&counters->errors[err], 1);
+}
+
+int addrs_stats_enabled(void) { return 1; }
+
+void addrs_stats_snapshot(struct addrs_stats_snapshot * snapshot)
+{
+	assert(snapshot);
+	memset(snapshot, 0, sizeof(*snapshot));
+
+	struct stats_counters * counters = __atomic_load_n(&s_counters_list, __ATOMIC_ACQUIRE);
+	for(; counters; counters = counters->next) {
+		++snapshot->num_threads;
+		for(int i = 0; i < addrs_stats_stages_count; ++i) {
+			snapshot->ticks[i] += __atomic_load_n(&counters->ticks[i], __ATOMIC_RELAXED);
+			snapshot->calls[i] += __atomic_load_n(&counters->calls[i], __ATOMIC_RELAXED);
+		}
+		for(int i = 0; i < addrs_stats_errors_count; ++i) {
+			snapshot->errors[i] += __atomic_load_n(&counters->errors[i], __ATOMIC_RELAXED);
+		}
+	}
+}
+
+void addrs_stats_reset(void)
+{
+	// not synchronized with writers: values recorded concurrently with a reset may be lost
+	struct stats_counters * counters = __atomic_load_n(&s_counters_list, __ATOMIC_ACQUIRE);
+	for(; counters; counters = counters->next) {
+		for(int i = 0; i < addrs_stats_stages_count; ++i) {
+			__atomic_store_n(&counters->ticks[i], 0, __ATOMIC_RELAXED);
+			__atomic_store_n(&counters->calls[i], 0, __ATOMIC_RELAXED);
+		}
+		for(int i = 0; i < addrs_stats_errors_count; ++i) {
+			__atomic_store_n(&counters->errors[i], 0, __ATOMIC_RELAXED);
+		}
+	}
+}
+
+#else
+
+int addrs_stats_enabled(void) { return 0; }
+void addrs_stats_snapshot(struct addrs_stats_snapshot * snapshot)
+{
+	assert(snapshot);
+	memset(snapshot, 0, sizeof(*snapshot));
+}
+void addrs_stats_reset(void) { }
+
+#endif
+
+void addrs_stats_dump(const struct addrs_stats_snapshot * snapshot, FILE * fp)
+{
+	assert(snapshot);
+	if(NULL == fp) fp = stderr;
+
+	if(!addrs_stats_enabled()) {
+		fprintf(fp, "[stats]: instrumentation disabled at build time (rebuild with STATS=1)\n");
+		return;
+	}
+
+	uint64_t total_ticks = 0;
+	for(int i = 0; i < addrs_stats_stages_count; ++i) total_ticks += snapshot->ticks[i];
+
+	fprintf(fp, "[stats]: threads=%d, total_ticks=%lu\n", snapshot->num_threads, (unsigned long)total_ticks);
+	fprintf(fp, "  %-16s %12s %16s %12s %8s\n", "stage", "calls", "ticks", "ticks/call", "share");
+	for(int i = 0; i < addrs_stats_stages_count; ++i) {
+		uint64_t calls = snapshot->calls[i];
+		uint64_t ticks = snapshot->ticks[i];
+		fprintf(fp, "  %-16s %12lu %16lu %12.1f %7.2f%%\n",
+			s_stage_names[i],
+			(unsigned long)calls, (unsigned long)ticks,
+			calls?((double)ticks / (double)calls):0.0,
+			total_ticks?((double)ticks * 100.0 / (double)total_ticks):0.0);
+	}
+
+	fprintf(fp, "  %-16s %12s\n", "error", "count");
+	for(int i = 0; i < addrs_stats_errors_count; ++i) {
+		fprintf(fp, "  %-16s %12lu\n", s_error_names[i], (unsigned long)snapshot->errors[i]);
+	}
+	return;
+}
@@ -0,0 +1,386 @@
+/*
+ * addrs_transcode.c
+ * 
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ * 
+ * The MIT License (MIT)
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to deal 
+ * in the Software without restriction, including without limitation the rights 
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all 
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS 
+ * IN THE SOFTWARE.
+ * 
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <assert.h>
+#include <endian.h>
+
+#include "sha.h"
+#include "hash_lanes.h"
+#include "hash_fused.h"
+#include "base58.h"
+#include "bech32.h"
+#include "utils.h"
+#include "thread_pool.h"
+#include "arena.h"
+
+#include "addrs_transcode.h"
+
+#define HASH160_SIZE	(BITCOIN_ADDRS_HASH160_SIZE)
+#define CHECKSUM_SIZE	(4)
+
+static inline uint32_t load_be32(const unsigned char * p) { uint32_t x; memcpy(&x, p, 4); return be32toh(x); }
+
+static const char * s_error_names[addrs_transcode_errors_count] = {
+	[addrs_transcode_error_none] = "ok",
+	[addrs_transcode_error_invalid] = "invalid",
+	[addrs_transcode_error_checksum] = "checksum",
+	[addrs_transcode_error_unsupported] = "unsupported",
+};
+
+const char * addrs_transcode_error_to_string(enum addrs_transcode_error err)
+{
+	if(err < 0 || err >= addrs_transcode_errors_count) return NULL;
+	return s_error_names[err];
+}
+
+/* multi-lane checksums unless the scalar kernel runs on SHA extensions (same policy as pubkey_to_addrs.c) */
+static int s_lanes_checksums = -1;
+static inline int use_lanes_checksums(void)
+{
+	int lanes = __atomic_load_n(&s_lanes_checksums, __ATOMIC_RELAXED);
+	if(lanes < 0) {
+		lanes = !sha256_has_sha_ni();
+		__atomic_store_n(&s_lanes_checksums, lanes, __ATOMIC_RELAXED);
+	}
+	return lanes;
+}
+
+/**
+ * decode_address()
+ *   the 20-byte program of a p2pkh / p2wpkh address;
+ *   Base58Check addresses keep their payload [ version | hash160 | checksum ] for the checksum pass.
+ * @return 0 (bech32), 1 (Base58Check, checksum not verified yet) or -(enum addrs_transcode_error)
+**/
+static int decode_address(const char * addr, size_t cb_addr, struct addrs_transcode_record * record,
+	unsigned char payload[static BASE58_PAYLOAD_25])
+{
+	if(cb_addr > 3 && 0 == strncasecmp(addr, "bc1", 3)) {
+		char hrp[84];
+		uint8_t version = 0;
+		unsigned char program[40];
+		ssize_t cb_program = bech32_decode(addr, cb_addr, hrp, &version, program);
+		if(cb_program < 0) return -addrs_transcode_error_invalid;
+		if(version != 0 || cb_program != HASH160_SIZE) return -addrs_transcode_error_unsupported;	// p2wsh, taproot
+		
+		record->from_type = bitcoin_address_type_bech32;
+		memcpy(record->hash160, program, HASH160_SIZE);
+		return 0;
+	}
+	
+	if(base58_decode_25(addr, cb_addr, payload) < 0) {
+		// another network's segwit address?
+		char hrp[84];
+		uint8_t version = 0;
+		unsigned char program[40];
+		if(bech32_decode(addr, cb_addr, hrp, &version, program) < 0) return -addrs_transcode_error_invalid;
+		return -addrs_transcode_error_unsupported;
+	}
+	record->from_type = (payload[0] == bitcoin_address_prefix_p2sh)?bitcoin_address_type_p2sh_p2pkh:bitcoin_address_type_p2pkh;
+	memcpy(record->hash160, &payload[1], HASH160_SIZE);
+	return 1;
+}
+
+/* [ version | hash160 ] Base58Check payloads (21 bytes) as single padded SHA-256 blocks, one per lane */
+static void lanes_load_payload(hash_lanes_t block[static 16], size_t lane, const unsigned char payload[static 1 + HASH160_SIZE])
+{
+	for(int i = 0; i < 5; ++i) block[i][lane] = load_be32(&payload[i * 4]);
+	block[5][lane] = ((uint32_t)payload[20] << 24) | 0x800000;
+}
+
+ssize_t addrs_transcode_batch(struct addrs_transcode_record * records, size_t count, enum bitcoin_address_type to_type)
+{
+	assert(records);
+	if(to_type != bitcoin_address_type_p2pkh && to_type != bitcoin_address_type_bech32) return -1;
+	
+	const int lanes_checksums = use_lanes_checksums();
+	ssize_t num_ok = 0;
+	hash_lanes_t block[16];
+	hash_lanes_t checksums;
+	unsigned char payloads[HASH_LANES][BASE58_PAYLOAD_25];
+	int8_t from_base58[HASH_LANES];
+	
+	for(size_t first = 0; first < count; first += HASH_LANES) {
+		size_t num_lanes = ((count - first) < HASH_LANES)?(count - first):HASH_LANES;
+		memset(block, 0, sizeof(block));
+		
+		// pass 1. decode; each lane needs at most one checksum:
+		//   Base58Check sources verify theirs (a p2pkh target reuses it), bech32 sources into p2pkh compute one
+		for(size_t lane = 0; lane < num_lanes; ++lane) {
+			struct addrs_transcode_record * record = &records[first + lane];
+			record->cb_transcoded = 0;
+			record->transcoded[0] = '\0';
+			
+			unsigned char * payload = payloads[lane];
+			int rc = decode_address(record->addr, strnlen(record->addr, BITCOIN_ADDRS_MAX_LENGTH), record, payload);
+			from_base58[lane] = rc;
+			if(rc < 0) {
+				record->err_code = -rc;
+				continue;
+			}
+			record->err_code = addrs_transcode_error_none;
+			if(0 == rc) {
+				if(to_type != bitcoin_address_type_p2pkh) continue;
+				payload[0] = bitcoin_address_prefix_p2pkh;
+				memcpy(&payload[1], record->hash160, HASH160_SIZE);
+			}
+			if(lanes_checksums) lanes_load_payload(block, lane, payload);
+		}
+		
+		if(lanes_checksums) {
+			block[15] += (uint32_t)((1 + HASH160_SIZE) * 8);
+			hash256_checksum_lanes(&checksums, block);
+		}
+		
+		// pass 2. verify / append the checksums and encode
+		for(size_t lane = 0; lane < num_lanes; ++lane) {
+			struct addrs_transcode_record * record = &records[first + lane];
+			if(from_base58[lane] < 0) continue;
+			
+			unsigned char * payload = payloads[lane];
+			const int need_checksum = from_base58[lane] || to_type == bitcoin_address_type_p2pkh;
+			uint32_t checksum = 0;
+			if(need_checksum) {
+				if(lanes_checksums) checksum = htobe32(checksums[lane]);
+				else hash256_checksum_21(payload, (unsigned char *)&checksum);
+			}
+			
+			if(from_base58[lane]) {
+				if(memcmp(&payload[1 + HASH160_SIZE], &checksum, CHECKSUM_SIZE) != 0) {
+					record->err_code = addrs_transcode_error_checksum;
+					continue;
+				}
+				if(payload[0] != bitcoin_address_prefix_p2pkh) {
+					record->err_code = addrs_transcode_error_unsupported;	// p2sh (script hash), testnet, WIF...
+					continue;
+				}
+			}
+			
+			ssize_t cb;
+			if(to_type == bitcoin_address_type_p2pkh) {
+				memcpy(&payload[1 + HASH160_SIZE], &checksum, CHECKSUM_SIZE);
+				cb = base58_encode_25(payload, record->transcoded);
+			}else {
+				cb = bech32_encode(0, "bc", record->hash160, HASH160_SIZE, record->transcoded);
+			}
+			if(cb <= 0 || cb >= BITCOIN_ADDRS_MAX_LENGTH) {
+				record->err_code = addrs_transcode_error_invalid;
+				continue;
+			}
+			record->cb_transcoded = cb;
+			++num_ok;
+		}
+	}
+	return num_ok;
+}
+
+struct parallel_batch
+{
+	struct addrs_transcode_record * records;
+	enum bitcoin_address_type to_type;
+	ssize_t num_ok;
+};
+
+static void transcode_range(size_t begin, size_t end, void * user_data)
+{
+	struct parallel_batch * batch = user_data;
+	ssize_t num_ok = addrs_transcode_batch(batch->records + begin, end - begin, batch->to_type);
+	__atomic_add_fetch(&batch->num_ok, num_ok, __ATOMIC_RELAXED);
+}
+
+ssize_t addrs_transcode_batch_parallel(struct thread_pool * pool, struct addrs_transcode_record * records, size_t count,
+	enum bitcoin_address_type to_type)
+{
+	assert(records);
+	if(to_type != bitcoin_address_type_p2pkh && to_type != bitcoin_address_type_bech32) return -1;
+	if(NULL == pool) pool = thread_pool_default();
+	
+	struct parallel_batch batch = { .records = records, .to_type = to_type };
+	thread_pool_parallel_for(pool, 0, count, 0, transcode_range, &batch);
+	return batch.num_ok;
+}
+
+ssize_t addrs_transcode(const char * addr, enum bitcoin_address_type to_type, char ** p_addr)
+{
+	assert(addr && p_addr);
+	struct addrs_transcode_record record[1];
+	size_t cb_addr = strlen(addr);
+	if(cb_addr >= BITCOIN_ADDRS_MAX_LENGTH) return -addrs_transcode_error_invalid;
+	memcpy(record->addr, addr, cb_addr + 1);
+	
+	ssize_t num_ok = addrs_transcode_batch(record, 1, to_type);
+	if(num_ok < 0) return -addrs_transcode_error_unsupported;
+	if(0 == num_ok) return -record->err_code;
+	
+	char * transcoded = *p_addr;
+	if(NULL == transcoded) {
+		transcoded = lib_calloc(BITCOIN_ADDRS_MAX_LENGTH, 1);
+		assert(transcoded);
+		*p_addr = transcoded;
+	}
+	memcpy(transcoded, record->transcoded, record->cb_transcoded + 1);
+	return record->cb_transcoded;
+}
+
+
+#if defined(_TEST_ADDRS_TRANSCODE) && defined(_STAND_ALONE)
+static inline uint64_t splitmix64(uint64_t * state)
+{
+	uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+static void test_known_vectors(void)
+{
+	static const struct {
+		const char * addr;
+		enum bitcoin_address_type to_type;
+		enum addrs_transcode_error err;
+		const char * transcoded;
+	} vectors[] = {
+		{ "1A1zP1eP5QGefi2DMPTfTL5SLmv7DivfNa", bitcoin_address_type_bech32, 0, "bc1qvt5s0v2uhuna2sjnn84ldu8m2r4m3rcc4048ry" },
+		{ "1A1zP1eP5QGefi2DMPTfTL5SLmv7DivfNa", bitcoin_address_type_p2pkh, 0, "1A1zP1eP5QGefi2DMPTfTL5SLmv7DivfNa" },
+		{ "bc1qvt5s0v2uhuna2sjnn84ldu8m2r4m3rcc4048ry", bitcoin_address_type_p2pkh, 0, "1A1zP1eP5QGefi2DMPTfTL5SLmv7DivfNa" },
+		{ "BC1QVT5S0V2UHUNA2SJNN84LDU8M2R4M3RCC4048RY", bitcoin_address_type_bech32, 0, "bc1qvt5s0v2uhuna2sjnn84ldu8m2r4m3rcc4048ry" },
+		{ "1A1zP1eP5QGefi2DMPTfTL5SLmv7DivfNb", bitcoin_address_type_bech32, addrs_transcode_error_checksum, NULL },
+		{ "1A1zP1eP5QGefi2DMPTfTL5SLmv7DivfN0", bitcoin_address_type_bech32, addrs_transcode_error_invalid, NULL },
+		{ "bc1qvt5s0v2uhuna2sjnn84ldu8m2r4m3rcc4048rz", bitcoin_address_type_p2pkh, addrs_transcode_error_invalid, NULL },
+		{ "38bxLNKsRnCTXcfQggeDYJ6vMjKnQZa9Dy", bitcoin_address_type_bech32, addrs_transcode_error_unsupported, NULL },	// p2sh
+		{ "mpXwg4jMtRhuSpVq4xS3HFHmCmWp9NyGKt", bitcoin_address_type_bech32, addrs_transcode_error_unsupported, NULL },	// testnet
+		{ "tb1qvt5s0v2uhuna2sjnn84ldu8m2r4m3rcclfw5ch", bitcoin_address_type_p2pkh, addrs_transcode_error_unsupported, NULL },
+		{ "bc1p0xlxvlhemja6c4dqv22uapctqupfhlxm9h8z3k2e72q4k9hcz7vqzk5jj0", bitcoin_address_type_p2pkh, addrs_transcode_error_unsupported, NULL },	// taproot
+		{ "", bitcoin_address_type_p2pkh, addrs_transcode_error_invalid, NULL },
+		{ "hello world", bitcoin_address_type_p2pkh, addrs_transcode_error_invalid, NULL },
+	};
+	
+	for(size_t i = 0; i < sizeof(vectors) / sizeof(vectors[0]); ++i) {
+		char addr[BITCOIN_ADDRS_MAX_LENGTH] = "";
+		char * p_addr = addr;
+		ssize_t cb = addrs_transcode(vectors[i].addr, vectors[i].to_type, &p_addr);
+		printf("%s -> %s: %s\n", vectors[i].addr, bitcoin_address_type_to_string(vectors[i].to_type),
+			(cb > 0)?addr:addrs_transcode_error_to_string(-cb));
+		if(vectors[i].err) {
+			assert(cb == -(ssize_t)vectors[i].err);
+		}else {
+			assert(cb == strlen(vectors[i].transcoded));
+			assert(0 == strcmp(addr, vectors[i].transcoded));
+		}
+	}
+	
+	char * p_addr = NULL;
+	assert(-addrs_transcode_error_unsupported == addrs_transcode("1A1zP1eP5QGefi2DMPTfTL5SLmv7DivfNa", bitcoin_address_type_p2sh_p2pkh, &p_addr));
+	assert(NULL == p_addr);
+	printf("==== %s: PASSED ====\n", __FUNCTION__);
+}
+
+#define NUM_RECORDS	(100000)
+static void test_batch(uint64_t seed)
+{
+	struct addrs_transcode_record * records = calloc(NUM_RECORDS, sizeof(*records));
+	char (*p2pkh)[BITCOIN_ADDRS_MAX_LENGTH] = calloc(NUM_RECORDS, BITCOIN_ADDRS_MAX_LENGTH);
+	char (*bech32)[BITCOIN_ADDRS_MAX_LENGTH] = calloc(NUM_RECORDS, BITCOIN_ADDRS_MAX_LENGTH);
+	unsigned char (*hashes)[HASH160_SIZE] = calloc(NUM_RECORDS, HASH160_SIZE);
+	assert(records && p2pkh && bech32 && hashes);
+	
+	for(size_t i = 0; i < NUM_RECORDS; ++i) {
+		for(int j = 0; j < HASH160_SIZE; ++j) hashes[i][j] = splitmix64(&seed);
+		if(i % 97 == 0) memset(hashes[i], 0, 1 + (i / 97) % HASH160_SIZE);	// leading '1's
+		char * addr = p2pkh[i];
+		hash160_to_p2pkh(hashes[i], &addr);
+		addr = bech32[i];
+		witness_program_to_segwit(0, hashes[i], HASH160_SIZE, &addr);
+	}
+	
+	for(int lanes = 0; lanes < 2; ++lanes) {
+		s_lanes_checksums = lanes;
+		for(int parallel = 0; parallel < 2; ++parallel) {
+			for(int to_type = bitcoin_address_type_p2pkh; to_type <= bitcoin_address_type_bech32; to_type += bitcoin_address_type_bech32) {
+				// mixed sources: p2pkh, bech32, and some corrupted p2pkh
+				for(size_t i = 0; i < NUM_RECORDS; ++i) {
+					memset(&records[i], 0xA5, sizeof(records[i]));
+					strcpy(records[i].addr, (i % 3)?p2pkh[i]:bech32[i]);
+					if(i % 11 == 1) records[i].addr[5] = (records[i].addr[5] == 'x')?'y':'x';
+				}
+				ssize_t num_ok = parallel?addrs_transcode_batch_parallel(NULL, records, NUM_RECORDS, to_type)
+					:addrs_transcode_batch(records, NUM_RECORDS, to_type);
+				
+				ssize_t expected_ok = 0;
+				for(size_t i = 0; i < NUM_RECORDS; ++i) {
+					const struct addrs_transcode_record * record = &records[i];
+					if(i % 11 == 1) {
+						assert(record->err_code == addrs_transcode_error_checksum || record->err_code == addrs_transcode_error_invalid);
+						assert(record->cb_transcoded == 0);
+						continue;
+					}
+					++expected_ok;
+					assert(record->err_code == 0);
+					assert(record->from_type == ((i % 3)?bitcoin_address_type_p2pkh:bitcoin_address_type_bech32));
+					assert(0 == memcmp(record->hash160, hashes[i], HASH160_SIZE));
+					const char * expected = (to_type == bitcoin_address_type_p2pkh)?p2pkh[i]:bech32[i];
+					assert(record->cb_transcoded == strlen(expected));
+					assert(0 == strcmp(record->transcoded, expected));
+				}
+				assert(num_ok == expected_ok);
+			}
+		}
+	}
+	s_lanes_checksums = -1;
+	
+	// throughput
+	for(size_t i = 0; i < NUM_RECORDS; ++i) strcpy(records[i].addr, p2pkh[i]);
+	for(int to_type = bitcoin_address_type_p2pkh; to_type <= bitcoin_address_type_bech32; to_type += bitcoin_address_type_bech32) {
+		double time_elapsed;
+		app_timer_start(NULL);
+		ssize_t num_ok = addrs_transcode_batch_parallel(NULL, records, NUM_RECORDS, to_type);
+		time_elapsed = app_timer_stop(NULL);
+		assert(num_ok == NUM_RECORDS);
+		printf("p2pkh -> %s: %d addresses, %.6f s (%.2f M/s)\n", bitcoin_address_type_to_string(to_type),
+			NUM_RECORDS, time_elapsed, NUM_RECORDS / time_elapsed / 1e6);
+	}
+	
+	free(records);
+	free(p2pkh);
+	free(bech32);
+	free(hashes);
+	printf("==== %s: PASSED ====\n", __FUNCTION__);
+}
+#undef NUM_RECORDS
+
+int main(int argc, char ** argv)
+{
+	uint64_t seed = (argc > 1)?strtoull(argv[1], NULL, 0):20240607;
+	test_known_vectors();
+	test_batch(seed);
+	return 0;
+}
+#endif
@@ -0,0 +1,738 @@
+/*
+ * blocks_to_addrs.c
+ * 
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ * 
+ * The MIT License (MIT)
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to deal 
+ * in the Software without restriction, including without limitation the rights 
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all 
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS 
+ * IN THE SOFTWARE.
+ * 
+ */
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "sha.h"
+#include "ripemd.h"
+#include "hash_fused.h"
+#include "thread_pool.h"
+
+#include "blocks_to_addrs.h"
+
+#define BLOCK_HEADER_SIZE	(80)
+#define MIN_TX_SIZE	(60)	// version | 1 input (41) | 1 output (9) | locktime, rounded down
+#define MIN_INPUT_SIZE	(41)	// outpoint | empty scriptSig | sequence
+#define MIN_OUTPUT_SIZE	(9)	// value | empty script
+
+#define OP_0	(0x00)
+#define OP_DUP	(0x76)
+#define OP_HASH160	(0xa9)
+#define OP_EQUALVERIFY	(0x88)
+#define OP_CHECKSIG	(0xac)
+
+static const unsigned char s_mainnet_magic[4] = { 0xf9, 0xbe, 0xb4, 0xd9 };
+
+static const char * s_item_types[block_item_types_count] = {
+	[block_item_type_p2pk] = "p2pk",
+	[block_item_type_p2pk_uncompressed] = "p2pk-uncompressed",
+	[block_item_type_p2pkh] = "p2pkh",
+	[block_item_type_p2wpkh] = "p2wpkh",
+	[block_item_type_witness_pubkey] = "witness-pubkey",
+	[block_item_type_p2sh_witness_pubkey] = "p2sh-witness-pubkey",
+};
+
+enum block_item_type block_item_type_from_string(const char * type)
+{
+	if(NULL == type) return -1;
+	for(int i = 0; i < block_item_types_count; ++i) {
+		if(strcasecmp(type, s_item_types[i]) == 0) return i;
+	}
+	return -1;
+}
+
+const char * block_item_type_to_string(enum block_item_type type)
+{
+	if(type < 0 || type >= block_item_types_count) return NULL;
+	return s_item_types[type];
+}
+
+/******************************************************************************
+ * items: flat lists, deduplicated through an open-addressing index of (list position + 1)
+******************************************************************************/
+struct item
+{
+	uint8_t type;
+	uint8_t cb_data;
+	unsigned char data[BLOCK_ITEM_MAX_DATA_SIZE];
+};
+
+struct item_list
+{
+	struct item * items;
+	size_t count, max;
+};
+
+static void item_list_push(struct item_list * list, enum block_item_type type, const unsigned char * data, size_t cb_data)
+{
+	if(list->count == list->max) {
+		size_t max = list->max?(list->max * 2):256;
+		list->items = realloc(list->items, max * sizeof(*list->items));
+		assert(list->items);
+		list->max = max;
+	}
+	struct item * item = &list->items[list->count++];
+	item->type = type;
+	item->cb_data = cb_data;
+	memcpy(item->data, data, cb_data);
+}
+
+struct item_slot
+{
+	uint32_t index;	// position in the list + 1, 0: empty
+	uint32_t fingerprint;
+};
+
+struct item_set
+{
+	size_t mask;
+	size_t count;
+	struct item_slot * slots;
+};
+
+/* pubkeys (past their prefix byte) and hashes are uniform already */
+static inline uint32_t item_fingerprint(const struct item * item)
+{
+	uint64_t v;
+	memcpy(&v, item->data + (item->cb_data > BITCOIN_ADDRS_HASH160_SIZE), sizeof(v));
+	v ^= (item->type + 1) * 0x9e3779b97f4a7c15ULL;
+	return (uint32_t)(v ^ (v >> 32));
+}
+
+static void item_set_init(struct item_set * set, size_t capacity)
+{
+	size_t slots = 64;
+	while(slots < capacity * 2) slots <<= 1;
+	set->mask = slots - 1;
+	set->count = 0;
+	set->slots = calloc(slots, sizeof(*set->slots));
+	assert(set->slots);
+}
+
+static void item_set_grow(struct item_set * set)
+{
+	size_t mask = set->mask * 2 + 1;
+	struct item_slot * slots = calloc(mask + 1, sizeof(*slots));
+	assert(slots);
+	for(size_t i = 0; i <= set->mask; ++i) {
+		const struct item_slot * slot = &set->slots[i];
+		if(0 == slot->index) continue;
+		size_t j = slot->fingerprint & mask;
+		while(slots[j].index) j = (j + 1) & mask;
+		slots[j] = *slot;
+	}
+	free(set->slots);
+	set->slots = slots;
+	set->mask = mask;
+}
+
+/* appends item to list unless an equal one is there; @return 1 if appended */
+static int item_set_add(struct item_set * set, struct item_list * list, const struct item * item)
+{
+	if((set->count + 1) * 2 > set->mask + 1) item_set_grow(set);
+	uint32_t fingerprint = item_fingerprint(item);
+	for(size_t i = fingerprint & set->mask; ; i = (i + 1) & set->mask) {
+		struct item_slot * slot = &set->slots[i];
+		if(0 == slot->index) {
+			assert(list->count < UINT32_MAX);
+			item_list_push(list, item->type, item->data, item->cb_data);
+			slot->index = list->count;
+			slot->fingerprint = fingerprint;
+			++set->count;
+			return 1;
+		}
+		const struct item * other = &list->items[slot->index - 1];
+		if(slot->fingerprint == fingerprint && other->type == item->type && other->cb_data == item->cb_data
+			&& 0 == memcmp(other->data, item->data, item->cb_data)) return 0;
+	}
+}
+
+/******************************************************************************
+ * block / transaction parser
+******************************************************************************/
+struct reader
+{
+	const unsigned char * p;
+	const unsigned char * end;
+};
+
+/* CompactSize, canonical encodings only (as the node writes them) */
+static inline int read_compact_size(struct reader * reader, uint64_t * p_value)
+{
+	if(reader->p >= reader->end) return -1;
+	unsigned char c = *reader->p++;
+	if(c < 0xfd) {
+		*p_value = c;
+		return 0;
+	}
+	size_t size = (c == 0xfd)?2:(c == 0xfe)?4:8;
+	if((size_t)(reader->end - reader->p) < size) return -1;
+	uint64_t value = 0;
+	for(size_t i = 0; i < size; ++i) value |= (uint64_t)reader->p[i] << (8 * i);
+	reader->p += size;
+	if(value < ((c == 0xfd)?0xfd:(c == 0xfe)?0x10000:0x100000000ULL)) return -1;
+	*p_value = value;
+	return 0;
+}
+
+static inline int skip_bytes(struct reader * reader, uint64_t size)
+{
+	if((uint64_t)(reader->end - reader->p) < size) return -1;
+	reader->p += size;
+	return 0;
+}
+
+/* CompactSize length | bytes */
+static inline int read_bytes(struct reader * reader, const unsigned char ** p_data, uint64_t * p_size)
+{
+	if(read_compact_size(reader, p_size)) return -1;
+	*p_data = reader->p;
+	return skip_bytes(reader, *p_size);
+}
+
+struct block_counts
+{
+	uint64_t transactions;
+	uint64_t inputs;
+	uint64_t outputs;
+};
+
+static void collect_output(struct item_list * items, const unsigned char * script, size_t cb_script)
+{
+	switch(cb_script) {
+	case 35:	// <33> OP_CHECKSIG
+		if(script[0] == 33 && (script[1] == 0x02 || script[1] == 0x03) && script[34] == OP_CHECKSIG) {
+			item_list_push(items, block_item_type_p2pk, script + 1, 33);
+		}
+		break;
+	case 67:	// <65> OP_CHECKSIG
+		if(script[0] == 65 && script[1] == 0x04 && script[66] == OP_CHECKSIG) {
+			item_list_push(items, block_item_type_p2pk_uncompressed, script + 1, 65);
+		}
+		break;
+	case 25:	// OP_DUP OP_HASH160 <20> OP_EQUALVERIFY OP_CHECKSIG
+		if(script[0] == OP_DUP && script[1] == OP_HASH160 && script[2] == 20
+			&& script[23] == OP_EQUALVERIFY && script[24] == OP_CHECKSIG) {
+			item_list_push(items, block_item_type_p2pkh, script + 3, 20);
+		}
+		break;
+	case 22:	// OP_0 <20>
+		if(script[0] == OP_0 && script[1] == 20) item_list_push(items, block_item_type_p2wpkh, script + 2, 20);
+		break;
+	default:
+		break;
+	}
+}
+
+/**
+ * tx: version | [ 0x00 0x01 ] | inputs | outputs | [ witnesses ] | locktime
+ *   the witnesses follow the outputs: the inputs are walked again beside them for their scriptSigs
+**/
+static int parse_tx(struct reader * reader, struct item_list * items, struct block_counts * counts)
+{
+	if(skip_bytes(reader, 4)) return -1;
+	int segwit = (reader->end - reader->p) >= 2 && reader->p[0] == 0x00 && reader->p[1] == 0x01;
+	if(segwit) reader->p += 2;
+
+	uint64_t num_inputs = 0, num_outputs = 0, cb = 0;
+	const unsigned char * data = NULL;
+	if(read_compact_size(reader, &num_inputs) || num_inputs == 0
+		|| num_inputs > (uint64_t)(reader->end - reader->p) / MIN_INPUT_SIZE) return -1;
+	const unsigned char * inputs = reader->p;
+	for(uint64_t i = 0; i < num_inputs; ++i) {
+		if(skip_bytes(reader, 36) || read_bytes(reader, &data, &cb) || skip_bytes(reader, 4)) return -1;
+	}
+
+	if(read_compact_size(reader, &num_outputs) || num_outputs > (uint64_t)(reader->end - reader->p) / MIN_OUTPUT_SIZE) return -1;
+	for(uint64_t i = 0; i < num_outputs; ++i) {
+		if(skip_bytes(reader, 8) || read_bytes(reader, &data, &cb)) return -1;
+		collect_output(items, data, cb);
+	}
+
+	if(segwit) {
+		struct reader input = { inputs, reader->p };
+		for(uint64_t i = 0; i < num_inputs; ++i) {
+			const unsigned char * script_sig = NULL;
+			uint64_t cb_script_sig = 0, num_stack_items = 0;
+			skip_bytes(&input, 36);
+			read_bytes(&input, &script_sig, &cb_script_sig);
+			skip_bytes(&input, 4);
+
+			// p2wpkh spend: [ signature, pubkey ]
+			if(read_compact_size(reader, &num_stack_items)) return -1;
+			const unsigned char * pubkey = NULL;
+			for(uint64_t k = 0; k < num_stack_items; ++k) {
+				if(read_bytes(reader, &data, &cb)) return -1;
+				if(k == 1 && cb == 33 && (data[0] == 0x02 || data[0] == 0x03)) pubkey = data;
+			}
+			if(num_stack_items != 2 || NULL == pubkey) continue;
+			if(cb_script_sig == 0) {
+				item_list_push(items, block_item_type_witness_pubkey, pubkey, 33);
+			}else if(cb_script_sig == 23 && script_sig[0] == 22 && script_sig[1] == OP_0 && script_sig[2] == 20) {
+				item_list_push(items, block_item_type_p2sh_witness_pubkey, pubkey, 33);	// push( OP_0 <20> )
+			}
+		}
+	}
+	if(skip_bytes(reader, 4)) return -1;
+
+	++counts->transactions;
+	counts->inputs += num_inputs;
+	counts->outputs += num_outputs;
+	return 0;
+}
+
+/* block: header | CompactSize(txs) | txs, the whole of it must parse */
+static int parse_block(const unsigned char * block, size_t size, struct item_list * items, struct block_counts * counts)
+{
+	if(size < BLOCK_HEADER_SIZE) return -1;
+	struct reader reader = { block + BLOCK_HEADER_SIZE, block + size };
+	uint64_t num_txs = 0;
+	if(read_compact_size(&reader, &num_txs) || num_txs == 0 || num_txs > size / MIN_TX_SIZE) return -1;
+	for(uint64_t i = 0; i < num_txs; ++i) {
+		if(parse_tx(&reader, items, counts)) return -1;
+	}
+	return (reader.p == reader.end)?0:-1;
+}
+
+/******************************************************************************
+ * files
+******************************************************************************/
+struct file_job
+{
+	const char * path;
+	int error;
+	struct item_list items;	// unique within the file, in order
+	struct blocks_extract_stats stats;
+};
+
+struct extract_context
+{
+	unsigned char magic[4];
+	uint64_t xor_key;	// 8 key bytes, in memory order
+	struct file_job * files;
+};
+
+/* Bitcoin Core obfuscates byte i of a file with key[i % 8]; the private mapping is unmasked in place */
+static void unmask(unsigned char * data, size_t size, uint64_t xor_key)
+{
+	size_t i = 0;
+	for(; i + 8 <= size; i += 8) {
+		uint64_t v;
+		memcpy(&v, data + i, 8);
+		v ^= xor_key;
+		memcpy(data + i, &v, 8);
+	}
+	const unsigned char * key = (const unsigned char *)&xor_key;
+	for(; i < size; ++i) data[i] ^= key[i % 8];
+}
+
+static void parse_file(const struct extract_context * ctx, struct file_job * job)
+{
+	int fd = open(job->path, O_RDONLY | O_CLOEXEC);
+	struct stat st;
+	if(fd < 0 || fstat(fd, &st) != 0) {
+		fprintf(stderr, "[blocks]: %s: %s\n", job->path, strerror(errno));
+		if(fd >= 0) close(fd);
+		job->error = 1;
+		return;
+	}
+	size_t size = st.st_size;
+	job->stats.files = 1;
+	job->stats.bytes = size;
+	if(size == 0) {
+		close(fd);
+		return;
+	}
+
+	int prot = ctx->xor_key?(PROT_READ | PROT_WRITE):PROT_READ;
+	unsigned char * data = mmap(NULL, size, prot, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(data == MAP_FAILED) {
+		fprintf(stderr, "[blocks]: mmap %s: %s\n", job->path, strerror(errno));
+		job->error = 1;
+		return;
+	}
+	madvise(data, size, MADV_SEQUENTIAL);
+	if(ctx->xor_key) unmask(data, size, ctx->xor_key);
+
+	// the items of a block are staged and only kept if the whole block parses
+	struct item_list block_items = { NULL };
+	struct item_set set[1];
+	item_set_init(set, size / 256);
+	size_t pos = 0;
+	while(size - pos >= 8 && 0 == memcmp(data + pos, ctx->magic, 4)) {
+		uint32_t cb_block = data[pos + 4] | (data[pos + 5] << 8) | (data[pos + 6] << 16) | ((uint32_t)data[pos + 7] << 24);
+		pos += 8;
+		++job->stats.blocks;
+		if(cb_block > size - pos) {
+			++job->stats.malformed_blocks;	// cut short
+			break;
+		}
+
+		struct block_counts counts = { 0 };
+		block_items.count = 0;
+		if(parse_block(data + pos, cb_block, &block_items, &counts)) {
+			++job->stats.malformed_blocks;
+		}else {
+			job->stats.transactions += counts.transactions;
+			job->stats.inputs += counts.inputs;
+			job->stats.outputs += counts.outputs;
+			job->stats.items += block_items.count;
+			for(size_t i = 0; i < block_items.count; ++i) item_set_add(set, &job->items, &block_items.items[i]);
+		}
+		pos += cb_block;
+	}
+	free(block_items.items);
+	free(set->slots);
+	munmap(data, size);
+}
+
+static void parse_files(size_t begin, size_t end, void * user_data)
+{
+	const struct extract_context * ctx = user_data;
+	for(size_t i = begin; i < end; ++i) parse_file(ctx, &ctx->files[i]);
+}
+
+/******************************************************************************
+ * encoders: one address per unique item
+******************************************************************************/
+static void hash160_of(const unsigned char * data, size_t size, unsigned char hash[static 20])
+{
+	unsigned char sha[32];
+	sha256_hash(data, size, sha);
+	ripemd160_hash(sha, 32, hash);
+}
+
+static void encode_item(struct block_item * item)
+{
+	char * addr = item->addr;
+	ssize_t cb_addr = -1;
+	switch(item->type) {
+	case block_item_type_p2pk:
+		hash160_33(item->data, item->hash160);
+		cb_addr = hash160_to_p2pkh(item->hash160, &addr);
+		break;
+	case block_item_type_p2pk_uncompressed:
+		hash160_of(item->data, 65, item->hash160);
+		cb_addr = hash160_to_p2pkh(item->hash160, &addr);
+		break;
+	case block_item_type_p2pkh:
+		memcpy(item->hash160, item->data, 20);
+		cb_addr = hash160_to_p2pkh(item->hash160, &addr);
+		break;
+	case block_item_type_p2wpkh:
+		memcpy(item->hash160, item->data, 20);
+		cb_addr = witness_program_to_segwit(0, item->hash160, 20, &addr);
+		break;
+	case block_item_type_witness_pubkey:
+		hash160_33(item->data, item->hash160);
+		cb_addr = witness_program_to_segwit(0, item->hash160, 20, &addr);
+		break;
+	case block_item_type_p2sh_witness_pubkey:
+		{
+			// redeem script: OP_0 <hash160(pubkey)>
+			unsigned char redeem_script[2 + 20] = { OP_0, 20 };
+			hash160_33(item->data, &redeem_script[2]);
+			hash160_of(redeem_script, sizeof(redeem_script), item->hash160);
+			cb_addr = script_hash_to_p2sh(item->hash160, &addr);
+		}
+		break;
+	default:
+		break;
+	}
+	item->err_code = (cb_addr > 0)?0:-1;
+	item->cb_addr = (cb_addr > 0)?cb_addr:0;
+}
+
+static void encode_items(size_t begin, size_t end, void * user_data)
+{
+	struct block_item * items = user_data;
+	for(size_t i = begin; i < end; ++i) encode_item(&items[i]);
+}
+
+int blocks_read_xor_key(const char * blocks_dir, unsigned char xor_key[static 8])
+{
+	memset(xor_key, 0, 8);
+	char path[4096] = "";
+	snprintf(path, sizeof(path), "%s/xor.dat", blocks_dir);
+	FILE * fp = fopen(path, "rb");
+	if(NULL == fp) return (errno == ENOENT)?1:-1;
+	size_t cb = fread(xor_key, 1, 8, fp);
+	fclose(fp);
+	if(cb != 8) {
+		memset(xor_key, 0, 8);
+		return -1;
+	}
+	return 0;
+}
+
+ssize_t blocks_extract(const char * const * paths, size_t num_paths, const struct blocks_extract_config * config,
+	struct block_item ** p_items, struct blocks_extract_stats * p_stats)
+{
+	assert(p_items && (paths || num_paths == 0));
+	*p_items = NULL;
+	struct blocks_extract_stats stats[1];
+	memset(stats, 0, sizeof(stats));
+	struct timespec begin_time, end_time;
+	clock_gettime(CLOCK_MONOTONIC, &begin_time);
+
+	static const unsigned char zeros[8];
+	struct extract_context ctx[1];
+	memset(ctx, 0, sizeof(ctx));
+	memcpy(ctx->magic, (config && memcmp(config->network_magic, zeros, 4))?config->network_magic:s_mainnet_magic, 4);
+	if(config) memcpy(&ctx->xor_key, config->xor_key, 8);
+	ctx->files = calloc(num_paths + 1, sizeof(*ctx->files));
+	assert(ctx->files);
+	for(size_t i = 0; i < num_paths; ++i) ctx->files[i].path = paths[i];
+
+	struct thread_pool * pool = (config && config->pool)?config->pool:thread_pool_default();
+	thread_pool_parallel_for(pool, 0, num_paths, 1, parse_files, ctx);
+
+	// merge in file order: the first appearance of an item is kept
+	ssize_t rc = 0;
+	struct item_list unique = { NULL };
+	uint32_t * file_indices = NULL;
+	struct item_set set[1];
+	item_set_init(set, 0);
+	for(size_t i = 0; i < num_paths; ++i) {
+		struct file_job * job = &ctx->files[i];
+		if(job->error) rc = -1;
+		stats->files += job->stats.files;
+		stats->bytes += job->stats.bytes;
+		stats->blocks += job->stats.blocks;
+		stats->malformed_blocks += job->stats.malformed_blocks;
+		stats->transactions += job->stats.transactions;
+		stats->inputs += job->stats.inputs;
+		stats->outputs += job->stats.outputs;
+		stats->items += job->stats.items;
+		if(rc) continue;
+
+		size_t first = unique.count;
+		for(size_t k = 0; k < job->items.count; ++k) item_set_add(set, &unique, &job->items.items[k]);
+		if(unique.count > first) {
+			file_indices = realloc(file_indices, unique.max * sizeof(*file_indices));
+			assert(file_indices);
+			for(size_t k = first; k < unique.count; ++k) file_indices[k] = i;
+		}
+		free(job->items.items);
+		job->items.items = NULL;
+	}
+	free(set->slots);
+
+	struct block_item * items = NULL;
+	if(0 == rc && unique.count > 0) {
+		items = calloc(unique.count, sizeof(*items));
+		assert(items);
+		for(size_t i = 0; i < unique.count; ++i) {
+			items[i].type = unique.items[i].type;
+			items[i].cb_data = unique.items[i].cb_data;
+			memcpy(items[i].data, unique.items[i].data, unique.items[i].cb_data);
+			items[i].file_index = file_indices[i];
+		}
+		thread_pool_parallel_for(pool, 0, unique.count, 0, encode_items, items);
+	}
+	if(0 == rc) {
+		rc = unique.count;
+		stats->unique_items = unique.count;
+	}
+	free(unique.items);
+	free(file_indices);
+	for(size_t i = 0; i < num_paths; ++i) free(ctx->files[i].items.items);
+	free(ctx->files);
+
+	clock_gettime(CLOCK_MONOTONIC, &end_time);
+	stats->elapsed = (end_time.tv_sec - begin_time.tv_sec) + (end_time.tv_nsec - begin_time.tv_nsec) / 1e9;
+	if(p_stats) *p_stats = *stats;
+	*p_items = items;
+	return rc;
+}
+
+
+#if defined(_TEST_BLOCKS_TO_ADDRS) && defined(_STAND_ALONE)
+/*
+ * fixture tests/blocks/blk00000.dat: the mainnet genesis block, then two synthetic blocks
+ *   1: p2pk (compressed) + p2pkh coinbase; a legacy tx repeating the genesis pubkey and the p2pkh hash
+ *   2: segwit coinbase paying p2wpkh; a segwit tx spending p2wpkh, p2sh-p2wpkh and legacy inputs,
+ *      paying p2wpkh, p2tr, p2sh and p2pkh (the p2tr / p2sh outputs carry no key)
+ * followed by zero padding. The same file twice, its obfuscated copy, a corrupted block and a cut file.
+ */
+#include "utils.h"
+#include "arena.h"
+
+#define FIXTURE_PATH	"tests/blocks/blk00000.dat"
+
+static const struct
+{
+	const char * type;
+	const char * data_hex;
+	const char * addr;
+}s_expected[] = {
+	{ "p2pk-uncompressed", "04678afdb0fe5548271967f1a67130b7105cd6a828e03909a67962e0ea1f61deb649f6bc3f4cef38c4f35504e51ec112de5c384df7ba0b8d578a4c702b6bf11d5f", "1A1zP1eP5QGefi2DMPTfTL5SLmv7DivfNa" },
+	{ "p2pk", "0279be667ef9dcbbac55a06295ce870b07029bfcdb2dce28d959f2815b16f81798", "1BgGZ9tcN4rm9KBzDn7KprQz87SZ26SAMH" },
+	{ "p2pkh", "06afd46bcdfd22ef94ac122aa11f241244a37ecc", "1cMh228HTCiwS8ZsaakH8A8wze1JR5ZsP" },
+	{ "p2wpkh", "7dd65592d0ab2fe0d0257d571abf032cd9db93dc", "bc1q0ht9tyks4vh7p5p904t340cr9nvahy7u3re7zg" },
+	{ "p2wpkh", "751e76e8199196d454941c45d1b3a323f1433bd6", "bc1qw508d6qejxtdg4y5r3zarvary0c5xw7kv8f3t4" },
+	{ "p2pkh", "751e76e8199196d454941c45d1b3a323f1433bd6", "1BgGZ9tcN4rm9KBzDn7KprQz87SZ26SAMH" },
+	{ "witness-pubkey", "02f9308a019258c31049344f85f89d5229b531c845836f99b08601f113bce036f9", "bc1q0ht9tyks4vh7p5p904t340cr9nvahy7u3re7zg" },
+	{ "p2sh-witness-pubkey", "02c6047f9441ed7d6d3045406e95c07cd85c778e4b8cef3ca7abac09b95c709ee5", "3FWHHE3RVgyv5vYmMrcoRdA25uugWvQbso" },
+};
+#define NUM_EXPECTED	(sizeof(s_expected) / sizeof(s_expected[0]))
+
+/* items must be the listed subset of s_expected, in order */
+static void verify_items(const struct block_item * items, ssize_t count, const int * indices, size_t num_indices)
+{
+	assert(count == (ssize_t)num_indices);
+	for(size_t i = 0; i < num_indices; ++i) {
+		const struct block_item * item = &items[i];
+		int k = indices[i];
+		assert(item->type == block_item_type_from_string(s_expected[k].type));
+		assert(0 == strcmp(block_item_type_to_string(item->type), s_expected[k].type));
+		char * data_hex = NULL;
+		bin2hex(item->data, item->cb_data, &data_hex);
+		assert(0 == strcmp(data_hex, s_expected[k].data_hex));
+		lib_free(data_hex);
+		assert(0 == item->err_code && item->cb_addr == strlen(s_expected[k].addr));
+		assert(0 == strcmp(item->addr, s_expected[k].addr));
+	}
+}
+
+static size_t read_fixture(const char * path, unsigned char ** p_data)
+{
+	FILE * fp = fopen(path, "rb");
+	assert(fp);
+	static unsigned char data[65536];
+	size_t size = fread(data, 1, sizeof(data), fp);
+	fclose(fp);
+	*p_data = data;
+	return size;
+}
+
+static void write_file(const char * path, const unsigned char * data, size_t size)
+{
+	FILE * fp = fopen(path, "wb");
+	assert(fp);
+	assert(size == fwrite(data, 1, size, fp));
+	fclose(fp);
+}
+
+int main(int argc, char ** argv)
+{
+	const char * fixture = (argc > 1)?argv[1]:FIXTURE_PATH;
+	unsigned char * data = NULL;
+	size_t size = read_fixture(fixture, &data);
+	assert(size > 1000);
+
+	thread_pool_t * pool = thread_pool_new(4, 0);
+	struct blocks_extract_config config = { .pool = pool };
+	struct blocks_extract_stats stats[1];
+	struct block_item * items = NULL;
+	static const int all[] = { 0, 1, 2, 3, 4, 5, 6, 7 };
+
+	ssize_t count = blocks_extract(&fixture, 1, &config, &items, stats);
+	verify_items(items, count, all, NUM_EXPECTED);
+	assert(stats->files == 1 && stats->bytes == size && stats->blocks == 3 && stats->malformed_blocks == 0);
+	assert(stats->transactions == 5 && stats->inputs == 7 && stats->outputs == 12);
+	assert(stats->items == 10 && stats->unique_items == NUM_EXPECTED);
+	free(items);
+
+	// the same file twice: nothing new from the second one
+	const char * twice[] = { fixture, fixture };
+	count = blocks_extract(twice, 2, &config, &items, stats);
+	verify_items(items, count, all, NUM_EXPECTED);
+	for(ssize_t i = 0; i < count; ++i) assert(items[i].file_index == 0);
+	assert(stats->files == 2 && stats->blocks == 6 && stats->items == 20 && stats->unique_items == NUM_EXPECTED);
+	free(items);
+
+	char dir[] = "/tmp/test_blocks_XXXXXX";
+	assert(mkdtemp(dir));
+	char path[256], xor_path[256];
+	snprintf(path, sizeof(path), "%s/blk00001.dat", dir);
+	snprintf(xor_path, sizeof(xor_path), "%s/xor.dat", dir);
+	const char * paths[] = { path };
+
+	// obfuscated (blocks/xor.dat)
+	unsigned char key[8];
+	assert(1 == blocks_read_xor_key(dir, key));
+	static const unsigned char xor_key[8] = { 0x5a, 0x01, 0xff, 0x80, 0x13, 0x37, 0x00, 0xc4 };
+	write_file(xor_path, xor_key, 8);
+	assert(0 == blocks_read_xor_key(dir, config.xor_key));
+	unsigned char * masked = malloc(size);
+	assert(masked);
+	for(size_t i = 0; i < size; ++i) masked[i] = data[i] ^ xor_key[i % 8];
+	write_file(path, masked, size);
+	count = blocks_extract(paths, 1, &config, &items, stats);
+	verify_items(items, count, all, NUM_EXPECTED);
+	free(items);
+	free(masked);
+	memset(config.xor_key, 0, 8);
+	unlink(xor_path);
+
+	// block 1 claims three transactions: skipped as a whole
+	size_t block1 = 8 + (data[4] | (data[5] << 8)) + 8;
+	unsigned char * corrupted = malloc(size);
+	assert(corrupted);
+	memcpy(corrupted, data, size);
+	assert(corrupted[block1 + BLOCK_HEADER_SIZE] == 2);
+	corrupted[block1 + BLOCK_HEADER_SIZE] = 3;
+	write_file(path, corrupted, size);
+	static const int without_block1[] = { 0, 3, 4, 5, 6, 7 };
+	count = blocks_extract(paths, 1, &config, &items, stats);
+	verify_items(items, count, without_block1, 6);
+	assert(stats->blocks == 3 && stats->malformed_blocks == 1 && stats->transactions == 3);
+	free(items);
+	free(corrupted);
+
+	// cut in the middle of block 2
+	write_file(path, data, size - 200);
+	static const int first_blocks[] = { 0, 1, 2 };
+	count = blocks_extract(paths, 1, &config, &items, stats);
+	verify_items(items, count, first_blocks, 3);
+	assert(stats->blocks == 3 && stats->malformed_blocks == 1);
+	free(items);
+
+	// a missing file fails the whole extraction
+	const char * missing[] = { fixture, "/nonexistent/blk00000.dat" };
+	assert(-1 == blocks_extract(missing, 2, &config, &items, stats) && NULL == items);
+
+	unlink(path);
+	rmdir(dir);
+	thread_pool_free(pool);
+	printf("==== %s: PASSED ====\n", __FILE__);
+	return 0;
+}
+#endif
@@ -0,0 +1,667 @@
+/*
+ * descriptor_to_addrs.c
+ * 
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ * 
+ * The MIT License (MIT)
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to deal 
+ * in the Software without restriction, including without limitation the rights 
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all 
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS 
+ * IN THE SOFTWARE.
+ * 
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <endian.h>
+
+#include "sha.h"
+#include "hmac.h"
+#include "base58.h"
+#include "utils.h"
+#include "thread_pool.h"
+
+#include "descriptor_to_addrs.h"
+#include "privkey_to_addrs.h"
+#include "multisig_to_addrs.h"
+
+#define DESCRIPTOR_BATCH_SIZE	(32)	// indices per block: keys are derived, then encoded while still in cache
+#define XPUB_SIZE	(78)	// version(4) | depth | parent fingerprint(4) | child number(4) | chain code(32) | pubkey(33)
+#define XPUB_MAX_LENGTH	(112)
+#define BIP32_HARDENED	(0x80000000u)
+
+/******************************************************************************
+ * checksum (BIP380)
+******************************************************************************/
+static const char s_input_charset[] = "0123456789()[],'/*abcdefgh@:$%{}"
+	"IJKLMNOPQRSTUVWXYZ&+-.;<=>?!^_|~"
+	"ijklmnopqrstuvwxyzABCDEFGH`#\"\\ ";
+static const char s_checksum_charset[] = "qpzry9x8gf2tvdw0s3jn54khce6mua7l";
+
+static inline uint64_t descriptor_polymod(uint64_t c, int value)
+{
+	uint8_t c0 = c >> 35;
+	c = ((c & 0x7ffffffffULL) << 5) ^ value;
+	if(c0 & 0x01) c ^= 0xf5dee51989ULL;
+	if(c0 & 0x02) c ^= 0xa9fdca3312ULL;
+	if(c0 & 0x04) c ^= 0x1bab10e32dULL;
+	if(c0 & 0x08) c ^= 0x3706b1677aULL;
+	if(c0 & 0x10) c ^= 0x644d626ffdULL;
+	return c;
+}
+
+int descriptor_checksum(const char * descriptor, size_t cb_descriptor, char checksum[static DESCRIPTOR_CHECKSUM_LENGTH + 1])
+{
+	uint64_t c = 1;
+	int cls = 0, cls_count = 0;
+	for(size_t i = 0; i < cb_descriptor; ++i) {
+		const char * pos = (descriptor[i] != '\0')?strchr(s_input_charset, descriptor[i]):NULL;
+		if(NULL == pos) return -1;
+		int value = pos - s_input_charset;
+		c = descriptor_polymod(c, value & 31);
+		cls = cls * 3 + (value >> 5);
+		if(++cls_count == 3) {
+			c = descriptor_polymod(c, cls);
+			cls = 0;
+			cls_count = 0;
+		}
+	}
+	if(cls_count > 0) c = descriptor_polymod(c, cls);
+	for(int i = 0; i < DESCRIPTOR_CHECKSUM_LENGTH; ++i) c = descriptor_polymod(c, 0);
+	c ^= 1;
+
+	for(int i = 0; i < DESCRIPTOR_CHECKSUM_LENGTH; ++i) {
+		checksum[i] = s_checksum_charset[(c >> (5 * (7 - i))) & 31];
+	}
+	checksum[DESCRIPTOR_CHECKSUM_LENGTH] = '\0';
+	return 0;
+}
+
+/******************************************************************************
+ * plan
+******************************************************************************/
+enum plan_encoder
+{
+	plan_encoder_single,	// pubkeys_to_addrs_batch(), one address type
+	plan_encoder_multisig,	// multisigs_to_addrs_batch(), one address type
+};
+
+struct plan_key
+{
+	int ranged;	// 1: the last step is the wildcard
+	unsigned char pubkey[BITCOIN_ADDRS_PUBKEY_SIZE];	// the key, or the parent of the ranged step
+	struct bitcoin_addrs_point point;	// parsed pubkey (ranged keys)
+	hmac_sha512_t hmac;	// keyed with the parent chain code, the parent pubkey absorbed (ranged keys)
+};
+
+struct descriptor_plan
+{
+	enum plan_encoder encoder;
+	int address_type;	// enum bitcoin_address_type / enum multisig_address_type
+	int multisig_flags;
+	unsigned int m, n;	// n: number of keys (1 for single-key descriptors)
+	int ranged;
+	struct plan_key keys[MULTISIG_MAX_KEYS];
+};
+
+/* the extended public key after the fixed steps */
+struct xpub
+{
+	unsigned char chain_code[32];
+	unsigned char pubkey[BITCOIN_ADDRS_PUBKEY_SIZE];
+	struct bitcoin_addrs_point point;
+};
+
+static int xpub_decode(const char * b58, size_t cb_b58, struct xpub * xpub)
+{
+	static const unsigned char mainnet_version[4] = { 0x04, 0x88, 0xb2, 0x1e };
+	if(cb_b58 > XPUB_MAX_LENGTH) return -1;
+
+	unsigned char data[XPUB_MAX_LENGTH];
+	unsigned char * p_data = data;
+	if(base58_decode(b58, cb_b58, &p_data) != XPUB_SIZE + 4) return -1;
+
+	unsigned char hash[32];
+	sha256_hash(data, XPUB_SIZE, hash);
+	sha256_hash(hash, 32, hash);
+	if(memcmp(hash, &data[XPUB_SIZE], 4) != 0) return -1;
+	if(memcmp(data, mainnet_version, 4) != 0) return -1;
+
+	memcpy(xpub->chain_code, &data[13], 32);
+	memcpy(xpub->pubkey, &data[45], BITCOIN_ADDRS_PUBKEY_SIZE);
+	if(xpub->pubkey[0] != 0x02 && xpub->pubkey[0] != 0x03) return -1;
+	return 0;
+}
+
+/* keys the HMAC with the chain code and absorbs the parent pubkey: per child only ser32(index) is left */
+static void key_schedule(hmac_sha512_t * hmac, const unsigned char chain_code[static 32], const unsigned char pubkey[static BITCOIN_ADDRS_PUBKEY_SIZE])
+{
+	hmac_sha512_init(hmac, chain_code, 32);
+	hmac_sha512_update(hmac, pubkey, BITCOIN_ADDRS_PUBKEY_SIZE);
+}
+
+/* CKDpub: I = HMAC-SHA512(chain_code, pubkey | ser32(index)), child = pubkey + I[0:32] * G, child chain code = I[32:64] */
+static int derive_child(const hmac_sha512_t * schedule, const struct bitcoin_addrs_point * point, uint32_t index,
+	unsigned char child[static BITCOIN_ADDRS_PUBKEY_SIZE], unsigned char child_chain_code[32])
+{
+	hmac_sha512_t hmac = *schedule;
+	uint32_t be_index = htobe32(index);
+	unsigned char digest[64];
+	hmac_sha512_update(&hmac, &be_index, 4);
+	hmac_sha512_final(&hmac, digest);
+	if(pubkey_tweak_add(point, digest, child) != 0) return -1;
+	if(child_chain_code) memcpy(child_chain_code, &digest[32], 32);
+	return 0;
+}
+
+/******************************************************************************
+ * parser
+******************************************************************************/
+struct parser
+{
+	const char * p;
+	const char * end;
+	const char * error;
+};
+
+static inline int accept(struct parser * parser, const char * token)
+{
+	size_t length = strlen(token);
+	if((size_t)(parser->end - parser->p) < length || memcmp(parser->p, token, length) != 0) return 0;
+	parser->p += length;
+	return 1;
+}
+
+static inline int fail(struct parser * parser, const char * error)
+{
+	if(NULL == parser->error) parser->error = error;
+	return -1;
+}
+
+static int parse_number(struct parser * parser, uint32_t * p_value)
+{
+	uint64_t value = 0;
+	const char * begin = parser->p;
+	while(parser->p < parser->end && *parser->p >= '0' && *parser->p <= '9') {
+		value = value * 10 + (*parser->p++ - '0');
+		if(value > UINT32_MAX) return fail(parser, "number out of range");
+	}
+	if(parser->p == begin) return fail(parser, "number expected");
+	*p_value = value;
+	return 0;
+}
+
+/* KEY := [ '[' origin ']' ] ( hex pubkey | xpub ( '/' step )* [ '/' '*' ] ) */
+static int parse_key(struct parser * parser, struct plan_key * key)
+{
+	if(accept(parser, "[")) {	// key origin: informational only
+		const char * close = memchr(parser->p, ']', parser->end - parser->p);
+		if(NULL == close) return fail(parser, "unterminated key origin");
+		parser->p = close + 1;
+	}
+
+	const char * begin = parser->p;
+	while(parser->p < parser->end && *parser->p != '/' && *parser->p != ',' && *parser->p != ')') ++parser->p;
+	size_t length = parser->p - begin;
+
+	if(length == BITCOIN_ADDRS_PUBKEY_SIZE * 2) {
+		void * p_pubkey = key->pubkey;
+		if(hex2bin(begin, length, &p_pubkey) != BITCOIN_ADDRS_PUBKEY_SIZE
+			|| (key->pubkey[0] != 0x02 && key->pubkey[0] != 0x03))
+		{
+			return fail(parser, "invalid compressed pubkey");
+		}
+		if(parser->p < parser->end && *parser->p == '/') return fail(parser, "derivation steps on a non-extended key");
+		return 0;
+	}
+
+	struct xpub xpub;
+	if(length < 4 || memcmp(begin, "xpub", 4) != 0 || xpub_decode(begin, length, &xpub) != 0) {
+		return fail(parser, "invalid key (compressed hex pubkey or mainnet xpub expected)");
+	}
+
+	int has_point = 0;
+	while(accept(parser, "/")) {
+		if(accept(parser, "*")) {
+			if(parser->p < parser->end && (*parser->p == '\'' || *parser->p == 'h' || *parser->p == 'H')) {
+				return fail(parser, "hardened wildcard needs a private key");
+			}
+			key->ranged = 1;
+			break;
+		}
+		uint32_t index = 0;
+		if(parse_number(parser, &index)) return -1;
+		if(parser->p < parser->end && (*parser->p == '\'' || *parser->p == 'h' || *parser->p == 'H')) {
+			return fail(parser, "hardened step needs a private key");
+		}
+		if(index >= BIP32_HARDENED) return fail(parser, "step out of range");
+
+		if(!has_point && pubkey_parse(xpub.pubkey, &xpub.point) != 0) return fail(parser, "xpub derivation needs libsecp256k1");
+		has_point = 1;
+		hmac_sha512_t hmac;
+		key_schedule(&hmac, xpub.chain_code, xpub.pubkey);
+		if(derive_child(&hmac, &xpub.point, index, xpub.pubkey, xpub.chain_code) != 0
+			|| pubkey_parse(xpub.pubkey, &xpub.point) != 0)
+		{
+			return fail(parser, "invalid child key");
+		}
+	}
+
+	memcpy(key->pubkey, xpub.pubkey, BITCOIN_ADDRS_PUBKEY_SIZE);
+	if(key->ranged) {
+		if(!has_point && pubkey_parse(xpub.pubkey, &xpub.point) != 0) return fail(parser, "xpub derivation needs libsecp256k1");
+		key->point = xpub.point;
+		key_schedule(&key->hmac, xpub.chain_code, xpub.pubkey);
+	}
+	return 0;
+}
+
+/* MULTI := ( 'multi' | 'sortedmulti' ) '(' k ( ',' KEY )+ ')' */
+static int parse_multi(struct parser * parser, struct descriptor_plan * plan)
+{
+	if(accept(parser, "sortedmulti(")) plan->multisig_flags = 0;
+	else if(accept(parser, "multi(")) plan->multisig_flags = MULTISIG_KEEP_ORDER;
+	else return fail(parser, "multi() or sortedmulti() expected");
+
+	uint32_t m = 0;
+	if(parse_number(parser, &m)) return -1;
+	unsigned int n = 0;
+	while(accept(parser, ",")) {
+		if(n == MULTISIG_MAX_KEYS) return fail(parser, "too many keys (at most 15)");
+		if(parse_key(parser, &plan->keys[n++])) return -1;
+	}
+	if(!accept(parser, ")")) return fail(parser, "')' expected");
+	if(m < 1 || m > n) return fail(parser, "invalid threshold");
+
+	plan->encoder = plan_encoder_multisig;
+	plan->m = m;
+	plan->n = n;
+	return 0;
+}
+
+static int parse_single(struct parser * parser, struct descriptor_plan * plan, enum bitcoin_address_type type)
+{
+	plan->encoder = plan_encoder_single;
+	plan->address_type = type;
+	plan->m = plan->n = 1;
+	if(parse_key(parser, &plan->keys[0])) return -1;
+	if(!accept(parser, ")")) return fail(parser, "')' expected");
+	return 0;
+}
+
+static int parse_descriptor(struct parser * parser, struct descriptor_plan * plan)
+{
+	if(accept(parser, "pkh(")) return parse_single(parser, plan, bitcoin_address_type_p2pkh);
+	if(accept(parser, "wpkh(")) return parse_single(parser, plan, bitcoin_address_type_bech32);
+
+	int rc = 0;
+	if(accept(parser, "sh(")) {
+		if(accept(parser, "wpkh(")) {
+			rc = parse_single(parser, plan, bitcoin_address_type_p2sh_p2pkh);
+		}else if(accept(parser, "wsh(")) {
+			plan->address_type = multisig_address_type_p2sh_p2wsh;
+			rc = parse_multi(parser, plan);
+			if(0 == rc && !accept(parser, ")")) rc = fail(parser, "')' expected");
+		}else {
+			plan->address_type = multisig_address_type_p2sh;
+			rc = parse_multi(parser, plan);
+		}
+	}else if(accept(parser, "wsh(")) {
+		plan->address_type = multisig_address_type_p2wsh;
+		rc = parse_multi(parser, plan);
+	}else {
+		return fail(parser, "unsupported descriptor (pkh, wpkh, sh, wsh expected)");
+	}
+	if(0 == rc && !accept(parser, ")")) rc = fail(parser, "')' expected");
+	return rc;
+}
+
+descriptor_plan_t * descriptor_compile(const char * descriptor, const char ** p_error)
+{
+	assert(descriptor);
+	size_t cb_descriptor = strlen(descriptor);
+	const char * error = NULL;
+
+	// '#' checksum
+	const char * hash = memchr(descriptor, '#', cb_descriptor);
+	if(hash) {
+		char checksum[DESCRIPTOR_CHECKSUM_LENGTH + 1];
+		if(strlen(hash + 1) != DESCRIPTOR_CHECKSUM_LENGTH) error = "invalid checksum length";
+		else if(descriptor_checksum(descriptor, hash - descriptor, checksum) != 0) error = "invalid character";
+		else if(memcmp(checksum, hash + 1, DESCRIPTOR_CHECKSUM_LENGTH) != 0) error = "checksum mismatch";
+		cb_descriptor = hash - descriptor;
+	}
+
+	struct descriptor_plan * plan = NULL;
+	if(NULL == error) {
+		plan = calloc(1, sizeof(*plan));
+		assert(plan);
+
+		struct parser parser = { .p = descriptor, .end = descriptor + cb_descriptor };
+		if(parse_descriptor(&parser, plan) == 0 && parser.p != parser.end) fail(&parser, "trailing characters");
+		error = parser.error;
+	}
+	if(error) {
+		if(p_error) *p_error = error;
+		descriptor_plan_free(plan);
+		return NULL;
+	}
+
+	for(unsigned int i = 0; i < plan->n; ++i) plan->ranged |= plan->keys[i].ranged;
+	return plan;
+}
+
+void descriptor_plan_free(descriptor_plan_t * plan)
+{
+	free(plan);
+}
+
+int descriptor_plan_is_ranged(const descriptor_plan_t * plan)
+{
+	return plan->ranged;
+}
+
+const char * descriptor_plan_get_address_type(const descriptor_plan_t * plan)
+{
+	if(plan->encoder == plan_encoder_multisig) return multisig_address_type_to_string(plan->address_type);
+	return bitcoin_address_type_to_string(plan->address_type);
+}
+
+/******************************************************************************
+ * execution
+******************************************************************************/
+/* one key for every index of the block; the ranged test runs once per key and block, not per index */
+static uint64_t derive_block(const struct plan_key * key, uint32_t first_index, size_t count,
+	unsigned char * pubkeys, size_t stride)
+{
+	uint64_t failed = 0;
+	if(!key->ranged) {
+		for(size_t i = 0; i < count; ++i) memcpy(pubkeys + i * stride, key->pubkey, BITCOIN_ADDRS_PUBKEY_SIZE);
+		return 0;
+	}
+	for(size_t i = 0; i < count; ++i) {
+		unsigned char * pubkey = pubkeys + i * stride;
+		uint64_t index = (uint64_t)first_index + i;
+		if(index >= BIP32_HARDENED || derive_child(&key->hmac, &key->point, index, pubkey, NULL) != 0) {
+			memset(pubkey, 0, BITCOIN_ADDRS_PUBKEY_SIZE);
+			failed |= (uint64_t)1 << i;
+		}
+	}
+	return failed;
+}
+
+static inline void emit(struct descriptor_address * addr, uint32_t index, int ok, const char * src, uint8_t cb_src)
+{
+	addr->index = index;
+	addr->err_code = ok?0:-1;
+	addr->cb_addr = ok?cb_src:0;
+	if(ok) memcpy(addr->addr, src, cb_src + 1);
+	else addr->addr[0] = '\0';
+}
+
+static ssize_t execute_single(const struct descriptor_plan * plan, uint32_t first_index, size_t count, struct descriptor_address * addrs)
+{
+	const uint32_t types_mask = BITCOIN_ADDRESS_TYPE_MASK(plan->address_type);
+	struct bitcoin_addrs_record records[DESCRIPTOR_BATCH_SIZE];
+	ssize_t num_ok = 0;
+	for(size_t first = 0; first < count; first += DESCRIPTOR_BATCH_SIZE) {
+		size_t num_keys = ((count - first) < DESCRIPTOR_BATCH_SIZE)?(count - first):DESCRIPTOR_BATCH_SIZE;
+		uint32_t index = first_index + first;
+		uint64_t failed = derive_block(&plan->keys[0], index, num_keys, records[0].pubkey, sizeof(records[0]));
+		pubkeys_to_addrs_batch(records, num_keys, types_mask);
+
+		for(size_t i = 0; i < num_keys; ++i) {
+			const struct bitcoin_addrs_record * record = &records[i];
+			int ok = !((failed >> i) & 1) && 0 == record->err_code;
+			emit(&addrs[first + i], index + i, ok, record->addrs[plan->address_type], record->cb_addrs[plan->address_type]);
+			num_ok += ok;
+		}
+	}
+	return num_ok;
+}
+
+static ssize_t execute_multisig(const struct descriptor_plan * plan, uint32_t first_index, size_t count, struct descriptor_address * addrs)
+{
+	const uint32_t types_mask = MULTISIG_ADDRESS_TYPE_MASK(plan->address_type);
+	struct multisig_record records[DESCRIPTOR_BATCH_SIZE];
+	ssize_t num_ok = 0;
+	for(size_t first = 0; first < count; first += DESCRIPTOR_BATCH_SIZE) {
+		size_t num_sets = ((count - first) < DESCRIPTOR_BATCH_SIZE)?(count - first):DESCRIPTOR_BATCH_SIZE;
+		uint32_t index = first_index + first;
+		uint64_t failed = 0;
+		for(unsigned int k = 0; k < plan->n; ++k) {
+			failed |= derive_block(&plan->keys[k], index, num_sets, records[0].pubkeys[k], sizeof(records[0]));
+		}
+		for(size_t i = 0; i < num_sets; ++i) {
+			records[i].m = plan->m;
+			records[i].n = plan->n;
+		}
+		multisigs_to_addrs_batch(records, num_sets, types_mask, plan->multisig_flags);
+
+		for(size_t i = 0; i < num_sets; ++i) {
+			const struct multisig_record * record = &records[i];
+			int ok = !((failed >> i) & 1) && 0 == record->err_code;
+			emit(&addrs[first + i], index + i, ok, record->addrs[plan->address_type], record->cb_addrs[plan->address_type]);
+			num_ok += ok;
+		}
+	}
+	return num_ok;
+}
+
+ssize_t descriptor_plan_execute(const descriptor_plan_t * plan, uint32_t first_index, size_t count, struct descriptor_address * addrs)
+{
+	assert(plan && addrs);
+	if(plan->encoder == plan_encoder_multisig) return execute_multisig(plan, first_index, count, addrs);
+	return execute_single(plan, first_index, count, addrs);
+}
+
+struct parallel_execution
+{
+	const struct descriptor_plan * plan;
+	uint32_t first_index;
+	struct descriptor_address * addrs;
+	ssize_t num_ok;
+};
+
+static void execute_range(size_t begin, size_t end, void * user_data)
+{
+	struct parallel_execution * execution = user_data;
+	ssize_t num_ok = descriptor_plan_execute(execution->plan, execution->first_index + begin, end - begin, execution->addrs + begin);
+	__atomic_add_fetch(&execution->num_ok, num_ok, __ATOMIC_RELAXED);
+}
+
+ssize_t descriptor_plan_execute_parallel(struct thread_pool * pool,
+	const descriptor_plan_t * plan, uint32_t first_index, size_t count, struct descriptor_address * addrs)
+{
+	assert(plan && addrs);
+	if(NULL == pool) pool = thread_pool_default();
+
+	struct parallel_execution execution = { .plan = plan, .first_index = first_index, .addrs = addrs };
+	thread_pool_parallel_for(pool, 0, count, DESCRIPTOR_BATCH_SIZE, execute_range, &execution);
+	return execution.num_ok;
+}
+
+
+#if defined(_TEST_DESCRIPTOR_TO_ADDRS) && defined(_STAND_ALONE)
+/*
+ * checksums (BIP380 example), hex-key descriptors against the single-key / multisig vectors,
+ * rejected descriptors; with libsecp256k1: ranged xpub descriptors (BIP32 test vector 1 keys)
+ * against an independent BIP32 implementation, and execute() == execute_parallel() == one index at a time
+ */
+#include <stddef.h>
+#include <time.h>
+
+#define XPUB_M	"xpub661MyMwAqRbcFtXgS5sYJABqqG9YLmC4Q1Rdap9gSE8NqtwybGhePY2gZ29ESFjqJoCu1Rupje8YtGqsefD265TMg7usUDFdp6W1EGMcet8"
+#define XPUB_0H	"xpub68Gmy5EdvgibQVfPdqkBBCHxA5htiqg55crXYuXoQRKfDBFA1WEjWgP6LHhwBZeNK1VTsfTFUHCdrfp1bgwQ9xv5ski8PX9rL2dZXvgGDnw"
+#define PUBKEY_G	"0279be667ef9dcbbac55a06295ce870b07029bfcdb2dce28d959f2815b16f81798"
+#define BIP67_KEY_1	"02ff12471208c14bd580709cb2358d98975247d8765f92bc25eab3b2763ed605f8"
+#define BIP67_KEY_2	"02fe6f0a5a297eb38c391581c4413e084773ea23954d93f7753db7dc0adc188b2f"
+
+static double elapsed(const struct timespec * begin, const struct timespec * end)
+{
+	return (end->tv_sec - begin->tv_sec) + (end->tv_nsec - begin->tv_nsec) / 1e9;
+}
+
+static void check_addresses(const char * descriptor, uint32_t first_index, size_t count, const char * const * expected)
+{
+	const char * error = NULL;
+	descriptor_plan_t * plan = descriptor_compile(descriptor, &error);
+	if(NULL == plan) fprintf(stderr, "%s: %s\n", descriptor, error);
+	assert(plan);
+
+	struct descriptor_address addrs[8];
+	assert(count <= 8);
+	assert(count == descriptor_plan_execute(plan, first_index, count, addrs));
+	for(size_t i = 0; i < count; ++i) {
+		assert(addrs[i].index == first_index + i && 0 == addrs[i].err_code);
+		assert(addrs[i].cb_addr == strlen(expected[i]) && 0 == strcmp(addrs[i].addr, expected[i]));
+	}
+	descriptor_plan_free(plan);
+}
+
+#define NUM_INDICES (2000)
+int main(int argc, char ** argv)
+{
+	char checksum[DESCRIPTOR_CHECKSUM_LENGTH + 1];
+	const char * example = "pkh([d34db33f/44'/0'/0']xpub6ERApfZwUNrhLCkDtcHTcxd75RbzS1ed54G1LkBUHQVHQKqhMkhgbmJbZRkrgZw4koxb5JaHWkY4ALHY2grBGRjaDMzQLcgJvLJuZZvRcEL/1/*)";
+	assert(0 == descriptor_checksum(example, strlen(example), checksum) && 0 == strcmp(checksum, "ml40v0wf"));
+	assert(-1 == descriptor_checksum("wpkh(\xc3\xa9)", 7, checksum));
+
+	// hex keys: no derivation
+	{
+		static const char * p2pkh[1] = { "1BgGZ9tcN4rm9KBzDn7KprQz87SZ26SAMH" };
+		static const char * p2sh_p2wpkh[1] = { "3JvL6Ymt8MVWiCNHC7oWU6nLeHNJKLZGLN" };
+		static const char * p2wpkh[1] = { "bc1qw508d6qejxtdg4y5r3zarvary0c5xw7kv8f3t4" };
+		static const char * bip67_p2sh[2] = { "39bgKC7RFbpoCRbtD5KEdkYKtNyhpsNa3Z", "39bgKC7RFbpoCRbtD5KEdkYKtNyhpsNa3Z" };
+		static const char * bip67_p2wsh[1] = { "bc1qknwt9mhqpd7hrjrvpqz57zjqk28xlp2h90te6v22en0m3uctnams3pq5ce" };
+		static const char * bip67_p2sh_p2wsh[1] = { "3BBLivaThSP3C31jzmQJiMWBM7BLndaWfh" };
+		check_addresses("pkh(" PUBKEY_G ")", 0, 1, p2pkh);
+		check_addresses("sh(wpkh([ffffffff/49'/0'/0']" PUBKEY_G "))", 7, 1, p2sh_p2wpkh);
+		check_addresses("wpkh(" PUBKEY_G ")", 0, 1, p2wpkh);
+		check_addresses("sh(sortedmulti(2," BIP67_KEY_1 "," BIP67_KEY_2 "))", 0, 2, bip67_p2sh);
+		check_addresses("sh(multi(2," BIP67_KEY_2 "," BIP67_KEY_1 "))", 0, 1, bip67_p2sh);	// already in BIP67 order
+		check_addresses("wsh(sortedmulti(2," BIP67_KEY_1 "," BIP67_KEY_2 "))", 0, 1, bip67_p2wsh);
+		check_addresses("sh(wsh(sortedmulti(2," BIP67_KEY_1 "," BIP67_KEY_2 ")))", 0, 1, bip67_p2sh_p2wsh);
+
+		// multi() keeps the given order: another script
+		const char * error = NULL;
+		descriptor_plan_t * plan = descriptor_compile("sh(multi(2," BIP67_KEY_1 "," BIP67_KEY_2 "))", &error);
+		struct descriptor_address addr[1];
+		assert(plan && 1 == descriptor_plan_execute(plan, 0, 1, addr) && 0 != strcmp(addr->addr, bip67_p2sh[0]));
+		assert(!descriptor_plan_is_ranged(plan));
+		assert(0 == strcmp(descriptor_plan_get_address_type(plan), "p2sh"));
+		descriptor_plan_free(plan);
+
+		// an xpub without steps is its own key
+		static const char * xpub_p2sh[1] = { "35s8fMk2MKLdqA1Ls6xepkQfyXeq2A5ZZn" };
+		check_addresses("sh(multi(1," XPUB_M "," PUBKEY_G "))", 0, 1, xpub_p2sh);
+	}
+
+	// rejected
+	{
+		static const char * invalid[] = {
+			"",
+			"pkh(" PUBKEY_G,
+			"pkh(" PUBKEY_G "))",
+			"wpkh(" PUBKEY_G ")#00000000",
+			"wpkh(" PUBKEY_G ")#abc",
+			"tr(" PUBKEY_G ")",
+			"wpkh(04" PUBKEY_G ")",
+			"wpkh(0579be667ef9dcbbac55a06295ce870b07029bfcdb2dce28d959f2815b16f81798)",
+			"wpkh(" PUBKEY_G "/0)",
+			"wpkh(" XPUB_M "/0'/*)",
+			"wpkh(" XPUB_M "/0/*h)",
+			"wpkh(" XPUB_M "/2147483648/*)",
+			"wpkh(" XPUB_M "x/0/*)",
+			"sh(multi(3," BIP67_KEY_1 "," BIP67_KEY_2 "))",
+			"sh(multi(0," BIP67_KEY_1 "))",
+			"wsh(multi(1))",
+			"wsh(wpkh(" PUBKEY_G "))",
+		};
+		for(size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); ++i) {
+			const char * error = NULL;
+			descriptor_plan_t * plan = descriptor_compile(invalid[i], &error);
+			if(plan) fprintf(stderr, "accepted: %s\n", invalid[i]);
+			assert(NULL == plan && error);
+		}
+	}
+
+	const char * ranged = "sh(wsh(multi(2," XPUB_M "/0/*," XPUB_0H "/1/*," PUBKEY_G ")))#ymgyjqa2";
+	if(!privkey_to_addrs_is_supported()) {
+		const char * error = NULL;
+		assert(NULL == descriptor_compile(ranged, &error) && error);
+		printf("(built without libsecp256k1: hex-key descriptors only)\n");
+		printf("==== %s: PASSED ====\n", __FILE__);
+		return 0;
+	}
+
+	{
+		static const char * p2pkh[3] = { "1NwEtFZ6Td7cpKaJtYoeryS6avP2TUkSMh", "18FcseQ86zCaXzLbgDsH86292xb2EuKtFW", "1NZ97rKhSPy6NLud5Dp89E4yH5a2fUGeyC" };
+		static const char * p2wpkh[3] = { "bc1qp5wfcq48h6d63wyy9qz0awtpfqwwv4sma86mhz", "bc1qrfxr69jqnhwufxgkqgcdep9prq4j4vuw2wyg0v", "bc1qhvd6suvqzjcu9pxjhrwhtrlj85ny3n2mqql5w4" };
+		static const char * p2wpkh_1000[1] = { "bc1qz7me5uvtjpp4gww72dx202amv3wc92a3v9hqyy" };
+		static const char * p2sh_p2wpkh[2] = { "3JqdtNpqcQW6HLLk8fXnqagzUUFtery3rK", "3JqdtNpqcQW6HLLk8fXnqagzUUFtery3rK" };
+		static const char * p2wsh[3] = {
+			"bc1qnec2awypwn0kdhxd0l8x75xtt3edx4q3fn2atwk2x84f6fk5pphs72xpq6",
+			"bc1qffqlta2trjdvfhtwnprhvmredawrulzmw74d57nhuhzcdxzlcmaslyruzq",
+			"bc1qzsmznn5m3c5unfz24600qpdzeefv6ttcg8fdxr3lu6hzw84424yqejav3d" };
+		static const char * p2sh_p2wsh[3] = { "3L1zTvaphBwCTQQMk84LXcEPQW6hdprALP", "3HdkKK5MjPS9Srcv41RATroCQt7KqUPpJm", "3HZeXLHuiKzL2pmjLfg1fybaYiFhtRRk2b" };
+		check_addresses("pkh(" XPUB_M "/1/*)", 0, 3, p2pkh);
+		check_addresses("wpkh([d34db33f/84'/0'/0']" XPUB_M "/0/*)#zpuvqnlw", 0, 3, p2wpkh);
+		check_addresses("wpkh(" XPUB_M "/0/*)", 1000, 1, p2wpkh_1000);
+		check_addresses("sh(wpkh(" XPUB_M "/0/5))", 0, 2, p2sh_p2wpkh);
+		check_addresses("wsh(sortedmulti(2," XPUB_M "/0/*," XPUB_0H "/1/*," PUBKEY_G "))", 0, 3, p2wsh);
+		check_addresses(ranged, 0, 3, p2sh_p2wsh);
+	}
+
+	// block boundaries, parallel execution, the end of the unhardened range
+	static const char * descriptors[] = {
+		"wpkh(" XPUB_M "/0/*)",
+		"wsh(sortedmulti(2," XPUB_M "/0/*," XPUB_0H "/1/*," PUBKEY_G "))",
+	};
+	static struct descriptor_address addrs[NUM_INDICES], parallel[NUM_INDICES];
+	for(size_t d = 0; d < sizeof(descriptors) / sizeof(descriptors[0]); ++d) {
+		descriptor_plan_t * plan = descriptor_compile(descriptors[d], NULL);
+		assert(plan && descriptor_plan_is_ranged(plan));
+
+		struct timespec begin, end;
+		clock_gettime(CLOCK_MONOTONIC, &begin);
+		assert(NUM_INDICES == descriptor_plan_execute(plan, 100, NUM_INDICES, addrs));
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		printf("%s: %.2f K addrs/s\n", descriptor_plan_get_address_type(plan), NUM_INDICES / elapsed(&begin, &end) / 1e3);
+
+		assert(NUM_INDICES == descriptor_plan_execute_parallel(NULL, plan, 100, NUM_INDICES, parallel));
+		for(int i = 0; i < NUM_INDICES; ++i) {
+			assert(0 == memcmp(&addrs[i], &parallel[i], offsetof(struct descriptor_address, addr) + addrs[i].cb_addr + 1));
+			if(i % 97 == 0) {
+				struct descriptor_address one[1];
+				assert(1 == descriptor_plan_execute(plan, 100 + i, 1, one));
+				assert(0 == strcmp(one->addr, addrs[i].addr));
+			}
+		}
+
+		assert(2 == descriptor_plan_execute(plan, BIP32_HARDENED - 2, 3, addrs));
+		assert(addrs[0].err_code == 0 && addrs[1].err_code == 0 && addrs[2].err_code != 0 && addrs[2].cb_addr == 0);
+		descriptor_plan_free(plan);
+	}
+
+	printf("==== %s: PASSED ====\n", __FILE__);
+	return 0;
+}
+#endif
@@ -31,22 +31,168 @@
 #include <string.h>
 #include <assert.h>
 #include <getopt.h>
+#include <glob.h>
+#include <signal.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sched.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
 
+#include "utils.h"
+#include "thread_pool.h"
 #include "pubkey_to_addrs.h"
+#include "privkey_to_addrs.h"
+#include "descriptor_to_addrs.h"
+#include "utxo_snapshot.h"
+#include "blocks_to_addrs.h"
+#include "addrs_transcode.h"
+#include "addrs_classify.h"
+#include "addrs_stats.h"
+#include "addrs_output.h"
+#include "addrs_bulk.h"
+#include "addrs_metrics.h"
+#include "addrs_daemon.h"
 
 static void print_usuage(const char * exe_name)
 {
 	fprintf(stderr, "Usuage: %s pubkey_hex [addr_type]  ## addr_type: [ p2pkh, p2sh-p2wpkh, bech32 ]\n", exe_name);
-	fprintf(stderr, "        %s --pubkey=pubkey_hex [--type=addr_type]\n", exe_name);
+	fprintf(stderr, "        %s --pubkey=pubkey_hex [--type=addr_type] [--format=fmt] [--stats] [--scripthash]\n", exe_name);
+	fprintf(stderr, "  bulk: %s --input=pubkeys.txt [--output=addrs.txt] [--threads=N] [--type=addr_type] [--format=fmt] [--stats]\n"
+					"           [--metrics-file=path.prom] [--metrics-socket=path.sock] [--metrics-interval=seconds]\n"
+					"           [--io=auto|io_uring|sync] [--numa[=shards]] [--huge-pages[=hugetlb|thp]] [--input-format=pubkey|wif]\n"
+					"           [--check-pubkeys] [--checkpoint=path [--checkpoint-interval=seconds]] [--resume]\n", exe_name);
+	fprintf(stderr, "  bench: %s --bench[=num_keys] [--threads=N] [--type=addr_type] [--format=fmt] [--io=...]\n", exe_name);
+	fprintf(stderr, "daemon: %s --daemon=path.sock [--threads=N]\n", exe_name);
+	fprintf(stderr, "  descriptor: %s --descriptor='wpkh(xpub.../0/*)' [--range=begin[:end]] [--threads=N]\n", exe_name);
+	fprintf(stderr, "  utxo scan: %s --scan-utxo=snapshot.dat --keys=pubkeys.txt [--threads=N]\n", exe_name);
+	fprintf(stderr, "  blocks: %s --scan-blocks=blocks_dir|blk00000.dat [--threads=N]\n", exe_name);
+	fprintf(stderr, "  transcode: %s --transcode=p2pkh|bech32 [address | --input=addrs.txt] [--output=out.txt] [--threads=N]\n", exe_name);
+	fprintf(stderr, "  classify: %s --classify [address | --input=addrs.txt] [--output=out.txt] [--threads=N]\n", exe_name);
+	fprintf(stderr, "  fmt: [ text, csv, jsonl, binary ]\n");
 	return;
 }
 
-int parse_args(int argc, char ** argv, char ** p_pubkey_hex, char ** p_addr_type)
+struct app_options
+{
+	char * pubkey_hex;
+	char * addr_type;
+	char * format;
+	char * io_backend;
+	char * huge_pages;
+	char * input_format;
+	char * descriptor;
+	char * range;
+	char * utxo_snapshot;
+	char * keys_file;
+	char * blocks_path;
+	char * transcode;	// target address type
+	int classify;
+	int scripthash;	// single key: print the scriptPubKey and Electrum scripthash after each address
+	
+	int bulk_mode;
+	struct addrs_bulk_config bulk;
+	
+	char * daemon_socket;
+	
+	int bench_mode;
+	size_t bench_keys;
+	
+	char * metrics_file;
+	char * metrics_socket;
+	double metrics_interval;
+};
+
+static void print_stats(void)
+{
+	struct addrs_stats_snapshot snapshot[1];
+	addrs_stats_snapshot(snapshot);
+	addrs_stats_dump(snapshot, stderr);
+}
+
+static void output_address(const char * addr_type, const char * addr)
+{
+	ADDRS_STATS_BEGIN(output);
+	int rc = printf("[%s addr]: %s\n", addr_type, addr);
+	ADDRS_STATS_END(output, addrs_stats_stage_output);
+	if(rc < 0) ADDRS_STATS_ERROR(addrs_stats_error_output);
+	return;
+}
+
+static int output_script(const char * pubkey_hex, enum bitcoin_address_type type)
+{
+	unsigned char script[BITCOIN_ADDRS_SCRIPT_MAX_SIZE], scripthash[ELECTRUM_SCRIPTHASH_SIZE];
+	ssize_t cb_script = pubkey_to_script_pubkey(pubkey_hex, type, script, scripthash);
+	if(cb_script <= 0) return -1;
+	
+	char script_hex[BITCOIN_ADDRS_SCRIPT_MAX_SIZE * 2 + 1], scripthash_hex[ELECTRUM_SCRIPTHASH_SIZE * 2 + 1];
+	for(ssize_t i = 0; i < cb_script; ++i) sprintf(&script_hex[i * 2], "%.2x", script[i]);
+	for(int i = 0; i < ELECTRUM_SCRIPTHASH_SIZE; ++i) sprintf(&scripthash_hex[i * 2], "%.2x", scripthash[i]);
+	const char * addr_type = bitcoin_address_type_to_string(type);
+	printf("[%s script]: %s\n", addr_type, script_hex);
+	printf("[%s scripthash]: %s\n", addr_type, scripthash_hex);
+	return 0;
+}
+
+enum long_option_id
+{
+	long_option_metrics_file = 1000,
+	long_option_metrics_socket,
+	long_option_metrics_interval,
+	long_option_io,
+	long_option_daemon,
+	long_option_numa,
+	long_option_bench,
+	long_option_huge_pages,
+	long_option_input_format,
+	long_option_descriptor,
+	long_option_range,
+	long_option_scan_utxo,
+	long_option_keys,
+	long_option_scan_blocks,
+	long_option_scripthash,
+	long_option_transcode,
+	long_option_classify,
+	long_option_check_pubkeys,
+	long_option_checkpoint,
+	long_option_checkpoint_interval,
+	long_option_resume,
+};
+
+int parse_args(int argc, char ** argv, struct app_options * opts)
 {
 	static struct option options[] = {
 		{"pubkey", required_argument, 0, 'p'},
 		{"type", required_argument, 0, 't'},
-		{"help", required_argument, 0, 'h'},
+		{"stats", no_argument, 0, 's'},
+		{"input", required_argument, 0, 'i'},
+		{"output", required_argument, 0, 'o'},
+		{"threads", required_argument, 0, 'j'},
+		{"format", required_argument, 0, 'f'},
+		{"io", required_argument, 0, long_option_io},
+		{"daemon", required_argument, 0, long_option_daemon},
+		{"numa", optional_argument, 0, long_option_numa},
+		{"bench", optional_argument, 0, long_option_bench},
+		{"huge-pages", optional_argument, 0, long_option_huge_pages},
+		{"input-format", required_argument, 0, long_option_input_format},
+		{"descriptor", required_argument, 0, long_option_descriptor},
+		{"range", required_argument, 0, long_option_range},
+		{"scan-utxo", required_argument, 0, long_option_scan_utxo},
+		{"keys", required_argument, 0, long_option_keys},
+		{"scan-blocks", required_argument, 0, long_option_scan_blocks},
+		{"scripthash", no_argument, 0, long_option_scripthash},
+		{"transcode", required_argument, 0, long_option_transcode},
+		{"classify", no_argument, 0, long_option_classify},
+		{"check-pubkeys", no_argument, 0, long_option_check_pubkeys},
+		{"checkpoint", required_argument, 0, long_option_checkpoint},
+		{"checkpoint-interval", required_argument, 0, long_option_checkpoint_interval},
+		{"resume", no_argument, 0, long_option_resume},
+		{"metrics-file", required_argument, 0, long_option_metrics_file},
+		{"metrics-socket", required_argument, 0, long_option_metrics_socket},
+		{"metrics-interval", required_argument, 0, long_option_metrics_interval},
+		{"help", no_argument, 0, 'h'},
+		{NULL, 0, 0, 0},
 	};
 	
 	char * pubkey_hex = NULL;
@@ -54,21 +200,47 @@ int parse_args(int argc, char ** argv, char ** p_pubkey_hex, char ** p_addr_type
 	
 	while(1) {
 		int option_index = 0;
-		int c = getopt_long(argc, argv, "p:t:h", options, &option_index);
+		int c = getopt_long(argc, argv, "p:t:si:o:j:f:h", options, &option_index);
 		if(c == -1) break;
 		
 		switch(c) {
 		case 'p': pubkey_hex = optarg; break;
 		case 't': addr_type = optarg; break;
+		case 's': atexit(print_stats); break;
+		case 'i': opts->bulk_mode = 1; opts->bulk.input_file = optarg; break;
+		case 'o': opts->bulk.output_file = optarg; break;
+		case 'j': opts->bulk.num_threads = atoi(optarg); break;
+		case 'f': opts->format = optarg; break;
+		case long_option_metrics_file: opts->metrics_file = optarg; break;
+		case long_option_metrics_socket: opts->metrics_socket = optarg; break;
+		case long_option_metrics_interval: opts->metrics_interval = atof(optarg); break;
+		case long_option_io: opts->io_backend = optarg; break;
+		case long_option_daemon: opts->daemon_socket = optarg; break;
+		case long_option_numa: opts->bulk.numa_shards = optarg?atoi(optarg):-1; break;
+		case long_option_bench: opts->bench_mode = 1; opts->bench_keys = optarg?strtoul(optarg, NULL, 10):0; break;
+		case long_option_huge_pages: opts->huge_pages = optarg?optarg:"hugetlb"; break;
+		case long_option_input_format: opts->input_format = optarg; break;
+		case long_option_descriptor: opts->descriptor = optarg; break;
+		case long_option_range: opts->range = optarg; break;
+		case long_option_scan_utxo: opts->utxo_snapshot = optarg; break;
+		case long_option_keys: opts->keys_file = optarg; break;
+		case long_option_scan_blocks: opts->blocks_path = optarg; break;
+		case long_option_scripthash: opts->scripthash = 1; break;
+		case long_option_transcode: opts->transcode = optarg; break;
+		case long_option_classify: opts->classify = 1; break;
+		case long_option_check_pubkeys: opts->bulk.check_pubkeys = 1; break;
+		case long_option_checkpoint: opts->bulk.checkpoint_file = optarg; break;
+		case long_option_checkpoint_interval: opts->bulk.checkpoint_interval = atof(optarg); break;
+		case long_option_resume: opts->bulk.resume = 1; break;
 		case 'h': 
 		default:
-			print_usuage(argv[0]); return 0;
+			print_usuage(argv[0]);
 			exit((c != 'h'));
 		}
 	}
 	
 	while(optind < argc) {
-		if(NULL == pubkey_hex) {
+		if(NULL == pubkey_hex && !opts->bulk_mode) {
 			pubkey_hex = argv[optind++];
 			continue;
 		}
@@ -81,25 +253,725 @@ int parse_args(int argc, char ** argv, char ** p_pubkey_hex, char ** p_addr_type
 		printf("[WARNING]: unknown non-option args: %s\n", argv[optind++]);
 	}
 	
-	if(NULL == pubkey_hex) {
+	if(NULL == pubkey_hex && !opts->bulk_mode && !opts->daemon_socket && !opts->bench_mode && !opts->descriptor && !opts->utxo_snapshot && !opts->blocks_path
+		&& !opts->transcode && !opts->classify) {
 		print_usuage(argv[0]);
 		exit(1);
 	}
 	
-	*p_pubkey_hex = pubkey_hex;
-	*p_addr_type = addr_type;
+	opts->pubkey_hex = pubkey_hex;
+	opts->addr_type = addr_type;
 	
 	return 0;
 }
 
+static int parse_format(const char * name, enum addrs_output_format * p_format)
+{
+	*p_format = addrs_output_format_text;
+	if(NULL == name) return 0;
+	
+	enum addrs_output_format format = addrs_output_format_from_string(name);
+	if(format < 0 || format >= addrs_output_formats_count) {
+		fprintf(stderr, "unknown format: '%s'\n", name);
+		return -1;
+	}
+	*p_format = format;
+	return 0;
+}
+
+static int parse_types_mask(const char * addr_type, uint32_t * p_types_mask)
+{
+	*p_types_mask = BITCOIN_ADDRESS_TYPES_ALL;
+	if(NULL == addr_type) return 0;
+	
+	enum bitcoin_address_type type = bitcoin_address_type_from_string(addr_type);
+	if(type < 0 || type >= bitcoin_address_types_count) {
+		fprintf(stderr, "unknown addr_type: '%s'\n", addr_type);
+		return -1;
+	}
+	*p_types_mask = BITCOIN_ADDRESS_TYPE_MASK(type);
+	return 0;
+}
+
+/*
+ * single key through the output format engine
+ */
+static int run_formatted(struct app_options * opts)
+{
+	enum addrs_output_format format = addrs_output_format_text;
+	uint32_t types_mask = 0;
+	if(parse_format(opts->format, &format) || parse_types_mask(opts->addr_type, &types_mask)) return -1;
+	
+	struct bitcoin_addrs_record record[1];
+	memset(record, 0, sizeof(record));
+	
+	const char * pubkey_hex = opts->pubkey_hex;
+	void * pubkey = record->pubkey;
+	if(strlen(pubkey_hex) != (BITCOIN_ADDRS_PUBKEY_SIZE * 2)
+		|| hex2bin(pubkey_hex, BITCOIN_ADDRS_PUBKEY_SIZE * 2, &pubkey) != BITCOIN_ADDRS_PUBKEY_SIZE) 
+	{
+		fprintf(stderr, "invalid pubkey: '%s'\n", pubkey_hex);
+		return -1;
+	}
+	if(pubkeys_to_addrs_batch(record, 1, types_mask | BITCOIN_ADDRS_CHECK_PUBKEYS) != 1) {
+		if(record->err_code == BITCOIN_ADDRS_ERR_PUBKEY) {
+			fprintf(stderr, "invalid pubkey (not a compressed point of secp256k1): '%s'\n", pubkey_hex);
+		}
+		return -1;
+	}
+	
+	char buf[4096];
+	ssize_t cb_header = addrs_output_format_header(format, types_mask, buf, sizeof(buf));
+	assert(cb_header >= 0);
+	assert((cb_header + addrs_output_max_record_size(format, types_mask)) <= sizeof(buf));
+	
+	ADDRS_STATS_BEGIN(output);
+	size_t cb = cb_header + addrs_output_format_record(format, types_mask, record, buf + cb_header);
+	int rc = (fwrite(buf, 1, cb, stdout) == cb)?0:-1;
+	ADDRS_STATS_END(output, addrs_stats_stage_output);
+	if(rc) ADDRS_STATS_ERROR(addrs_stats_error_output);
+	return rc;
+}
+
+static int get_bulk_metrics(void * user_data, struct addrs_bulk_metrics * metrics)
+{
+	return addrs_bulk_get_metrics(user_data, metrics);
+}
+
+static int parse_bulk_options(struct app_options * opts)
+{
+	enum addrs_output_format format = addrs_output_format_text;
+	if(parse_format(opts->format, &format) || parse_types_mask(opts->addr_type, &opts->bulk.types_mask)) return -1;
+	opts->bulk.format = format;
+	if(opts->io_backend) {
+		enum addrs_io_backend backend = addrs_io_backend_from_string(opts->io_backend);
+		if(backend < 0 || backend >= addrs_io_backends_count) {
+			fprintf(stderr, "unknown io backend: '%s'\n", opts->io_backend);
+			return -1;
+		}
+		opts->bulk.io_backend = backend;
+	}
+	if(opts->huge_pages) {
+		enum huge_pages_mode mode = huge_pages_mode_from_string(opts->huge_pages);
+		if(mode < 0 || mode >= huge_pages_modes_count) {
+			fprintf(stderr, "unknown huge pages mode: '%s'\n", opts->huge_pages);
+			return -1;
+		}
+		opts->bulk.huge_pages = mode;
+	}
+	if(opts->input_format) {
+		enum addrs_bulk_input_format input_format = addrs_bulk_input_format_from_string(opts->input_format);
+		if(input_format < 0 || input_format >= addrs_bulk_input_formats_count) {
+			fprintf(stderr, "unknown input format: '%s'\n", opts->input_format);
+			return -1;
+		}
+		if(input_format == addrs_bulk_input_format_wif && !privkey_to_addrs_is_supported()) {
+			fprintf(stderr, "WIF input needs libsecp256k1 (rebuild with libsecp256k1 installed)\n");
+			return -1;
+		}
+		opts->bulk.input_format = input_format;
+	}
+	if(opts->bulk.resume && NULL == opts->bulk.checkpoint_file) {
+		// default checkpoint: next to the output
+		static char checkpoint_file[PATH_MAX];
+		const char * output_file = opts->bulk.output_file;
+		if(NULL == output_file || strcmp(output_file, "-") == 0
+			|| snprintf(checkpoint_file, sizeof(checkpoint_file), "%s.checkpoint", output_file) >= (int)sizeof(checkpoint_file)) {
+			fprintf(stderr, "--resume needs --output=file (or --checkpoint=path)\n");
+			return -1;
+		}
+		opts->bulk.checkpoint_file = checkpoint_file;
+	}
+	return 0;
+}
+
+static int run_bulk(struct app_options * opts)
+{
+	if(parse_bulk_options(opts)) return -1;
+	
+	addrs_bulk_t * bulk = addrs_bulk_new(&opts->bulk);
+	assert(bulk);
+	
+	addrs_metrics_exporter_t * exporter = NULL;
+	if(opts->metrics_file || opts->metrics_socket) {
+		exporter = addrs_metrics_exporter_new(get_bulk_metrics, bulk, 
+			opts->metrics_file, opts->metrics_socket, opts->metrics_interval);
+		assert(exporter);
+		if(addrs_metrics_exporter_start(exporter) != 0) {
+			addrs_metrics_exporter_free(exporter);
+			addrs_bulk_free(bulk);
+			return -1;
+		}
+	}
+	
+	int rc = addrs_bulk_run(bulk);
+	
+	addrs_metrics_exporter_free(exporter);	// stop and publish the final snapshot
+	
+	struct addrs_bulk_metrics metrics[1];
+	addrs_bulk_get_metrics(bulk, metrics);
+	uint64_t num_errors = 0;
+	for(int i = 0; i < addrs_bulk_errors_count; ++i) num_errors += metrics->errors[i];
+	fprintf(stderr, "[bulk]: io=%s, shards=%d, huge_pages=%s, keys=%lu, errors=%lu, elapsed=%.3fs, %.1f keys/s\n",
+		addrs_io_backend_to_string(addrs_bulk_get_io_backend(bulk)), metrics->num_shards,
+		huge_pages_mode_to_string(metrics->huge_pages),
+		(unsigned long)metrics->keys, (unsigned long)num_errors, metrics->uptime,
+		(metrics->uptime > 0)?((double)metrics->keys / metrics->uptime):0.0);
+	
+	addrs_bulk_free(bulk);
+	return rc;
+}
+
+/*
+ * dTLB misses (loads + stores) of the calling thread and of every thread it creates
+ * until stopped; unavailable without perf events (perf_event_paranoid, containers)
+ */
+struct dtlb_counter
+{
+	int fds[2];
+};
+
+static void dtlb_counter_start(struct dtlb_counter * counter)
+{
+	static const uint64_t ops[2] = { PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_OP_WRITE };
+	for(int i = 0; i < 2; ++i) {
+		struct perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = PERF_TYPE_HW_CACHE;
+		attr.config = PERF_COUNT_HW_CACHE_DTLB | (ops[i] << 8) | ((uint64_t)PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+		attr.inherit = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		counter->fds[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+	}
+}
+
+/* @return -1 if no counter could be opened; inherited counts are complete once the threads are joined */
+static int64_t dtlb_counter_stop(struct dtlb_counter * counter)
+{
+	int64_t misses = -1;
+	for(int i = 0; i < 2; ++i) {
+		if(counter->fds[i] < 0) continue;
+		uint64_t value = 0;
+		if(read(counter->fds[i], &value, sizeof(value)) == sizeof(value)) misses = (misses < 0)?(int64_t)value:(misses + (int64_t)value);
+		close(counter->fds[i]);
+		counter->fds[i] = -1;
+	}
+	return misses;
+}
+
+/*
+ * bench: the same generated input through the bulk pipeline, unsharded with regular and
+ * with huge-page buffers, with every worker and buffer on one node, and sharded over all NUMA nodes
+ */
+static int run_bench(struct app_options * opts)
+{
+	if(parse_bulk_options(opts)) return -1;
+	size_t num_keys = opts->bench_keys?opts->bench_keys:1000000;
+	
+	const char * tmp_dir = getenv("TMPDIR");
+	if(NULL == tmp_dir) tmp_dir = "/tmp";
+	char input_file[4096] = "";
+	char output_file[4096] = "";
+	snprintf(input_file, sizeof(input_file), "%s/pubkey_to_addrs.bench.in.XXXXXX", tmp_dir);
+	snprintf(output_file, sizeof(output_file), "%s/pubkey_to_addrs.bench.out.XXXXXX", tmp_dir);
+	int fd_in = mkstemp(input_file);
+	int fd_out = mkstemp(output_file);
+	if(fd_in < 0 || fd_out < 0) {
+		perror("mkstemp");
+		return -1;
+	}
+	close(fd_out);
+	
+	FILE * fp = fdopen(fd_in, "w");
+	assert(fp);
+	uint64_t state = 2021;
+	for(size_t i = 0; i < num_keys; ++i) {
+		unsigned char pubkey[BITCOIN_ADDRS_PUBKEY_SIZE];
+		char hex[BITCOIN_ADDRS_PUBKEY_SIZE * 2 + 1];
+		char * p_hex = hex;
+		for(int j = 0; j < BITCOIN_ADDRS_PUBKEY_SIZE; ++j) {
+			state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+			pubkey[j] = state >> 56;
+		}
+		pubkey[0] = 0x02 | (pubkey[0] & 1);
+		bin2hex(pubkey, BITCOIN_ADDRS_PUBKEY_SIZE, &p_hex);
+		fprintf(fp, "%s\n", hex);
+	}
+	fclose(fp);
+	
+	int cpus[CPU_SETSIZE];
+	int cpu_nodes[CPU_SETSIZE];
+	int num_nodes = 1;
+	int num_cpus = get_cpu_topology(cpus, cpu_nodes, CPU_SETSIZE, &num_nodes);
+	fprintf(stderr, "[bench]: keys=%zu, cpus=%d, numa nodes=%d%s\n", num_keys, num_cpus, num_nodes,
+		(num_nodes > 1)?"":" (single-node host: numa == single-node)");
+	
+	const int huge_pages = opts->huge_pages?opts->bulk.huge_pages:huge_pages_hugetlb;
+	static const struct {
+		const char * name;
+		int numa_shards;
+		int huge_pages;	// < 0: --huge-pages, or hugetlb when not given
+	} runs[] = {
+		{ "unsharded", 0, huge_pages_none },
+		{ "huge-pages", 0, -1 },
+		{ "single-node", 1, -1 },
+		{ "numa", -1, -1 },
+	};
+	int rc = 0;
+	int64_t dtlb_misses[sizeof(runs) / sizeof(runs[0])];
+	for(size_t i = 0; i < sizeof(runs) / sizeof(runs[0]) && 0 == rc; ++i) {
+		struct addrs_bulk_config config = opts->bulk;
+		config.input_file = input_file;
+		config.output_file = output_file;
+		config.numa_shards = runs[i].numa_shards;
+		config.huge_pages = (runs[i].huge_pages < 0)?huge_pages:runs[i].huge_pages;
+		
+		addrs_bulk_t * bulk = addrs_bulk_new(&config);
+		assert(bulk);
+		struct dtlb_counter dtlb;
+		dtlb_counter_start(&dtlb);
+		rc = addrs_bulk_run(bulk);
+		dtlb_misses[i] = dtlb_counter_stop(&dtlb);
+		
+		struct addrs_bulk_metrics metrics[1];
+		addrs_bulk_get_metrics(bulk, metrics);
+		char dtlb_text[100] = "n/a";
+		if(dtlb_misses[i] >= 0) {
+			snprintf(dtlb_text, sizeof(dtlb_text), "%.3f/key", metrics->keys?((double)dtlb_misses[i] / metrics->keys):0.0);
+			if(i > 0 && dtlb_misses[0] > 0) {
+				size_t cb = strlen(dtlb_text);
+				snprintf(dtlb_text + cb, sizeof(dtlb_text) - cb, " (%+.1f%% vs unsharded)",
+					((double)dtlb_misses[i] - dtlb_misses[0]) * 100.0 / dtlb_misses[0]);
+			}
+		}
+		fprintf(stderr, "[bench]: %-12s threads=%d, shards=%d, io=%s, huge_pages=%s: %.3fs, %.1f keys/s, dTLB misses: %s\n",
+			runs[i].name, metrics->num_workers, metrics->num_shards,
+			addrs_io_backend_to_string(addrs_bulk_get_io_backend(bulk)),
+			huge_pages_mode_to_string(metrics->huge_pages),
+			metrics->uptime, (metrics->uptime > 0)?((double)metrics->keys / metrics->uptime):0.0,
+			dtlb_text);
+		if(metrics->keys != num_keys) rc = -1;
+		addrs_bulk_free(bulk);
+	}
+	
+	unlink(input_file);
+	unlink(output_file);
+	return rc;
+}
+
+static addrs_daemon_t * s_daemon;
+static void on_stop_signal(int sig)
+{
+	if(s_daemon) addrs_daemon_stop(s_daemon);
+}
+
+static int run_daemon(struct app_options * opts)
+{
+	struct addrs_daemon_config config = {
+		.socket_path = opts->daemon_socket,
+		.num_threads = opts->bulk.num_threads,
+	};
+	addrs_daemon_t * daemon = addrs_daemon_new(&config);
+	assert(daemon);
+	
+	s_daemon = daemon;
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = on_stop_signal;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	signal(SIGPIPE, SIG_IGN);
+	
+	fprintf(stderr, "[daemon]: listening on %s\n", config.socket_path);
+	int rc = addrs_daemon_run(daemon);
+	
+	struct addrs_daemon_stats stats[1];
+	addrs_daemon_get_stats(daemon, stats);
+	fprintf(stderr, "[daemon]: connections=%lu, requests=%lu, batches=%lu (%.1f requests/batch), errors=%lu\n",
+		(unsigned long)stats->connections, (unsigned long)stats->requests, (unsigned long)stats->batches,
+		stats->batches?((double)stats->requests / stats->batches):0.0,
+		(unsigned long)stats->errors);
+	
+	s_daemon = NULL;
+	addrs_daemon_free(daemon);
+	return rc;
+}
+
+/*
+ * descriptor: one "index address" line per index of the (inclusive) range
+ */
+static int run_descriptor(struct app_options * opts)
+{
+	unsigned long begin = 0, end = 0;
+	if(opts->range) {
+		char * p_end = NULL;
+		begin = end = strtoul(opts->range, &p_end, 10);
+		if(p_end && *p_end == ':') end = strtoul(p_end + 1, &p_end, 10);
+		if(NULL == p_end || *p_end != '\0' || end < begin || end > UINT32_MAX) {
+			fprintf(stderr, "invalid range: '%s'\n", opts->range);
+			return -1;
+		}
+	}
+	
+	const char * error = NULL;
+	descriptor_plan_t * plan = descriptor_compile(opts->descriptor, &error);
+	if(NULL == plan) {
+		fprintf(stderr, "invalid descriptor: %s\n", error);
+		return -1;
+	}
+	
+	thread_pool_t * pool = (opts->bulk.num_threads > 0)?thread_pool_new(opts->bulk.num_threads, 0):NULL;
+	static struct descriptor_address addrs[4096];
+	int rc = 0;
+	for(uint64_t first = begin; first <= end && 0 == rc; first += 4096) {
+		size_t count = ((end - first + 1) < 4096)?(end - first + 1):4096;
+		descriptor_plan_execute_parallel(pool, plan, first, count, addrs);
+		for(size_t i = 0; i < count; ++i) {
+			if(addrs[i].err_code) {
+				fprintf(stderr, "index %u: derivation failed\n", addrs[i].index);
+				continue;
+			}
+			if(printf("%u %s\n", addrs[i].index, addrs[i].addr) < 0) {
+				ADDRS_STATS_ERROR(addrs_stats_error_output);
+				rc = -1;
+				break;
+			}
+		}
+	}
+	
+	if(pool) thread_pool_free(pool);
+	descriptor_plan_free(plan);
+	return rc;
+}
+
+/*
+ * utxo scan: every coin of a dumptxoutset snapshot paying to a key of the list (one hex pubkey per line)
+ * "txid:vout type amount line" per match
+ */
+static void print_utxo_match(const struct utxo_match * match, void * user_data)
+{
+	(void)user_data;
+	char txid[65];
+	for(int i = 0; i < 32; ++i) sprintf(&txid[i * 2], "%.2x", match->txid[31 - i]);
+	printf("%s:%u %s %lu.%.8lu %u\n", txid, match->vout, utxo_match_type_to_string(match->type),
+		(unsigned long)(match->amount / 100000000), (unsigned long)(match->amount % 100000000), match->tag + 1);
+}
+
+static int run_scan_utxo(struct app_options * opts)
+{
+	if(NULL == opts->keys_file) {
+		fprintf(stderr, "--scan-utxo needs --keys=pubkeys.txt\n");
+		return -1;
+	}
+	FILE * fp = fopen(opts->keys_file, "r");
+	if(NULL == fp) {
+		perror(opts->keys_file);
+		return -1;
+	}
+	
+	thread_pool_t * pool = (opts->bulk.num_threads > 0)?thread_pool_new(opts->bulk.num_threads, 0):NULL;
+	utxo_keyset_t * set = utxo_keyset_new(0);
+	static struct bitcoin_addrs_record records[4096];
+	uint32_t tags[4096];
+	size_t count = 0, num_keys = 0;
+	uint32_t line_number = 0;
+	char line[4096];
+	int eof = 0;
+	while(!eof) {
+		eof = (NULL == fgets(line, sizeof(line), fp));
+		if(!eof) {
+			size_t cb = strcspn(line, "\r\n");
+			line[cb] = '\0';
+			++line_number;
+			if(cb == 0) continue;
+			void * pubkey = records[count].pubkey;
+			if(cb != BITCOIN_ADDRS_PUBKEY_SIZE * 2 || hex2bin(line, cb, &pubkey) != BITCOIN_ADDRS_PUBKEY_SIZE
+				|| (records[count].pubkey[0] != 0x02 && records[count].pubkey[0] != 0x03)) {
+				fprintf(stderr, "%s:%u: not a compressed hex pubkey\n", opts->keys_file, line_number);
+				continue;
+			}
+			tags[count++] = line_number - 1;
+		}
+		if(count == 4096 || (eof && count)) {
+			// hash160 only: no address is encoded
+			pubkeys_to_addrs_batch_parallel(pool, records, count, 0);
+			for(size_t i = 0; i < count; ++i) utxo_keyset_add_record(set, &records[i], tags[i]);
+			num_keys += count;
+			count = 0;
+		}
+	}
+	fclose(fp);
+	
+	struct utxo_scan_config config = { .pool = pool };
+	struct utxo_scan_stats stats[1];
+	int rc = utxo_snapshot_scan(opts->utxo_snapshot, set, &config, print_utxo_match, NULL, stats);
+	uint64_t amount = 0;
+	for(int type = 0; type < utxo_match_types_count; ++type) amount += stats->match_amounts[type];
+	fprintf(stderr, "[utxo]: %lu keys, %lu coins, %lu matches, %lu.%.8lu BTC, %.1f MB in %.3f s (%lu chunks, %lu parsed again)\n",
+		(unsigned long)num_keys, (unsigned long)stats->coins, (unsigned long)stats->matches,
+		(unsigned long)(amount / 100000000), (unsigned long)(amount % 100000000), stats->bytes / 1e6, stats->elapsed,
+		(unsigned long)stats->chunks, (unsigned long)stats->reparsed_chunks);
+	
+	utxo_keyset_free(set);
+	if(pool) thread_pool_free(pool);
+	return rc;
+}
+
+/*
+ * blocks: every pubkey / key hash of a node's blk*.dat files (a blocks directory, or one file),
+ * "type address data_hex" per unique item
+ */
+static int run_scan_blocks(struct app_options * opts)
+{
+	struct blocks_extract_config config = { .pool = NULL };
+	glob_t files;
+	memset(&files, 0, sizeof(files));
+	const char * single_path[1] = { opts->blocks_path };
+	const char * const * paths = single_path;
+	size_t num_paths = 1;
+	
+	struct stat st;
+	if(stat(opts->blocks_path, &st) == 0 && S_ISDIR(st.st_mode)) {
+		if(blocks_read_xor_key(opts->blocks_path, config.xor_key) < 0) {
+			fprintf(stderr, "%s/xor.dat: unreadable\n", opts->blocks_path);
+			return -1;
+		}
+		char pattern[4096] = "";
+		snprintf(pattern, sizeof(pattern), "%s/blk[0-9]*.dat", opts->blocks_path);
+		if(glob(pattern, 0, NULL, &files) != 0) {
+			fprintf(stderr, "no block files in %s\n", opts->blocks_path);
+			globfree(&files);
+			return -1;
+		}
+		paths = (const char * const *)files.gl_pathv;	// sorted: blk00000.dat, blk00001.dat, ...
+		num_paths = files.gl_pathc;
+	}
+	
+	thread_pool_t * pool = (opts->bulk.num_threads > 0)?thread_pool_new(opts->bulk.num_threads, 0):NULL;
+	config.pool = pool;
+	struct block_item * items = NULL;
+	struct blocks_extract_stats stats[1];
+	ssize_t count = blocks_extract(paths, num_paths, &config, &items, stats);
+	int rc = (count < 0)?-1:0;
+	for(ssize_t i = 0; i < count; ++i) {
+		const struct block_item * item = &items[i];
+		if(item->err_code) continue;
+		char data_hex[BLOCK_ITEM_MAX_DATA_SIZE * 2 + 1];
+		for(int k = 0; k < item->cb_data; ++k) sprintf(&data_hex[k * 2], "%.2x", item->data[k]);
+		if(printf("%s %s %s\n", block_item_type_to_string(item->type), item->addr, data_hex) < 0) {
+			ADDRS_STATS_ERROR(addrs_stats_error_output);
+			rc = -1;
+			break;
+		}
+	}
+	fprintf(stderr, "[blocks]: %lu files, %lu blocks (%lu malformed), %lu txs, %lu items, %lu unique, %.1f MB in %.3f s\n",
+		(unsigned long)stats->files, (unsigned long)stats->blocks, (unsigned long)stats->malformed_blocks,
+		(unsigned long)stats->transactions, (unsigned long)stats->items, (unsigned long)stats->unique_items,
+		stats->bytes / 1e6, stats->elapsed);
+	
+	free(items);
+	if(pool) thread_pool_free(pool);
+	globfree(&files);
+	return rc;
+}
+
+/*
+ * transcode: the same key hash in another address format (p2pkh <-> bech32), no pubkey needed;
+ * one address per line in, "address transcoded" per line out
+ */
+static int run_transcode(struct app_options * opts)
+{
+	enum bitcoin_address_type to_type = bitcoin_address_type_from_string(opts->transcode);
+	if(to_type != bitcoin_address_type_p2pkh && to_type != bitcoin_address_type_bech32) {
+		fprintf(stderr, "--transcode: target must be p2pkh or bech32, not '%s'\n", opts->transcode);
+		return -1;
+	}
+	
+	// a single address on the command line
+	if(opts->pubkey_hex) {
+		char addr[BITCOIN_ADDRS_MAX_LENGTH] = "";
+		char * p_addr = addr;
+		ssize_t cb = addrs_transcode(opts->pubkey_hex, to_type, &p_addr);
+		if(cb <= 0) {
+			fprintf(stderr, "%s: %s\n", opts->pubkey_hex, addrs_transcode_error_to_string(-cb));
+			return -1;
+		}
+		printf("%s %s\n", opts->pubkey_hex, addr);
+		return 0;
+	}
+	
+	const char * input_file = opts->bulk.input_file;
+	FILE * fp = (input_file && strcmp(input_file, "-") != 0)?fopen(input_file, "r"):stdin;
+	if(NULL == fp) {
+		perror(input_file);
+		return -1;
+	}
+	if(NULL == input_file) input_file = "stdin";
+	FILE * out = stdout;
+	if(opts->bulk.output_file && NULL == (out = fopen(opts->bulk.output_file, "w"))) {
+		perror(opts->bulk.output_file);
+		if(fp != stdin) fclose(fp);
+		return -1;
+	}
+	
+	thread_pool_t * pool = (opts->bulk.num_threads > 0)?thread_pool_new(opts->bulk.num_threads, 0):NULL;
+	static struct addrs_transcode_record records[65536];
+	static uint64_t line_numbers[65536];
+	size_t count = 0;
+	uint64_t line_number = 0, num_addrs = 0, num_errors = 0;
+	char line[4096];
+	int eof = 0, rc = 0;
+	app_timer_start(NULL);
+	while(!eof && 0 == rc) {
+		eof = (NULL == fgets(line, sizeof(line), fp));
+		if(!eof) {
+			size_t cb = strcspn(line, " \t\r\n");
+			line[cb] = '\0';
+			++line_number;
+			if(cb == 0 || line[0] == '#') continue;
+			if(cb >= BITCOIN_ADDRS_MAX_LENGTH) {
+				fprintf(stderr, "%s:%lu: %s\n", input_file, (unsigned long)line_number,
+					addrs_transcode_error_to_string(addrs_transcode_error_invalid));
+				++num_errors;
+				continue;
+			}
+			memcpy(records[count].addr, line, cb + 1);
+			line_numbers[count++] = line_number;
+		}
+		if(count == 65536 || (eof && count)) {
+			addrs_transcode_batch_parallel(pool, records, count, to_type);
+			for(size_t i = 0; i < count; ++i) {
+				const struct addrs_transcode_record * record = &records[i];
+				if(record->err_code) {
+					fprintf(stderr, "%s:%lu: %s: %s\n", input_file, (unsigned long)line_numbers[i], record->addr,
+						addrs_transcode_error_to_string(record->err_code));
+					++num_errors;
+					continue;
+				}
+				if(fprintf(out, "%s %s\n", record->addr, record->transcoded) < 0) {
+					ADDRS_STATS_ERROR(addrs_stats_error_output);
+					rc = -1;
+					break;
+				}
+			}
+			num_addrs += count;
+			count = 0;
+		}
+	}
+	double time_elapsed = app_timer_stop(NULL);
+	fprintf(stderr, "[transcode]: %lu addresses -> %s, %lu errors, %.3f s\n",
+		(unsigned long)num_addrs, bitcoin_address_type_to_string(to_type), (unsigned long)num_errors, time_elapsed);
+	
+	if(pool) thread_pool_free(pool);
+	if(fp != stdin) fclose(fp);
+	if(out != stdout && fclose(out) != 0) rc = -1;
+	return rc;
+}
+
+/*
+ * classify: "address network type program_hex" per valid address, "address invalid reason" otherwise
+ */
+static int output_class(FILE * out, const char * addr, const struct addrs_class * cls)
+{
+	if(cls->err_code) {
+		return fprintf(out, "%s invalid %s\n", addr, addrs_class_error_to_string(cls->err_code));
+	}
+	char program_hex[ADDRS_CLASS_MAX_PROGRAM_SIZE * 2 + 1];
+	for(int i = 0; i < cls->cb_program; ++i) sprintf(&program_hex[i * 2], "%.2x", cls->program[i]);
+	program_hex[cls->cb_program * 2] = '\0';
+	return fprintf(out, "%s %s %s %s\n", addr, addrs_network_to_string(cls->network), addrs_class_type_to_string(cls->type), program_hex);
+}
+
+#define CLASSIFY_BATCH_SIZE	(65536)
+#define CLASSIFY_SLOT_SIZE	(96)	// longer lines are rejected by length anyway
+static int run_classify(struct app_options * opts)
+{
+	if(opts->pubkey_hex) {
+		struct addrs_class cls[1];
+		int err = addrs_classify(opts->pubkey_hex, -1, cls);
+		output_class(stdout, opts->pubkey_hex, cls);
+		return err?-1:0;
+	}
+	
+	const char * input_file = opts->bulk.input_file;
+	FILE * fp = (input_file && strcmp(input_file, "-") != 0)?fopen(input_file, "r"):stdin;
+	if(NULL == fp) {
+		perror(input_file);
+		return -1;
+	}
+	FILE * out = stdout;
+	if(opts->bulk.output_file && NULL == (out = fopen(opts->bulk.output_file, "w"))) {
+		perror(opts->bulk.output_file);
+		if(fp != stdin) fclose(fp);
+		return -1;
+	}
+	
+	thread_pool_t * pool = (opts->bulk.num_threads > 0)?thread_pool_new(opts->bulk.num_threads, 0):NULL;
+	static char lines[CLASSIFY_BATCH_SIZE][CLASSIFY_SLOT_SIZE];
+	static const char * addrs[CLASSIFY_BATCH_SIZE];
+	static size_t lengths[CLASSIFY_BATCH_SIZE];
+	static struct addrs_class classes[CLASSIFY_BATCH_SIZE];
+	size_t count = 0;
+	uint64_t num_addrs = 0, num_valid = 0;
+	char line[4096];
+	int eof = 0, rc = 0;
+	app_timer_start(NULL);
+	while(!eof && 0 == rc) {
+		eof = (NULL == fgets(line, sizeof(line), fp));
+		if(!eof) {
+			size_t cb = strcspn(line, "\r\n");
+			if(cb == 0 || line[0] == '#') continue;
+			if(cb >= CLASSIFY_SLOT_SIZE) cb = CLASSIFY_SLOT_SIZE - 1;
+			memcpy(lines[count], line, cb);
+			lines[count][cb] = '\0';
+			addrs[count] = lines[count];
+			lengths[count++] = cb;
+		}
+		if(count == CLASSIFY_BATCH_SIZE || (eof && count)) {
+			num_valid += addrs_classify_batch_parallel(pool, addrs, lengths, count, classes);
+			for(size_t i = 0; i < count; ++i) {
+				if(output_class(out, addrs[i], &classes[i]) < 0) {
+					ADDRS_STATS_ERROR(addrs_stats_error_output);
+					rc = -1;
+					break;
+				}
+			}
+			num_addrs += count;
+			count = 0;
+		}
+	}
+	double time_elapsed = app_timer_stop(NULL);
+	fprintf(stderr, "[classify]: %lu lines, %lu valid addresses, %.3f s\n",
+		(unsigned long)num_addrs, (unsigned long)num_valid, time_elapsed);
+	
+	if(pool) thread_pool_free(pool);
+	if(fp != stdin) fclose(fp);
+	if(out != stdout && fclose(out) != 0) rc = -1;
+	return rc;
+}
+
 int main(int argc, char **argv)
 {
-	char * pubkey_hex = NULL;
-	char * addr_type = NULL;
+	struct app_options opts[1];
+	memset(opts, 0, sizeof(opts));
 	int rc = 0;
-	rc = parse_args(argc, argv, &pubkey_hex, &addr_type);
+	rc = parse_args(argc, argv, opts);
 	assert(0 == rc);
 	
+	if(opts->bench_mode) return (run_bench(opts) == 0)?0:1;
+	if(opts->descriptor) return (run_descriptor(opts) == 0)?0:1;
+	if(opts->utxo_snapshot) return (run_scan_utxo(opts) == 0)?0:1;
+	if(opts->blocks_path) return (run_scan_blocks(opts) == 0)?0:1;
+	if(opts->transcode) return (run_transcode(opts) == 0)?0:1;
+	if(opts->classify) return (run_classify(opts) == 0)?0:1;
+	if(opts->daemon_socket) return (run_daemon(opts) == 0)?0:1;
+	if(opts->bulk_mode) return (run_bulk(opts) == 0)?0:1;
+	if(opts->format) return (run_formatted(opts) == 0)?0:1;
+	
+	char * pubkey_hex = opts->pubkey_hex;
+	char * addr_type = opts->addr_type;
 	assert(pubkey_hex);
 	
 	const char * addr_type_p2pkh = bitcoin_address_type_to_string(bitcoin_address_type_p2pkh);
@@ -112,18 +984,21 @@ int main(int argc, char **argv)
 	
 	if(NULL == addr_type) {
 		cb_addr = pubkey_to_p2pkh(pubkey_hex, &addr);
-		assert(cb_addr > 0);
-		printf("[%s addr]: %s\n", addr_type_p2pkh, addr);
+		if(cb_addr <= 0) return 1;
+		output_address(addr_type_p2pkh, addr);
+		if(opts->scripthash && output_script(pubkey_hex, bitcoin_address_type_p2pkh)) return 1;
 		
 		memset(addr_buf, 0, sizeof(addr_buf));
 		cb_addr = pubkey_to_p2sh_p2wpkh(pubkey_hex, &addr);
-		assert(cb_addr > 0);
-		printf("[%s addr]: %s\n", addr_type_p2sh_p2pkh, addr);
+		if(cb_addr <= 0) return 1;
+		output_address(addr_type_p2sh_p2pkh, addr);
+		if(opts->scripthash && output_script(pubkey_hex, bitcoin_address_type_p2sh_p2pkh)) return 1;
 		
 		memset(addr_buf, 0, sizeof(addr_buf));
 		cb_addr = pubkey_to_bech32(pubkey_hex, &addr);
-		assert(cb_addr > 0);
-		printf("[%s addr]: %s\n", addr_type_bech32, addr);
+		if(cb_addr <= 0) return 1;
+		output_address(addr_type_bech32, addr);
+		if(opts->scripthash && output_script(pubkey_hex, bitcoin_address_type_bech32)) return 1;
 		return 0;
 	} 
 	
@@ -131,23 +1006,24 @@ int main(int argc, char **argv)
 	switch(type) {
 	case bitcoin_address_type_p2pkh:
 		cb_addr = pubkey_to_p2pkh(pubkey_hex, &addr);
-		assert(cb_addr > 0);
-		printf("[%s addr]: %s\n", addr_type_p2pkh, addr);
+		if(cb_addr <= 0) return 1;
+		output_address(addr_type_p2pkh, addr);
 		break;
 	case bitcoin_address_type_p2sh_p2pkh:
 		cb_addr = pubkey_to_p2sh_p2wpkh(pubkey_hex, &addr);
-		assert(cb_addr > 0);
-		printf("[%s addr]: %s\n", addr_type_p2sh_p2pkh, addr);
+		if(cb_addr <= 0) return 1;
+		output_address(addr_type_p2sh_p2pkh, addr);
 		break;
 	case bitcoin_address_type_bech32:
 		cb_addr = pubkey_to_bech32(pubkey_hex, &addr);
-		assert(cb_addr > 0);
-		printf("[%s addr]: %s\n", addr_type_bech32, addr);
+		if(cb_addr <= 0) return 1;
+		output_address(addr_type_bech32, addr);
 		break;
 	default:
 		fprintf(stderr, "unknown addr_type: '%s'\n", addr_type);
 		return -1;
 	}
+	if(opts->scripthash && output_script(pubkey_hex, type)) return 1;
 
 	return 0;
 }
@@ -0,0 +1,385 @@
+/*
+ * multisig_to_addrs.c
+ * 
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ * 
+ * The MIT License (MIT)
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to deal 
+ * in the Software without restriction, including without limitation the rights 
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all 
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS 
+ * IN THE SOFTWARE.
+ * 
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <endian.h>
+
+#include "sha.h"
+#include "ripemd.h"
+#include "utils.h"
+#include "thread_pool.h"
+
+#include "multisig_to_addrs.h"
+#include "addrs_stats.h"
+
+#define OP_0	(0x00)
+#define OP_1	(0x51)	// OP_m: OP_1 + (m - 1)
+#define OP_CHECKMULTISIG	(0xae)
+#define PUSH_PUBKEY	(BITCOIN_ADDRS_PUBKEY_SIZE)	// push 33 bytes
+
+static const char * s_address_types[multisig_address_types_count] = {
+	[multisig_address_type_p2sh] = "p2sh",
+	[multisig_address_type_p2wsh] = "p2wsh",
+	[multisig_address_type_p2sh_p2wsh] = "p2sh-p2wsh",
+};
+
+enum multisig_address_type multisig_address_type_from_string(const char * type)
+{
+	if(NULL == type) return -1;
+	for(int i = 0; i < multisig_address_types_count; ++i) {
+		if(strcasecmp(type, s_address_types[i]) == 0) return i;
+	}
+	return -1;
+}
+
+const char * multisig_address_type_to_string(enum multisig_address_type type)
+{
+	if(type < 0 || type >= multisig_address_types_count) return NULL;
+	return s_address_types[type];
+}
+
+/******************************************************************************
+ * script
+******************************************************************************/
+static inline uint64_t load_be64(const unsigned char * p)
+{
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+	return be64toh(v);
+}
+
+static inline int pubkey_less(const unsigned char * a, uint64_t key_a, const unsigned char * b, uint64_t key_b)
+{
+	if(key_a != key_b) return key_a < key_b;
+	return memcmp(a + 8, b + 8, BITCOIN_ADDRS_PUBKEY_SIZE - 8) < 0;
+}
+
+ssize_t multisig_script(unsigned int m, unsigned int n, const unsigned char (* pubkeys)[BITCOIN_ADDRS_PUBKEY_SIZE], int flags,
+	unsigned char script[static MULTISIG_SCRIPT_MAX_SIZE])
+{
+	if(m < 1 || m > n || n > MULTISIG_MAX_KEYS) return -1;
+
+	// BIP67: insertion sort on the leading 8 bytes (big-endian), the rest only breaks ties
+	const unsigned char * keys[MULTISIG_MAX_KEYS];
+	uint64_t prefixes[MULTISIG_MAX_KEYS];
+	for(unsigned int i = 0; i < n; ++i) {
+		const unsigned char * key = pubkeys[i];
+		if(key[0] != 0x02 && key[0] != 0x03) return -1;
+		uint64_t prefix = load_be64(key);
+
+		unsigned int j = i;
+		if(!(flags & MULTISIG_KEEP_ORDER)) {
+			for(; j > 0 && pubkey_less(key, prefix, keys[j - 1], prefixes[j - 1]); --j) {
+				keys[j] = keys[j - 1];
+				prefixes[j] = prefixes[j - 1];
+			}
+		}
+		keys[j] = key;
+		prefixes[j] = prefix;
+	}
+
+	unsigned char * p = script;
+	*p++ = OP_1 + (m - 1);
+	for(unsigned int i = 0; i < n; ++i) {
+		*p++ = PUSH_PUBKEY;
+		memcpy(p, keys[i], BITCOIN_ADDRS_PUBKEY_SIZE);
+		p += BITCOIN_ADDRS_PUBKEY_SIZE;
+	}
+	*p++ = OP_1 + (n - 1);
+	*p++ = OP_CHECKMULTISIG;
+	return p - script;
+}
+
+/******************************************************************************
+ * batch
+******************************************************************************/
+static int multisig_to_addrs(struct multisig_record * record, uint32_t types_mask, int flags)
+{
+	unsigned char script[MULTISIG_SCRIPT_MAX_SIZE];
+	ssize_t cb_script = multisig_script(record->m, record->n, record->pubkeys, flags, script);
+	if(cb_script <= 0) {
+		ADDRS_STATS_ERROR(addrs_stats_error_multisig);
+		return -1;
+	}
+
+	ADDRS_STATS_BEGIN(sha256);
+	sha256_hash(script, cb_script, record->script_sha256);
+	ADDRS_STATS_END(sha256, addrs_stats_stage_sha256);
+
+	for(int type = 0; type < multisig_address_types_count; ++type) {
+		if(!(types_mask & MULTISIG_ADDRESS_TYPE_MASK(type))) continue;
+		
+		char * addr = record->addrs[type];
+		unsigned char script_hash[BITCOIN_ADDRS_HASH160_SIZE];
+		ssize_t cb_addr = -1;
+		switch(type) {
+		case multisig_address_type_p2sh:
+			ADDRS_STATS_BEGIN(ripemd160);
+			ripemd160_hash(record->script_sha256, 32, script_hash);
+			ADDRS_STATS_END(ripemd160, addrs_stats_stage_ripemd160);
+			cb_addr = script_hash_to_p2sh(script_hash, &addr);
+			break;
+		case multisig_address_type_p2wsh:
+			cb_addr = witness_program_to_segwit(0, record->script_sha256, 32, &addr);
+			break;
+		case multisig_address_type_p2sh_p2wsh:
+			{
+				// redeem_script: [ OP_0 | 32 | sha256(script) ]
+				unsigned char redeem_script[2 + 32] = { [0] = OP_0, [1] = 32 };
+				memcpy(&redeem_script[2], record->script_sha256, 32);
+				unsigned char hash[32];
+				ADDRS_STATS_BEGIN(hash160);
+				sha256_hash(redeem_script, sizeof(redeem_script), hash);
+				ripemd160_hash(hash, 32, script_hash);
+				ADDRS_STATS_END(hash160, addrs_stats_stage_hash160);
+				cb_addr = script_hash_to_p2sh(script_hash, &addr);
+			}
+			break;
+		}
+		if(cb_addr <= 0 || cb_addr >= BITCOIN_ADDRS_MAX_LENGTH) return -1;
+		record->cb_addrs[type] = cb_addr;
+	}
+	return 0;
+}
+
+ssize_t multisigs_to_addrs_batch(struct multisig_record * records, size_t count, uint32_t types_mask, int flags)
+{
+	assert(records);
+	ssize_t num_ok = 0;
+	for(size_t i = 0; i < count; ++i) {
+		struct multisig_record * record = &records[i];
+		memset(record->cb_addrs, 0, sizeof(record->cb_addrs));
+		record->err_code = multisig_to_addrs(record, types_mask, flags);
+		if(record->err_code) memset(record->cb_addrs, 0, sizeof(record->cb_addrs));
+		else ++num_ok;
+	}
+	return num_ok;
+}
+
+struct parallel_batch
+{
+	struct multisig_record * records;
+	uint32_t types_mask;
+	int flags;
+	ssize_t num_ok;
+};
+
+static void convert_range(size_t begin, size_t end, void * user_data)
+{
+	struct parallel_batch * batch = user_data;
+	ssize_t num_ok = multisigs_to_addrs_batch(batch->records + begin, end - begin, batch->types_mask, batch->flags);
+	__atomic_add_fetch(&batch->num_ok, num_ok, __ATOMIC_RELAXED);
+}
+
+ssize_t multisigs_to_addrs_batch_parallel(struct thread_pool * pool,
+	struct multisig_record * records, size_t count, uint32_t types_mask, int flags)
+{
+	assert(records);
+	if(NULL == pool) pool = thread_pool_default();
+
+	struct parallel_batch batch = { .records = records, .types_mask = types_mask, .flags = flags };
+	thread_pool_parallel_for(pool, 0, count, 0, convert_range, &batch);
+	return batch.num_ok;
+}
+
+
+#if defined(_TEST_MULTISIG_TO_ADDRS) && defined(_STAND_ALONE)
+/*
+ * BIP67 vectors (script and p2sh address), p2wsh / p2sh-p2wsh addresses of the same scripts,
+ * a 15-of-15 (multi-block) script, rejected key sets, and the batch paths on random key sets:
+ * sorted key sets give the same addresses for every permutation of their keys
+ */
+#include <time.h>
+#include "arena.h"
+
+static uint64_t s_state = 67;
+static uint32_t next_random(void)
+{
+	s_state = s_state * 6364136223846793005ULL + 1442695040888963407ULL;
+	return (uint32_t)(s_state >> 32);
+}
+
+static double elapsed(const struct timespec * begin, const struct timespec * end)
+{
+	return (end->tv_sec - begin->tv_sec) + (end->tv_nsec - begin->tv_nsec) / 1e9;
+}
+
+static void load_keys(struct multisig_record * record, unsigned int m, const char * const * pubkeys_hex, unsigned int n)
+{
+	memset(record, 0, sizeof(*record));
+	record->m = m;
+	record->n = n;
+	for(unsigned int i = 0; i < n; ++i) {
+		void * p_key = record->pubkeys[i];
+		assert(BITCOIN_ADDRS_PUBKEY_SIZE == hex2bin(pubkeys_hex[i], 66, &p_key));
+	}
+}
+
+#define NUM_SETS (10000)
+int main(int argc, char ** argv)
+{
+	static const struct {
+		unsigned int m, n;
+		const char * pubkeys[3];
+		const char * script_hex;
+		const char * addrs[multisig_address_types_count];
+	} vectors[] = {
+		{ 2, 2, {
+			"02ff12471208c14bd580709cb2358d98975247d8765f92bc25eab3b2763ed605f8",
+			"02fe6f0a5a297eb38c391581c4413e084773ea23954d93f7753db7dc0adc188b2f" },
+			"522102fe6f0a5a297eb38c391581c4413e084773ea23954d93f7753db7dc0adc188b2f"
+			"2102ff12471208c14bd580709cb2358d98975247d8765f92bc25eab3b2763ed605f852ae",
+			{ "39bgKC7RFbpoCRbtD5KEdkYKtNyhpsNa3Z",
+			  "bc1qknwt9mhqpd7hrjrvpqz57zjqk28xlp2h90te6v22en0m3uctnams3pq5ce",
+			  "3BBLivaThSP3C31jzmQJiMWBM7BLndaWfh" },
+		},
+		{ 2, 3, {
+			"02632b12f4ac5b1d1b72b2a3b508c19172de44f6f46bcee50ba33f3f9291e47ed0",
+			"027735a29bae7780a9755fae7a1c4374c656ac6a69ea9f3697fda61bb99a4f3e77",
+			"02e2cc6bd5f45edd43bebe7cb9b675f0ce9ed3efe613b177588290ad188d11b404" },
+			"522102632b12f4ac5b1d1b72b2a3b508c19172de44f6f46bcee50ba33f3f9291e47ed0"
+			"21027735a29bae7780a9755fae7a1c4374c656ac6a69ea9f3697fda61bb99a4f3e77"
+			"2102e2cc6bd5f45edd43bebe7cb9b675f0ce9ed3efe613b177588290ad188d11b40453ae",
+			{ "3CKHTjBKxCARLzwABMu9yD85kvtm7WnMfH",
+			  "bc1qud6dmdcc27eg8s5hsy6a075gs49w65l6xtc4cplp6m2d4ggh43wqew2vqs",
+			  "31iXMTVFX7qKnPnGVx2ZmJYWuNy3BiCNHS" },
+		},
+	};
+
+	assert(multisig_address_type_p2sh_p2wsh == multisig_address_type_from_string("P2SH-P2WSH"));
+	assert(-1 == (int)multisig_address_type_from_string("p2pkh"));
+
+	for(size_t i = 0; i < sizeof(vectors) / sizeof(vectors[0]); ++i) {
+		struct multisig_record record[1];
+		load_keys(record, vectors[i].m, vectors[i].pubkeys, vectors[i].n);
+
+		unsigned char script[MULTISIG_SCRIPT_MAX_SIZE];
+		ssize_t cb_script = multisig_script(record->m, record->n, record->pubkeys, 0, script);
+		assert(cb_script == strlen(vectors[i].script_hex) / 2);
+		char * script_hex = NULL;
+		bin2hex(script, cb_script, &script_hex);
+		assert(0 == strcmp(script_hex, vectors[i].script_hex));
+		lib_free(script_hex);
+
+		assert(1 == multisigs_to_addrs_batch(record, 1, MULTISIG_ADDRESS_TYPES_ALL, 0));
+		for(int type = 0; type < multisig_address_types_count; ++type) {
+			assert(record->cb_addrs[type] == strlen(vectors[i].addrs[type]));
+			assert(0 == strcmp(record->addrs[type], vectors[i].addrs[type]));
+		}
+
+		// the first vector is given unsorted: its script differs in the given order
+		unsigned char unsorted[MULTISIG_SCRIPT_MAX_SIZE];
+		assert(cb_script == multisig_script(record->m, record->n, record->pubkeys, MULTISIG_KEEP_ORDER, unsorted));
+		assert((0 == memcmp(script, unsorted, cb_script)) == (i != 0));
+	}
+
+	// 11-of-15: the script spans 9 SHA-256 blocks
+	{
+		struct multisig_record record[1] = {{ .m = 11, .n = 15 }};
+		for(int i = 0; i < 15; ++i) {
+			record->pubkeys[i][0] = 0x02 | (i & 1);
+			for(int j = 1; j < BITCOIN_ADDRS_PUBKEY_SIZE; ++j) record->pubkeys[i][j] = i * 37 + j * 11;
+		}
+		unsigned char script[MULTISIG_SCRIPT_MAX_SIZE];
+		assert(MULTISIG_SCRIPT_MAX_SIZE == multisig_script(11, 15, record->pubkeys, 0, script));
+		assert(1 == multisigs_to_addrs_batch(record, 1, MULTISIG_ADDRESS_TYPES_ALL, 0));
+		assert(0 == strcmp(record->addrs[multisig_address_type_p2sh], "3LSvYw1NwMitKWTMKBkHBhQ78SRm8DbxRr"));
+		assert(0 == strcmp(record->addrs[multisig_address_type_p2wsh], "bc1qn3nzlagqzwykugluf3gz96fkl0p6ks7xfp3mug4pvn7s2upyu4aq6w8wca"));
+		assert(0 == strcmp(record->addrs[multisig_address_type_p2sh_p2wsh], "35L6t4vdMcEH5h2G16HcCvHyCZYxx1sAmo"));
+	}
+
+	// invalid key sets
+	{
+		struct multisig_record records[5];
+		for(int i = 0; i < 5; ++i) {
+			load_keys(&records[i], vectors[1].m, vectors[1].pubkeys, vectors[1].n);
+		}
+		records[0].m = 0;
+		records[1].m = 4;
+		records[2].n = MULTISIG_MAX_KEYS + 1;
+		records[3].pubkeys[2][0] = 0x04;
+		assert(1 == multisigs_to_addrs_batch(records, 5, MULTISIG_ADDRESS_TYPES_ALL, 0));
+		for(int i = 0; i < 4; ++i) {
+			assert(records[i].err_code != 0);
+			for(int type = 0; type < multisig_address_types_count; ++type) assert(0 == records[i].cb_addrs[type]);
+		}
+		assert(0 == records[4].err_code);
+	}
+
+	// random 1-of-1 .. 15-of-15 sets: a shuffled copy gives the same addresses, serial == parallel
+	static struct multisig_record records[NUM_SETS], shuffled[NUM_SETS];
+	for(int i = 0; i < NUM_SETS; ++i) {
+		struct multisig_record * record = &records[i];
+		record->n = 1 + next_random() % MULTISIG_MAX_KEYS;
+		record->m = 1 + next_random() % record->n;
+		for(int k = 0; k < record->n; ++k) {
+			for(int j = 0; j < BITCOIN_ADDRS_PUBKEY_SIZE; ++j) record->pubkeys[k][j] = next_random();
+			record->pubkeys[k][0] = 0x02 | (record->pubkeys[k][1] & 1);
+			if(k && (next_random() % 4) == 0) {	// share a long prefix with the previous key
+				memcpy(record->pubkeys[k], record->pubkeys[k - 1], 8 + next_random() % 24);
+			}
+		}
+		shuffled[i] = *record;
+		for(int k = record->n - 1; k > 0; --k) {
+			int j = next_random() % (k + 1);
+			unsigned char tmp[BITCOIN_ADDRS_PUBKEY_SIZE];
+			memcpy(tmp, shuffled[i].pubkeys[k], sizeof(tmp));
+			memcpy(shuffled[i].pubkeys[k], shuffled[i].pubkeys[j], sizeof(tmp));
+			memcpy(shuffled[i].pubkeys[j], tmp, sizeof(tmp));
+		}
+	}
+
+	struct timespec begin, end;
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+	assert(NUM_SETS == multisigs_to_addrs_batch(records, NUM_SETS, MULTISIG_ADDRESS_TYPES_ALL, 0));
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	printf("multisigs_to_addrs_batch: %.2f K sets/s\n", NUM_SETS / elapsed(&begin, &end) / 1e3);
+
+	assert(NUM_SETS == multisigs_to_addrs_batch_parallel(NULL, shuffled, NUM_SETS, MULTISIG_ADDRESS_TYPES_ALL, 0));
+	for(int i = 0; i < NUM_SETS; ++i) {
+		assert(0 == memcmp(records[i].script_sha256, shuffled[i].script_sha256, 32));
+		for(int type = 0; type < multisig_address_types_count; ++type) {
+			assert(0 == strcmp(records[i].addrs[type], shuffled[i].addrs[type]));
+		}
+	}
+
+	// types_mask: p2wsh only
+	memset(shuffled, 0, sizeof(shuffled[0]));
+	shuffled[0] = records[0];
+	memset(shuffled[0].addrs, 0, sizeof(shuffled[0].addrs));
+	assert(1 == multisigs_to_addrs_batch(shuffled, 1, MULTISIG_ADDRESS_TYPE_MASK(multisig_address_type_p2wsh), 0));
+	assert(0 == shuffled[0].cb_addrs[multisig_address_type_p2sh] && 0 == shuffled[0].cb_addrs[multisig_address_type_p2sh_p2wsh]);
+	assert(0 == strcmp(shuffled[0].addrs[multisig_address_type_p2wsh], records[0].addrs[multisig_address_type_p2wsh]));
+
+	printf("==== %s: PASSED ====\n", __FILE__);
+	return 0;
+}
+#endif
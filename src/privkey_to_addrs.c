@@ -0,0 +1,454 @@
+/*
+ * privkey_to_addrs.c
+ * 
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ * 
+ * The MIT License (MIT)
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to deal 
+ * in the Software without restriction, including without limitation the rights 
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all 
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS 
+ * IN THE SOFTWARE.
+ * 
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <endian.h>
+#include <pthread.h>
+
+#ifdef HAVE_LIBSECP256K1
+#include <sys/random.h>
+#include <secp256k1.h>
+#endif
+
+#include "sha.h"
+#include "base58.h"
+#include "utils.h"
+#include "thread_pool.h"
+
+#include "privkey_to_addrs.h"
+#include "addrs_stats.h"
+
+#define PRIVKEY_BATCH_SIZE	(64)	// keys per block: pubkeys are computed, then hashed while still in cache
+
+/******************************************************************************
+ * WIF
+******************************************************************************/
+static inline int b58_digit(unsigned char c)
+{
+	if(c >= '1' && c <= '9') return c - '1';
+	if(c >= 'A' && c <= 'H') return c - 'A' + 9;
+	if(c >= 'J' && c <= 'N') return c - 'J' + 17;
+	if(c >= 'P' && c <= 'Z') return c - 'P' + 22;
+	if(c >= 'a' && c <= 'k') return c - 'a' + 33;
+	if(c >= 'm' && c <= 'z') return c - 'm' + 44;
+	return -1;
+}
+
+int wif_decode(const char * wif, size_t cb_wif, unsigned char privkey[static BITCOIN_ADDRS_PRIVKEY_SIZE], int * p_compressed)
+{
+	// a payload starting with 0x80 fixes the length: 38 bytes (compressed) -> 52 digits, 37 bytes -> 51 digits
+	if(NULL == wif || (cb_wif != 51 && cb_wif != 52)) return -1;
+	const int compressed = (cb_wif == 52);
+
+	// base58 -> 320-bit integer in 32-bit limbs (least significant first); 58^52 < 2^305, no overflow
+	uint32_t limbs[10] = { 0 };
+	for(size_t i = 0; i < cb_wif; ++i) {
+		int digit = b58_digit(wif[i]);
+		if(digit < 0) return -1;
+		uint64_t carry = digit;
+		for(int j = 0; j < 10; ++j) {
+			carry += (uint64_t)limbs[j] * 58;
+			limbs[j] = (uint32_t)carry;
+			carry >>= 32;
+		}
+	}
+
+	unsigned char bytes[40];
+	for(int j = 0; j < 10; ++j) {
+		uint32_t be = htobe32(limbs[9 - j]);
+		memcpy(&bytes[j * 4], &be, 4);
+	}
+
+	// [ 0x80 | privkey | (0x01) | checksum(4) ], right-aligned in bytes[]
+	const size_t cb_payload = compressed?38:37;
+	const unsigned char * payload = bytes + sizeof(bytes) - cb_payload;
+	int err = 0;
+	for(const unsigned char * p = bytes; p < payload; ++p) err |= *p;
+	err |= payload[0] ^ bitcoin_address_prefix_privkey;
+	if(compressed) err |= payload[33] ^ 0x01;
+
+	unsigned char hash[32];
+	sha256_hash(payload, cb_payload - 4, hash);
+	sha256_hash(hash, 32, hash);
+	err |= memcmp(hash, payload + cb_payload - 4, 4);
+
+	if(0 == err) memcpy(privkey, payload + 1, BITCOIN_ADDRS_PRIVKEY_SIZE);
+	explicit_bzero(bytes, sizeof(bytes));
+	explicit_bzero(limbs, sizeof(limbs));
+	if(err) return -1;
+	if(p_compressed) *p_compressed = compressed;
+	return 0;
+}
+
+ssize_t wif_encode(const unsigned char privkey[static BITCOIN_ADDRS_PRIVKEY_SIZE], int compressed, char ** p_wif)
+{
+	unsigned char payload[1 + BITCOIN_ADDRS_PRIVKEY_SIZE + 1 + 4] = { [0] = bitcoin_address_prefix_privkey };
+	size_t cb_payload = 1 + BITCOIN_ADDRS_PRIVKEY_SIZE;
+	memcpy(&payload[1], privkey, BITCOIN_ADDRS_PRIVKEY_SIZE);
+	if(compressed) payload[cb_payload++] = 0x01;
+
+	unsigned char hash[32];
+	sha256_hash(payload, cb_payload, hash);
+	sha256_hash(hash, 32, hash);
+	memcpy(&payload[cb_payload], hash, 4);
+
+	ssize_t cb_wif = base58_encode(payload, cb_payload + 4, p_wif);
+	explicit_bzero(payload, sizeof(payload));
+	return cb_wif;
+}
+
+/******************************************************************************
+ * privkey -> pubkey, point arithmetic
+******************************************************************************/
+#ifdef HAVE_LIBSECP256K1
+static pthread_key_t s_context_key;
+static pthread_once_t s_context_once = PTHREAD_ONCE_INIT;
+
+static void context_destroy(void * ctx)
+{
+	secp256k1_context_destroy(ctx);
+}
+
+static void context_key_init(void)
+{
+	int rc = pthread_key_create(&s_context_key, context_destroy);
+	assert(0 == rc);
+}
+
+/* one signing context per thread, never shared: created (and blinded) on the thread's first key */
+static secp256k1_context * thread_context(void)
+{
+	pthread_once(&s_context_once, context_key_init);
+	secp256k1_context * ctx = pthread_getspecific(s_context_key);
+	if(ctx) return ctx;
+
+	ctx = secp256k1_context_create(SECP256K1_CONTEXT_SIGN);
+	assert(ctx);
+	unsigned char seed[32];
+	if(getrandom(seed, sizeof(seed), 0) == sizeof(seed)) {
+		int ok = secp256k1_context_randomize(ctx, seed);
+		assert(ok);
+	}
+	explicit_bzero(seed, sizeof(seed));
+	pthread_setspecific(s_context_key, ctx);
+	return ctx;
+}
+#endif
+
+int privkey_to_addrs_is_supported(void)
+{
+#ifdef HAVE_LIBSECP256K1
+	return 1;
+#else
+	return 0;
+#endif
+}
+
+int privkey_to_pubkey(const unsigned char privkey[static BITCOIN_ADDRS_PRIVKEY_SIZE], unsigned char pubkey[static BITCOIN_ADDRS_PUBKEY_SIZE])
+{
+#ifdef HAVE_LIBSECP256K1
+	secp256k1_context * ctx = thread_context();
+	secp256k1_pubkey point;
+	if(!secp256k1_ec_pubkey_create(ctx, &point, privkey)) return -1;
+
+	size_t cb_pubkey = BITCOIN_ADDRS_PUBKEY_SIZE;
+	secp256k1_ec_pubkey_serialize(ctx, pubkey, &cb_pubkey, &point, SECP256K1_EC_COMPRESSED);
+	return 0;
+#else
+	(void)privkey; (void)pubkey;
+	return -1;
+#endif
+}
+
+int pubkey_parse(const unsigned char pubkey[static BITCOIN_ADDRS_PUBKEY_SIZE], struct bitcoin_addrs_point * point)
+{
+#ifdef HAVE_LIBSECP256K1
+	_Static_assert(sizeof(secp256k1_pubkey) == sizeof(point->data), "secp256k1_pubkey size");
+	if(pubkey[0] != 0x02 && pubkey[0] != 0x03) return -1;
+	secp256k1_pubkey parsed;
+	if(!secp256k1_ec_pubkey_parse(thread_context(), &parsed, pubkey, BITCOIN_ADDRS_PUBKEY_SIZE)) return -1;
+	memcpy(point->data, &parsed, sizeof(point->data));
+	return 0;
+#else
+	(void)pubkey; (void)point;
+	return -1;
+#endif
+}
+
+int pubkey_tweak_add(const struct bitcoin_addrs_point * parent, const unsigned char tweak[static 32],
+	unsigned char child[static BITCOIN_ADDRS_PUBKEY_SIZE])
+{
+#ifdef HAVE_LIBSECP256K1
+	secp256k1_context * ctx = thread_context();
+	secp256k1_pubkey point;
+	memcpy(&point, parent->data, sizeof(point));
+	if(!secp256k1_ec_pubkey_tweak_add(ctx, &point, tweak)) return -1;
+
+	size_t cb_pubkey = BITCOIN_ADDRS_PUBKEY_SIZE;
+	secp256k1_ec_pubkey_serialize(ctx, child, &cb_pubkey, &point, SECP256K1_EC_COMPRESSED);
+	return 0;
+#else
+	(void)parent; (void)tweak; (void)child;
+	return -1;
+#endif
+}
+
+/******************************************************************************
+ * batch
+******************************************************************************/
+ssize_t privkeys_to_addrs_batch(const char * const * wifs, struct bitcoin_addrs_record * records, size_t count, uint32_t types_mask)
+{
+	assert(wifs && records);
+	ssize_t num_ok = 0;
+	for(size_t first = 0; first < count; first += PRIVKEY_BATCH_SIZE) {
+		size_t num_keys = ((count - first) < PRIVKEY_BATCH_SIZE)?(count - first):PRIVKEY_BATCH_SIZE;
+		struct bitcoin_addrs_record * block = &records[first];
+
+		uint64_t failed = 0;
+		for(size_t i = 0; i < num_keys; ++i) {
+			unsigned char privkey[BITCOIN_ADDRS_PRIVKEY_SIZE];
+			int compressed = 0;
+			const char * wif = wifs[first + i];
+			if(NULL == wif
+				|| wif_decode(wif, strlen(wif), privkey, &compressed) != 0 || !compressed
+				|| privkey_to_pubkey(privkey, block[i].pubkey) != 0)
+			{
+				ADDRS_STATS_ERROR(addrs_stats_error_privkey);
+				memset(block[i].pubkey, 0, sizeof(block[i].pubkey));
+				failed |= (uint64_t)1 << i;
+			}
+			explicit_bzero(privkey, sizeof(privkey));
+		}
+
+		num_ok += pubkeys_to_addrs_batch(block, num_keys, types_mask);
+		for(; failed; failed &= failed - 1) {
+			struct bitcoin_addrs_record * record = &block[__builtin_ctzll(failed)];
+			if(0 == record->err_code) --num_ok;
+			record->err_code = -1;
+			memset(record->cb_addrs, 0, sizeof(record->cb_addrs));
+			memset(record->hash160, 0, sizeof(record->hash160));
+		}
+	}
+	return num_ok;
+}
+
+struct parallel_batch
+{
+	const char * const * wifs;
+	struct bitcoin_addrs_record * records;
+	uint32_t types_mask;
+	ssize_t num_ok;
+};
+
+static void convert_range(size_t begin, size_t end, void * user_data)
+{
+	struct parallel_batch * batch = user_data;
+	ssize_t num_ok = privkeys_to_addrs_batch(batch->wifs + begin, batch->records + begin, end - begin, batch->types_mask);
+	__atomic_add_fetch(&batch->num_ok, num_ok, __ATOMIC_RELAXED);
+}
+
+ssize_t privkeys_to_addrs_batch_parallel(struct thread_pool * pool,
+	const char * const * wifs, struct bitcoin_addrs_record * records, size_t count, uint32_t types_mask)
+{
+	assert(wifs && records);
+	if(NULL == pool) pool = thread_pool_default();
+
+	struct parallel_batch batch = { .wifs = wifs, .records = records, .types_mask = types_mask };
+	thread_pool_parallel_for(pool, 0, count, 0, convert_range, &batch);
+	return batch.num_ok;
+}
+
+
+#if defined(_TEST_PRIVKEY_TO_ADDRS) && defined(_STAND_ALONE)
+/*
+ * WIF vectors, round trips and corruptions; with libsecp256k1: known addresses of privkey 1 (pubkey = G),
+ * rejected secret keys, and the batch paths against privkey_to_pubkey() + pubkeys_to_addrs_batch()
+ */
+#include <time.h>
+#include "arena.h"
+
+static uint64_t s_state = 2021;
+static uint32_t next_random(void)
+{
+	s_state = s_state * 6364136223846793005ULL + 1442695040888963407ULL;
+	return (uint32_t)(s_state >> 32);
+}
+
+static void random_privkey(unsigned char privkey[static 32])
+{
+	for(int i = 0; i < 32; ++i) privkey[i] = next_random();
+	privkey[0] &= 0x7f;	// below n
+	privkey[31] |= 1;	// not zero
+}
+
+static double elapsed(const struct timespec * begin, const struct timespec * end)
+{
+	return (end->tv_sec - begin->tv_sec) + (end->tv_nsec - begin->tv_nsec) / 1e9;
+}
+
+#define NUM_KEYS (10000)
+int main(int argc, char **argv)
+{
+	static const struct {
+		const char * privkey_hex;
+		int compressed;
+		const char * wif;
+	} vectors[] = {
+		{ "0c28fca386c7a227600b2fe50b7cae11ec86d3bf1fbe471be89827e19d72aa1d", 0, "5HueCGU8rMjxEXxiPuD5BDku4MkFqeZyd4dZ1jvhTVqvbTLvyTJ" },
+		{ "0c28fca386c7a227600b2fe50b7cae11ec86d3bf1fbe471be89827e19d72aa1d", 1, "KwdMAjGmerYanjeui5SHS7JkmpZvVipYvB2LJGU1ZxJwYvP98617" },
+		{ "0000000000000000000000000000000000000000000000000000000000000001", 1, "KwDiBf89QgGbjEhKnhXJuH7LrciVrZi3qYjgd9M7rFU73sVHnoWn" },
+	};
+
+	for(size_t i = 0; i < sizeof(vectors) / sizeof(vectors[0]); ++i) {
+		unsigned char privkey[32], decoded[32];
+		void * p_privkey = privkey;
+		assert(32 == hex2bin(vectors[i].privkey_hex, 64, &p_privkey));
+
+		char wif[BITCOIN_ADDRS_WIF_MAX_LENGTH + 1] = "";
+		char * p_wif = wif;
+		ssize_t cb_wif = wif_encode(privkey, vectors[i].compressed, &p_wif);
+		assert(cb_wif == strlen(vectors[i].wif) && 0 == strcmp(wif, vectors[i].wif));
+
+		int compressed = -1;
+		assert(0 == wif_decode(wif, cb_wif, decoded, &compressed));
+		assert(compressed == vectors[i].compressed && 0 == memcmp(decoded, privkey, 32));
+	}
+
+	// round trips, then every single-digit substitution is rejected
+	for(int i = 0; i < 1000; ++i) {
+		unsigned char privkey[32], decoded[32];
+		random_privkey(privkey);
+		int compressed = i & 1, flag = -1;
+		char wif[BITCOIN_ADDRS_WIF_MAX_LENGTH + 1] = "";
+		char * p_wif = wif;
+		ssize_t cb_wif = wif_encode(privkey, compressed, &p_wif);
+		assert(cb_wif == (compressed?52:51));
+		assert(0 == wif_decode(wif, cb_wif, decoded, &flag) && flag == compressed && 0 == memcmp(decoded, privkey, 32));
+
+		int pos = next_random() % cb_wif;
+		char saved = wif[pos];
+		wif[pos] = (saved == 'z')?'2':'z';
+		assert(-1 == wif_decode(wif, cb_wif, decoded, NULL));
+		wif[pos] = '0';	// not a base58 digit
+		assert(-1 == wif_decode(wif, cb_wif, decoded, NULL));
+		wif[pos] = saved;
+		assert(-1 == wif_decode(wif, cb_wif - 1, decoded, NULL));
+	}
+
+	// testnet version byte (0xef) with a valid checksum
+	{
+		unsigned char payload[38] = { 0xef, [32] = 1, [33] = 0x01 }, hash[32];
+		sha256_hash(payload, 34, hash);
+		sha256_hash(hash, 32, hash);
+		memcpy(&payload[34], hash, 4);
+		char * wif = NULL;
+		ssize_t cb_wif = base58_encode(payload, sizeof(payload), &wif);
+		unsigned char decoded[32];
+		assert(cb_wif == 52 && -1 == wif_decode(wif, cb_wif, decoded, NULL));
+		lib_free(wif);
+	}
+
+	static char wif_strings[NUM_KEYS][BITCOIN_ADDRS_WIF_MAX_LENGTH + 1];
+	static const char * wifs[NUM_KEYS];
+	static struct bitcoin_addrs_record records[NUM_KEYS], expected[NUM_KEYS];
+	for(int i = 0; i < NUM_KEYS; ++i) {
+		unsigned char privkey[32];
+		random_privkey(privkey);
+		char * p_wif = wif_strings[i];
+		wif_encode(privkey, 1, &p_wif);
+		wifs[i] = wif_strings[i];
+		if(privkey_to_pubkey(privkey, expected[i].pubkey) != 0) assert(!privkey_to_addrs_is_supported());
+	}
+	strcpy(wif_strings[7], "5HueCGU8rMjxEXxiPuD5BDku4MkFqeZyd4dZ1jvhTVqvbTLvyTJ");	// uncompressed: rejected
+	wifs[11] = NULL;
+
+	if(!privkey_to_addrs_is_supported()) {
+		assert(0 == privkeys_to_addrs_batch(wifs, records, NUM_KEYS, BITCOIN_ADDRESS_TYPES_ALL));
+		for(int i = 0; i < NUM_KEYS; ++i) assert(records[i].err_code != 0);
+		printf("(built without libsecp256k1: WIF codec only)\n");
+		printf("==== %s: PASSED ====\n", __FILE__);
+		return 0;
+	}
+
+	// privkey 1: pubkey G
+	{
+		static const char * expected_addrs[bitcoin_address_types_count] = {
+			[bitcoin_address_type_p2pkh] = "1BgGZ9tcN4rm9KBzDn7KprQz87SZ26SAMH",
+			[bitcoin_address_type_p2sh_p2pkh] = "3JvL6Ymt8MVWiCNHC7oWU6nLeHNJKLZGLN",
+			[bitcoin_address_type_bech32] = "bc1qw508d6qejxtdg4y5r3zarvary0c5xw7kv8f3t4",
+		};
+		const char * one[1] = { vectors[2].wif };
+		struct bitcoin_addrs_record record[1];
+		assert(1 == privkeys_to_addrs_batch(one, record, 1, BITCOIN_ADDRESS_TYPES_ALL));
+		for(int type = 0; type < bitcoin_address_types_count; ++type) {
+			assert(0 == strcmp(record->addrs[type], expected_addrs[type]));
+		}
+
+		// 0 and n are not secret keys
+		unsigned char zero[32] = { 0 }, pubkey[33];
+		unsigned char n[32] = {
+			0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xfe,
+			0xba, 0xae, 0xdc, 0xe6, 0xaf, 0x48, 0xa0, 0x3b, 0xbf, 0xd2, 0x5e, 0x8c, 0xd0, 0x36, 0x41, 0x41,
+		};
+		assert(-1 == privkey_to_pubkey(zero, pubkey));
+		assert(-1 == privkey_to_pubkey(n, pubkey));
+	}
+
+	// batch / parallel against privkey_to_pubkey() + pubkeys_to_addrs_batch()
+	assert(NUM_KEYS == pubkeys_to_addrs_batch(expected, NUM_KEYS, BITCOIN_ADDRESS_TYPES_ALL));
+	for(int pass = 0; pass < 2; ++pass) {
+		memset(records, 0, sizeof(records));
+		struct timespec begin, end;
+		clock_gettime(CLOCK_MONOTONIC, &begin);
+		ssize_t num_ok = pass?privkeys_to_addrs_batch_parallel(NULL, wifs, records, NUM_KEYS, BITCOIN_ADDRESS_TYPES_ALL)
+			:privkeys_to_addrs_batch(wifs, records, NUM_KEYS, BITCOIN_ADDRESS_TYPES_ALL);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		printf("%s: %.2f K keys/s\n", pass?"privkeys_to_addrs_batch_parallel":"privkeys_to_addrs_batch",
+			NUM_KEYS / elapsed(&begin, &end) / 1e3);
+
+		assert(num_ok == NUM_KEYS - 2);
+		for(int i = 0; i < NUM_KEYS; ++i) {
+			if(i == 7 || i == 11) {
+				assert(records[i].err_code != 0);
+				continue;
+			}
+			assert(0 == records[i].err_code);
+			assert(0 == memcmp(records[i].pubkey, expected[i].pubkey, 33));
+			for(int type = 0; type < bitcoin_address_types_count; ++type) {
+				assert(0 == strcmp(records[i].addrs[type], expected[i].addrs[type]));
+			}
+		}
+	}
+
+	printf("==== %s: PASSED ====\n", __FILE__);
+	return 0;
+}
+#endif
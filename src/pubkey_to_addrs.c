@@ -30,14 +30,21 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <endian.h>
 
 #include "sha.h"
 #include "ripemd.h"
+#include "hash_lanes.h"
+#include "hash_fused.h"
+#include "secp256k1_point.h"
 #include "base58.h"
 #include "utils.h"
 #include "bech32.h"
+#include "thread_pool.h"
+#include "arena.h"
 
 #include "pubkey_to_addrs.h"
+#include "addrs_stats.h"
 
 #define COMPRESSED_PUBKEY_SIZE	(33)
 #define BITCOIN_ADDR_MAX_SIZE	(100)
@@ -76,18 +83,16 @@ enum hash_method hash_method_from_string(const char * method)
 	return hash_method_unknown;
 }
 
-enum bitcoin_address_prefix
-{
-	bitcoin_address_prefix_p2pkh = 0,
-	bitcoin_address_prefix_p2sh = 5,
-	bitcoin_address_prefix_privkey = 80,
-};
-
 void hash160(const void * data, size_t size, unsigned char hash[static RIPEMD_HASH_SIZE])
 {
 	unsigned char tmp_hash[SHA256_HASH_SIZE];
+	ADDRS_STATS_BEGIN(sha256);
 	sha256_hash(data, size, tmp_hash);
+	ADDRS_STATS_END(sha256, addrs_stats_stage_sha256);
+	
+	ADDRS_STATS_BEGIN(ripemd160);
 	ripemd160_hash(tmp_hash, SHA256_HASH_SIZE, hash);
+	ADDRS_STATS_END(ripemd160, addrs_stats_stage_ripemd160);
 	return;
 }
 void hash256(const void * data, size_t size, unsigned char hash[static SHA256_HASH_SIZE])
@@ -113,92 +118,157 @@ const char * bitcoin_address_type_to_string(enum bitcoin_address_type type)
 	return s_address_types[type];
 }
 
-static ssize_t generate_p2pkh_address(const unsigned char pubkey[static COMPRESSED_PUBKEY_SIZE], char **p_addr)
+/**
+ * [ prefix | hash160 | hash256_checksum(4bytes) ], base58 encoded
+ * checksum: NULL computes it; the batch path passes the checksums of its multi-lane kernel
+**/
+static ssize_t encode_base58check_address(unsigned char prefix, const unsigned char hash[static RIPEMD_HASH_SIZE],
+	const unsigned char * checksum, char ** p_addr)
 {
 	char * addr = *p_addr;
 	if(NULL == addr) {
-		addr = calloc(BITCOIN_ADDR_MAX_SIZE, 1);
+		addr = lib_calloc(BITCOIN_ADDR_MAX_SIZE, 1);
 		assert(addr);
 		*p_addr = addr;
 	}
 	
-	// step 1. generate ext pubkey data: 
-	// [ prefix | hash160(pubkey) | hash256_checksum(4bytes) ]
+	// step 1. generate ext pubkey data
 	unsigned char ext_pubkey[1 + RIPEMD_HASH_SIZE + 4] = { 
-		[0] = bitcoin_address_prefix_p2pkh,
+		[0] = prefix,
 	};
-	unsigned char checksum[SHA256_HASH_SIZE];
-	hash160(pubkey, COMPRESSED_PUBKEY_SIZE, &ext_pubkey[1]);
-	hash256(ext_pubkey, 1 + RIPEMD_HASH_SIZE, checksum);
-	memcpy(&ext_pubkey[1+ RIPEMD_HASH_SIZE], checksum, 4);
+	memcpy(&ext_pubkey[1], hash, RIPEMD_HASH_SIZE);
+	if(checksum) {
+		memcpy(&ext_pubkey[1 + RIPEMD_HASH_SIZE], checksum, 4);
+	}else {
+		ADDRS_STATS_BEGIN(checksum);
+		hash256_checksum_21(ext_pubkey, &ext_pubkey[1 + RIPEMD_HASH_SIZE]);
+		ADDRS_STATS_END(checksum, addrs_stats_stage_checksum);
+	}
 	
 	// step2. base58 encode
-	return base58_encode(ext_pubkey, 1 + RIPEMD_HASH_SIZE + 4, p_addr);
+	ADDRS_STATS_BEGIN(base58);
+	ssize_t cb_addr = base58_encode_25(ext_pubkey, addr);	// fixed-width: no allocation, no byte-wise carries
+	ADDRS_STATS_END(base58, addrs_stats_stage_base58_encode);
+	if(cb_addr <= 0) ADDRS_STATS_ERROR(addrs_stats_error_encode);
+	return cb_addr;
 }
 
-static ssize_t generate_p2sh_p2wpkh_address(const unsigned char pubkey[static COMPRESSED_PUBKEY_SIZE], char ** p_addr) 
+ssize_t hash160_to_p2pkh(const unsigned char hash[static RIPEMD_HASH_SIZE], char ** p_addr)
 {
+	return encode_base58check_address(bitcoin_address_prefix_p2pkh, hash, NULL, p_addr);
+}
+
+ssize_t script_hash_to_p2sh(const unsigned char script_hash[static RIPEMD_HASH_SIZE], char ** p_addr)
+{
+	return encode_base58check_address(bitcoin_address_prefix_p2sh, script_hash, NULL, p_addr);
+}
+
+ssize_t witness_program_to_segwit(uint8_t version, const unsigned char * program, size_t cb_program, char ** p_addr)
+{
+	if(version > 16 || cb_program < 2 || cb_program > 40) return -1;
 	char * addr = *p_addr;
 	if(NULL == addr) {
-		addr = calloc(COMPRESSED_PUBKEY_SIZE, 1);
+		addr = lib_calloc(BITCOIN_ADDR_MAX_SIZE, 1);
 		assert(addr);
 		*p_addr = addr;
 	}
 	
-	// step 1. generate redeem_script (witness program): 
+	ADDRS_STATS_BEGIN(bech32);
+	ssize_t cb_addr = bech32_encode(version, "bc", program, cb_program, addr);
+	ADDRS_STATS_END(bech32, addrs_stats_stage_bech32_encode);
+	if(cb_addr <= 0) ADDRS_STATS_ERROR(addrs_stats_error_encode);
+	return cb_addr;
+}
+
+static ssize_t encode_p2pkh_address(const unsigned char hash[static RIPEMD_HASH_SIZE], char **p_addr)
+{
+	return hash160_to_p2pkh(hash, p_addr);
+}
+
+static ssize_t encode_p2sh_address(const unsigned char script_hash[static RIPEMD_HASH_SIZE], char ** p_addr)
+{
+	// script_hash: hash160(redeem_script)
+	return script_hash_to_p2sh(script_hash, p_addr);
+}
+
+static ssize_t encode_p2sh_p2wpkh_address(const unsigned char hash[static RIPEMD_HASH_SIZE], char ** p_addr) 
+{
+	// redeem_script (witness program): 
 	// [ 0 | <hash_length> | hash160(pubkey) ]
 	unsigned char redeem_script[1 + 1 + RIPEMD_HASH_SIZE] = {
 		[0] = 0, // p2sh flag
 		[1] = 20, // hash length
 	};
-	hash160(pubkey, COMPRESSED_PUBKEY_SIZE, &redeem_script[2]);
-	
-	// step 2. generate ext pubkey data: 
-	// [ prefix | hash160(redeem_script) | hash256_checksum(4bytes) ]
-	unsigned char ext_pubkey[1 + RIPEMD_HASH_SIZE + 4] = { 
-		[0] = bitcoin_address_prefix_p2sh,
-	};
-	unsigned char checksum[SHA256_HASH_SIZE];
-	hash160(redeem_script, 2 + RIPEMD_HASH_SIZE, &ext_pubkey[1]);
-	hash256(ext_pubkey, 1 + RIPEMD_HASH_SIZE, checksum);
-	memcpy(&ext_pubkey[1+ RIPEMD_HASH_SIZE], checksum, 4);
+	memcpy(&redeem_script[2], hash, RIPEMD_HASH_SIZE);
 	
-	// step3. base58 encode
-	return base58_encode(ext_pubkey, 1 + RIPEMD_HASH_SIZE + 4, p_addr);
+	unsigned char script_hash[RIPEMD_HASH_SIZE];
+	hash160(redeem_script, 2 + RIPEMD_HASH_SIZE, script_hash);
+	return encode_p2sh_address(script_hash, p_addr);
 }
 
-static ssize_t generate_bech32_address(const unsigned char pubkey[static COMPRESSED_PUBKEY_SIZE], char ** p_addr) 
+static ssize_t encode_bech32_address(const unsigned char hash[static RIPEMD_HASH_SIZE], char ** p_addr) 
+{
+	return witness_program_to_segwit(0, hash, RIPEMD_HASH_SIZE, p_addr);
+}
+
+static ssize_t generate_p2pkh_address(const unsigned char pubkey[static COMPRESSED_PUBKEY_SIZE], char **p_addr)
 {
-	char * addr = *p_addr;
-	if(NULL == addr) {
-		addr = calloc(100, 1);
-		assert(addr);
-		*p_addr = addr;
-	}
-	
 	unsigned char hash[RIPEMD_HASH_SIZE] = { 0 };
-	hash160(pubkey, COMPRESSED_PUBKEY_SIZE, hash);
-	
-	return bech32_encode(0, "bc", hash, RIPEMD_HASH_SIZE, addr);
+	ADDRS_STATS_BEGIN(hash160);
+	hash160_33(pubkey, hash);
+	ADDRS_STATS_END(hash160, addrs_stats_stage_hash160);
+	return encode_p2pkh_address(hash, p_addr);
+}
+
+static ssize_t generate_p2sh_p2wpkh_address(const unsigned char pubkey[static COMPRESSED_PUBKEY_SIZE], char ** p_addr) 
+{
+	unsigned char hash[RIPEMD_HASH_SIZE] = { 0 };
+	ADDRS_STATS_BEGIN(hash160);
+	hash160_33(pubkey, hash);
+	ADDRS_STATS_END(hash160, addrs_stats_stage_hash160);
+	return encode_p2sh_p2wpkh_address(hash, p_addr);
 }
 
+static ssize_t generate_bech32_address(const unsigned char pubkey[static COMPRESSED_PUBKEY_SIZE], char ** p_addr) 
+{
+	unsigned char hash[RIPEMD_HASH_SIZE] = { 0 };
+	ADDRS_STATS_BEGIN(hash160);
+	hash160_33(pubkey, hash);
+	ADDRS_STATS_END(hash160, addrs_stats_stage_hash160);
+	return encode_bech32_address(hash, p_addr);
+}
 
+typedef ssize_t (* encode_address_func)(const unsigned char hash[static RIPEMD_HASH_SIZE], char ** p_addr);
+static const encode_address_func s_encoders[bitcoin_address_types_count] = {
+	[bitcoin_address_type_p2pkh] = encode_p2pkh_address,
+	[bitcoin_address_type_p2sh_p2pkh] = encode_p2sh_p2wpkh_address,
+	[bitcoin_address_type_bech32] = encode_bech32_address,
+};
 
 static inline int parse_pubkey(const char * pubkey_hex, unsigned char pubkey[static COMPRESSED_PUBKEY_SIZE])
 {
 	assert(pubkey_hex);
 	int cb_pubkey_hex = strlen(pubkey_hex);
 	if(cb_pubkey_hex != (COMPRESSED_PUBKEY_SIZE * 2)) {
+		ADDRS_STATS_ERROR(addrs_stats_error_pubkey_length);
 		fprintf(stderr, "invalid pubkey length: cb=%d, pubkey='%s'.\n", cb_pubkey_hex, pubkey_hex);
 		return -1;
 	}
 	
 	void * data = pubkey;
+	ADDRS_STATS_BEGIN(hex_parse);
 	ssize_t cb = hex2bin(pubkey_hex, cb_pubkey_hex, &data);
+	ADDRS_STATS_END(hex_parse, addrs_stats_stage_hex_parse);
 	if(cb != 33) {
+		ADDRS_STATS_ERROR(addrs_stats_error_pubkey_hex);
 		fprintf(stderr, "invalid pubkey_hex format: pubkey='%s'.\n", pubkey_hex);
 		return -1;
 	}
+	if(0 != secp256k1_pubkey_check(pubkey)) {
+		ADDRS_STATS_ERROR(addrs_stats_error_pubkey_point);
+		fprintf(stderr, "invalid pubkey (not a compressed point of secp256k1): pubkey='%s'.\n", pubkey_hex);
+		return -1;
+	}
 	return 0;
 }
 
@@ -207,7 +277,7 @@ ssize_t pubkey_to_p2pkh(const char * pubkey_hex, char ** p_addr)
 	unsigned char pubkey[COMPRESSED_PUBKEY_SIZE] = { 0 };
 	if(0 != parse_pubkey(pubkey_hex, pubkey)) return -1;
 	
-	return generate_p2sh_p2wpkh_address(pubkey, p_addr);
+	return generate_p2pkh_address(pubkey, p_addr);
 }
 
 ssize_t pubkey_to_p2sh_p2wpkh(const char * pubkey_hex, char ** p_addr)
@@ -215,7 +285,7 @@ ssize_t pubkey_to_p2sh_p2wpkh(const char * pubkey_hex, char ** p_addr)
 	unsigned char pubkey[COMPRESSED_PUBKEY_SIZE] = { 0 };
 	if(0 != parse_pubkey(pubkey_hex, pubkey)) return -1;
 	
-	return generate_p2pkh_address(pubkey, p_addr);
+	return generate_p2sh_p2wpkh_address(pubkey, p_addr);
 }
 ssize_t pubkey_to_bech32(const char * pubkey_hex, char ** p_addr)
 {
@@ -224,3 +294,923 @@ ssize_t pubkey_to_bech32(const char * pubkey_hex, char ** p_addr)
 	
 	return generate_bech32_address(pubkey, p_addr);
 }
+
+/*
+ * batch hashing, structure-of-arrays:
+ *   HASH_LANES keys at a time; message blocks and hash states are word-interleaved (block[word][lane])
+ *   and stay that way from SHA-256 through RIPEMD-160, and for p2sh-p2wpkh through the second hash160
+ *   of the redeem script. Digests are transposed back to bytes only for the encoders.
+ */
+struct lanes_batch
+{
+	hash_lanes_t block[16];
+	hash_lanes_t hash160[5];	// RIPEMD-160 state words of hash160(pubkey)
+	hash_lanes_t script_hash[5];	// hash160(p2wpkh redeem script)
+	hash_lanes_t p2pkh_checksum;	// big-endian words: first 4 bytes of hash256(0x00 | hash160)
+	hash_lanes_t p2sh_checksum;	// hash256(0x05 | script_hash)
+};
+
+#define lanes_bswap32(x) (((x) << 24) | (((x) & 0xff00) << 8) | (((x) >> 8) & 0xff00) | ((x) >> 24))
+
+/* record fields sit at any offset (hash160 at 33, odd script strides): byte copies, one load / store once compiled */
+static inline uint32_t load_be32(const unsigned char * p) { uint32_t x; memcpy(&x, p, 4); return be32toh(x); }
+static inline uint32_t load_le32(const unsigned char * p) { uint32_t x; memcpy(&x, p, 4); return le32toh(x); }
+static inline void store_le32(unsigned char * p, uint32_t x) { x = htole32(x); memcpy(p, &x, 4); }
+
+/* single padded SHA-256 block of each 33-byte pubkey, big-endian words */
+static void lanes_load_pubkeys(struct lanes_batch * batch, const struct bitcoin_addrs_record * records, size_t count)
+{
+	memset(batch->block, 0, sizeof(batch->block));
+	for(size_t lane = 0; lane < count; ++lane) {
+		const unsigned char * pubkey = records[lane].pubkey;
+		for(int i = 0; i < 8; ++i) batch->block[i][lane] = load_be32(&pubkey[i * 4]);
+		batch->block[8][lane] = ((uint32_t)pubkey[32] << 24) | 0x800000;
+	}
+	batch->block[15] += COMPRESSED_PUBKEY_SIZE * 8;
+}
+
+/* [ 0 | 20 | hash160 ] redeem scripts, built from the interleaved RIPEMD-160 words */
+static void lanes_load_p2wpkh_scripts(struct lanes_batch * batch)
+{
+	hash_lanes_t hb[5];	// big-endian words of the hash160 bytes
+	for(int i = 0; i < 5; ++i) hb[i] = lanes_bswap32(batch->hash160[i]);
+
+	memset(batch->block, 0, sizeof(batch->block));
+	batch->block[0] = (hb[0] >> 16) | 0x00140000;
+	for(int i = 1; i < 5; ++i) batch->block[i] = (hb[i - 1] << 16) | (hb[i] >> 16);
+	batch->block[5] = (hb[4] << 16) | 0x8000;
+	batch->block[15] += (2 + RIPEMD_HASH_SIZE) * 8;
+}
+
+/* [ prefix | hash ] Base58Check payloads (21 bytes) */
+static void lanes_load_checksum_payloads(struct lanes_batch * batch, unsigned char prefix, const hash_lanes_t hash[static 5])
+{
+	hash_lanes_t hb[5];
+	for(int i = 0; i < 5; ++i) hb[i] = lanes_bswap32(hash[i]);
+
+	memset(batch->block, 0, sizeof(batch->block));
+	batch->block[0] = (hb[0] >> 8) | ((uint32_t)prefix << 24);
+	for(int i = 1; i < 5; ++i) batch->block[i] = (hb[i - 1] << 24) | (hb[i] >> 8);
+	batch->block[5] = (hb[4] << 24) | 0x800000;
+	batch->block[15] += (1 + RIPEMD_HASH_SIZE) * 8;
+}
+
+static void lanes_checksum(struct lanes_batch * batch, unsigned char prefix, const hash_lanes_t hash[static 5], hash_lanes_t * checksum)
+{
+	ADDRS_STATS_BEGIN(checksum);
+	lanes_load_checksum_payloads(batch, prefix, hash);
+	hash256_checksum_lanes(checksum, batch->block);
+	ADDRS_STATS_END(checksum, addrs_stats_stage_checksum);
+}
+
+static void lanes_hash160(struct lanes_batch * batch, hash_lanes_t hash[static 5])
+{
+	ADDRS_STATS_BEGIN(hash160);
+	hash160_lanes(hash, batch->block);
+	ADDRS_STATS_END(hash160, addrs_stats_stage_hash160);
+}
+
+static inline void lanes_store_hash160(const hash_lanes_t hash[static 5], size_t lane, unsigned char out[static RIPEMD_HASH_SIZE])
+{
+	for(int i = 0; i < 5; ++i) store_le32(&out[i * 4], hash[i][lane]);
+}
+
+/* multi-lane checksums unless the scalar kernel runs on SHA extensions (faster per payload there) */
+static int s_lanes_checksums = -1;
+static inline int use_lanes_checksums(void)
+{
+	int lanes = __atomic_load_n(&s_lanes_checksums, __ATOMIC_RELAXED);
+	if(lanes < 0) {
+		lanes = !sha256_has_sha_ni();
+		__atomic_store_n(&s_lanes_checksums, lanes, __ATOMIC_RELAXED);
+	}
+	return lanes;
+}
+
+/* valid: NULL, or the curve-point bitmap of records[0 .. count) */
+static ssize_t convert_batch(struct bitcoin_addrs_record * records, size_t count, uint32_t types_mask, const uint64_t * valid)
+{
+	const int need_script_hash = (types_mask & BITCOIN_ADDRESS_TYPE_MASK(bitcoin_address_type_p2sh_p2pkh)) != 0;
+	const int need_p2pkh = (types_mask & BITCOIN_ADDRESS_TYPE_MASK(bitcoin_address_type_p2pkh)) != 0;
+	const int lanes_checksums = use_lanes_checksums();
+	ssize_t num_ok = 0;
+	struct lanes_batch batch[1];
+	for(size_t first = 0; first < count; first += HASH_LANES) {
+		size_t num_lanes = ((count - first) < HASH_LANES)?(count - first):HASH_LANES;
+		
+		// hash once, encode every requested type from the same hash160
+		lanes_load_pubkeys(batch, &records[first], num_lanes);
+		lanes_hash160(batch, batch->hash160);
+		if(need_script_hash) {
+			lanes_load_p2wpkh_scripts(batch);
+			lanes_hash160(batch, batch->script_hash);
+			if(lanes_checksums) lanes_checksum(batch, bitcoin_address_prefix_p2sh, batch->script_hash, &batch->p2sh_checksum);
+		}
+		if(need_p2pkh && lanes_checksums) lanes_checksum(batch, bitcoin_address_prefix_p2pkh, batch->hash160, &batch->p2pkh_checksum);
+		
+		for(size_t lane = 0; lane < num_lanes; ++lane) {
+			struct bitcoin_addrs_record * record = &records[first + lane];
+			record->err_code = 0;
+			memset(record->cb_addrs, 0, sizeof(record->cb_addrs));
+			if(valid && !secp256k1_bitmap_test(valid, first + lane)) {
+				ADDRS_STATS_ERROR(addrs_stats_error_pubkey_point);
+				record->err_code = BITCOIN_ADDRS_ERR_PUBKEY;
+				memset(record->hash160, 0, sizeof(record->hash160));
+				continue;
+			}
+			lanes_store_hash160(batch->hash160, lane, record->hash160);
+			
+			unsigned char script_hash[RIPEMD_HASH_SIZE];
+			if(need_script_hash) lanes_store_hash160(batch->script_hash, lane, script_hash);
+			
+			for(int type = 0; type < bitcoin_address_types_count; ++type) {
+				if(!(types_mask & BITCOIN_ADDRESS_TYPE_MASK(type))) continue;
+				
+				char * addr = record->addrs[type];
+				ssize_t cb_addr;
+				uint32_t checksum = 0;
+				switch(type) {
+				case bitcoin_address_type_p2pkh:
+					if(lanes_checksums) checksum = htobe32(batch->p2pkh_checksum[lane]);
+					cb_addr = encode_base58check_address(bitcoin_address_prefix_p2pkh, record->hash160,
+						lanes_checksums?(unsigned char *)&checksum:NULL, &addr);
+					break;
+				case bitcoin_address_type_p2sh_p2pkh:
+					if(lanes_checksums) checksum = htobe32(batch->p2sh_checksum[lane]);
+					cb_addr = encode_base58check_address(bitcoin_address_prefix_p2sh, script_hash,
+						lanes_checksums?(unsigned char *)&checksum:NULL, &addr);
+					break;
+				default:
+					cb_addr = s_encoders[type](record->hash160, &addr);
+					break;
+				}
+				if(cb_addr <= 0 || cb_addr >= BITCOIN_ADDRS_MAX_LENGTH) {
+					record->err_code = BITCOIN_ADDRS_ERR_ENCODE;
+					continue;
+				}
+				record->cb_addrs[type] = cb_addr;
+			}
+			if(0 == record->err_code) ++num_ok;
+		}
+	}
+	return num_ok;
+}
+
+#define CHECK_WINDOW	(512)	// records per curve-point bitmap
+ssize_t pubkeys_to_addrs_batch(struct bitcoin_addrs_record * records, size_t count, uint32_t types_mask)
+{
+	assert(records);
+	if(!(types_mask & BITCOIN_ADDRS_CHECK_PUBKEYS)) return convert_batch(records, count, types_mask, NULL);
+	
+	types_mask &= ~BITCOIN_ADDRS_CHECK_PUBKEYS;
+	ssize_t num_ok = 0;
+	uint64_t valid[CHECK_WINDOW / 64];
+	for(size_t first = 0; first < count; first += CHECK_WINDOW) {
+		size_t num_records = ((count - first) < CHECK_WINDOW)?(count - first):CHECK_WINDOW;
+		ADDRS_STATS_BEGIN(pubkey_check);
+		size_t num_valid = secp256k1_pubkeys_check_batch(records[first].pubkey, sizeof(*records), num_records, valid);
+		ADDRS_STATS_END(pubkey_check, addrs_stats_stage_pubkey_check);
+		(void)num_valid;
+		num_ok += convert_batch(&records[first], num_records, types_mask, valid);
+	}
+	return num_ok;
+}
+#undef CHECK_WINDOW
+
+struct parallel_batch
+{
+	struct bitcoin_addrs_record * records;
+	uint32_t types_mask;
+	ssize_t num_ok;
+};
+
+static void convert_range(size_t begin, size_t end, void * user_data)
+{
+	struct parallel_batch * batch = user_data;
+	ssize_t num_ok = pubkeys_to_addrs_batch(batch->records + begin, end - begin, batch->types_mask);
+	__atomic_add_fetch(&batch->num_ok, num_ok, __ATOMIC_RELAXED);
+}
+
+ssize_t pubkeys_to_addrs_batch_parallel(struct thread_pool * pool, struct bitcoin_addrs_record * records, size_t count, uint32_t types_mask)
+{
+	assert(records);
+	if(NULL == pool) pool = thread_pool_default();
+	
+	struct parallel_batch batch = { .records = records, .types_mask = types_mask };
+	thread_pool_parallel_for(pool, 0, count, 0, convert_range, &batch);
+	return batch.num_ok;
+}
+
+/*
+ * scriptPubKeys / Electrum scripthashes
+ */
+#define OP_0	(0x00)
+#define OP_DUP	(0x76)
+#define OP_HASH160	(0xa9)
+#define OP_EQUAL	(0x87)
+#define OP_EQUALVERIFY	(0x88)
+#define OP_CHECKSIG	(0xac)
+
+static size_t build_script_pubkey(enum bitcoin_address_type type, const unsigned char hash[static RIPEMD_HASH_SIZE],
+	const unsigned char script_hash[static RIPEMD_HASH_SIZE], unsigned char script[static BITCOIN_ADDRS_SCRIPT_MAX_SIZE])
+{
+	switch(type) {
+	case bitcoin_address_type_p2pkh:
+		script[0] = OP_DUP;
+		script[1] = OP_HASH160;
+		script[2] = RIPEMD_HASH_SIZE;
+		memcpy(&script[3], hash, RIPEMD_HASH_SIZE);
+		script[23] = OP_EQUALVERIFY;
+		script[24] = OP_CHECKSIG;
+		return 25;
+	case bitcoin_address_type_p2sh_p2pkh:
+		script[0] = OP_HASH160;
+		script[1] = RIPEMD_HASH_SIZE;
+		memcpy(&script[2], script_hash, RIPEMD_HASH_SIZE);
+		script[22] = OP_EQUAL;
+		return 23;
+	case bitcoin_address_type_bech32:
+		script[0] = OP_0;
+		script[1] = RIPEMD_HASH_SIZE;
+		memcpy(&script[2], hash, RIPEMD_HASH_SIZE);
+		return 22;
+	default:
+		break;
+	}
+	return 0;
+}
+
+ssize_t hash160_to_script_pubkey(enum bitcoin_address_type type, const unsigned char hash[static RIPEMD_HASH_SIZE],
+	unsigned char script[static BITCOIN_ADDRS_SCRIPT_MAX_SIZE])
+{
+	if(type < 0 || type >= bitcoin_address_types_count) return -1;
+	unsigned char script_hash[RIPEMD_HASH_SIZE];
+	if(type == bitcoin_address_type_p2sh_p2pkh) {
+		unsigned char redeem_script[2 + RIPEMD_HASH_SIZE] = { OP_0, RIPEMD_HASH_SIZE };
+		memcpy(&redeem_script[2], hash, RIPEMD_HASH_SIZE);
+		hash160(redeem_script, sizeof(redeem_script), script_hash);
+	}
+	return build_script_pubkey(type, hash, script_hash, script);
+}
+
+void electrum_scripthash(const unsigned char * script, size_t cb_script, unsigned char scripthash[static ELECTRUM_SCRIPTHASH_SIZE])
+{
+	unsigned char digest[SHA256_HASH_SIZE];
+	ADDRS_STATS_BEGIN(sha256);
+	sha256_hash(script, cb_script, digest);
+	ADDRS_STATS_END(sha256, addrs_stats_stage_sha256);
+	for(int i = 0; i < SHA256_HASH_SIZE; ++i) scripthash[i] = digest[SHA256_HASH_SIZE - 1 - i];
+}
+
+ssize_t pubkey_to_script_pubkey(const char * pubkey_hex, enum bitcoin_address_type type,
+	unsigned char script[static BITCOIN_ADDRS_SCRIPT_MAX_SIZE], unsigned char * scripthash)
+{
+	unsigned char pubkey[COMPRESSED_PUBKEY_SIZE] = { 0 };
+	if(0 != parse_pubkey(pubkey_hex, pubkey)) return -1;
+	
+	unsigned char hash[RIPEMD_HASH_SIZE];
+	ADDRS_STATS_BEGIN(hash160);
+	hash160_33(pubkey, hash);
+	ADDRS_STATS_END(hash160, addrs_stats_stage_hash160);
+	ssize_t cb_script = hash160_to_script_pubkey(type, hash, script);
+	if(cb_script > 0 && scripthash) electrum_scripthash(script, cb_script, scripthash);
+	return cb_script;
+}
+
+/* single padded SHA-256 block per lane: messages of the same length (<= 55 bytes), stride bytes apart */
+static void lanes_load_messages(struct lanes_batch * batch, const unsigned char * messages, size_t stride, size_t length, size_t count)
+{
+	memset(batch->block, 0, sizeof(batch->block));
+	for(size_t lane = 0; lane < count; ++lane) {
+		unsigned char block[64] = { 0 };
+		memcpy(block, messages + lane * stride, length);
+		block[length] = 0x80;
+		for(int i = 0; i < 14; ++i) batch->block[i][lane] = load_be32(&block[i * 4]);
+	}
+	batch->block[15] += (uint32_t)(length * 8);
+}
+
+/* digest words are big-endian: reversing the digest bytes stores each word little-endian, last word first;
+ * lanes not set in lanes_mask are left untouched */
+static void lanes_store_scripthashes(const hash_lanes_t state[static 8], unsigned char * scripthashes, size_t stride, size_t count,
+	uint32_t lanes_mask)
+{
+	for(size_t lane = 0; lane < count; ++lane) {
+		if(!(lanes_mask & (1u << lane))) continue;
+		unsigned char * scripthash = scripthashes + lane * stride;
+		for(int i = 0; i < 8; ++i) store_le32(&scripthash[28 - i * 4], state[i][lane]);
+	}
+}
+
+ssize_t pubkeys_to_scripts_batch(const struct bitcoin_addrs_record * records, size_t count, uint32_t types_mask,
+	struct bitcoin_addrs_scripts * scripts)
+{
+	assert(records && scripts);
+	const int need_script_hash = (types_mask & BITCOIN_ADDRESS_TYPE_MASK(bitcoin_address_type_p2sh_p2pkh)) != 0;
+	const int lanes_sha256 = use_lanes_checksums();
+	ssize_t num_ok = 0;
+	struct lanes_batch batch[1];
+	for(size_t first = 0; first < count; first += HASH_LANES) {
+		size_t num_lanes = ((count - first) < HASH_LANES)?(count - first):HASH_LANES;
+		
+		// p2sh-p2wpkh: hash160 of the redeem script, from the stored hash160 words;
+		// failed records may have no hash160, their lanes (and the unused ones) hash zeros
+		if(need_script_hash) {
+			memset(batch->hash160, 0, sizeof(batch->hash160));
+			for(size_t lane = 0; lane < num_lanes; ++lane) {
+				if(records[first + lane].err_code) continue;
+				for(int i = 0; i < 5; ++i) batch->hash160[i][lane] = load_le32(&records[first + lane].hash160[i * 4]);
+			}
+			lanes_load_p2wpkh_scripts(batch);
+			lanes_hash160(batch, batch->script_hash);
+		}
+		
+		uint32_t ok_lanes = 0;
+		for(size_t lane = 0; lane < num_lanes; ++lane) {
+			const struct bitcoin_addrs_record * record = &records[first + lane];
+			struct bitcoin_addrs_scripts * out = &scripts[first + lane];
+			memset(out->cb_scripts, 0, sizeof(out->cb_scripts));
+			if(record->err_code) {
+				// the lanes pass below loads every lane of the group: no caller bytes left undefined
+				memset(out->scripts, 0, sizeof(out->scripts));
+				memset(out->scripthashes, 0, sizeof(out->scripthashes));
+				continue;
+			}
+			
+			unsigned char script_hash[RIPEMD_HASH_SIZE];
+			if(need_script_hash) lanes_store_hash160(batch->script_hash, lane, script_hash);
+			for(int type = 0; type < bitcoin_address_types_count; ++type) {
+				if(!(types_mask & BITCOIN_ADDRESS_TYPE_MASK(type))) continue;
+				out->cb_scripts[type] = build_script_pubkey(type, record->hash160, script_hash, out->scripts[type]);
+				if(!lanes_sha256) electrum_scripthash(out->scripts[type], out->cb_scripts[type], out->scripthashes[type]);
+			}
+			ok_lanes |= 1u << lane;
+			++num_ok;
+		}
+		if(!lanes_sha256) continue;
+		
+		// a script type has one length: its scripts are hashed across the lanes
+		for(int type = 0; type < bitcoin_address_types_count; ++type) {
+			if(!(types_mask & BITCOIN_ADDRESS_TYPE_MASK(type))) continue;
+			hash_lanes_t state[8];
+			size_t length = (type == bitcoin_address_type_p2pkh)?25:(type == bitcoin_address_type_p2sh_p2pkh)?23:22;
+			ADDRS_STATS_BEGIN(sha256);
+			lanes_load_messages(batch, scripts[first].scripts[type], sizeof(*scripts), length, num_lanes);
+			sha256_lanes_init(state);
+			sha256_lanes_transform(state, batch->block);
+			ADDRS_STATS_END(sha256, addrs_stats_stage_sha256);
+			lanes_store_scripthashes(state, scripts[first].scripthashes[type], sizeof(*scripts), num_lanes, ok_lanes);
+		}
+	}
+	return num_ok;
+}
+
+struct parallel_scripts
+{
+	const struct bitcoin_addrs_record * records;
+	uint32_t types_mask;
+	struct bitcoin_addrs_scripts * scripts;
+	ssize_t num_ok;
+};
+
+static void scripts_range(size_t begin, size_t end, void * user_data)
+{
+	struct parallel_scripts * batch = user_data;
+	ssize_t num_ok = pubkeys_to_scripts_batch(batch->records + begin, end - begin, batch->types_mask, batch->scripts + begin);
+	__atomic_add_fetch(&batch->num_ok, num_ok, __ATOMIC_RELAXED);
+}
+
+ssize_t pubkeys_to_scripts_batch_parallel(struct thread_pool * pool, const struct bitcoin_addrs_record * records, size_t count,
+	uint32_t types_mask, struct bitcoin_addrs_scripts * scripts)
+{
+	assert(records && scripts);
+	if(NULL == pool) pool = thread_pool_default();
+	
+	struct parallel_scripts batch = { .records = records, .types_mask = types_mask, .scripts = scripts };
+	thread_pool_parallel_for(pool, 0, count, 0, scripts_range, &batch);
+	return batch.num_ok;
+}
+
+
+#if defined(_TEST_PUBKEY_TO_ADDRS) && defined(_STAND_ALONE)
+/*
+ * differential test:
+ *   every production path is compared bit-exactly against a slow, independent reference path:
+ *     hash160: gnutls sha256 (without HAVE_GNUTLS: the incremental sha256_init/update/final) + generic ripemd160 init/update/final
+ *     base58check: schoolbook long division of the big-endian payload
+ *     bech32: BIP173 reference polymod / convertbits
+ *
+ *   usage: test_pubkey_to_addrs [rounds] [seed]
+ */
+#include <time.h>
+#ifdef HAVE_GNUTLS
+#include <gnutls/crypto.h>
+static void ref_sha256(const void * data, size_t size, unsigned char hash[static 32])
+{
+	gnutls_hash_fast(GNUTLS_DIG_SHA256, data, size, hash);
+}
+#else
+static void ref_sha256(const void * data, size_t size, unsigned char hash[static 32])
+{
+	sha256_ctx_t ctx[1];
+	sha256_init(ctx);
+	sha256_update(ctx, data, size);
+	sha256_final(ctx, hash);
+}
+#endif
+
+static const char * s_ref_b58_digits = "123456789ABCDEFGHJKLMNPQRSTUVWXYZabcdefghijkmnopqrstuvwxyz";
+static const char * s_ref_bech32_digits = "qpzry9x8gf2tvdw0s3jn54khce6mua7l";
+
+static void ref_hash160(const void * data, size_t size, unsigned char hash[static 20])
+{
+	unsigned char sha[32];
+	ref_sha256(data, size, sha);
+	ripemd160_ctx_t ctx[1];
+	ripemd160_init(ctx);
+	ripemd160_update(ctx, sha, 32);
+	ripemd160_final(ctx, hash);
+}
+
+static void ref_base58check(uint8_t prefix, const unsigned char hash[static 20], char * addr)
+{
+	unsigned char payload[25] = { prefix };
+	unsigned char sha[32];
+	memcpy(&payload[1], hash, 20);
+	ref_sha256(payload, 21, sha);
+	ref_sha256(sha, 32, sha);
+	memcpy(&payload[21], sha, 4);
+	
+	char digits[64];
+	int num_digits = 0;
+	int start = 0;
+	while(start < 25 && payload[start] == 0) ++start;
+	for(int i = start; i < 25; ) {
+		// payload /= 58, collect the remainder
+		int remainder = 0;
+		for(int j = i; j < 25; ++j) {
+			int value = remainder * 256 + payload[j];
+			payload[j] = value / 58;
+			remainder = value % 58;
+		}
+		digits[num_digits++] = s_ref_b58_digits[remainder];
+		while(i < 25 && payload[i] == 0) ++i;
+	}
+	char * p = addr;
+	for(int i = 0; i < start; ++i) *p++ = '1';
+	while(num_digits > 0) *p++ = digits[--num_digits];
+	*p = '\0';
+}
+
+static uint32_t ref_bech32_polymod(const uint8_t * values, size_t count)
+{
+	static const uint32_t generator[5] = { 0x3b6a57b2, 0x26508e6d, 0x1ea119fa, 0x3d4233dd, 0x2a1462b3 };
+	uint32_t chk = 1;
+	for(size_t i = 0; i < count; ++i) {
+		uint32_t top = chk >> 25;
+		chk = ((chk & 0x1ffffff) << 5) ^ values[i];
+		for(int j = 0; j < 5; ++j) if((top >> j) & 1) chk ^= generator[j];
+	}
+	return chk;
+}
+
+static void ref_bech32_p2wpkh(const unsigned char hash[static 20], char * addr)
+{
+	// hrp_expand("bc") + [ version ] + convertbits(hash, 8, 5) + 6 zeros
+	uint8_t values[5 + 1 + 32 + 6] = { 'b' >> 5, 'c' >> 5, 0, 'b' & 31, 'c' & 31, 0 };
+	size_t count = 6;
+	uint32_t acc = 0;
+	int bits = 0;
+	for(int i = 0; i < 20; ++i) {
+		acc = (acc << 8) | hash[i];
+		bits += 8;
+		while(bits >= 5) {
+			bits -= 5;
+			values[count++] = (acc >> bits) & 31;
+		}
+	}
+	assert(bits == 0);
+	size_t cb_data = count;
+	memset(&values[count], 0, 6);
+	count += 6;
+	uint32_t checksum = ref_bech32_polymod(values, count) ^ 1;
+	
+	char * p = addr;
+	*p++ = 'b'; *p++ = 'c'; *p++ = '1';
+	for(size_t i = 5; i < cb_data; ++i) *p++ = s_ref_bech32_digits[values[i]];
+	for(int i = 0; i < 6; ++i) *p++ = s_ref_bech32_digits[(checksum >> (5 * (5 - i))) & 31];
+	*p = '\0';
+}
+
+static void ref_pubkey_to_addrs(const unsigned char pubkey[static 33], char addrs[static bitcoin_address_types_count][BITCOIN_ADDRS_MAX_LENGTH])
+{
+	unsigned char hash[20];
+	ref_hash160(pubkey, 33, hash);
+	ref_base58check(bitcoin_address_prefix_p2pkh, hash, addrs[bitcoin_address_type_p2pkh]);
+	
+	unsigned char redeem_script[22] = { 0x00, 0x14 };
+	memcpy(&redeem_script[2], hash, 20);
+	unsigned char script_hash[20];
+	ref_hash160(redeem_script, sizeof(redeem_script), script_hash);
+	ref_base58check(bitcoin_address_prefix_p2sh, script_hash, addrs[bitcoin_address_type_p2sh_p2pkh]);
+	
+	ref_bech32_p2wpkh(hash, addrs[bitcoin_address_type_bech32]);
+}
+
+/*
+ * paths under test: each converts 'count' keys and fills addrs[count][types]
+ */
+typedef void (* convert_path_func)(const unsigned char (*pubkeys)[33], size_t count, char (*addrs)[bitcoin_address_types_count][BITCOIN_ADDRS_MAX_LENGTH]);
+
+static void path_single_hex(const unsigned char (*pubkeys)[33], size_t count, char (*addrs)[bitcoin_address_types_count][BITCOIN_ADDRS_MAX_LENGTH])
+{
+	for(size_t i = 0; i < count; ++i) {
+		char pubkey_hex[67] = "";
+		char * p_hex = pubkey_hex;
+		bin2hex(pubkeys[i], 33, &p_hex);
+		
+		char * addr = addrs[i][bitcoin_address_type_p2pkh];
+		ssize_t cb = pubkey_to_p2pkh(pubkey_hex, &addr);
+		assert(cb > 0);
+		addr = addrs[i][bitcoin_address_type_p2sh_p2pkh];
+		cb = pubkey_to_p2sh_p2wpkh(pubkey_hex, &addr);
+		assert(cb > 0);
+		addr = addrs[i][bitcoin_address_type_bech32];
+		cb = pubkey_to_bech32(pubkey_hex, &addr);
+		assert(cb > 0);
+	}
+}
+
+static void path_batch(const unsigned char (*pubkeys)[33], size_t count, char (*addrs)[bitcoin_address_types_count][BITCOIN_ADDRS_MAX_LENGTH])
+{
+	static struct bitcoin_addrs_record records[256];
+	assert(count <= 256);
+	for(size_t i = 0; i < count; ++i) memcpy(records[i].pubkey, pubkeys[i], 33);
+	ssize_t num_ok = pubkeys_to_addrs_batch(records, count, BITCOIN_ADDRESS_TYPES_ALL);
+	assert(num_ok == count);
+	for(size_t i = 0; i < count; ++i) memcpy(addrs[i], records[i].addrs, sizeof(addrs[i]));
+}
+
+/* one type per call: each type's hashes and checksums are only computed when selected */
+static void path_batch_per_type(const unsigned char (*pubkeys)[33], size_t count, char (*addrs)[bitcoin_address_types_count][BITCOIN_ADDRS_MAX_LENGTH])
+{
+	static struct bitcoin_addrs_record records[256];
+	assert(count <= 256);
+	for(size_t i = 0; i < count; ++i) memcpy(records[i].pubkey, pubkeys[i], 33);
+	for(int type = 0; type < bitcoin_address_types_count; ++type) {
+		ssize_t num_ok = pubkeys_to_addrs_batch(records, count, BITCOIN_ADDRESS_TYPE_MASK(type));
+		assert(num_ok == count);
+		for(size_t i = 0; i < count; ++i) memcpy(addrs[i][type], records[i].addrs[type], BITCOIN_ADDRS_MAX_LENGTH);
+	}
+}
+
+/* forces the multi-lane checksum kernel, whatever the cpu */
+static void path_batch_lanes_checksums(const unsigned char (*pubkeys)[33], size_t count, char (*addrs)[bitcoin_address_types_count][BITCOIN_ADDRS_MAX_LENGTH])
+{
+	int lanes = use_lanes_checksums();
+	s_lanes_checksums = 1;
+	path_batch_per_type(pubkeys, count, addrs);
+	s_lanes_checksums = lanes;
+}
+
+static void path_batch_parallel(const unsigned char (*pubkeys)[33], size_t count, char (*addrs)[bitcoin_address_types_count][BITCOIN_ADDRS_MAX_LENGTH])
+{
+	static struct bitcoin_addrs_record records[256];
+	static thread_pool_t * pool;
+	if(NULL == pool) pool = thread_pool_new(4, 0);	// more workers than cpus on small boxes: exercises stealing
+	assert(count <= 256);
+	for(size_t i = 0; i < count; ++i) memcpy(records[i].pubkey, pubkeys[i], 33);
+	ssize_t num_ok = pubkeys_to_addrs_batch_parallel(pool, records, count, BITCOIN_ADDRESS_TYPES_ALL);
+	assert(num_ok == count);
+	for(size_t i = 0; i < count; ++i) memcpy(addrs[i], records[i].addrs, sizeof(addrs[i]));
+}
+
+static const struct {
+	const char * name;
+	convert_path_func convert;
+} s_paths[] = {
+	{ "single_hex", path_single_hex },
+	{ "batch", path_batch },
+	{ "batch_per_type", path_batch_per_type },
+	{ "batch_lanes_checksums", path_batch_lanes_checksums },
+	{ "batch_parallel", path_batch_parallel },
+};
+#define NUM_PATHS (sizeof(s_paths) / sizeof(s_paths[0]))
+
+static inline uint64_t splitmix64(uint64_t * state)
+{
+	uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+/* random x, bumped until it is a point of secp256k1 (every single-key path validates the pubkey) */
+static void random_pubkey(uint64_t * state, unsigned char pubkey[static 33])
+{
+	for(int j = 0; j < 4; ++j) {
+		uint64_t r = splitmix64(state);
+		memcpy(&pubkey[1 + j * 8], &r, 8);
+	}
+	pubkey[0] = 0x02 | (pubkey[1] & 1);
+	while(0 != secp256k1_pubkey_check(pubkey)) ++pubkey[32];
+}
+
+static void test_known_vectors(void)
+{
+	// generator point G
+	static const char * pubkey_hex = "0279be667ef9dcbbac55a06295ce870b07029bfcdb2dce28d959f2815b16f81798";
+	static const char * expected[bitcoin_address_types_count] = {
+		[bitcoin_address_type_p2pkh] = "1BgGZ9tcN4rm9KBzDn7KprQz87SZ26SAMH",
+		[bitcoin_address_type_p2sh_p2pkh] = "3JvL6Ymt8MVWiCNHC7oWU6nLeHNJKLZGLN",
+		[bitcoin_address_type_bech32] = "bc1qw508d6qejxtdg4y5r3zarvary0c5xw7kv8f3t4",
+	};
+	
+	unsigned char pubkey[1][33];
+	void * p_pubkey = pubkey[0];
+	hex2bin(pubkey_hex, 66, &p_pubkey);
+	
+	char ref_addrs[bitcoin_address_types_count][BITCOIN_ADDRS_MAX_LENGTH];
+	ref_pubkey_to_addrs(pubkey[0], ref_addrs);
+	for(int type = 0; type < bitcoin_address_types_count; ++type) {
+		assert(0 == strcmp(ref_addrs[type], expected[type]));
+	}
+	
+	for(size_t p = 0; p < NUM_PATHS; ++p) {
+		char addrs[1][bitcoin_address_types_count][BITCOIN_ADDRS_MAX_LENGTH];
+		memset(addrs, 0, sizeof(addrs));
+		s_paths[p].convert((const unsigned char (*)[33])pubkey, 1, addrs);
+		for(int type = 0; type < bitcoin_address_types_count; ++type) {
+			printf("[%s] %-12s: %s\n", s_paths[p].name, s_address_types[type], addrs[0][type]);
+			assert(0 == strcmp(addrs[0][type], expected[type]));
+		}
+	}
+}
+
+/*
+ * scriptPubKeys / scripthashes: the Electrum protocol documentation example, G and 2G,
+ * then the batch (lanes and scalar sha256) against the single-key path and a reference build
+ */
+static void ref_scripthash(const unsigned char * script, size_t cb_script, char scripthash_hex[static 65])
+{
+	unsigned char digest[32];
+	ref_sha256(script, cb_script, digest);
+	for(int i = 0; i < 32; ++i) sprintf(&scripthash_hex[i * 2], "%.2x", digest[31 - i]);
+}
+
+static void test_scripts(uint64_t seed)
+{
+	static const struct {
+		const char * pubkey_hex;
+		const char * scripts[bitcoin_address_types_count][2];	// script, scripthash
+	} vectors[] = {
+		{ "0279be667ef9dcbbac55a06295ce870b07029bfcdb2dce28d959f2815b16f81798", {
+			{ "76a914751e76e8199196d454941c45d1b3a323f1433bd688ac", "8bd2c4f79944cd6a3cb1730cf92c513ae259eb271d81918457f3753eebe14a3f" },
+			{ "a914bcfeb728b584253d5f3f70bcb780e9ef218a68f487", "fdc7d5e92a18f7d2ed38bbc0828dc1487c9ccbb58fe3c082c87e7d39f378ab69" },
+			{ "0014751e76e8199196d454941c45d1b3a323f1433bd6", "9623df75239b5daa7f5f03042d325b51498c4bb7059c7748b17049bf96f73888" } } },
+		{ "02c6047f9441ed7d6d3045406e95c07cd85c778e4b8cef3ca7abac09b95c709ee5", {
+			{ "76a91406afd46bcdfd22ef94ac122aa11f241244a37ecc88ac", "79d6fedf08b0a964f2b364c31d2e4f45e5f87f452ede6d1797ae11e83b71f0cd" },
+			{ "a914978a0121f9a24de65a13bab0c43c3a48be074eae87", "0bfc9a8f7db045d27acad0ff39a0e15540c1648d423b2d703feaeebb6525f347" },
+			{ "001406afd46bcdfd22ef94ac122aa11f241244a37ecc", "d9a8bf6810a45ec818ded455cca21fee9a7cd67a55fa4664816c5f8e7fbac24b" } } },
+	};
+	
+	// 1A1zP1eP5QGefi2DMPTfTL5SLmv7DivfNa
+	unsigned char script[BITCOIN_ADDRS_SCRIPT_MAX_SIZE], scripthash[ELECTRUM_SCRIPTHASH_SIZE];
+	unsigned char hash[20];
+	void * p_hash = hash;
+	hex2bin("62e907b15cbf27d5425399ebf6f0fb50ebb88f18", 40, &p_hash);
+	assert(25 == hash160_to_script_pubkey(bitcoin_address_type_p2pkh, hash, script));
+	electrum_scripthash(script, 25, scripthash);
+	char * hex = NULL;
+	bin2hex(scripthash, 32, &hex);
+	assert(0 == strcmp(hex, "8b01df4e368ea28f8dc0423bcf7a4923e3a12d307c875e47a0cfbf90b5c39161"));
+	lib_free(hex);
+	hex = NULL;
+	assert(-1 == hash160_to_script_pubkey(bitcoin_address_types_count, hash, script));
+	
+	struct bitcoin_addrs_record records[2];
+	struct bitcoin_addrs_scripts scripts[2];
+	for(size_t i = 0; i < 2; ++i) {
+		void * p_pubkey = records[i].pubkey;
+		hex2bin(vectors[i].pubkey_hex, 66, &p_pubkey);
+		for(int type = 0; type < bitcoin_address_types_count; ++type) {
+			ssize_t cb_script = pubkey_to_script_pubkey(vectors[i].pubkey_hex, type, script, scripthash);
+			assert(cb_script * 2 == strlen(vectors[i].scripts[type][0]));
+			bin2hex(script, cb_script, &hex);
+			assert(0 == strcmp(hex, vectors[i].scripts[type][0]));
+			lib_free(hex);
+			hex = NULL;
+			bin2hex(scripthash, 32, &hex);
+			assert(0 == strcmp(hex, vectors[i].scripts[type][1]));
+			lib_free(hex);
+			hex = NULL;
+		}
+	}
+	assert(-1 == pubkey_to_script_pubkey("02", bitcoin_address_type_p2pkh, script, NULL));
+	assert(2 == pubkeys_to_addrs_batch(records, 2, 0));
+	for(int lanes = 0; lanes < 2; ++lanes) {
+		s_lanes_checksums = lanes;
+		assert(2 == pubkeys_to_scripts_batch(records, 2, BITCOIN_ADDRESS_TYPES_ALL, scripts));
+		for(size_t i = 0; i < 2; ++i) {
+			for(int type = 0; type < bitcoin_address_types_count; ++type) {
+				bin2hex(scripts[i].scripts[type], scripts[i].cb_scripts[type], &hex);
+				assert(0 == strcmp(hex, vectors[i].scripts[type][0]));
+				lib_free(hex);
+				hex = NULL;
+				bin2hex(scripts[i].scripthashes[type], 32, &hex);
+				assert(0 == strcmp(hex, vectors[i].scripts[type][1]));
+				lib_free(hex);
+				hex = NULL;
+			}
+		}
+	}
+	
+	// random keys, every type subset, both sha256 paths, an erroneous record in the middle
+	#define NUM_SCRIPT_KEYS (1000)
+	static struct bitcoin_addrs_record keys[NUM_SCRIPT_KEYS];
+	static struct bitcoin_addrs_scripts batch_scripts[NUM_SCRIPT_KEYS];
+	uint64_t state = seed;
+	for(size_t i = 0; i < NUM_SCRIPT_KEYS; ++i) {
+		random_pubkey(&state, keys[i].pubkey);
+	}
+	assert(NUM_SCRIPT_KEYS == pubkeys_to_addrs_batch(keys, NUM_SCRIPT_KEYS, 0));
+	keys[77].err_code = -1;
+	thread_pool_t * pool = thread_pool_new(4, 0);
+	for(uint32_t mask = 1; mask <= BITCOIN_ADDRESS_TYPES_ALL; ++mask) {
+		for(int lanes = 0; lanes < 3; ++lanes) {
+			s_lanes_checksums = lanes & 1;
+			ssize_t num_ok = (lanes < 2)?pubkeys_to_scripts_batch(keys, NUM_SCRIPT_KEYS, mask, batch_scripts)
+				:pubkeys_to_scripts_batch_parallel(pool, keys, NUM_SCRIPT_KEYS, mask, batch_scripts);
+			assert(num_ok == NUM_SCRIPT_KEYS - 1);
+			for(size_t i = 0; i < NUM_SCRIPT_KEYS; ++i) {
+				for(int type = 0; type < bitcoin_address_types_count; ++type) {
+					if(i == 77 || !(mask & BITCOIN_ADDRESS_TYPE_MASK(type))) {
+						assert(0 == batch_scripts[i].cb_scripts[type]);
+						continue;
+					}
+					// reference: the script from ref_hash160, hashed with ref_sha256
+					unsigned char ref_script[BITCOIN_ADDRS_SCRIPT_MAX_SIZE], script_hash[20];
+					unsigned char redeem_script[22] = { 0x00, 20 };
+					ref_hash160(keys[i].pubkey, 33, &redeem_script[2]);
+					ref_hash160(redeem_script, 22, script_hash);
+					size_t cb_script = build_script_pubkey(type, &redeem_script[2], script_hash, ref_script);
+					char ref_hex[65], batch_hex[65];
+					ref_scripthash(ref_script, cb_script, ref_hex);
+					for(int k = 0; k < 32; ++k) sprintf(&batch_hex[k * 2], "%.2x", batch_scripts[i].scripthashes[type][k]);
+					assert(batch_scripts[i].cb_scripts[type] == cb_script);
+					assert(0 == memcmp(batch_scripts[i].scripts[type], ref_script, cb_script));
+					assert(0 == strcmp(batch_hex, ref_hex));
+				}
+			}
+		}
+	}
+	s_lanes_checksums = -1;
+	thread_pool_free(pool);
+	printf("scripts / scripthashes: PASSED\n");
+}
+
+/*
+ * failed records inside a lane group: their hash160 and script slots hold no valid data (poisoned here),
+ * the lanes pass must neither read them into the other lanes nor leave garbage scripthashes behind
+ */
+static void test_scripts_failed_lanes(uint64_t seed)
+{
+	#define NUM_LANES_KEYS (3 * HASH_LANES + 5)
+	const size_t failed[] = { HASH_LANES + 3, 3 * HASH_LANES + 2 };	// mid-group, and in the partial last group
+	struct bitcoin_addrs_record * records = malloc(NUM_LANES_KEYS * sizeof(*records));
+	struct bitcoin_addrs_scripts * expected = malloc(NUM_LANES_KEYS * sizeof(*expected));
+	struct bitcoin_addrs_scripts * scripts = malloc(NUM_LANES_KEYS * sizeof(*scripts));
+	assert(records && expected && scripts);
+	
+	uint64_t state = seed;
+	for(size_t i = 0; i < NUM_LANES_KEYS; ++i) random_pubkey(&state, records[i].pubkey);
+	assert(NUM_LANES_KEYS == pubkeys_to_addrs_batch(records, NUM_LANES_KEYS, 0));
+	s_lanes_checksums = 0;
+	assert(NUM_LANES_KEYS == pubkeys_to_scripts_batch(records, NUM_LANES_KEYS, BITCOIN_ADDRESS_TYPES_ALL, expected));
+	for(size_t k = 0; k < sizeof(failed) / sizeof(failed[0]); ++k) {
+		records[failed[k]].err_code = BITCOIN_ADDRS_ERR_PUBKEY;
+		memset(records[failed[k]].hash160, 0xa5, sizeof(records[failed[k]].hash160));
+	}
+	
+	for(int lanes = 0; lanes < 2; ++lanes) {
+		s_lanes_checksums = lanes;
+		memset(scripts, 0xa5, NUM_LANES_KEYS * sizeof(*scripts));
+		ssize_t num_ok = pubkeys_to_scripts_batch(records, NUM_LANES_KEYS, BITCOIN_ADDRESS_TYPES_ALL, scripts);
+		assert(num_ok == NUM_LANES_KEYS - 2);
+		for(size_t i = 0; i < NUM_LANES_KEYS; ++i) {
+			if(records[i].err_code) {
+				static const struct bitcoin_addrs_scripts zeros;
+				assert(0 == memcmp(&scripts[i], &zeros, sizeof(zeros)));
+				continue;
+			}
+			for(int type = 0; type < bitcoin_address_types_count; ++type) {
+				assert(scripts[i].cb_scripts[type] == expected[i].cb_scripts[type]);
+				assert(0 == memcmp(scripts[i].scripts[type], expected[i].scripts[type], expected[i].cb_scripts[type]));
+				assert(0 == memcmp(scripts[i].scripthashes[type], expected[i].scripthashes[type], ELECTRUM_SCRIPTHASH_SIZE));
+			}
+		}
+	}
+	s_lanes_checksums = -1;
+	free(records);
+	free(expected);
+	free(scripts);
+	printf("scripts with failed lanes: PASSED\n");
+}
+
+/*
+ * BITCOIN_ADDRS_CHECK_PUBKEYS: bad prefixes and off-curve keys scattered over several check windows
+ * are flagged, the valid ones convert exactly as without the check
+ */
+static void test_check_pubkeys(uint64_t seed)
+{
+	#define NUM_CHECK_KEYS (1500)
+	static struct bitcoin_addrs_record checked[NUM_CHECK_KEYS], unchecked[NUM_CHECK_KEYS];
+	uint64_t state = seed;
+	size_t num_valid = 0;
+	for(size_t i = 0; i < NUM_CHECK_KEYS; ++i) {
+		random_pubkey(&state, unchecked[i].pubkey);
+		if(i % 7 == 3) unchecked[i].pubkey[0] = (i & 8)?0x04:0x00;
+		else if(i % 5 == 1) {
+			while(0 == secp256k1_pubkey_check(unchecked[i].pubkey)) ++unchecked[i].pubkey[32];
+		}
+		else ++num_valid;
+		memcpy(checked[i].pubkey, unchecked[i].pubkey, 33);
+	}
+	
+	assert(-1 == parse_pubkey("0479be667ef9dcbbac55a06295ce870b07029bfcdb2dce28d959f2815b16f81798", checked[0].pubkey));
+	assert(-1 == parse_pubkey("0279be667ef9dcbbac55a06295ce870b07029bfcdb2dce28d959f2815b16f8179c", checked[0].pubkey));
+	memcpy(checked[0].pubkey, unchecked[0].pubkey, 33);
+	
+	assert(NUM_CHECK_KEYS == pubkeys_to_addrs_batch(unchecked, NUM_CHECK_KEYS, BITCOIN_ADDRESS_TYPES_ALL));
+	assert(num_valid == pubkeys_to_addrs_batch(checked, NUM_CHECK_KEYS, BITCOIN_ADDRESS_TYPES_ALL | BITCOIN_ADDRS_CHECK_PUBKEYS));
+	for(size_t i = 0; i < NUM_CHECK_KEYS; ++i) {
+		int valid = (i % 7 != 3) && (i % 5 != 1);
+		if(!valid) {
+			assert(checked[i].err_code == BITCOIN_ADDRS_ERR_PUBKEY);
+			for(int type = 0; type < bitcoin_address_types_count; ++type) assert(0 == checked[i].cb_addrs[type]);
+			continue;
+		}
+		assert(0 == checked[i].err_code);
+		assert(0 == memcmp(checked[i].hash160, unchecked[i].hash160, sizeof(checked[i].hash160)));
+		for(int type = 0; type < bitcoin_address_types_count; ++type) {
+			assert(checked[i].cb_addrs[type] == unchecked[i].cb_addrs[type]);
+			assert(0 == memcmp(checked[i].addrs[type], unchecked[i].addrs[type], checked[i].cb_addrs[type]));
+		}
+	}
+	printf("check pubkeys: PASSED\n");
+}
+
+int main(int argc, char ** argv)
+{
+	long rounds = (argc > 1)?atol(argv[1]):1000000;
+	uint64_t seed = (argc > 2)?strtoull(argv[2], NULL, 0):(uint64_t)time(NULL);
+	
+	test_known_vectors();
+	test_scripts(seed);
+	test_scripts_failed_lanes(seed);
+	test_check_pubkeys(seed);
+	
+	printf("differential test: rounds=%ld, seed=%lu, paths=%d\n", rounds, (unsigned long)seed, (int)NUM_PATHS);
+	
+	#define BATCH_SIZE (256)
+	static unsigned char pubkeys[BATCH_SIZE][33];
+	static char ref_addrs[BATCH_SIZE][bitcoin_address_types_count][BITCOIN_ADDRS_MAX_LENGTH];
+	static char addrs[BATCH_SIZE][bitcoin_address_types_count][BITCOIN_ADDRS_MAX_LENGTH];
+	
+	uint64_t state = seed;
+	double time_ref = 0.0;
+	double time_paths[NUM_PATHS] = { 0.0 };
+	for(long n = 0; n < rounds; n += BATCH_SIZE) {
+		size_t count = ((rounds - n) < BATCH_SIZE)?(rounds - n):BATCH_SIZE;
+		for(size_t i = 0; i < count; ++i) {
+			random_pubkey(&state, pubkeys[i]);
+		}
+		
+		app_timer_start(NULL);
+		for(size_t i = 0; i < count; ++i) ref_pubkey_to_addrs(pubkeys[i], ref_addrs[i]);
+		time_ref += app_timer_stop(NULL);
+		
+		for(size_t p = 0; p < NUM_PATHS; ++p) {
+			memset(addrs, 0, sizeof(addrs[0]) * count);
+			app_timer_start(NULL);
+			s_paths[p].convert((const unsigned char (*)[33])pubkeys, count, addrs);
+			time_paths[p] += app_timer_stop(NULL);
+			
+			for(size_t i = 0; i < count; ++i) {
+				for(int type = 0; type < bitcoin_address_types_count; ++type) {
+					if(strcmp(addrs[i][type], ref_addrs[i][type]) == 0) continue;
+					printf("MISMATCH: path=%s, type=%s, pubkey=", s_paths[p].name, s_address_types[type]);
+					dump(pubkeys[i], 33);
+					printf("\n  expected: %s\n  actual  : %s\n", ref_addrs[i][type], addrs[i][type]);
+					abort();
+				}
+			}
+		}
+	}
+	
+	printf("  %-16s: %.3f s\n", "reference", time_ref);
+	for(size_t p = 0; p < NUM_PATHS; ++p) printf("  %-16s: %.3f s\n", s_paths[p].name, time_paths[p]);
+	printf("==== %s: PASSED ====\n", __FILE__);
+	return 0;
+}
+#endif
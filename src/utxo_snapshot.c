@@ -0,0 +1,930 @@
+/*
+ * utxo_snapshot.c
+ * 
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ * 
+ * The MIT License (MIT)
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to deal 
+ * in the Software without restriction, including without limitation the rights 
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all 
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS 
+ * IN THE SOFTWARE.
+ * 
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "sha.h"
+#include "ripemd.h"
+#include "hash_fused.h"
+#include "thread_pool.h"
+
+#include "utxo_snapshot.h"
+#include "multisig_to_addrs.h"
+
+#define SNAPSHOT_CHUNK_SIZE	(64 << 20)
+#define SNAPSHOT_MAGIC	"utxo\xff"
+#define SNAPSHOT_SYNC_RECORDS	(8)	// consecutive records that must parse to accept a speculative chunk start
+#define SNAPSHOT_SEAM_MARKS	(32)	// leading record boundaries kept per chunk to join a speculative parse at the seam
+
+// sanity bounds of a record; a speculative start has to pass them all
+#define MAX_MONEY	(2100000000000000ULL)
+#define MAX_COMPRESSED_AMOUNT	(20000000000000000ULL)	// > CompressAmount(n) for any n <= MAX_MONEY
+#define MAX_SCRIPT_SIZE	(10000)	// larger scripts are unspendable, never in the UTXO set
+#define MAX_TX_OUTPUTS	(1u << 20)
+#define MAX_HEIGHT	(1u << 26)
+
+/******************************************************************************
+ * key set: open addressing over the leading hash bytes, read-only (and lock-free) while scanning
+******************************************************************************/
+struct keyset_entry
+{
+	uint64_t fingerprint;	// 0: empty slot
+	uint32_t tag;
+	uint8_t kind;
+	unsigned char key[32];
+};
+
+struct utxo_keyset
+{
+	size_t mask;	// capacity - 1, capacity is a power of 2
+	size_t count;
+	struct keyset_entry * entries;
+};
+
+static inline size_t key_size(enum utxo_key_kind kind)
+{
+	return (kind == utxo_key_kind_witness_script_hash)?32:20;
+}
+
+/* the keys are hash outputs: their leading bytes are already uniform */
+static inline uint64_t key_fingerprint(enum utxo_key_kind kind, const unsigned char * key)
+{
+	uint64_t fingerprint;
+	memcpy(&fingerprint, key, sizeof(fingerprint));
+	fingerprint ^= (kind + 1) * 0x9e3779b97f4a7c15ULL;
+	return fingerprint?fingerprint:1;
+}
+
+static struct keyset_entry * keyset_slot(struct keyset_entry * entries, size_t mask,
+	enum utxo_key_kind kind, const unsigned char * key, uint64_t fingerprint)
+{
+	for(size_t i = fingerprint & mask; ; i = (i + 1) & mask) {
+		struct keyset_entry * entry = &entries[i];
+		if(0 == entry->fingerprint) return entry;
+		if(entry->fingerprint == fingerprint && entry->kind == kind && 0 == memcmp(entry->key, key, key_size(kind))) return entry;
+	}
+}
+
+utxo_keyset_t * utxo_keyset_new(size_t capacity)
+{
+	size_t slots = 64;
+	while(slots < capacity * 2) slots <<= 1;
+
+	utxo_keyset_t * set = calloc(1, sizeof(*set));
+	assert(set);
+	set->mask = slots - 1;
+	set->entries = calloc(slots, sizeof(*set->entries));
+	assert(set->entries);
+	return set;
+}
+
+void utxo_keyset_free(utxo_keyset_t * set)
+{
+	if(NULL == set) return;
+	free(set->entries);
+	free(set);
+}
+
+size_t utxo_keyset_get_count(const utxo_keyset_t * set)
+{
+	return set->count;
+}
+
+static void keyset_grow(utxo_keyset_t * set)
+{
+	size_t mask = set->mask * 2 + 1;
+	struct keyset_entry * entries = calloc(mask + 1, sizeof(*entries));
+	assert(entries);
+	for(size_t i = 0; i <= set->mask; ++i) {
+		const struct keyset_entry * entry = &set->entries[i];
+		if(entry->fingerprint) *keyset_slot(entries, mask, entry->kind, entry->key, entry->fingerprint) = *entry;
+	}
+	free(set->entries);
+	set->entries = entries;
+	set->mask = mask;
+}
+
+int utxo_keyset_add(utxo_keyset_t * set, enum utxo_key_kind kind, const unsigned char * key, uint32_t tag)
+{
+	assert(set && key && kind >= 0 && kind < utxo_key_kinds_count);
+	if((set->count + 1) * 2 > set->mask + 1) keyset_grow(set);
+
+	uint64_t fingerprint = key_fingerprint(kind, key);
+	struct keyset_entry * entry = keyset_slot(set->entries, set->mask, kind, key, fingerprint);
+	if(entry->fingerprint) return 1;
+
+	entry->fingerprint = fingerprint;
+	entry->tag = tag;
+	entry->kind = kind;
+	memcpy(entry->key, key, key_size(kind));
+	++set->count;
+	return 0;
+}
+
+int utxo_keyset_find(const utxo_keyset_t * set, enum utxo_key_kind kind, const unsigned char * key, uint32_t * p_tag)
+{
+	const struct keyset_entry * entry = keyset_slot(set->entries, set->mask, kind, key, key_fingerprint(kind, key));
+	if(0 == entry->fingerprint) return 0;
+	if(p_tag) *p_tag = entry->tag;
+	return 1;
+}
+
+static void hash160_of(const unsigned char * data, size_t size, unsigned char hash[static 20])
+{
+	unsigned char sha[32];
+	sha256_hash(data, size, sha);
+	ripemd160_hash(sha, 32, hash);
+}
+
+void utxo_keyset_add_record(utxo_keyset_t * set, const struct bitcoin_addrs_record * record, uint32_t tag)
+{
+	if(record->err_code) return;
+	utxo_keyset_add(set, utxo_key_kind_pubkey_hash, record->hash160, tag);
+
+	// p2sh-p2wpkh: hash160([ OP_0 | 20 | hash160(pubkey) ])
+	unsigned char redeem_script[2 + 20] = { 0x00, 20 }, script_hash[20];
+	memcpy(&redeem_script[2], record->hash160, 20);
+	hash160_of(redeem_script, sizeof(redeem_script), script_hash);
+	utxo_keyset_add(set, utxo_key_kind_script_hash, script_hash, tag);
+}
+
+void utxo_keyset_add_multisig(utxo_keyset_t * set, const struct multisig_record * record, uint32_t tag)
+{
+	if(record->err_code) return;
+	unsigned char script_hash[20];
+	ripemd160_hash(record->script_sha256, 32, script_hash);
+	utxo_keyset_add(set, utxo_key_kind_script_hash, script_hash, tag);
+	utxo_keyset_add(set, utxo_key_kind_witness_script_hash, record->script_sha256, tag);
+
+	// p2sh-p2wsh: hash160([ OP_0 | 32 | sha256(script) ])
+	unsigned char redeem_script[2 + 32] = { 0x00, 32 };
+	memcpy(&redeem_script[2], record->script_sha256, 32);
+	hash160_of(redeem_script, sizeof(redeem_script), script_hash);
+	utxo_keyset_add(set, utxo_key_kind_script_hash, script_hash, tag);
+}
+
+/******************************************************************************
+ * snapshot records
+******************************************************************************/
+static const char * s_match_types[utxo_match_types_count] = {
+	[utxo_match_type_p2pk] = "p2pk",
+	[utxo_match_type_p2pk_uncompressed] = "p2pk-uncompressed",
+	[utxo_match_type_p2pkh] = "p2pkh",
+	[utxo_match_type_p2sh] = "p2sh",
+	[utxo_match_type_p2wpkh] = "p2wpkh",
+	[utxo_match_type_p2wsh] = "p2wsh",
+};
+
+const char * utxo_match_type_to_string(enum utxo_match_type type)
+{
+	if(type < 0 || type >= utxo_match_types_count) return NULL;
+	return s_match_types[type];
+}
+
+struct reader
+{
+	const unsigned char * p;
+	const unsigned char * end;
+};
+
+/* Bitcoin Core VARINT: base-128, most significant group first, every continuation group offset by one */
+static inline int read_varint(struct reader * reader, uint64_t * p_value)
+{
+	uint64_t value = 0;
+	while(reader->p < reader->end) {
+		unsigned char c = *reader->p++;
+		if(value > (UINT64_MAX >> 7)) return -1;
+		value = (value << 7) | (c & 0x7f);
+		if(!(c & 0x80)) {
+			*p_value = value;
+			return 0;
+		}
+		if(value == UINT64_MAX) return -1;
+		++value;
+	}
+	return -1;
+}
+
+/* CompactSize, canonical encodings only */
+static inline int read_compact_size(struct reader * reader, uint64_t * p_value)
+{
+	if(reader->p >= reader->end) return -1;
+	unsigned char c = *reader->p++;
+	if(c < 0xfd) {
+		*p_value = c;
+		return 0;
+	}
+	size_t size = (c == 0xfd)?2:(c == 0xfe)?4:8;
+	if((size_t)(reader->end - reader->p) < size) return -1;
+	uint64_t value = 0;
+	for(size_t i = 0; i < size; ++i) value |= (uint64_t)reader->p[i] << (8 * i);
+	reader->p += size;
+	if(value < ((c == 0xfd)?0xfd:(c == 0xfe)?0x10000:0x100000000ULL)) return -1;
+	*p_value = value;
+	return 0;
+}
+
+static inline uint64_t decompress_amount(uint64_t x)
+{
+	if(0 == x) return 0;
+	--x;
+	int e = x % 10;
+	x /= 10;
+	uint64_t n = 0;
+	if(e < 9) {
+		int d = (x % 9) + 1;
+		x /= 9;
+		n = x * 10 + d;
+	}else {
+		n = x + 1;
+	}
+	while(e--) n *= 10;
+	return n;
+}
+
+struct scan_context
+{
+	const unsigned char * data;
+	size_t size;
+	size_t data_start;	// first record
+	int grouped;	// v28+: [ txid | CompactSize(coins) | ( CompactSize(vout) coin )* ]; else [ txid | vout (u32) | coin ]
+	const utxo_keyset_t * set;
+};
+
+struct chunk_result
+{
+	size_t begin, end;	// chunk range: records starting in [begin, end)
+	size_t start, stop;	// first record boundary, boundary after the last record
+	int synced;
+	int error;
+	uint64_t coins;
+	struct utxo_match * matches;
+	size_t first_match, num_matches, max_matches;
+
+	// a wrong speculative start usually falls into step with the real records after a few of them:
+	// the parse is kept from the first boundary it shares with its predecessor
+	struct
+	{
+		size_t offset;
+		uint64_t coins;
+		size_t num_matches;
+	}marks[SNAPSHOT_SEAM_MARKS];
+	size_t num_marks;
+};
+
+static void chunk_add_match(struct chunk_result * result, const unsigned char * txid, uint32_t vout, uint64_t code,
+	uint64_t amount, enum utxo_match_type type, uint32_t tag)
+{
+	if(result->num_matches == result->max_matches) {
+		size_t max_matches = result->max_matches?(result->max_matches * 2):64;
+		result->matches = realloc(result->matches, max_matches * sizeof(*result->matches));
+		assert(result->matches);
+		result->max_matches = max_matches;
+	}
+	struct utxo_match * match = &result->matches[result->num_matches++];
+	memcpy(match->txid, txid, 32);
+	match->vout = vout;
+	match->height = code >> 1;
+	match->coinbase = code & 1;
+	match->amount = amount;
+	match->type = type;
+	match->tag = tag;
+}
+
+/**
+ * coin: VARINT(height * 2 + coinbase) | VARINT(CompressAmount(amount)) | compressed script
+ *   compressed script: VARINT(n), n = 0: p2pkh hash, 1: p2sh hash, 2 / 3: compressed pubkey x,
+ *   4 / 5: x of an uncompressed pubkey (y parity n & 1), else n - 6 bytes of raw script
+ * result NULL: validation only (speculative start)
+**/
+static int parse_coin(const struct scan_context * ctx, struct reader * reader, const unsigned char * txid, uint32_t vout,
+	struct chunk_result * result)
+{
+	uint64_t code = 0, compressed_amount = 0, n = 0;
+	if(read_varint(reader, &code) || (code >> 1) == 0 || (code >> 1) >= MAX_HEIGHT) return -1;	// the genesis output is not in the set
+	if(read_varint(reader, &compressed_amount) || compressed_amount > MAX_COMPRESSED_AMOUNT) return -1;
+	uint64_t amount = decompress_amount(compressed_amount);
+	if(amount > MAX_MONEY) return -1;
+	if(read_varint(reader, &n)) return -1;
+
+	size_t cb_script = (n < 2)?20:(n < 6)?32:(n - 6);
+	if(n >= 6 && (n - 6) > MAX_SCRIPT_SIZE) return -1;
+	if((size_t)(reader->end - reader->p) < cb_script) return -1;
+	const unsigned char * script = reader->p;
+	reader->p += cb_script;
+	if(NULL == result) return 0;
+
+	enum utxo_match_type type;
+	enum utxo_key_kind kind = utxo_key_kind_pubkey_hash;
+	const unsigned char * key = script;
+	unsigned char hash[20];
+	switch(n) {
+	case 0: type = utxo_match_type_p2pkh; break;
+	case 1: type = utxo_match_type_p2sh; kind = utxo_key_kind_script_hash; break;
+	case 2: case 3: case 4: case 5:
+		{
+			// the uncompressed form (4 / 5) belongs to the same key as its compressed form
+			unsigned char pubkey[33] = { (n & 1)?0x03:0x02 };
+			memcpy(&pubkey[1], script, 32);
+			hash160_33(pubkey, hash);
+			key = hash;
+			type = (n < 4)?utxo_match_type_p2pk:utxo_match_type_p2pk_uncompressed;
+		}
+		break;
+	default:
+		if(cb_script == 22 && script[0] == 0x00 && script[1] == 20) {
+			type = utxo_match_type_p2wpkh;
+		}else if(cb_script == 34 && script[0] == 0x00 && script[1] == 32) {
+			type = utxo_match_type_p2wsh;
+			kind = utxo_key_kind_witness_script_hash;
+		}else {
+			return 0;	// not a type derived from keys of this library
+		}
+		key = script + 2;
+		break;
+	}
+
+	uint32_t tag = 0;
+	if(utxo_keyset_find(ctx->set, kind, key, &tag)) chunk_add_match(result, txid, vout, code, amount, type, tag);
+	return 0;
+}
+
+/* one record: a txid group (v28+) or a single coin; outpoints must ascend from *p_prev_txid / *p_prev_vout */
+static int parse_record(const struct scan_context * ctx, struct reader * reader,
+	const unsigned char ** p_prev_txid, uint32_t * p_prev_vout, struct chunk_result * result, uint64_t * p_coins)
+{
+	if(reader->end - reader->p < 32) return -1;
+	const unsigned char * txid = reader->p;
+	reader->p += 32;
+	int cmp = (*p_prev_txid)?memcmp(txid, *p_prev_txid, 32):1;
+	*p_prev_txid = txid;
+
+	if(!ctx->grouped) {
+		if(reader->end - reader->p < 4) return -1;
+		uint32_t vout = reader->p[0] | (reader->p[1] << 8) | (reader->p[2] << 16) | ((uint32_t)reader->p[3] << 24);
+		reader->p += 4;
+		if(cmp < 0 || (cmp == 0 && vout <= *p_prev_vout) || vout >= MAX_TX_OUTPUTS) return -1;
+		*p_prev_vout = vout;
+		++*p_coins;
+		return parse_coin(ctx, reader, txid, vout, result);
+	}
+
+	uint64_t num_coins = 0;
+	if(cmp <= 0 || read_compact_size(reader, &num_coins) || num_coins == 0 || num_coins > MAX_TX_OUTPUTS) return -1;
+	int64_t prev_vout = -1;
+	for(uint64_t i = 0; i < num_coins; ++i) {
+		uint64_t vout = 0;
+		if(read_compact_size(reader, &vout) || (int64_t)vout <= prev_vout || vout >= MAX_TX_OUTPUTS) return -1;
+		prev_vout = vout;
+		if(parse_coin(ctx, reader, txid, vout, result)) return -1;
+	}
+	*p_coins += num_coins;
+	return 0;
+}
+
+/* parses the records starting in [start, limit) */
+static void parse_range(const struct scan_context * ctx, struct chunk_result * result, size_t start, size_t limit)
+{
+	struct reader reader = { ctx->data + start, ctx->data + ctx->size };
+	const unsigned char * prev_txid = NULL;
+	uint32_t prev_vout = 0;
+
+	result->start = start;
+	result->error = 0;
+	result->coins = 0;
+	result->first_match = 0;
+	result->num_matches = 0;
+	result->num_marks = 0;
+	while((size_t)(reader.p - ctx->data) < limit) {
+		if(result->num_marks < SNAPSHOT_SEAM_MARKS) {
+			result->marks[result->num_marks].offset = reader.p - ctx->data;
+			result->marks[result->num_marks].coins = result->coins;
+			result->marks[result->num_marks].num_matches = result->num_matches;
+			++result->num_marks;
+		}
+		if(parse_record(ctx, &reader, &prev_txid, &prev_vout, result, &result->coins)) {
+			result->error = 1;
+			break;
+		}
+	}
+	result->stop = reader.p - ctx->data;
+}
+
+/* the first offset in [begin, end) where SNAPSHOT_SYNC_RECORDS records (or all up to the end of the file) parse */
+static int find_start(const struct scan_context * ctx, size_t begin, size_t end, size_t * p_start)
+{
+	const unsigned char * data_end = ctx->data + ctx->size;
+	for(size_t offset = begin; offset < end; ++offset) {
+		struct reader reader = { ctx->data + offset, data_end };
+		const unsigned char * prev_txid = NULL;
+		uint32_t prev_vout = 0;
+		uint64_t coins = 0;
+		int ok = 1;
+		for(int i = 0; i < SNAPSHOT_SYNC_RECORDS && reader.p < data_end && ok; ++i) {
+			ok = (0 == parse_record(ctx, &reader, &prev_txid, &prev_vout, NULL, &coins));
+		}
+		if(ok) {
+			*p_start = offset;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+struct scan_job
+{
+	const struct scan_context * ctx;
+	struct chunk_result * chunks;
+};
+
+static void scan_chunks(size_t begin, size_t end, void * user_data)
+{
+	struct scan_job * job = user_data;
+	const struct scan_context * ctx = job->ctx;
+	const size_t page_size = sysconf(_SC_PAGESIZE);
+	for(size_t i = begin; i < end; ++i) {
+		struct chunk_result * chunk = &job->chunks[i];
+		size_t page = chunk->begin & ~(page_size - 1);
+		madvise((void *)(ctx->data + page), chunk->end - page, MADV_WILLNEED);
+
+		size_t start = ctx->data_start;
+		chunk->synced = (i == 0) || (0 == find_start(ctx, chunk->begin, chunk->end, &start));
+		if(chunk->synced) parse_range(ctx, chunk, start, chunk->end);
+	}
+}
+
+/* drops the records parsed before pos; @return 0 if pos is not one of the chunk's leading record boundaries */
+static int join_seam(struct chunk_result * chunk, size_t pos)
+{
+	for(size_t i = 0; i < chunk->num_marks; ++i) {
+		if(chunk->marks[i].offset == pos) {
+			chunk->start = pos;
+			chunk->coins -= chunk->marks[i].coins;
+			chunk->first_match = chunk->marks[i].num_matches;
+			return 1;
+		}
+		if(chunk->marks[i].offset > pos) break;
+	}
+	return 0;
+}
+
+/* v28+: magic(5) | version(u16) | network magic(4) | base blockhash(32) | coins count(u64); before: blockhash | coins count */
+static int parse_metadata(struct scan_context * ctx, struct utxo_scan_stats * stats)
+{
+	const unsigned char * p = ctx->data;
+	size_t size = ctx->size;
+	if(size >= 5 && 0 == memcmp(p, SNAPSHOT_MAGIC, 5)) {
+		if(size < 5 + 2 + 4 + 32 + 8) return -1;
+		stats->format_version = p[5] | (p[6] << 8);
+		if(stats->format_version != 2) return -1;
+		p += 5 + 2 + 4;
+		ctx->grouped = 1;
+	}else {
+		if(size < 32 + 8) return -1;
+		stats->format_version = 0;
+		ctx->grouped = 0;
+	}
+	memcpy(stats->base_blockhash, p, 32);
+	p += 32;
+	stats->coins_count = 0;
+	for(int i = 0; i < 8; ++i) stats->coins_count |= (uint64_t)p[i] << (8 * i);
+	ctx->data_start = (p + 8) - ctx->data;
+	return 0;
+}
+
+int utxo_snapshot_scan(const char * path, const utxo_keyset_t * set, const struct utxo_scan_config * config,
+	utxo_match_callback on_match, void * user_data, struct utxo_scan_stats * p_stats)
+{
+	assert(path && set);
+	struct utxo_scan_stats stats[1];
+	memset(stats, 0, sizeof(stats));
+	struct timespec begin_time, end_time;
+	clock_gettime(CLOCK_MONOTONIC, &begin_time);
+
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if(fd < 0) {
+		perror("open snapshot");
+		return -1;
+	}
+	struct stat st;
+	if(fstat(fd, &st) != 0 || st.st_size == 0) {
+		close(fd);
+		return -1;
+	}
+
+	struct scan_context ctx[1] = {{ .size = st.st_size, .set = set }};
+	void * data = mmap(NULL, ctx->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(data == MAP_FAILED) {
+		perror("mmap snapshot");
+		return -1;
+	}
+	ctx->data = data;
+	stats->bytes = ctx->size;
+
+	int rc = parse_metadata(ctx, stats);
+	size_t chunk_size = (config && config->chunk_size)?config->chunk_size:SNAPSHOT_CHUNK_SIZE;
+	size_t num_chunks = (ctx->size - ctx->data_start + chunk_size - 1) / chunk_size;
+	struct chunk_result * chunks = calloc(num_chunks + 1, sizeof(*chunks));
+	assert(chunks);
+	for(size_t i = 0; i < num_chunks; ++i) {
+		chunks[i].begin = ctx->data_start + i * chunk_size;
+		chunks[i].end = (i + 1 == num_chunks)?ctx->size:(chunks[i].begin + chunk_size);
+	}
+	stats->chunks = num_chunks;
+
+	if(0 == rc) {
+		struct thread_pool * pool = (config && config->pool)?config->pool:thread_pool_default();
+		struct scan_job job = { .ctx = ctx, .chunks = chunks };
+		thread_pool_parallel_for(pool, 0, num_chunks, 1, scan_chunks, &job);
+
+		// verify the seams in file order: each chunk must start where its predecessor stopped
+		size_t pos = ctx->data_start;
+		for(size_t i = 0; i < num_chunks; ++i) {
+			struct chunk_result * chunk = &chunks[i];
+			if(pos >= chunk->end) {
+				// the predecessor's last record spans the whole chunk
+				parse_range(ctx, chunk, pos, chunk->end);
+			}else if(!chunk->synced || !join_seam(chunk, pos)) {
+				++stats->reparsed_chunks;
+				parse_range(ctx, chunk, pos, chunk->end);
+			}
+			if(chunk->error) {
+				fprintf(stderr, "[utxo]: malformed snapshot near offset %zu\n", chunk->stop);
+				rc = -1;
+				break;
+			}
+			for(size_t m = chunk->first_match; m < chunk->num_matches; ++m) {
+				++stats->matches;
+				stats->match_amounts[chunk->matches[m].type] += chunk->matches[m].amount;
+				if(on_match) on_match(&chunk->matches[m], user_data);
+			}
+			stats->coins += chunk->coins;
+			pos = chunk->stop;
+		}
+		if(0 == rc && (pos != ctx->size || stats->coins != stats->coins_count)) {
+			fprintf(stderr, "[utxo]: %lu coins parsed, the metadata says %lu\n",
+				(unsigned long)stats->coins, (unsigned long)stats->coins_count);
+			rc = -1;
+		}
+	}
+
+	for(size_t i = 0; i < num_chunks; ++i) free(chunks[i].matches);
+	free(chunks);
+	munmap(data, ctx->size);
+
+	clock_gettime(CLOCK_MONOTONIC, &end_time);
+	stats->elapsed = (end_time.tv_sec - begin_time.tv_sec) + (end_time.tv_nsec - begin_time.tv_nsec) / 1e9;
+	if(p_stats) *p_stats = *stats;
+	return rc;
+}
+
+
+#if defined(_TEST_UTXO_SNAPSHOT) && defined(_STAND_ALONE)
+/*
+ * amount compression vectors (Bitcoin Core compress_tests), then synthetic snapshots in both formats:
+ * random coins of every script form, some paying to the key set; every chunk size must report
+ * the same matches as the generator planted. Truncated files and wrong coin counts are errors.
+ */
+#include "multisig_to_addrs.h"
+
+static uint64_t s_state = 44;
+static uint32_t next_random(void)
+{
+	s_state = s_state * 6364136223846793005ULL + 1442695040888963407ULL;
+	return (uint32_t)(s_state >> 32);
+}
+
+static uint64_t compress_amount(uint64_t n)
+{
+	if(0 == n) return 0;
+	int e = 0;
+	while(((n % 10) == 0) && e < 9) {
+		n /= 10;
+		++e;
+	}
+	if(e < 9) {
+		int d = n % 10;
+		n /= 10;
+		return 1 + (n * 9 + d - 1) * 10 + e;
+	}
+	return 1 + (n - 1) * 10 + 9;
+}
+
+static void write_varint(FILE * fp, uint64_t n)
+{
+	unsigned char tmp[10];
+	int length = 0;
+	while(1) {
+		tmp[length] = (n & 0x7f) | (length?0x80:0x00);
+		if(n <= 0x7f) break;
+		n = (n >> 7) - 1;
+		++length;
+	}
+	do fputc(tmp[length], fp); while(length--);
+}
+
+static void write_compact_size(FILE * fp, uint64_t n)
+{
+	if(n < 0xfd) {
+		fputc(n, fp);
+	}else {
+		fputc(0xfd, fp);
+		fputc(n & 0xff, fp);
+		fputc(n >> 8, fp);
+	}
+}
+
+#define NUM_KEYS (64)
+#define NUM_MULTISIGS (4)
+#define NUM_TXIDS (5000)
+#define MAX_MATCHES (4096)
+
+struct test_keys
+{
+	struct bitcoin_addrs_record records[NUM_KEYS];
+	struct multisig_record multisigs[NUM_MULTISIGS];
+	utxo_keyset_t * set;
+};
+
+struct test_matches
+{
+	size_t count;
+	struct utxo_match matches[MAX_MATCHES];
+};
+
+static void on_test_match(const struct utxo_match * match, void * user_data)
+{
+	struct test_matches * found = user_data;
+	assert(found->count < MAX_MATCHES);
+	found->matches[found->count++] = *match;
+}
+
+/* one coin, paying to a key of the set every 64th time; planted matches go to 'expected' */
+static void write_coin(FILE * fp, const struct test_keys * keys, const unsigned char txid[static 32], uint32_t vout,
+	uint64_t * p_total, struct test_matches * expected)
+{
+	uint32_t height = 1 + next_random() % 900000;
+	int coinbase = (next_random() % 50) == 0;
+	uint64_t amount = (next_random() % 4)?((uint64_t)next_random() * 1000 % MAX_MONEY):((next_random() % 100) * 100000000ULL);
+	write_varint(fp, height * 2 + coinbase);
+	write_varint(fp, compress_amount(amount));
+
+	int planted = (next_random() % 64) == 0;
+	uint32_t key_index = next_random() % NUM_KEYS;
+	const struct bitcoin_addrs_record * record = &keys->records[key_index];
+	unsigned char random_bytes[100];
+	for(size_t i = 0; i < sizeof(random_bytes); ++i) random_bytes[i] = next_random();
+	const unsigned char * hash = planted?record->hash160:random_bytes;
+
+	int form = next_random() % 9;
+	enum utxo_match_type type = utxo_match_type_p2pkh;
+	uint32_t tag = key_index;
+	unsigned char script[100];
+	switch(form) {
+	case 0:	// p2pkh
+		write_varint(fp, 0);
+		fwrite(hash, 1, 20, fp);
+		break;
+	case 1:	// p2sh: a p2sh-p2wpkh script hash, or a multisig
+		if(planted && (next_random() & 1)) {
+			tag = next_random() % NUM_MULTISIGS;
+			ripemd160_hash(keys->multisigs[tag].script_sha256, 32, script);
+		}else {
+			unsigned char redeem_script[22] = { 0x00, 20 };
+			memcpy(&redeem_script[2], hash, 20);
+			hash160_of(redeem_script, sizeof(redeem_script), script);
+		}
+		write_varint(fp, 1);
+		fwrite(script, 1, 20, fp);
+		type = utxo_match_type_p2sh;
+		break;
+	case 2: case 3:	// p2pk, compressed / uncompressed
+		{
+			const unsigned char * pubkey = planted?record->pubkey:random_bytes;
+			int n = (pubkey[0] & 1) + ((form == 3)?4:2);
+			write_varint(fp, n);
+			fwrite(&pubkey[1], 1, 32, fp);
+			type = (form == 3)?utxo_match_type_p2pk_uncompressed:utxo_match_type_p2pk;
+		}
+		break;
+	case 4:	// p2wpkh
+		script[0] = 0x00;
+		script[1] = 20;
+		memcpy(&script[2], hash, 20);
+		write_varint(fp, 6 + 22);
+		fwrite(script, 1, 22, fp);
+		type = utxo_match_type_p2wpkh;
+		break;
+	case 5:	// p2wsh
+		tag = next_random() % NUM_MULTISIGS;
+		script[0] = 0x00;
+		script[1] = 32;
+		memcpy(&script[2], planted?keys->multisigs[tag].script_sha256:random_bytes, 32);
+		write_varint(fp, 6 + 34);
+		fwrite(script, 1, 34, fp);
+		type = utxo_match_type_p2wsh;
+		break;
+	case 6:	// p2tr: never matched
+		script[0] = 0x51;
+		script[1] = 32;
+		memcpy(&script[2], hash, 32);
+		write_varint(fp, 6 + 34);
+		fwrite(script, 1, 34, fp);
+		planted = 0;
+		break;
+	default:	// other scripts, up to 300 bytes
+		{
+			size_t cb_script = next_random() % 300;
+			write_varint(fp, 6 + cb_script);
+			for(size_t i = 0; i < cb_script; ++i) fputc(next_random(), fp);
+			planted = 0;
+		}
+		break;
+	}
+	++*p_total;
+
+	if(planted) {
+		assert(expected->count < MAX_MATCHES);
+		struct utxo_match * match = &expected->matches[expected->count++];
+		memcpy(match->txid, txid, 32);
+		match->vout = vout;
+		match->height = height;
+		match->coinbase = coinbase;
+		match->amount = amount;
+		match->type = type;
+		match->tag = tag;
+	}
+}
+
+static int compare_txids(const void * a, const void * b)
+{
+	return memcmp(a, b, 32);
+}
+
+/* @return the file size */
+static size_t write_snapshot(const char * path, int grouped, const struct test_keys * keys, int64_t coins_count_delta,
+	struct test_matches * expected)
+{
+	static unsigned char txids[NUM_TXIDS][32];
+	for(int i = 0; i < NUM_TXIDS; ++i) for(int j = 0; j < 32; ++j) txids[i][j] = next_random();
+	qsort(txids, NUM_TXIDS, 32, compare_txids);
+
+	FILE * fp = fopen(path, "w+b");
+	assert(fp);
+	unsigned char blockhash[32] = { 0 };
+	if(grouped) {
+		static const unsigned char network_magic[4] = { 0xf9, 0xbe, 0xb4, 0xd9 };
+		fwrite(SNAPSHOT_MAGIC, 1, 5, fp);
+		fputc(2, fp);
+		fputc(0, fp);
+		fwrite(network_magic, 1, 4, fp);
+	}
+	fwrite(blockhash, 1, 32, fp);
+	long coins_count_offset = ftell(fp);
+	uint64_t coins_count = 0;
+	fwrite(&coins_count, 8, 1, fp);
+
+	expected->count = 0;
+	for(int i = 0; i < NUM_TXIDS; ++i) {
+		uint32_t num_coins = 1 + ((next_random() % 8)?(next_random() % 3):(next_random() % 300));
+		uint32_t vout = next_random() % 4;
+		if(grouped) {
+			fwrite(txids[i], 1, 32, fp);
+			write_compact_size(fp, num_coins);
+		}
+		for(uint32_t k = 0; k < num_coins; ++k, vout += 1 + (next_random() % 3)) {
+			if(grouped) {
+				write_compact_size(fp, vout);
+			}else {
+				fwrite(txids[i], 1, 32, fp);
+				unsigned char le_vout[4] = { vout, vout >> 8, vout >> 16, vout >> 24 };
+				fwrite(le_vout, 1, 4, fp);
+			}
+			write_coin(fp, keys, txids[i], vout, &coins_count, expected);
+		}
+	}
+
+	size_t size = ftell(fp);
+	coins_count += coins_count_delta;
+	fseek(fp, coins_count_offset, SEEK_SET);
+	fwrite(&coins_count, 8, 1, fp);	// little-endian host
+	fclose(fp);
+	return size;
+}
+
+int main(int argc, char ** argv)
+{
+	static const struct { uint64_t amount, compressed; } amounts[] = {
+		{ 0, 0x0 }, { 1, 0x1 }, { 1000000, 0x7 }, { 100000000, 0x9 }, { 5000000000ULL, 0x32 }, { 2100000000000000ULL, 0x1406f40 },
+	};
+	for(size_t i = 0; i < sizeof(amounts) / sizeof(amounts[0]); ++i) {
+		assert(compress_amount(amounts[i].amount) == amounts[i].compressed);
+		assert(decompress_amount(amounts[i].compressed) == amounts[i].amount);
+	}
+	for(uint64_t i = 0; i < 100000; ++i) assert(decompress_amount(compress_amount(i * 997)) == i * 997);
+
+	// key set
+	static struct test_keys keys[1];
+	for(int i = 0; i < NUM_KEYS; ++i) {
+		for(int j = 0; j < 33; ++j) keys->records[i].pubkey[j] = next_random();
+		keys->records[i].pubkey[0] = 0x02 | (keys->records[i].pubkey[1] & 1);
+	}
+	assert(NUM_KEYS == pubkeys_to_addrs_batch(keys->records, NUM_KEYS, 0));
+	for(int i = 0; i < NUM_MULTISIGS; ++i) {
+		struct multisig_record * multisig = &keys->multisigs[i];
+		multisig->m = 2;
+		multisig->n = 3;
+		for(int k = 0; k < 3; ++k) memcpy(multisig->pubkeys[k], keys->records[i * 3 + k].pubkey, 33);
+	}
+	assert(NUM_MULTISIGS == multisigs_to_addrs_batch(keys->multisigs, NUM_MULTISIGS, 0, 0));
+
+	keys->set = utxo_keyset_new(4);	// grows
+	for(int i = 0; i < NUM_KEYS; ++i) utxo_keyset_add_record(keys->set, &keys->records[i], i);
+	for(int i = 0; i < NUM_MULTISIGS; ++i) utxo_keyset_add_multisig(keys->set, &keys->multisigs[i], i);
+	assert(utxo_keyset_get_count(keys->set) == NUM_KEYS * 2 + NUM_MULTISIGS * 3);
+	assert(1 == utxo_keyset_add(keys->set, utxo_key_kind_pubkey_hash, keys->records[5].hash160, 99));
+	uint32_t tag = 0;
+	assert(utxo_keyset_find(keys->set, utxo_key_kind_pubkey_hash, keys->records[5].hash160, &tag) && tag == 5);
+	assert(!utxo_keyset_find(keys->set, utxo_key_kind_script_hash, keys->records[5].hash160, NULL));
+
+	char path[] = "/tmp/test_utxo_snapshot_XXXXXX";
+	int fd = mkstemp(path);
+	assert(fd >= 0);
+	close(fd);
+
+	static struct test_matches expected[1], found[1];
+	thread_pool_t * pool = thread_pool_new(4, 0);
+	for(int grouped = 0; grouped < 2; ++grouped) {
+		size_t size = write_snapshot(path, grouped, keys, 0, expected);
+		assert(expected->count > 100);
+
+		static const size_t chunk_sizes[] = { 0, 65536, 4096, 1000, 97 };
+		for(size_t c = 0; c < sizeof(chunk_sizes) / sizeof(chunk_sizes[0]); ++c) {
+			struct utxo_scan_config config = { .chunk_size = chunk_sizes[c], .pool = pool };
+			struct utxo_scan_stats stats[1];
+			found->count = 0;
+			assert(0 == utxo_snapshot_scan(path, keys->set, &config, on_test_match, found, stats));
+			assert(stats->format_version == (grouped?2:0) && stats->coins == stats->coins_count && stats->bytes == size);
+			assert(stats->matches == expected->count && found->count == expected->count);
+			for(size_t i = 0; i < expected->count; ++i) {
+				const struct utxo_match * a = &found->matches[i], * b = &expected->matches[i];
+				assert(0 == memcmp(a->txid, b->txid, 32) && a->vout == b->vout);
+				assert(a->height == b->height && a->coinbase == b->coinbase && a->amount == b->amount);
+				assert(a->type == b->type && a->tag == b->tag);
+			}
+			printf("%s format, chunk size %zu: %lu coins, %lu matches, %lu chunks (%lu parsed again), %.1f MB/s\n",
+				grouped?"v28":"legacy", chunk_sizes[c], (unsigned long)stats->coins, (unsigned long)stats->matches,
+				(unsigned long)stats->chunks, (unsigned long)stats->reparsed_chunks, size / stats->elapsed / 1e6);
+		}
+
+		// truncated: the last record is incomplete
+		assert(0 == truncate(path, size - 1));
+		assert(-1 == utxo_snapshot_scan(path, keys->set, NULL, NULL, NULL, NULL));
+
+		// the metadata disagrees with the records
+		write_snapshot(path, grouped, keys, 1, expected);
+		struct utxo_scan_config config = { .chunk_size = 4096, .pool = pool };
+		assert(-1 == utxo_snapshot_scan(path, keys->set, &config, NULL, NULL, NULL));
+	}
+	thread_pool_free(pool);
+	unlink(path);
+	utxo_keyset_free(keys->set);
+
+	printf("==== %s: PASSED ====\n", __FILE__);
+	return 0;
+}
+#endif
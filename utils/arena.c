@@ -0,0 +1,340 @@
+/*
+ * arena.c
+ * 
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ * 
+ * The MIT License (MIT)
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to deal 
+ * in the Software without restriction, including without limitation the rights 
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all 
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS 
+ * IN THE SOFTWARE.
+ * 
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "utils.h"
+#include "arena.h"
+
+#define ARENA_ALIGNMENT	(16)
+#define ARENA_DEFAULT_BLOCK_SIZE	(64 * 1024)
+#define ARENA_HUGE_PAGE_SIZE	(2 * 1024 * 1024)
+
+struct arena_block
+{
+	struct arena_block * next;
+	size_t size;	// mapped size, this header included
+	int huge;	// MAP_HUGETLB
+	int padding_;
+};
+#define ARENA_BLOCK_HEADER_SIZE	((sizeof(struct arena_block) + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1))
+
+struct arena
+{
+	unsigned char * ptr;	// bump pointer in the current block
+	unsigned char * end;
+	unsigned char * last;	// most recent allocation, lib_free() of it rolls ptr back
+
+	struct arena_block * first;
+	struct arena_block * current;
+	size_t used_in_prev_blocks;
+	size_t block_size;
+	int flags;
+};
+
+static __thread arena_t * s_thread_arena;
+
+static size_t round_up(size_t size, size_t align)
+{
+	return (size + align - 1) / align * align;
+}
+
+static struct arena_block * block_new(size_t size, int flags)
+{
+	enum huge_pages_mode mode = (flags & ARENA_HUGE_PAGES)?huge_pages_hugetlb:huge_pages_none;
+	size = round_up(size, (mode != huge_pages_none)?ARENA_HUGE_PAGE_SIZE:(size_t)sysconf(_SC_PAGESIZE));	// the whole mapping is usable
+	enum huge_pages_mode obtained = huge_pages_none;
+	struct arena_block * block = page_alloc(size, mode, -1, &obtained);
+	if(NULL == block) return NULL;
+	block->next = NULL;
+	block->size = size;
+	block->huge = (obtained == huge_pages_hugetlb);
+	return block;
+}
+
+static void arena_use_block(arena_t * arena, struct arena_block * block)
+{
+	arena->current = block;
+	arena->ptr = (unsigned char *)block + ARENA_BLOCK_HEADER_SIZE;
+	arena->end = (unsigned char *)block + block->size;
+	arena->last = NULL;
+}
+
+arena_t * arena_new(size_t block_size, int flags)
+{
+	if(0 == block_size) block_size = (flags & ARENA_HUGE_PAGES)?ARENA_HUGE_PAGE_SIZE:ARENA_DEFAULT_BLOCK_SIZE;
+
+	arena_t * arena = calloc(1, sizeof(*arena));
+	if(NULL == arena) return NULL;
+	arena->block_size = block_size;
+	arena->flags = flags;
+
+	arena->first = block_new(block_size, flags);
+	if(NULL == arena->first) {
+		free(arena);
+		return NULL;
+	}
+	arena_use_block(arena, arena->first);
+	return arena;
+}
+
+void arena_free(arena_t * arena)
+{
+	if(NULL == arena) return;
+	if(s_thread_arena == arena) s_thread_arena = NULL;
+
+	struct arena_block * block = arena->first;
+	while(block) {
+		struct arena_block * next = block->next;
+		page_free(block, block->size, (arena->flags & ARENA_HUGE_PAGES)?huge_pages_hugetlb:huge_pages_none);
+		block = next;
+	}
+	free(arena);
+}
+
+/* moves to the next block that can hold size bytes, mapping a new one if needed */
+static void * arena_alloc_slow(arena_t * arena, size_t size)
+{
+	struct arena_block * current = arena->current;
+	arena->used_in_prev_blocks += arena->ptr - ((unsigned char *)current + ARENA_BLOCK_HEADER_SIZE);
+
+	struct arena_block * block = current->next;
+	if(NULL == block || (block->size - ARENA_BLOCK_HEADER_SIZE) < size) {
+		// oversized requests get a block of their own, inserted after the current one
+		size_t block_size = arena->block_size;
+		if(block_size < size + ARENA_BLOCK_HEADER_SIZE) block_size = size + ARENA_BLOCK_HEADER_SIZE;
+		block = block_new(block_size, arena->flags);
+		if(NULL == block) return NULL;
+		block->next = current->next;
+		current->next = block;
+	}
+	arena_use_block(arena, block);
+
+	void * ptr = arena->ptr;
+	arena->last = arena->ptr;
+	arena->ptr += size;
+	return ptr;
+}
+
+void * arena_alloc(arena_t * arena, size_t size)
+{
+	size = round_up(size ? size : 1, ARENA_ALIGNMENT);
+	if(__builtin_expect((size_t)(arena->end - arena->ptr) < size, 0)) return arena_alloc_slow(arena, size);
+
+	void * ptr = arena->ptr;
+	arena->last = arena->ptr;
+	arena->ptr += size;
+	return ptr;
+}
+
+void * arena_calloc(arena_t * arena, size_t count, size_t size)
+{
+	size_t total;
+	if(__builtin_mul_overflow(count, size, &total)) return NULL;
+	void * ptr = arena_alloc(arena, total);
+	if(ptr) memset(ptr, 0, total);
+	return ptr;
+}
+
+void arena_reset(arena_t * arena)
+{
+	arena->used_in_prev_blocks = 0;
+	arena_use_block(arena, arena->first);
+}
+
+int arena_contains(const arena_t * arena, const void * ptr)
+{
+	for(const struct arena_block * block = arena->first; block; block = block->next) {
+		const unsigned char * begin = (const unsigned char *)block;
+		if((const unsigned char *)ptr >= begin && (const unsigned char *)ptr < begin + block->size) return 1;
+	}
+	return 0;
+}
+
+size_t arena_get_used(const arena_t * arena)
+{
+	return arena->used_in_prev_blocks + (arena->ptr - ((unsigned char *)arena->current + ARENA_BLOCK_HEADER_SIZE));
+}
+
+size_t arena_get_capacity(const arena_t * arena)
+{
+	size_t capacity = 0;
+	for(const struct arena_block * block = arena->first; block; block = block->next) capacity += block->size;
+	return capacity;
+}
+
+int arena_is_huge(const arena_t * arena)
+{
+	for(const struct arena_block * block = arena->first; block; block = block->next) {
+		if(!block->huge) return 0;
+	}
+	return 1;
+}
+
+arena_t * arena_attach(arena_t * arena)
+{
+	arena_t * prev = s_thread_arena;
+	s_thread_arena = arena;
+	return prev;
+}
+
+arena_t * arena_get_attached(void)
+{
+	return s_thread_arena;
+}
+
+void * lib_alloc(size_t size)
+{
+	arena_t * arena = s_thread_arena;
+	if(arena) return arena_alloc(arena, size);
+	return malloc(size);
+}
+
+void * lib_calloc(size_t count, size_t size)
+{
+	arena_t * arena = s_thread_arena;
+	if(arena) return arena_calloc(arena, count, size);
+	return calloc(count, size);
+}
+
+void lib_free(void * ptr)
+{
+	if(NULL == ptr) return;
+	arena_t * arena = s_thread_arena;
+	if(arena) {
+		// scratch buffers are usually freed right after use: give the space back
+		if(ptr == arena->last) {
+			arena->ptr = arena->last;
+			arena->last = NULL;
+			return;
+		}
+		if(arena_contains(arena, ptr)) return;
+	}
+	free(ptr);
+}
+
+
+#if defined(_TEST_ARENA) && defined(_STAND_ALONE)
+#include <time.h>
+
+static double elapsed_ms(const struct timespec * begin, const struct timespec * end)
+{
+	return (end->tv_sec - begin->tv_sec) * 1e3 + (end->tv_nsec - begin->tv_nsec) / 1e6;
+}
+
+#define ROUNDS	(1000000)
+int main(int argc, char ** argv)
+{
+	static const int flags_list[] = { 0, ARENA_HUGE_PAGES };
+	for(size_t f = 0; f < sizeof(flags_list) / sizeof(flags_list[0]); ++f) {
+		arena_t * arena = arena_new(4096, flags_list[f]);
+		assert(arena);
+
+		// alignment, disjoint allocations, block chaining
+		unsigned char * prev = NULL;
+		for(size_t i = 1; i < 1000; ++i) {
+			unsigned char * p = arena_alloc(arena, i);
+			assert(p && ((uintptr_t)p % ARENA_ALIGNMENT) == 0);
+			assert(arena_contains(arena, p) && arena_contains(arena, p + i - 1));
+			memset(p, (int)i, i);
+			if(prev) assert(prev[0] == (unsigned char)(i - 1));
+			prev = p;
+		}
+		size_t used = arena_get_used(arena);
+		size_t capacity = arena_get_capacity(arena);
+		assert(used >= 999 * 1000 / 2 && capacity >= used);
+
+		// oversized allocation
+		unsigned char * big = arena_calloc(arena, 1, capacity * 2);
+		assert(big && big[0] == 0 && big[capacity * 2 - 1] == 0);
+
+		// reset: O(1), the blocks are reused, nothing new is mapped
+		capacity = arena_get_capacity(arena);
+		arena_reset(arena);
+		assert(arena_get_used(arena) == 0);
+		for(size_t i = 1; i < 1000; ++i) assert(arena_alloc(arena, i));
+		assert(arena_get_capacity(arena) == capacity);
+
+		int dummy;
+		assert(!arena_contains(arena, &dummy));
+
+		// thread arena hooks
+		arena_reset(arena);
+		assert(NULL == arena_attach(arena));
+		assert(arena_get_attached() == arena);
+		char * s = lib_calloc(1, 100);
+		assert(arena_contains(arena, s) && s[99] == 0);
+		size_t before = arena_get_used(arena);
+		void * scratch = lib_alloc(64);
+		lib_free(scratch);	// last allocation: rolled back
+		assert(arena_get_used(arena) == before);
+		lib_free(s);	// not the last one: kept until reset
+		assert(arena_get_used(arena) == before);
+		assert(arena_attach(NULL) == arena);
+
+		void * heap = lib_alloc(32);
+		assert(heap && !arena_contains(arena, heap));
+		lib_free(heap);
+
+		// malloc / free vs. arena, base58 scratch pattern
+		struct timespec begin, end;
+		clock_gettime(CLOCK_MONOTONIC, &begin);
+		for(int i = 0; i < ROUNDS; ++i) {
+			void * out = lib_calloc(1, 48);
+			void * tmp = lib_calloc(1, 35);
+			lib_free(tmp);
+			lib_free(out);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		double malloc_ms = elapsed_ms(&begin, &end);
+
+		arena_attach(arena);
+		clock_gettime(CLOCK_MONOTONIC, &begin);
+		for(int i = 0; i < ROUNDS; ++i) {
+			void * out = lib_calloc(1, 48);
+			void * tmp = lib_calloc(1, 35);
+			lib_free(tmp);
+			(void)out;
+			if((i % 1024) == 1023) arena_reset(arena);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		arena_attach(NULL);
+
+		printf("flags=%d (huge pages: %s): ok, %d rounds: malloc %.3f ms, arena %.3f ms\n",
+			flags_list[f], arena_is_huge(arena)?"yes":"no",
+			ROUNDS, malloc_ms, elapsed_ms(&begin, &end));
+		arena_free(arena);
+	}
+	return 0;
+}
+#endif
@@ -0,0 +1,52 @@
+#ifndef BITCOIN_ADDRS_ARENA_H_
+#define BITCOIN_ADDRS_ARENA_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Bump arena:
+ *   allocations are carved out of mmap'd blocks and never freed one by one;
+ *   arena_reset() releases everything at once in O(1), the blocks are kept for reuse.
+ *   Not thread-safe: one arena per thread.
+**/
+
+enum arena_flags
+{
+	ARENA_HUGE_PAGES = 1,	// 2MB pages (MAP_HUGETLB, else transparent huge pages via madvise)
+};
+
+typedef struct arena arena_t;
+arena_t * arena_new(size_t block_size, int flags);	// block_size 0: 64KB (2MB with ARENA_HUGE_PAGES)
+void arena_free(arena_t * arena);
+
+void * arena_alloc(arena_t * arena, size_t size);	// 16-byte aligned, not initialized
+void * arena_calloc(arena_t * arena, size_t count, size_t size);
+void arena_reset(arena_t * arena);
+int arena_contains(const arena_t * arena, const void * ptr);
+
+size_t arena_get_used(const arena_t * arena);	// bytes allocated since the last reset
+size_t arena_get_capacity(const arena_t * arena);	// bytes mapped
+int arena_is_huge(const arena_t * arena);	// 1 if every block got MAP_HUGETLB pages
+
+/**
+ * thread arena:
+ *   library allocations (base58 scratch and outputs, hex2bin / bin2hex outputs, generated addresses)
+ *   go through lib_alloc() / lib_calloc() / lib_free(). While an arena is attached to the calling thread
+ *   they are served from it: library-allocated outputs then live until the owner resets the arena and
+ *   must not be passed to free(). Without an arena they fall back to malloc / free.
+**/
+arena_t * arena_attach(arena_t * arena);	// @return the previously attached arena, NULL detaches
+arena_t * arena_get_attached(void);
+
+void * lib_alloc(size_t size);
+void * lib_calloc(size_t count, size_t size);
+void lib_free(void * ptr);	// no-op for memory of the attached arena
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,681 @@
+/*
+ * thread_pool.c
+ * 
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ * 
+ * The MIT License (MIT)
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to deal 
+ * in the Software without restriction, including without limitation the rights 
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all 
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS 
+ * IN THE SOFTWARE.
+ * 
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+#include "utils.h"
+#include "thread_pool.h"
+
+#define POOL_CACHELINE_SIZE	(64)
+#define POOL_DEQUE_INITIAL_SIZE	(256)
+#define POOL_CHUNKS_PER_WORKER	(8)
+#define POOL_SPIN_ROUNDS	(64)
+#define POOL_MAX_CPUS	(4096)
+
+#define relaxed_load(p) __atomic_load_n(p, __ATOMIC_RELAXED)
+#define relaxed_store(p, value) __atomic_store_n(p, value, __ATOMIC_RELAXED)
+
+struct pool_worker;
+struct parallel_loop
+{
+	thread_pool_range_func func;
+	void * user_data;
+	size_t grain;
+	size_t remaining;	// items not yet processed; the loop is done at 0
+};
+
+struct pool_task
+{
+	struct pool_task * next;	// injection queue link
+	struct parallel_loop * loop;	// NULL: plain task
+	union {
+		struct {
+			thread_pool_task_func func;
+			void * user_data;
+		};
+		struct {
+			size_t begin;
+			size_t end;
+		};
+	};
+};
+
+/******************************************************************************
+ * Chase-Lev deque
+ *   Le, Pop, Cohen, Zappa Nardelli: "Correct and Efficient Work-Stealing for Weak Memory Models"
+ *   the owner pushes / takes at the bottom, thieves steal at the top.
+ *   grown arrays are kept until the pool is freed (a thief may still read the old one).
+******************************************************************************/
+struct deque_array
+{
+	struct deque_array * retired;
+	int64_t size;	// power of 2
+	struct pool_task * items[];
+};
+
+struct pool_deque
+{
+	int64_t top __attribute__((aligned(POOL_CACHELINE_SIZE)));
+	int64_t bottom __attribute__((aligned(POOL_CACHELINE_SIZE)));
+	struct deque_array * array;
+};
+
+#define DEQUE_EMPTY	((struct pool_task *)NULL)
+#define DEQUE_ABORT	((struct pool_task *)(intptr_t)-1)
+
+static struct deque_array * deque_array_new(int64_t size)
+{
+	struct deque_array * array = calloc(1, sizeof(*array) + size * sizeof(array->items[0]));
+	assert(array);
+	array->size = size;
+	return array;
+}
+
+static void deque_init(struct pool_deque * deque)
+{
+	deque->top = 0;
+	deque->bottom = 0;
+	deque->array = deque_array_new(POOL_DEQUE_INITIAL_SIZE);
+}
+
+static void deque_cleanup(struct pool_deque * deque)
+{
+	struct deque_array * array = deque->array;
+	while(array) {
+		struct deque_array * retired = array->retired;
+		free(array);
+		array = retired;
+	}
+	deque->array = NULL;
+}
+
+static struct deque_array * deque_grow(struct pool_deque * deque, struct deque_array * array, int64_t top, int64_t bottom)
+{
+	struct deque_array * new_array = deque_array_new(array->size * 2);
+	for(int64_t i = top; i < bottom; ++i) {
+		new_array->items[i & (new_array->size - 1)] = relaxed_load(&array->items[i & (array->size - 1)]);
+	}
+	new_array->retired = array;
+	__atomic_store_n(&deque->array, new_array, __ATOMIC_RELEASE);
+	return new_array;
+}
+
+static void deque_push(struct pool_deque * deque, struct pool_task * task)
+{
+	int64_t bottom = relaxed_load(&deque->bottom);
+	int64_t top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+	struct deque_array * array = relaxed_load(&deque->array);
+	if((bottom - top) > (array->size - 1)) array = deque_grow(deque, array, top, bottom);
+
+	relaxed_store(&array->items[bottom & (array->size - 1)], task);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	relaxed_store(&deque->bottom, bottom + 1);
+}
+
+static struct pool_task * deque_take(struct pool_deque * deque)
+{
+	int64_t bottom = relaxed_load(&deque->bottom) - 1;
+	struct deque_array * array = relaxed_load(&deque->array);
+	relaxed_store(&deque->bottom, bottom);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	int64_t top = relaxed_load(&deque->top);
+
+	if(top > bottom) {	// empty
+		relaxed_store(&deque->bottom, bottom + 1);
+		return DEQUE_EMPTY;
+	}
+
+	struct pool_task * task = relaxed_load(&array->items[bottom & (array->size - 1)]);
+	if(top == bottom) {	// last item: race against thieves
+		if(!__atomic_compare_exchange_n(&deque->top, &top, top + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) task = DEQUE_EMPTY;
+		relaxed_store(&deque->bottom, bottom + 1);
+	}
+	return task;
+}
+
+static struct pool_task * deque_steal(struct pool_deque * deque)
+{
+	int64_t top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	int64_t bottom = __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE);
+	if(top >= bottom) return DEQUE_EMPTY;
+
+	struct deque_array * array = __atomic_load_n(&deque->array, __ATOMIC_ACQUIRE);
+	struct pool_task * task = relaxed_load(&array->items[top & (array->size - 1)]);
+	if(!__atomic_compare_exchange_n(&deque->top, &top, top + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) return DEQUE_ABORT;
+	return task;
+}
+
+/******************************************************************************
+ * pool
+******************************************************************************/
+struct pool_worker
+{
+	thread_pool_t * pool;
+	pthread_t th;
+	int index;
+	int cpu;	// -1: not pinned
+	int node;
+
+	struct pool_deque deque;
+
+	// tasks submitted from outside the pool
+	pthread_mutex_t inject_mutex;
+	struct pool_task * inject_head;
+	struct pool_task * inject_tail;
+	int64_t inject_count;
+
+	// steal order: workers on the same node first
+	int * victims;
+	int num_local_victims;
+	int num_victims;
+	uint64_t rng;
+}__attribute__((aligned(POOL_CACHELINE_SIZE)));
+
+struct thread_pool
+{
+	int num_workers;
+	int num_nodes;
+	int flags;
+	struct pool_worker * workers;
+
+	uint32_t epoch __attribute__((aligned(POOL_CACHELINE_SIZE)));	// futex word, bumped on new work
+	int sleepers;
+	int quit;
+	uint32_t next_inject __attribute__((aligned(POOL_CACHELINE_SIZE)));
+};
+
+static __thread struct pool_worker * s_current_worker;
+
+static inline void cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#endif
+}
+
+static inline void futex_wait(uint32_t * addr, uint32_t value)
+{
+	syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, value, NULL, NULL, 0);
+}
+
+static inline void futex_wake(uint32_t * addr, int count)
+{
+	syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+}
+
+static inline uint64_t xorshift64(uint64_t * state)
+{
+	uint64_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	return (*state = x);
+}
+
+static inline struct pool_worker * current_worker(thread_pool_t * pool)
+{
+	struct pool_worker * worker = s_current_worker;
+	return (worker && worker->pool == pool)?worker:NULL;
+}
+
+/* wake one sleeping worker, if any; pairs with the sleepers increment in worker_thread() */
+static inline void pool_notify(thread_pool_t * pool)
+{
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if(relaxed_load(&pool->sleepers) > 0) {
+		__atomic_add_fetch(&pool->epoch, 1, __ATOMIC_SEQ_CST);
+		futex_wake(&pool->epoch, 1);
+	}
+}
+
+static void inject_task(thread_pool_t * pool, struct pool_task * task)
+{
+	uint32_t index = __atomic_fetch_add(&pool->next_inject, 1, __ATOMIC_RELAXED) % pool->num_workers;
+	struct pool_worker * worker = &pool->workers[index];
+	task->next = NULL;
+
+	pthread_mutex_lock(&worker->inject_mutex);
+	if(worker->inject_tail) worker->inject_tail->next = task;
+	else worker->inject_head = task;
+	worker->inject_tail = task;
+	relaxed_store(&worker->inject_count, worker->inject_count + 1);
+	pthread_mutex_unlock(&worker->inject_mutex);
+}
+
+static void push_task(thread_pool_t * pool, struct pool_worker * worker, struct pool_task * task)
+{
+	if(worker) deque_push(&worker->deque, task);
+	else inject_task(pool, task);
+	pool_notify(pool);
+}
+
+static struct pool_task * pop_injected(struct pool_worker * victim)
+{
+	if(0 == relaxed_load(&victim->inject_count)) return NULL;
+	pthread_mutex_lock(&victim->inject_mutex);
+	struct pool_task * task = victim->inject_head;
+	if(task) {
+		victim->inject_head = task->next;
+		if(NULL == victim->inject_head) victim->inject_tail = NULL;
+		relaxed_store(&victim->inject_count, victim->inject_count - 1);
+	}
+	pthread_mutex_unlock(&victim->inject_mutex);
+	return task;
+}
+
+static struct pool_task * steal_from(struct pool_worker * victim)
+{
+	while(1) {
+		struct pool_task * task = deque_steal(&victim->deque);
+		if(task != DEQUE_ABORT) return task;
+		cpu_relax();
+	}
+}
+
+static struct pool_task * find_task(thread_pool_t * pool, struct pool_worker * self)
+{
+	struct pool_task * task = NULL;
+	if(self) {
+		task = deque_take(&self->deque);
+		if(task) return task;
+		task = pop_injected(self);
+		if(task) return task;
+
+		// same node first, then remote nodes, each group from a random start
+		uint64_t r = xorshift64(&self->rng);
+		int num_local = self->num_local_victims;
+		int num_remote = self->num_victims - num_local;
+		for(int i = 0; i < num_local; ++i) {
+			struct pool_worker * victim = &pool->workers[self->victims[(r + i) % num_local]];
+			if((task = steal_from(victim)) || (task = pop_injected(victim))) return task;
+		}
+		for(int i = 0; i < num_remote; ++i) {
+			struct pool_worker * victim = &pool->workers[self->victims[num_local + (r + i) % num_remote]];
+			if((task = steal_from(victim)) || (task = pop_injected(victim))) return task;
+		}
+		return NULL;
+	}
+
+	// external helper (a thread waiting in parallel_for)
+	int start = relaxed_load(&pool->next_inject) % pool->num_workers;
+	for(int i = 0; i < pool->num_workers; ++i) {
+		struct pool_worker * victim = &pool->workers[(start + i) % pool->num_workers];
+		if((task = steal_from(victim)) || (task = pop_injected(victim))) return task;
+	}
+	return NULL;
+}
+
+/* runs [begin, end) of the loop, handing the upper halves out to thieves while above the grain */
+static void run_range(thread_pool_t * pool, struct pool_worker * worker, struct parallel_loop * loop, size_t begin, size_t end)
+{
+	while((end - begin) > loop->grain) {
+		size_t mid = begin + (end - begin) / 2;
+		struct pool_task * task = malloc(sizeof(*task));
+		assert(task);
+		task->loop = loop;
+		task->begin = mid;
+		task->end = end;
+		push_task(pool, worker, task);
+		end = mid;
+	}
+	loop->func(begin, end, loop->user_data);
+	__atomic_sub_fetch(&loop->remaining, end - begin, __ATOMIC_ACQ_REL);	// last access to loop
+}
+
+static void run_task(thread_pool_t * pool, struct pool_worker * worker, struct pool_task * task)
+{
+	if(task->loop) run_range(pool, worker, task->loop, task->begin, task->end);
+	else task->func(task->user_data);
+	free(task);
+}
+
+static void * worker_thread(void * user_data)
+{
+	struct pool_worker * worker = user_data;
+	thread_pool_t * pool = worker->pool;
+	s_current_worker = worker;
+
+	if(worker->cpu >= 0) {
+		cpu_set_t cpuset;
+		CPU_ZERO(&cpuset);
+		CPU_SET(worker->cpu, &cpuset);
+		pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset);
+	}
+
+	while(1) {
+		struct pool_task * task = NULL;
+		for(int i = 0; i < POOL_SPIN_ROUNDS && NULL == task; ++i) {
+			task = find_task(pool, worker);
+			if(NULL == task) cpu_relax();
+		}
+		if(task) {
+			run_task(pool, worker, task);
+			continue;
+		}
+
+		// sleep: announce, re-check, then wait for an epoch change
+		uint32_t epoch = __atomic_load_n(&pool->epoch, __ATOMIC_ACQUIRE);
+		__atomic_add_fetch(&pool->sleepers, 1, __ATOMIC_SEQ_CST);
+		task = find_task(pool, worker);
+		if(NULL == task) {
+			if(__atomic_load_n(&pool->quit, __ATOMIC_ACQUIRE)) {
+				__atomic_sub_fetch(&pool->sleepers, 1, __ATOMIC_SEQ_CST);
+				break;
+			}
+			futex_wait(&pool->epoch, epoch);
+		}
+		__atomic_sub_fetch(&pool->sleepers, 1, __ATOMIC_SEQ_CST);
+		if(task) run_task(pool, worker, task);
+	}
+	s_current_worker = NULL;
+	return NULL;
+}
+
+/******************************************************************************
+ * public API
+******************************************************************************/
+thread_pool_t * thread_pool_new(int num_workers, int flags)
+{
+	int * cpus = calloc(POOL_MAX_CPUS, sizeof(*cpus));
+	int * cpu_nodes = calloc(POOL_MAX_CPUS, sizeof(*cpu_nodes));
+	assert(cpus && cpu_nodes);
+	int num_nodes = 1;
+	int num_cpus = get_cpu_topology(cpus, cpu_nodes, POOL_MAX_CPUS, &num_nodes);
+
+	if(num_workers <= 0) num_workers = num_cpus;
+	if(num_workers <= 0) num_workers = 1;
+	if(num_workers > THREAD_POOL_MAX_WORKERS) num_workers = THREAD_POOL_MAX_WORKERS;
+	int pin_workers = (flags & THREAD_POOL_PIN_WORKERS) && num_cpus > 0;
+
+	thread_pool_t * pool = aligned_alloc(POOL_CACHELINE_SIZE, sizeof(*pool));	// cache-line aligned members
+	assert(pool);
+	memset(pool, 0, sizeof(*pool));
+	pool->num_workers = num_workers;
+	pool->num_nodes = pin_workers?num_nodes:1;
+	pool->flags = flags;
+
+	pool->workers = aligned_alloc(POOL_CACHELINE_SIZE, sizeof(*pool->workers) * num_workers);
+	assert(pool->workers);
+	memset(pool->workers, 0, sizeof(*pool->workers) * num_workers);
+	for(int i = 0; i < num_workers; ++i) {
+		struct pool_worker * worker = &pool->workers[i];
+		worker->pool = pool;
+		worker->index = i;
+		worker->cpu = pin_workers?cpus[i % num_cpus]:-1;
+		worker->node = pin_workers?cpu_nodes[i % num_cpus]:0;
+		worker->rng = 0x9e3779b97f4a7c15ULL * (i + 1);
+		deque_init(&worker->deque);
+		pthread_mutex_init(&worker->inject_mutex, NULL);
+	}
+
+	for(int i = 0; i < num_workers; ++i) {
+		struct pool_worker * worker = &pool->workers[i];
+		worker->victims = calloc(num_workers, sizeof(*worker->victims));
+		assert(worker->victims);
+		for(int j = 0; j < num_workers; ++j) {
+			if(j != i && pool->workers[j].node == worker->node) worker->victims[worker->num_victims++] = j;
+		}
+		worker->num_local_victims = worker->num_victims;
+		for(int j = 0; j < num_workers; ++j) {
+			if(pool->workers[j].node != worker->node) worker->victims[worker->num_victims++] = j;
+		}
+	}
+
+	for(int i = 0; i < num_workers; ++i) {
+		int rc = pthread_create(&pool->workers[i].th, NULL, worker_thread, &pool->workers[i]);
+		assert(0 == rc);
+	}
+	free(cpus);
+	free(cpu_nodes);
+	return pool;
+}
+
+void thread_pool_free(thread_pool_t * pool)
+{
+	if(NULL == pool) return;
+	__atomic_store_n(&pool->quit, 1, __ATOMIC_RELEASE);
+	__atomic_add_fetch(&pool->epoch, 1, __ATOMIC_SEQ_CST);
+	futex_wake(&pool->epoch, INT_MAX);
+
+	for(int i = 0; i < pool->num_workers; ++i) pthread_join(pool->workers[i].th, NULL);
+	for(int i = 0; i < pool->num_workers; ++i) {
+		struct pool_worker * worker = &pool->workers[i];
+		struct pool_task * task;
+		while((task = pop_injected(worker))) {	// raced with the shutdown
+			assert(NULL == task->loop);
+			task->func(task->user_data);
+			free(task);
+		}
+		deque_cleanup(&worker->deque);
+		pthread_mutex_destroy(&worker->inject_mutex);
+		free(worker->victims);
+	}
+	free(pool->workers);
+	free(pool);
+}
+
+int thread_pool_get_num_workers(const thread_pool_t * pool)
+{
+	assert(pool);
+	return pool->num_workers;
+}
+
+int thread_pool_get_num_nodes(const thread_pool_t * pool)
+{
+	assert(pool);
+	return pool->num_nodes;
+}
+
+static thread_pool_t * s_default_pool;
+static pthread_once_t s_default_pool_once = PTHREAD_ONCE_INIT;
+static void init_default_pool(void)
+{
+	const char * threads = getenv("BITCOIN_ADDRS_THREADS");
+	s_default_pool = thread_pool_new(threads?atoi(threads):0, 0);
+}
+
+thread_pool_t * thread_pool_default(void)
+{
+	pthread_once(&s_default_pool_once, init_default_pool);
+	return s_default_pool;
+}
+
+int thread_pool_submit(thread_pool_t * pool, thread_pool_task_func func, void * user_data)
+{
+	assert(pool && func);
+	if(__atomic_load_n(&pool->quit, __ATOMIC_ACQUIRE)) return -1;
+
+	struct pool_task * task = malloc(sizeof(*task));
+	assert(task);
+	task->loop = NULL;
+	task->func = func;
+	task->user_data = user_data;
+	push_task(pool, current_worker(pool), task);
+	return 0;
+}
+
+void thread_pool_parallel_for(thread_pool_t * pool, size_t begin, size_t end, size_t grain,
+	thread_pool_range_func func, void * user_data)
+{
+	assert(pool && func);
+	if(end <= begin) return;
+	size_t count = end - begin;
+	if(0 == grain) grain = count / ((size_t)pool->num_workers * POOL_CHUNKS_PER_WORKER);
+	if(0 == grain) grain = 1;
+	if(count <= grain) {
+		func(begin, end, user_data);
+		return;
+	}
+
+	struct parallel_loop loop = {
+		.func = func,
+		.user_data = user_data,
+		.grain = grain,
+		.remaining = count,
+	};
+	struct pool_worker * worker = current_worker(pool);
+	run_range(pool, worker, &loop, begin, end);
+
+	// help until every sub-range is done (sub-ranges may be running elsewhere)
+	while(__atomic_load_n(&loop.remaining, __ATOMIC_ACQUIRE) > 0) {
+		struct pool_task * task = find_task(pool, worker);
+		if(task) run_task(pool, worker, task);
+		else sched_yield();
+	}
+}
+
+#if defined(_TEST_THREAD_POOL) && defined(_STAND_ALONE)
+/*
+ * every index of a parallel_for must be visited exactly once, whatever the grain,
+ * with nested loops, concurrent external callers and fire-and-forget tasks
+ */
+#include <time.h>
+
+static void mark_range(size_t begin, size_t end, void * user_data)
+{
+	uint8_t * visited = user_data;
+	for(size_t i = begin; i < end; ++i) __atomic_add_fetch(&visited[i], 1, __ATOMIC_RELAXED);
+}
+
+static void check_visited(const uint8_t * visited, size_t count)
+{
+	for(size_t i = 0; i < count; ++i) assert(visited[i] == 1);
+}
+
+struct nested_context
+{
+	thread_pool_t * pool;
+	uint8_t * visited;	// NUM_OUTER x NUM_INNER
+};
+#define NUM_OUTER	(64)
+#define NUM_INNER	(1000)
+
+static void nested_outer(size_t begin, size_t end, void * user_data)
+{
+	struct nested_context * ctx = user_data;
+	for(size_t i = begin; i < end; ++i) {
+		thread_pool_parallel_for(ctx->pool, 0, NUM_INNER, 7, mark_range, ctx->visited + i * NUM_INNER);
+	}
+}
+
+static int64_t s_num_tasks;
+static void count_task(void * user_data)
+{
+	__atomic_add_fetch(&s_num_tasks, (intptr_t)user_data, __ATOMIC_RELAXED);
+}
+
+struct caller_context
+{
+	thread_pool_t * pool;
+	uint8_t * visited;
+	size_t count;
+};
+
+static void * external_caller(void * user_data)
+{
+	struct caller_context * ctx = user_data;
+	thread_pool_parallel_for(ctx->pool, 0, ctx->count, 0, mark_range, ctx->visited);
+	return NULL;
+}
+
+int main(int argc, char ** argv)
+{
+	static const int num_workers_list[] = { 1, 3, 8, 0 };
+	for(size_t w = 0; w < sizeof(num_workers_list) / sizeof(num_workers_list[0]); ++w) {
+		thread_pool_t * pool = thread_pool_new(num_workers_list[w], THREAD_POOL_PIN_WORKERS);
+		int num_workers = thread_pool_get_num_workers(pool);
+
+		// ranges x grains
+		static const size_t counts[] = { 1, 2, 17, 1000, 100000 };
+		static const size_t grains[] = { 0, 1, 3, 64, 1000000 };
+		for(size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); ++c) {
+			for(size_t g = 0; g < sizeof(grains) / sizeof(grains[0]); ++g) {
+				uint8_t * visited = calloc(counts[c] + 10, 1);
+				assert(visited);
+				thread_pool_parallel_for(pool, 10, counts[c] + 10, grains[g], mark_range, visited);
+				for(size_t i = 0; i < 10; ++i) assert(visited[i] == 0);
+				check_visited(visited + 10, counts[c]);
+				free(visited);
+			}
+		}
+
+		// nested loops from pool tasks
+		struct nested_context nested = { .pool = pool, .visited = calloc(NUM_OUTER * NUM_INNER, 1) };
+		assert(nested.visited);
+		thread_pool_parallel_for(pool, 0, NUM_OUTER, 1, nested_outer, &nested);
+		check_visited(nested.visited, NUM_OUTER * NUM_INNER);
+		free(nested.visited);
+
+		// concurrent external callers
+		#define NUM_CALLERS (4)
+		pthread_t threads[NUM_CALLERS];
+		struct caller_context callers[NUM_CALLERS];
+		for(int i = 0; i < NUM_CALLERS; ++i) {
+			callers[i] = (struct caller_context){ .pool = pool, .count = 50000 + i, .visited = calloc(50000 + i, 1) };
+			int rc = pthread_create(&threads[i], NULL, external_caller, &callers[i]);
+			assert(0 == rc);
+		}
+		for(int i = 0; i < NUM_CALLERS; ++i) {
+			pthread_join(threads[i], NULL);
+			check_visited(callers[i].visited, callers[i].count);
+			free(callers[i].visited);
+		}
+
+		// fire-and-forget tasks complete before free() returns
+		s_num_tasks = 0;
+		for(int i = 0; i < 10000; ++i) {
+			int rc = thread_pool_submit(pool, count_task, (void *)(intptr_t)1);
+			assert(0 == rc);
+		}
+		struct timespec begin, end;
+		clock_gettime(CLOCK_MONOTONIC, &begin);
+		thread_pool_free(pool);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		assert(s_num_tasks == 10000);
+		printf("workers=%-3d: ok (free: %.3f ms)\n", num_workers,
+			(end.tv_sec - begin.tv_sec) * 1e3 + (end.tv_nsec - begin.tv_nsec) / 1e6);
+	}
+
+	thread_pool_t * pool = thread_pool_default();
+	assert(pool);
+	printf("default pool: workers=%d, nodes=%d\n", thread_pool_get_num_workers(pool), thread_pool_get_num_nodes(pool));
+	return 0;
+}
+#endif
@@ -0,0 +1,60 @@
+#ifndef BITCOIN_ADDRS_THREAD_POOL_H_
+#define BITCOIN_ADDRS_THREAD_POOL_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Work-stealing thread pool:
+ *   every worker owns a Chase-Lev deque (push / pop at the bottom, thieves steal from the top),
+ *   tasks submitted from outside the pool go to per-worker injection queues (round-robin),
+ *   idle workers sleep on a futex; there is no pool-wide lock.
+ *
+ *   with THREAD_POOL_PIN_WORKERS, workers are pinned to the allowed cpus node by node
+ *   (/sys/devices/system/node), and steal from workers on their own node first.
+**/
+
+#define THREAD_POOL_MAX_WORKERS	(1024)
+
+enum thread_pool_flags
+{
+	THREAD_POOL_PIN_WORKERS = 1,
+};
+
+typedef struct thread_pool thread_pool_t;
+typedef void (* thread_pool_task_func)(void * user_data);
+typedef void (* thread_pool_range_func)(size_t begin, size_t end, void * user_data);
+
+/* num_workers <= 0: number of allowed cpus */
+thread_pool_t * thread_pool_new(int num_workers, int flags);
+void thread_pool_free(thread_pool_t * pool);	// runs every queued task, then joins the workers
+int thread_pool_get_num_workers(const thread_pool_t * pool);
+int thread_pool_get_num_nodes(const thread_pool_t * pool);
+
+/**
+ * thread_pool_default()
+ *   the process-wide pool shared by the library entry points,
+ *   created on first use (size: BITCOIN_ADDRS_THREADS env var, or the number of allowed cpus)
+**/
+thread_pool_t * thread_pool_default(void);
+
+/* fire and forget; @return 0 on success, -1 if the pool is shutting down */
+int thread_pool_submit(thread_pool_t * pool, thread_pool_task_func func, void * user_data);
+
+/**
+ * thread_pool_parallel_for()
+ *   calls func on disjoint sub-ranges covering [begin, end) and returns when all of them are done.
+ *   Ranges are split lazily (halving) down to grain items; idle workers steal the other halves.
+ *   The calling thread takes part in the work, so nested calls from pool tasks are fine.
+ * @param grain 0: automatic (about 8 chunks per worker)
+**/
+void thread_pool_parallel_for(thread_pool_t * pool, size_t begin, size_t end, size_t grain,
+	thread_pool_range_func func, void * user_data);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -32,8 +32,14 @@
 #include <assert.h>
 #include <errno.h>
 #include <stdint.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <linux/mempolicy.h>
 
 #include "utils.h"
+#include "arena.h"
 
 static const char s_hex_digits[256 * 2 + 1] = 
 	"00" "01" "02" "03" "04" "05" "06" "07"    "08" "09" "0a" "0b" "0c" "0d" "0e" "0f" 
@@ -92,7 +98,7 @@ ssize_t bin2hex(const void * data, size_t length, char ** p_hex)
 	char * hex = *p_hex;
 	if(NULL == hex)
 	{
-		hex = malloc(size + 1);
+		hex = lib_alloc(size + 1);
 		if(NULL == hex) return -1;
 		hex[size] = '\0';
 		*p_hex = hex;
@@ -116,7 +122,7 @@ ssize_t hex2bin(const char * hex, size_t length, void ** p_data)
 	unsigned char * data = * p_data;
 	if(NULL == data)
 	{
-		data = malloc(size);
+		data = lib_alloc(size);
 		assert(data);
 		if(NULL == data) return -1;
 	}
@@ -132,6 +138,176 @@ ssize_t hex2bin(const char * hex, size_t length, void ** p_data)
 	*p_data = data;
 	return size;
 label_err:
-	if(NULL == *p_data) free(data);
+	if(NULL == *p_data) lib_free(data);
 	return -1;
 }
+
+void dump(const void * data, size_t length)
+{
+	const unsigned char * p = data;
+	for(size_t i = 0; i < length; ++i) printf("%.2x", p[i]);
+}
+
+static app_timer_t s_app_timer[1];
+double app_timer_start(app_timer_t * timer)
+{
+	if(NULL == timer) timer = s_app_timer;
+	clock_gettime(CLOCK_MONOTONIC, &timer->begin);
+	return (double)timer->begin.tv_sec + (double)timer->begin.tv_nsec / 1000000000.0;
+}
+
+double app_timer_stop(app_timer_t * timer)
+{
+	if(NULL == timer) timer = s_app_timer;
+	clock_gettime(CLOCK_MONOTONIC, &timer->end);
+	return (double)(timer->end.tv_sec - timer->begin.tv_sec) 
+		+ (double)(timer->end.tv_nsec - timer->begin.tv_nsec) / 1000000000.0;
+}
+
+/* parses a sysfs cpulist ("0-3,8-11") into node_of[cpu] */
+static void parse_cpulist(const char * list, int node, int * node_of, int max_cpus)
+{
+	const char * p = list;
+	while(*p) {
+		char * end = NULL;
+		long first = strtol(p, &end, 10);
+		if(end == p) break;
+		long last = first;
+		p = end;
+		if(*p == '-') {
+			last = strtol(p + 1, &end, 10);
+			p = end;
+		}
+		for(long cpu = first; cpu <= last && cpu < max_cpus; ++cpu) if(cpu >= 0) node_of[cpu] = node;
+		if(*p != ',') break;
+		++p;
+	}
+}
+
+int get_cpu_topology(int * cpus, int * cpu_nodes, int max_cpus, int * p_num_nodes)
+{
+	if(max_cpus > CPU_SETSIZE) max_cpus = CPU_SETSIZE;
+	int * node_of = calloc(max_cpus, sizeof(*node_of));
+	assert(node_of);
+
+	int num_nodes = 0;
+	for(int node = 0; node < max_cpus; ++node) {
+		char path[100];
+		snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+		FILE * fp = fopen(path, "r");
+		if(NULL == fp) break;
+		char list[4096] = "";
+		if(fgets(list, sizeof(list), fp)) parse_cpulist(list, node, node_of, max_cpus);
+		fclose(fp);
+		num_nodes = node + 1;
+	}
+	if(num_nodes <= 0) num_nodes = 1;
+	if(p_num_nodes) *p_num_nodes = num_nodes;
+
+	cpu_set_t allowed;
+	CPU_ZERO(&allowed);
+	int num_cpus = 0;
+	if(sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+		for(int node = 0; node < num_nodes; ++node) {
+			for(int cpu = 0; cpu < max_cpus; ++cpu) {
+				if(!CPU_ISSET(cpu, &allowed) || node_of[cpu] != node) continue;
+				cpus[num_cpus] = cpu;
+				cpu_nodes[num_cpus] = node;
+				++num_cpus;
+			}
+		}
+	}
+	free(node_of);
+	return num_cpus;
+}
+
+int numa_bind_memory(void * addr, size_t size, int node)
+{
+	if(node < 0 || node >= (int)(sizeof(unsigned long) * 8)) return -1;
+	long page_size = sysconf(_SC_PAGESIZE);
+	if(page_size <= 0) page_size = 4096;
+
+	// whole pages inside [addr, addr + size)
+	uintptr_t begin = ((uintptr_t)addr + page_size - 1) & ~(uintptr_t)(page_size - 1);
+	uintptr_t end = ((uintptr_t)addr + size) & ~(uintptr_t)(page_size - 1);
+	if(end <= begin) return 0;
+
+	unsigned long nodemask = 1UL << node;
+	long rc = syscall(SYS_mbind, (void *)begin, end - begin, MPOL_PREFERRED, &nodemask, sizeof(nodemask) * 8, 0);
+	return (rc == 0)?0:-1;
+}
+
+#define HUGE_PAGE_SIZE	(2 * 1024 * 1024)
+
+static const char * s_huge_pages_modes[huge_pages_modes_count] = {
+	[huge_pages_none] = "off",
+	[huge_pages_transparent] = "thp",
+	[huge_pages_hugetlb] = "hugetlb",
+};
+
+enum huge_pages_mode huge_pages_mode_from_string(const char * name)
+{
+	if(NULL == name) return -1;
+	for(int i = 0; i < huge_pages_modes_count; ++i) {
+		if(strcmp(name, s_huge_pages_modes[i]) == 0) return i;
+	}
+	return -1;
+}
+
+const char * huge_pages_mode_to_string(enum huge_pages_mode mode)
+{
+	if(mode < 0 || mode >= huge_pages_modes_count) return NULL;
+	return s_huge_pages_modes[mode];
+}
+
+/* madvise(MADV_HUGEPAGE) succeeds but does nothing when THP is 'never' */
+static int thp_enabled(void)
+{
+	static int s_enabled = -1;
+	int enabled = __atomic_load_n(&s_enabled, __ATOMIC_RELAXED);
+	if(enabled >= 0) return enabled;
+
+	enabled = 0;
+	FILE * fp = fopen("/sys/kernel/mm/transparent_hugepage/enabled", "r");
+	if(fp) {
+		char line[200] = "";
+		if(fgets(line, sizeof(line), fp)) enabled = (NULL == strstr(line, "[never]"));
+		fclose(fp);
+	}
+	__atomic_store_n(&s_enabled, enabled, __ATOMIC_RELAXED);
+	return enabled;
+}
+
+static size_t page_alloc_size(size_t size, enum huge_pages_mode mode)
+{
+	size_t page_size = (mode != huge_pages_none)?HUGE_PAGE_SIZE:(size_t)sysconf(_SC_PAGESIZE);
+	if(size == 0) size = 1;
+	return (size + page_size - 1) / page_size * page_size;
+}
+
+void * page_alloc(size_t size, enum huge_pages_mode mode, int node, enum huge_pages_mode * p_obtained)
+{
+	size = page_alloc_size(size, mode);
+	void * mem = MAP_FAILED;
+	enum huge_pages_mode obtained = huge_pages_none;
+	if(mode == huge_pages_hugetlb) {
+		mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if(mem != MAP_FAILED) obtained = huge_pages_hugetlb;
+	}
+	if(mem == MAP_FAILED) {
+		mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if(mem == MAP_FAILED) return NULL;
+#ifdef MADV_HUGEPAGE
+		if(mode != huge_pages_none && thp_enabled() && madvise(mem, size, MADV_HUGEPAGE) == 0) obtained = huge_pages_transparent;
+#endif
+	}
+	if(node >= 0) numa_bind_memory(mem, size, node);
+	if(p_obtained) *p_obtained = obtained;
+	return mem;
+}
+
+void page_free(void * mem, size_t size, enum huge_pages_mode mode)
+{
+	if(NULL == mem) return;
+	munmap(mem, page_alloc_size(size, mode));
+}
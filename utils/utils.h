@@ -2,14 +2,59 @@
 #define BITCOIN_ADDRS_UTILS_H_
 
 #include <stdio.h>
+#include <stdint.h>
+#include <time.h>
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 int8_t hexdigit(unsigned char c);
+/* NULL output: allocated with lib_alloc() (see arena.h) */
 ssize_t bin2hex(const void * data, size_t length, char ** p_hex);
 ssize_t hex2bin(const char * hex, size_t length, void ** p_data);
 
+void dump(const void * data, size_t length);	// print hex to stdout
+
+typedef struct app_timer
+{
+	struct timespec begin;
+	struct timespec end;
+}app_timer_t;
+double app_timer_start(app_timer_t * timer);	// NULL: use the global timer
+double app_timer_stop(app_timer_t * timer);	// return the elapsed seconds
+
+/**
+ * get_cpu_topology()
+ *   the cpus this process may run on, ordered node by node (/sys/devices/system/node),
+ *   cpu_nodes[i] is the NUMA node of cpus[i]; hosts without NUMA report a single node 0.
+ * @return the number of cpus
+**/
+int get_cpu_topology(int * cpus, int * cpu_nodes, int max_cpus, int * p_num_nodes);
+
+/* prefer node for the pages of [addr, addr + size) not touched yet (mbind, MPOL_PREFERRED) */
+int numa_bind_memory(void * addr, size_t size, int node);
+
+enum huge_pages_mode
+{
+	huge_pages_none,
+	huge_pages_transparent,	// madvise(MADV_HUGEPAGE), needs THP 'madvise' or 'always'
+	huge_pages_hugetlb,	// MAP_HUGETLB, needs reserved pages (/proc/sys/vm/nr_hugepages)
+	huge_pages_modes_count
+};
+enum huge_pages_mode huge_pages_mode_from_string(const char * name);
+const char * huge_pages_mode_to_string(enum huge_pages_mode mode);
+
+/**
+ * page_alloc()
+ *   anonymous, zero-filled mapping of size bytes (rounded up to 2MB for huge pages),
+ *   node >= 0: its pages prefer that NUMA node.
+ *   huge_pages_hugetlb falls back to transparent huge pages, which fall back to regular pages;
+ *   *p_obtained (may be NULL) tells which one was used.
+ * @return NULL if the mapping failed
+**/
+void * page_alloc(size_t size, enum huge_pages_mode mode, int node, enum huge_pages_mode * p_obtained);
+void page_free(void * mem, size_t size, enum huge_pages_mode mode);	// size and mode as passed to page_alloc()
+
 #ifdef __cplusplus
 }
 #endif